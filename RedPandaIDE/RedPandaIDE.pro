@@ -109,14 +109,19 @@ SOURCES += \
     parser/cppparser.cpp \
     parser/cpppreprocessor.cpp \
     parser/cpptokenizer.cpp \
+    parser/includegraph.cpp \
+    parser/macroexpander.cpp \
+    parser/parserprofiler.cpp \
     parser/parserutils.cpp \
     parser/statementmodel.cpp \
+    parser/systemheadercache.cpp \
     problems/freeprojectsetformat.cpp \
     problems/ojproblemset.cpp \
     problems/problemcasevalidator.cpp \
     project.cpp \
     projectoptions.cpp \
     projecttemplate.cpp \
+    semantictokens.cpp \
     settingsdialog/compilerautolinkwidget.cpp \
     settingsdialog/debuggeneralwidget.cpp \
     settingsdialog/editorautosavewidget.cpp \
@@ -202,6 +207,7 @@ SOURCES += \
     widgets/newtemplatedialog.cpp \
     widgets/ojproblempropertywidget.cpp \
     widgets/ojproblemsetmodel.cpp \
+    widgets/parserprofiledialog.cpp \
     widgets/projectalreadyopendialog.cpp \
     widgets/qconsole.cpp \
     widgets/qpatchedcombobox.cpp \
@@ -233,14 +239,19 @@ HEADERS += \
     parser/cppparser.h \
     parser/cpppreprocessor.h \
     parser/cpptokenizer.h \
+    parser/includegraph.h \
+    parser/macroexpander.h \
+    parser/parserprofiler.h \
     parser/parserutils.h \
     parser/statementmodel.h \
+    parser/systemheadercache.h \
     problems/freeprojectsetformat.h \
     problems/ojproblemset.h \
     problems/problemcasevalidator.h \
     project.h \
     projectoptions.h \
     projecttemplate.h \
+    semantictokens.h \
     settingsdialog/compilerautolinkwidget.h \
     settingsdialog/debuggeneralwidget.h \
     settingsdialog/editorautosavewidget.h \
@@ -326,6 +337,7 @@ HEADERS += \
     widgets/newtemplatedialog.h \
     widgets/ojproblempropertywidget.h \
     widgets/ojproblemsetmodel.h \
+    widgets/parserprofiledialog.h \
     widgets/projectalreadyopendialog.h \
     widgets/qconsole.h \
     widgets/qpatchedcombobox.h \
@@ -387,6 +399,7 @@ FORMS += \
     widgets/newprojectunitdialog.ui \
     widgets/newtemplatedialog.ui \
     widgets/ojproblempropertywidget.ui \
+    widgets/parserprofiledialog.ui \
     widgets/projectalreadyopendialog.ui \
     widgets/searchdialog.ui \
     widgets/searchinfiledialog.ui \
@@ -236,7 +236,7 @@ void SDCCProjectCompiler::writeMakeObjFilesRules(QFile &file)
         QString objStr=genMakePath2(shortFileName);
         // if we have scanned it, use scanned info
         if (parser && parser->scannedFiles().contains(unit->fileName())) {
-            QSet<QString> fileIncludes = parser->getFileIncludes(unit->fileName());
+            QSet<QString> fileIncludes = parser->getFileDependencies(unit->fileName());
             foreach(const PProjectUnit &unit2, projectUnits) {
                 if (unit2==unit)
                     continue;
@@ -80,7 +80,9 @@ Editor::Editor(QWidget *parent, const QString& filename,
   mCurrentTipType{TipType::None},
   mSaving{false},
   mHoverModifiedLine{-1},
-  mWheelAccumulatedDelta{0}
+  mWheelAccumulatedDelta{0},
+  mSemanticTokenThread{nullptr},
+  mSemanticTokensOutdated{false}
 {
     mInited=false;
     mBackupFile=nullptr;
@@ -106,7 +108,9 @@ Editor::Editor(QWidget *parent, const QString& filename,
                                   e.reason());
         }
     }
-    syntaxer = syntaxerManager.getSyntaxer(mFilename);
+    // large files are opened as read-only views without highlighting
+    if (!document()->isMapped())
+        syntaxer = syntaxerManager.getSyntaxer(mFilename);
     resolveAutoDetectEncodingOption();
     if (syntaxer) {
         setSyntaxer(syntaxer);
@@ -155,6 +159,17 @@ Editor::Editor(QWidget *parent, const QString& filename,
             this, &Editor::onLinesDeleted);
     connect(this,&QSynEdit::linesInserted,
             this, &Editor::onLinesInserted);
+    //keep semantic tokens of the unchanged lines usable until they are recomputed
+    connect(document().get(), &QSynedit::Document::inserted,
+            this, [this](int index, int count) {
+        if (mSemanticTokens)
+            mSemanticTokens->insertLines(index, count);
+    });
+    connect(document().get(), &QSynedit::Document::deleted,
+            this, [this](int index, int count) {
+        if (mSemanticTokens)
+            mSemanticTokens->deleteLines(index, count);
+    });
 
     setContextMenuPolicy(Qt::CustomContextMenu);
 
@@ -229,6 +244,11 @@ Editor::Editor(QWidget *parent, const QString& filename,
 
 Editor::~Editor() {
     //qDebug()<<"editor "<<mFilename<<" deleted";
+    if (mSemanticTokenThread) {
+        //the thread deletes itself when it's finished
+        disconnect(mSemanticTokenThread, nullptr, this, nullptr);
+        mSemanticTokenThread->requestInterruption();
+    }
     cleanAutoBackup();
 }
 
@@ -1172,7 +1192,9 @@ void Editor::onPreparePaintHighlightToken(int line, int aChar, const QString &to
     //        PStatement statement = mParser->findStatementOf(mFilename,
     //          s , p.Line);
             StatementKind kind;
-            if (mParser->parsing()){
+            if (mSemanticTokens && mSemanticTokens->find(line, aChar, lineText, kind)) {
+                //resolved in the background after the last parse
+            } else if (mParser->parsing()){
                 kind=mIdentCache.value(QString("%1 %2").arg(aChar).arg(token),StatementKind::skUnknown);
             } else {
                 QStringList expression = getExpressionAtPosition(p);
@@ -2111,9 +2133,44 @@ void Editor::onEndParsing()
 {
 
     mIdentCache.clear();
+    updateSemanticTokens();
     invalidate();
 }
 
+void Editor::onSemanticTokensReady()
+{
+    SemanticTokenThread* thread = mSemanticTokenThread;
+    mSemanticTokenThread = nullptr;
+    if (!thread)
+        return;
+    if (thread->result()) {
+        mSemanticTokens = thread->result();
+        invalidate();
+    }
+    if (mSemanticTokensOutdated)
+        updateSemanticTokens();
+}
+
+void Editor::updateSemanticTokens()
+{
+    if (!mParser || !mParser->enabled()
+            || !syntaxer() || syntaxer()->language() != QSynedit::ProgrammingLanguage::CPP)
+        return;
+    if (mSemanticTokenThread) {
+        //it's using the old parse results, run again when it's done
+        mSemanticTokensOutdated = true;
+        mSemanticTokenThread->requestInterruption();
+        return;
+    }
+    mSemanticTokensOutdated = false;
+    mSemanticTokenThread = new SemanticTokenThread(mParser, mFilename, document()->snapshot());
+    connect(mSemanticTokenThread, &QThread::finished,
+            mSemanticTokenThread, &QObject::deleteLater);
+    connect(mSemanticTokenThread, &QThread::finished,
+            this, &Editor::onSemanticTokensReady);
+    mSemanticTokenThread->start(QThread::LowPriority);
+}
+
 void Editor::resolveAutoDetectEncodingOption()
 {
     if (mEncodingOption==ENCODING_AUTO_DETECT) {
@@ -2141,6 +2198,8 @@ bool Editor::isBraceChar(QChar ch)
 
 bool Editor::shouldOpenInReadonly()
 {
+    if (document()->isMapped())
+        return true;
     if (mProject && mProject->findUnit(mFilename))
         return false;
     return pSettings->editor().readOnlySytemHeader()
@@ -2275,42 +2334,54 @@ QStringList Editor::getExpressionAtPosition(
             syntaxer.next();
         }
         for (int i=tokens.count()-1;i>=0;i--) {
-            QString token = tokens[i];
-            switch(lastSymbolType) {
-            case LastSymbolType::ScopeResolutionOperator: //before '::'
-                if (token==">") {
-                    lastSymbolType=LastSymbolType::MatchingAngleQuotation;
-                    symbolMatchingLevel=0;
-                } else if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::ObjectMemberOperator: //before '.'
-            case LastSymbolType::PointerMemberOperator: //before '->'
-            case LastSymbolType::PointerToMemberOfObjectOperator: //before '.*'
-            case LastSymbolType::PointerToMemberOfPointerOperator: //before '->*'
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AsteriskSign: // before '*':
-                if (token == '*') {
-
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AmpersandSign: // before '&':
+            if (!matchExpressionToken(syntaxer, tokens[i], lastSymbolType, symbolMatchingLevel, result))
                 return result;
-                break;
-            case LastSymbolType::ParenthesisMatched: //before '()'
+        }
+
+        line--;
+        if (line>=0)
+            ch = document()->getLine(line).length()+1;
+    }
+    return result;
+}
+
+bool Editor::matchExpressionToken(const QSynedit::Syntaxer &syntaxer, const QString &token, LastSymbolType &lastSymbolType, int &symbolMatchingLevel, QStringList &expression)
+{
+    switch(lastSymbolType) {
+    case LastSymbolType::ScopeResolutionOperator: //before '::'
+        if (token==">") {
+            lastSymbolType=LastSymbolType::MatchingAngleQuotation;
+            symbolMatchingLevel=0;
+        } else if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::ObjectMemberOperator: //before '.'
+    case LastSymbolType::PointerMemberOperator: //before '->'
+    case LastSymbolType::PointerToMemberOfObjectOperator: //before '.*'
+    case LastSymbolType::PointerToMemberOfPointerOperator: //before '->*'
+        if (token == ")" ) {
+            lastSymbolType=LastSymbolType::MatchingParenthesis;
+            symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            lastSymbolType=LastSymbolType::MatchingBracket;
+            symbolMatchingLevel = 0;
+        } else if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::AsteriskSign: // before '*':
+        if (token == '*') {
+
+        } else
+            return false;
+        break;
+    case LastSymbolType::AmpersandSign: // before '&':
+        return false;
+        break;
+    case LastSymbolType::ParenthesisMatched: //before '()'
 //                if (token == ".") {
 //                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
 //                } else if (token=="->") {
@@ -2323,132 +2394,126 @@ QStringList Editor::getExpressionAtPosition(
 //                    lastSymbolType=LastSymbolType::MatchingAngleQuotation;
 //                    symbolMatchingLevel=0;
 //                } else
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (token == "*") {
-                    lastSymbolType=LastSymbolType::AsteriskSign;
-                } else if (token == "&") {
-                    lastSymbolType=LastSymbolType::AmpersandSign;
-                } else if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::BracketMatched: //before '[]'
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AngleQuotationMatched: //before '<>'
-                if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::None:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else if (token == ".") {
-                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
-                } else if (token=="->") {
-                    lastSymbolType = LastSymbolType::PointerMemberOperator;
-                } else if (token == ".*") {
-                    lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
-                } else if (token == "->*"){
-                    lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
-                } else if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentStartChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::TildeSign:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else {
-                    // "~" must appear after "::"
-                    result.pop_front();
-                    return result;
-                }
-                break;;
-            case LastSymbolType::Identifier:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else if (token == ".") {
-                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
-                } else if (token=="->") {
-                    lastSymbolType = LastSymbolType::PointerMemberOperator;
-                } else if (token == ".*") {
-                    lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
-                } else if (token == "->*"){
-                    lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
-                } else if (token == "~") {
-                    lastSymbolType=LastSymbolType::TildeSign;
-                } else if (token == "*") {
-                    lastSymbolType=LastSymbolType::AsteriskSign;
-                } else if (token == "&") {
-                    lastSymbolType=LastSymbolType::AmpersandSign;
-                } else
-                    return result; // stop matching;
-                break;
-            case LastSymbolType::MatchingParenthesis:
-                if (token=="(") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::ParenthesisMatched;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token==")") {
-                    symbolMatchingLevel++;
-                }
-                break;
-            case LastSymbolType::MatchingBracket:
-                if (token=="[") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::BracketMatched;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token=="]") {
-                    symbolMatchingLevel++;
-                }
-                break;
-            case LastSymbolType::MatchingAngleQuotation:
-                if (token=="<") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::AngleQuotationMatched;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token==">") {
-                    symbolMatchingLevel++;
-                }
-                break;
+        if (token == ")" ) {
+            lastSymbolType=LastSymbolType::MatchingParenthesis;
+            symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            lastSymbolType=LastSymbolType::MatchingBracket;
+            symbolMatchingLevel = 0;
+        } else if (token == "*") {
+            lastSymbolType=LastSymbolType::AsteriskSign;
+        } else if (token == "&") {
+            lastSymbolType=LastSymbolType::AmpersandSign;
+        } else if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::BracketMatched: //before '[]'
+        if (token == ")" ) {
+            lastSymbolType=LastSymbolType::MatchingParenthesis;
+            symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            lastSymbolType=LastSymbolType::MatchingBracket;
+            symbolMatchingLevel = 0;
+        } else if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::AngleQuotationMatched: //before '<>'
+        if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::None:
+        if (token =="::") {
+            lastSymbolType=LastSymbolType::ScopeResolutionOperator;
+        } else if (token == ".") {
+            lastSymbolType=LastSymbolType::ObjectMemberOperator;
+        } else if (token=="->") {
+            lastSymbolType = LastSymbolType::PointerMemberOperator;
+        } else if (token == ".*") {
+            lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
+        } else if (token == "->*"){
+            lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
+        } else if (token == ")" ) {
+            lastSymbolType=LastSymbolType::MatchingParenthesis;
+            symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            lastSymbolType=LastSymbolType::MatchingBracket;
+            symbolMatchingLevel = 0;
+        } else if (syntaxer.isIdentStartChar(token.front())) {
+            lastSymbolType=LastSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case LastSymbolType::TildeSign:
+        if (token =="::") {
+            lastSymbolType=LastSymbolType::ScopeResolutionOperator;
+        } else {
+            // "~" must appear after "::"
+            expression.pop_front();
+            return false;
+        }
+        break;;
+    case LastSymbolType::Identifier:
+        if (token =="::") {
+            lastSymbolType=LastSymbolType::ScopeResolutionOperator;
+        } else if (token == ".") {
+            lastSymbolType=LastSymbolType::ObjectMemberOperator;
+        } else if (token=="->") {
+            lastSymbolType = LastSymbolType::PointerMemberOperator;
+        } else if (token == ".*") {
+            lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
+        } else if (token == "->*"){
+            lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
+        } else if (token == "~") {
+            lastSymbolType=LastSymbolType::TildeSign;
+        } else if (token == "*") {
+            lastSymbolType=LastSymbolType::AsteriskSign;
+        } else if (token == "&") {
+            lastSymbolType=LastSymbolType::AmpersandSign;
+        } else
+            return false; // stop matching;
+        break;
+    case LastSymbolType::MatchingParenthesis:
+        if (token=="(") {
+            if (symbolMatchingLevel==0) {
+                lastSymbolType=LastSymbolType::ParenthesisMatched;
+            } else {
+                symbolMatchingLevel--;
             }
-            result.push_front(token);
+        } else if (token==")") {
+            symbolMatchingLevel++;
         }
-
-        line--;
-        if (line>=0)
-            ch = document()->getLine(line).length()+1;
+        break;
+    case LastSymbolType::MatchingBracket:
+        if (token=="[") {
+            if (symbolMatchingLevel==0) {
+                lastSymbolType=LastSymbolType::BracketMatched;
+            } else {
+                symbolMatchingLevel--;
+            }
+        } else if (token=="]") {
+            symbolMatchingLevel++;
+        }
+        break;
+    case LastSymbolType::MatchingAngleQuotation:
+        if (token=="<") {
+            if (symbolMatchingLevel==0) {
+                lastSymbolType=LastSymbolType::AngleQuotationMatched;
+            } else {
+                symbolMatchingLevel--;
+            }
+        } else if (token==">") {
+            symbolMatchingLevel++;
+        }
+        break;
     }
-    return result;
+    expression.push_front(token);
+    return true;
 }
 
 QString Editor::getWordForCompletionSearch(const QSynedit::BufferCoord &pos,bool permitTilde)
@@ -4052,8 +4117,10 @@ QString Editor::getParserHint(const QStringList& expression,const QString &/*s*/
         return "";
     // This piece of code changes the parser database, possibly making hints and code completion invalid...
     QString result;
+    // while the parser is busy, use the snapshot of its last results
+    PCppParser parser = CppParser::readableParser(mParser);
     // Exit early, don't bother creating a stream (which is slow)
-    PStatement statement = mParser->findStatementOf(
+    PStatement statement = parser->findStatementOf(
                 mFilename,expression,
                 line);
     if (!statement)
@@ -4064,11 +4131,11 @@ QString Editor::getParserHint(const QStringList& expression,const QString &/*s*/
           result = getHintForFunction(statement,mFilename,line);
     } else if (statement->line>0) {
         QFileInfo fileInfo(statement->fileName);
-        result = mParser->prettyPrintStatement(statement,mFilename, line) + " - "
+        result = parser->prettyPrintStatement(statement,mFilename, line) + " - "
                 + QString("%1(%2) ").arg(fileInfo.fileName()).arg(statement->line)
                 + tr("Ctrl+click for more info");
     } else {  // hard defines
-        result = mParser->prettyPrintStatement(statement, mFilename);
+        result = parser->prettyPrintStatement(statement, mFilename);
     }
 //    Result := StringReplace(Result, '|', #5, [rfReplaceAll]);
     return result;
@@ -5270,6 +5337,7 @@ void Editor::applySettings()
         }
 #endif
         ((QSynedit::CppSyntaxer*)(syntaxer().get()))->setCustomTypeKeywords(set);
+        invalidatePaintedLines();
     }
 
     this->setUndoLimit(pSettings->editor().undoLimit());
@@ -24,6 +24,7 @@
 #include "colorscheme.h"
 #include "common.h"
 #include "parser/cppparser.h"
+#include "semantictokens.h"
 #include "widgets/codecompletionpopup.h"
 #include "widgets/headercompletionpopup.h"
 
@@ -218,6 +219,15 @@ public:
     QString getWordForCompletionSearch(const QSynedit::BufferCoord& pos,bool permitTilde);
     QStringList getExpressionAtPosition(
             const QSynedit::BufferCoord& pos);
+    /**
+     * @brief Step of getExpressionAtPosition(), matching tokens from right to left.
+     * @return false if the expression ends before the token
+     */
+    static bool matchExpressionToken(const QSynedit::Syntaxer& syntaxer,
+                                     const QString& token,
+                                     LastSymbolType& lastSymbolType,
+                                     int& symbolMatchingLevel,
+                                     QStringList& expression);
     void resetBookmarks();
 
     const PCppParser &parser() const;
@@ -239,6 +249,7 @@ private slots:
     void onAutoBackupTimer();
     void onTooltipTimer();
     void onEndParsing();
+    void onSemanticTokensReady();
 
 private:
     void resolveAutoDetectEncodingOption();
@@ -298,6 +309,7 @@ private:
     void onExportedFormatToken(QSynedit::PSyntaxer syntaxer, int Line, int column, const QString& token,
         QSynedit::PTokenAttribute &attr);
     void onScrollBarValueChanged();
+    void updateSemanticTokens();
 private:
     bool mInited;
     QDateTime mBackupTime;
@@ -353,6 +365,9 @@ private:
     int mHoverModifiedLine;
     int mWheelAccumulatedDelta;
     QMap<QString,StatementKind> mIdentCache;
+    PSemanticTokenMap mSemanticTokens;
+    SemanticTokenThread* mSemanticTokenThread;
+    bool mSemanticTokensOutdated;
 
     static QHash<ParserLanguage,std::weak_ptr<CppParser>> mSharedParsers;
 
@@ -57,6 +57,7 @@ Editor* EditorList::newEditor(const QString& filename, const QByteArray& encodin
     // parentPageControl takes the owner ship
     Editor * e = new Editor(parentPageControl,filename,encoding,pProject,newFile,parentPageControl);
     connect(e, &Editor::renamed, this, &EditorList::onEditorRenamed);
+    registerDocument(e->filename(), e->document());
     updateLayout();
     connect(e,&Editor::fileSaved,
             pMainWindow, &MainWindow::onFileSaved);
@@ -122,12 +123,43 @@ void EditorList::doRemoveEditor(Editor *e)
     pMainWindow->fileSystemWatcher()->removePath(e->filename());
     pMainWindow->caretList().removeEditor(e);
     pMainWindow->updateCaretActions();
+    unregisterDocument(e->filename(), e->document());
     e->setParent(nullptr);
     delete e;
 }
 
+void EditorList::registerDocument(const QString &filename, const QSynedit::PDocument &document)
+{
+    if (filename.isEmpty())
+        return;
+    QMutexLocker locker(&mOpenedDocumentsMutex);
+    mOpenedDocuments.insert(documentKey(filename), document);
+}
+
+void EditorList::unregisterDocument(const QString &filename, const QSynedit::PDocument &document)
+{
+    if (filename.isEmpty())
+        return;
+    QMutexLocker locker(&mOpenedDocumentsMutex);
+    QString key = documentKey(filename);
+    if (mOpenedDocuments.value(key) == document)
+        mOpenedDocuments.remove(key);
+}
+
+QString EditorList::documentKey(const QString &filename)
+{
+    if (PATH_SENSITIVITY == Qt::CaseInsensitive)
+        return filename.toLower();
+    return filename;
+}
+
 void EditorList::onEditorRenamed(const QString &oldFilename, const QString &newFilename, bool firstSave)
 {
+    Editor* e = qobject_cast<Editor*>(sender());
+    if (e) {
+        unregisterDocument(oldFilename, e->document());
+        registerDocument(newFilename, e->document());
+    }
     emit editorRenamed(oldFilename, newFilename, firstSave);
 }
 
@@ -462,10 +494,17 @@ bool EditorList::getContentFromOpenedEditor(const QString &filename, QStringList
 {
     if (pMainWindow->isQuitting())
         return false;
-    Editor * e= getOpenedEditorByFilename(filename);
-    if (!e)
+    if (filename.isEmpty())
+        return false;
+    QSynedit::PDocument document;
+    {
+        QMutexLocker locker(&mOpenedDocumentsMutex);
+        document = mOpenedDocuments.value(documentKey(filename));
+    }
+    if (!document)
         return false;
-    buffer = e->contents();
+    //the lines are shared with the document, nothing is copied here
+    buffer = *(document->snapshot());
     return true;
 }
 
@@ -20,7 +20,10 @@
 #include <QTabWidget>
 #include <QSplitter>
 #include <QWidget>
+#include <QHash>
+#include <QMutex>
 #include "utils.h"
+#include "qsynedit/document.h"
 
 class Project;
 class Editor;
@@ -92,6 +95,9 @@ private:
     QTabWidget* getFocusedPageControl() const;
     void showLayout(LayoutShowType layout);
     void doRemoveEditor(Editor* e);
+    void registerDocument(const QString& filename, const QSynedit::PDocument& document);
+    void unregisterDocument(const QString& filename, const QSynedit::PDocument& document);
+    static QString documentKey(const QString& filename);
 private slots:
     void onEditorRenamed(const QString& oldFilename, const QString& newFilename, bool firstSave);
 private:
@@ -101,6 +107,11 @@ private:
     QSplitter *mSplitter;
     QWidget *mPanel;
     int mUpdateCount;
+    // documents of the opened editors, by filename.
+    // getContentFromOpenedEditor() is called from the parser threads,
+    // so it must not touch the editor widgets.
+    QHash<QString,QSynedit::PDocument> mOpenedDocuments;
+    mutable QMutex mOpenedDocumentsMutex;
 };
 
 #endif // EDITORLIST_H
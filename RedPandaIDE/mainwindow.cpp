@@ -52,6 +52,7 @@
 #include "widgets/infomessagebox.h"
 #include "widgets/newtemplatedialog.h"
 #include "visithistorymanager.h"
+#include "widgets/parserprofiledialog.h"
 #include "widgets/projectalreadyopendialog.h"
 #include "widgets/searchdialog.h"
 
@@ -2879,6 +2880,11 @@ void MainWindow::createCustomActions()
                 ui->projectView);
     connect(mProject_Rename_Unit, &QAction::triggered,
             this, &MainWindow::onProjectRenameUnit);
+    mProject_Show_Unit_Dependents = createAction(
+                tr("Files Including It..."),
+                ui->projectView);
+    connect(mProject_Show_Unit_Dependents, &QAction::triggered,
+            this, &MainWindow::onProjectShowUnitDependents);
     mProject_Add_Folder = createAction(
                 tr("Add Folder"),
                 ui->projectView);
@@ -2935,6 +2941,9 @@ void MainWindow::createCustomActions()
                 tr("In current project"),
                 ui->tabStructure);
     mClassBrowser_Show_WholeProject->setCheckable(true);
+    mClassBrowser_Show_ParserProfile = createAction(
+                tr("Parser profile..."),
+                ui->tabStructure);
 
     mClassBrowser_Sort_By_Name->setChecked(pSettings->ui().classBrowserSortAlpha());
     mClassBrowser_Sort_By_Type->setChecked(pSettings->ui().classBrowserSortType());
@@ -2958,6 +2967,9 @@ void MainWindow::createCustomActions()
     connect(mClassBrowser_Show_WholeProject,&QAction::triggered,
             this, &MainWindow::onClassBrowserChangeScope);
 
+    connect(mClassBrowser_Show_ParserProfile,&QAction::triggered,
+            this, &MainWindow::onClassBrowserShowParserProfile);
+
 
     //Files view
     mFilesView_CreateFolder = createAction(
@@ -3787,6 +3799,7 @@ void MainWindow::onProjectViewContextMenu(const QPoint &pos)
     }
     if (onUnit && !multiSelection) {
         menu.addAction(mProject_Rename_Unit);
+        menu.addAction(mProject_Show_Unit_Dependents);
     }
     menu.addSeparator();
 #ifdef ENABLE_VCS
@@ -3913,6 +3926,9 @@ void MainWindow::onClassBrowserContextMenu(const QPoint &pos)
             mClassBrowser_Show_WholeProject->setChecked(mProject->options().classBrowserType==ProjectClassBrowserType::WholeProject);
         }
     }
+    menu.addSeparator();
+    mClassBrowser_Show_ParserProfile->setEnabled(mClassBrowserModel.parser()!=nullptr);
+    menu.addAction(mClassBrowser_Show_ParserProfile);
 
     menu.exec(ui->projectView->mapToGlobal(pos));
 }
@@ -4802,6 +4818,15 @@ void MainWindow::onClassBrowserChangeScope()
     }
 }
 
+void MainWindow::onClassBrowserShowParserProfile()
+{
+    PCppParser parser = mClassBrowserModel.parser();
+    if (!parser)
+        return;
+    ParserProfileDialog dialog(parser->lastParseProfile(), this);
+    dialog.exec();
+}
+
 void MainWindow::onClassBrowserRefreshStart()
 {
     mClassBrowserCurrentStatement="";
@@ -4914,6 +4939,38 @@ void MainWindow::onProjectRenameUnit()
     }
 }
 
+void MainWindow::onProjectShowUnitDependents()
+{
+    if (!mProject)
+        return;
+    QModelIndex current = mProjectProxyModel->mapToSource(ui->projectView->selectionModel()->currentIndex());
+    if (!current.isValid())
+        return;
+    ProjectModelNode * node = static_cast<ProjectModelNode*>(current.internalPointer());
+    PProjectUnit unit = node->pUnit.lock();
+    if (!unit || !mProject->cppParser())
+        return;
+    PCppParser parser = CppParser::readableParser(mProject->cppParser());
+    QStringList files;
+    foreach (const QString& file, parser->getFileDependents(unit->fileName())) {
+        files.append(extractRelativePath(mProject->folder(),file));
+    }
+    files.sort();
+    QMessageBox box(this);
+    box.setWindowTitle(tr("Files Including It"));
+    box.setIcon(QMessageBox::Information);
+    if (files.isEmpty()) {
+        box.setText(tr("No file includes \"%1\".")
+                    .arg(extractFileName(unit->fileName())));
+    } else {
+        box.setText(tr("%1 files include \"%2\", directly or indirectly.")
+                    .arg(files.count())
+                    .arg(extractFileName(unit->fileName())));
+        box.setDetailedText(files.join("\n"));
+    }
+    box.exec();
+}
+
 void MainWindow::onBreakpointRemove()
 {
     int index =ui->tblBreakpoints->selectionModel()->currentIndex().row();
@@ -407,6 +407,7 @@ private slots:
     void onClassBrowserSortByType();
     void onClassBrowserSortByName();
     void onClassBrowserChangeScope();
+    void onClassBrowserShowParserProfile();
     void onClassBrowserRefreshStart();
     void onClassBrowserRefreshEnd();
 
@@ -416,6 +417,7 @@ private slots:
     void onProjectRenameFolder();
     void onProjectAddFolder();
     void onProjectRenameUnit();
+    void onProjectShowUnitDependents();
     void onBreakpointRemove();
     void onBreakpointViewRemoveAll();
     void onBreakpointViewProperty();
@@ -946,6 +948,7 @@ private:
     //actions for project view
     QAction * mProject_Add_Folder;
     QAction * mProject_Rename_Unit;
+    QAction * mProject_Show_Unit_Dependents;
     QAction * mProject_Rename_Folder;
     QAction * mProject_Remove_Folder;
     QAction * mProject_SwitchFileSystemViewMode;
@@ -959,6 +962,7 @@ private:
     QAction * mClassBrowser_goto_definition;
     QAction * mClassBrowser_Show_CurrentFile;
     QAction * mClassBrowser_Show_WholeProject;
+    QAction * mClassBrowser_Show_ParserProfile;
     QWidget * mClassBrowserToolbar;
 
     //actions for files view
@@ -20,15 +20,46 @@
 #include "qsynedit/syntaxer/cpp.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
 #include <QDate>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QHash>
 #include <QQueue>
 #include <QRegularExpression>
 #include <QThread>
+#include <QThreadPool>
 #include <QTime>
+#include <algorithm>
 
 static QAtomicInt cppParserCount(0);
 
+// parses quicker than this (in ms) don't take a snapshot, readers skip them as before
+#define SNAPSHOT_MIN_PARSE_TIME 100
+// evaluation results cached for a file, the cache of the file is emptied when it's full
+#define MAX_EVAL_CACHE_ENTRIES 4096
+
+class CppParseUnitTask : public QRunnable {
+public:
+    explicit CppParseUnitTask(const PCppParseUnit& unit):
+        mUnit(unit) {
+    }
+    void run() override {
+        QElapsedTimer timer;
+        timer.start();
+        mUnit->preprocessor.preprocess(mUnit->fileName);
+        mUnit->preprocessTime = timer.nsecsElapsed();
+        mUnit->lineCount = mUnit->preprocessor.result().count();
+        timer.restart();
+        mUnit->tokenizer.tokenize(mUnit->preprocessor.result());
+        mUnit->tokenizeTime = timer.nsecsElapsed();
+        mUnit->preprocessor.clearTempResults();
+    }
+private:
+    PCppParseUnit mUnit;
+};
+
 CppParser::CppParser(QObject *parent) : QObject(parent),
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
     mMutex()
@@ -60,6 +91,18 @@ CppParser::CppParser(QObject *parent) : QObject(parent),
     mCppKeywords = CppKeywords;
     mCppTypeKeywords = CppTypeKeywords;
     mEnabled = true;
+    mCachedSystemHeaderCount = 0;
+
+    mJobThread = nullptr;
+    mStopJobThread = false;
+    mParserFreeCount = 0;
+    mLastParseLatency = 0;
+    mCancelParse = false;
+    mParallelParsing = true;
+    mSnapshotTime = 0;
+    mLockStatistics = CppParserLockStatistics{0,0,0,0};
+    mProfileLockStatistics = mLockStatistics;
+    mEvalCacheStatistics = CppParserEvalCacheStatistics{0,0,0};
 
     internalClear();
 
@@ -72,10 +115,17 @@ CppParser::CppParser(QObject *parent) : QObject(parent),
 CppParser::~CppParser()
 {
     //qDebug()<<"delete parser";
+    {
+        QMutexLocker locker(&mJobMutex);
+        mJobs.clear();
+        mStopJobThread = true;
+        mCancelParse = true;
+        mJobCondition.wakeAll();
+    }
     while (true) {
         //wait for all methods finishes running
         {
-            QMutexLocker locker(&mMutex);
+            TimedMutexLocker locker(this);
             if (!mParsing && (mLockCount == 0)) {
               mParsing = true;
               break;
@@ -86,12 +136,16 @@ CppParser::~CppParser()
         QCoreApplication* app = QApplication::instance();
         app->processEvents();
     }
+    if (mJobThread) {
+        mJobThread->wait();
+        delete mJobThread;
+    }
     //qDebug()<<"-------- parser deleted ------------";
 }
 
 void CppParser::addHardDefineByLine(const QString &line)
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (line.startsWith('#')) {
         mPreprocessor.addHardDefineByLine(line.mid(1).trimmed());
     } else {
@@ -99,15 +153,21 @@ void CppParser::addHardDefineByLine(const QString &line)
     }
 }
 
+void CppParser::addHardDefinesByLines(const QStringList &lines)
+{
+    TimedMutexLocker locker(this);
+    mPreprocessor.addHardDefinesByLines(lines);
+}
+
 void CppParser::addIncludePath(const QString &value)
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     mPreprocessor.addIncludePath(includeTrailingPathDelimiter(value));
 }
 
 void CppParser::removeProjectFile(const QString &value)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
 
     mProjectFiles.remove(value);
     mFilesToScan.remove(value);
@@ -115,31 +175,31 @@ void CppParser::removeProjectFile(const QString &value)
 
 void CppParser::addProjectIncludePath(const QString &value)
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     mPreprocessor.addProjectIncludePath(includeTrailingPathDelimiter(value));
 }
 
 void CppParser::clearIncludePaths()
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     mPreprocessor.clearIncludePaths();
 }
 
 void CppParser::clearProjectIncludePaths()
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     mPreprocessor.clearProjectIncludePaths();
 }
 
 void CppParser::clearProjectFiles()
 {
-    QMutexLocker  locker(&mMutex);
+    TimedMutexLocker locker(this);
     mProjectFiles.clear();
 }
 
 QList<PStatement> CppParser::getListOfFunctions(const QString &fileName, const QString &phrase, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     QList<PStatement> result;
     if (mParsing)
         return result;
@@ -169,7 +229,7 @@ QList<PStatement> CppParser::getListOfFunctions(const QString &fileName, const Q
 
 PStatement CppParser::findScopeStatement(const QString &filename, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing) {
         return PStatement();
     }
@@ -187,15 +247,17 @@ PStatement CppParser::doFindScopeStatement(const QString &filename, int line) co
 
 PFileIncludes CppParser::findFileIncludes(const QString &filename, bool deleteIt)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     PFileIncludes fileIncludes = mPreprocessor.includesList().value(filename,PFileIncludes());
-    if (deleteIt && fileIncludes)
+    if (deleteIt && fileIncludes) {
         mPreprocessor.includesList().remove(filename);
+        mPreprocessor.includeGraph().removeIncludesOf(filename);
+    }
     return fileIncludes;
 }
 QString CppParser::findFirstTemplateParamOf(const QString &fileName, const QString &phrase, const PStatement& currentScope)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return "";
     return doFindFirstTemplateParamOf(fileName,phrase,currentScope);
@@ -203,7 +265,7 @@ QString CppParser::findFirstTemplateParamOf(const QString &fileName, const QStri
 
 QString CppParser::findTemplateParamOf(const QString &fileName, const QString &phrase, int index, const PStatement &currentScope)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return "";
     return doFindTemplateParamOf(fileName,phrase,index,currentScope);
@@ -211,7 +273,7 @@ QString CppParser::findTemplateParamOf(const QString &fileName, const QString &p
 
 PStatement CppParser::findFunctionAt(const QString &fileName, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
     if (!fileIncludes)
         return PStatement();
@@ -248,7 +310,7 @@ int CppParser::findLastOperator(const QString &phrase) const
 
 PStatementList CppParser::findNamespace(const QString &name)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return doFindNamespace(name);
 }
 
@@ -260,7 +322,7 @@ PStatementList CppParser::doFindNamespace(const QString &name) const
 
 PStatement CppParser::findStatement(const QString &fullname)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return doFindStatement(fullname);
 }
 
@@ -295,7 +357,7 @@ PStatement CppParser::doFindStatement(const QString &fullname) const
 
 PStatement CppParser::findStatementOf(const QString &fileName, const QString &phrase, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PStatement();
     return doFindStatementOf(fileName,phrase,line);
@@ -310,7 +372,7 @@ PStatement CppParser::findStatementOf(const QString &fileName,
                                       const PStatement& currentScope,
                                       PStatement &parentScopeType)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PStatement();
     return doFindStatementOf(fileName,phrase,currentScope,parentScopeType);
@@ -480,17 +542,13 @@ PEvalStatement CppParser::evalExpression(
         QStringList &phraseExpression,
         const PStatement &currentScope)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PEvalStatement();
 //    qDebug()<<phraseExpression;
-    int pos = 0;
-    return doEvalExpression(fileName,
-                            phraseExpression,
-                            pos,
-                            currentScope,
-                            PEvalStatement(),
-                            true);
+    return doEvalExpressionCached(fileName,
+                                  phraseExpression,
+                                  currentScope);
 }
 
 PStatement CppParser::doFindStatementOf(const QString &fileName, const QString &phrase, const PStatement& currentClass) const
@@ -502,7 +560,7 @@ PStatement CppParser::doFindStatementOf(const QString &fileName, const QString &
 
 PStatement CppParser::findStatementOf(const QString &fileName, const QStringList &expression, const PStatement &currentScope)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PStatement();
     return doFindStatementOf(fileName,expression,currentScope);
@@ -522,13 +580,9 @@ PStatement CppParser::doFindStatementOf(const QString &fileName, const QStringLi
     } else if (ownerExpression.isEmpty()) {
         return findMemberOfStatement(fileName, phrase,PStatement());
     } else {
-        int pos = 0;
-        PEvalStatement ownerEvalStatement = doEvalExpression(fileName,
+        PEvalStatement ownerEvalStatement = doEvalExpressionCached(fileName,
                                 ownerExpression,
-                                pos,
-                                currentScope,
-                                PEvalStatement(),
-                                true);
+                                currentScope);
         if (!ownerEvalStatement) {
             return PStatement();
         }
@@ -572,7 +626,7 @@ PStatement CppParser::doFindStatementOf(const QString &fileName, const QStringLi
 
 PStatement CppParser::findStatementOf(const QString &fileName, const QStringList &expression, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PStatement();
     return doFindStatementOf(fileName,expression,line);
@@ -594,7 +648,7 @@ PStatement CppParser::doFindStatementOf(const QString &fileName, const QStringLi
 
 PStatement CppParser::findAliasedStatement(const PStatement &statement)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return PStatement();
     return doFindAliasedStatement(statement);
@@ -602,7 +656,7 @@ PStatement CppParser::findAliasedStatement(const PStatement &statement)
 
 QList<PStatement> CppParser::listTypeStatements(const QString &fileName, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return QList<PStatement>();
     return doListTypeStatements(fileName,line);
@@ -644,7 +698,7 @@ QList<PStatement> CppParser::doListTypeStatements(const QString &fileName, int l
         }
         if (!scopeStatement)
             break;
-        usedNamespaces = usedNamespaces.unite(scopeStatement->usingList);
+        usedNamespaces = usedNamespaces.unite(scopeStatement->usingList());
         scopeStatement=scopeStatement->parentScope.lock();
     }
     usedNamespaces = usedNamespaces.unite(internalGetFileUsings(fileName));
@@ -674,7 +728,7 @@ PStatement CppParser::findStatementStartingFrom(const QString &fileName, const Q
             return result;
         // not found
         // search members of all usings (in current scope )
-        foreach (const QString& namespaceName, scopeStatement->usingList) {
+        foreach (const QString& namespaceName, scopeStatement->usingList()) {
             result = findStatementInNamespace(phrase,namespaceName);
             if (result)
                 return result;
@@ -700,7 +754,7 @@ PStatement CppParser::findStatementStartingFrom(const QString &fileName, const Q
 
 PStatement CppParser::findTypeDefinitionOf(const QString &fileName, const QString &aType, const PStatement& currentClass)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
 
     if (mParsing)
         return PStatement();
@@ -710,7 +764,7 @@ PStatement CppParser::findTypeDefinitionOf(const QString &fileName, const QStrin
 
 PStatement CppParser::findTypeDef(const PStatement &statement, const QString &fileName)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
 
     if (mParsing)
         return PStatement();
@@ -719,7 +773,7 @@ PStatement CppParser::findTypeDef(const PStatement &statement, const QString &fi
 
 bool CppParser::freeze()
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return false;
     mLockCount++;
@@ -728,7 +782,7 @@ bool CppParser::freeze()
 
 bool CppParser::freeze(const QString &serialId)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return false;
     if (mSerialId!=serialId)
@@ -739,7 +793,7 @@ bool CppParser::freeze(const QString &serialId)
 
 QStringList CppParser::getClassesList()
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
 
     QStringList list;
     return list;
@@ -761,7 +815,7 @@ QStringList CppParser::getClassesList()
 
 QStringList CppParser::getFileDirectIncludes(const QString &filename)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return QStringList();
     if (filename.isEmpty())
@@ -777,7 +831,7 @@ QStringList CppParser::getFileDirectIncludes(const QString &filename)
 
 QSet<QString> CppParser::getFileIncludes(const QString &filename)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     QSet<QString> list;
     if (mParsing)
         return list;
@@ -794,9 +848,29 @@ QSet<QString> CppParser::getFileIncludes(const QString &filename)
     return list;
 }
 
+QSet<QString> CppParser::getFileDependencies(const QString &filename)
+{
+    TimedMutexLocker locker(this);
+    if (mParsing)
+        return QSet<QString>();
+    if (filename.isEmpty())
+        return QSet<QString>();
+    return mPreprocessor.includeGraph().dependencies(filename);
+}
+
+QSet<QString> CppParser::getFileDependents(const QString &filename)
+{
+    TimedMutexLocker locker(this);
+    if (mParsing)
+        return QSet<QString>();
+    if (filename.isEmpty())
+        return QSet<QString>();
+    return mPreprocessor.includeGraph().dependents(filename);
+}
+
 QSet<QString> CppParser::getFileUsings(const QString &filename)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return internalGetFileUsings(filename);
 }
 
@@ -826,7 +900,7 @@ QSet<QString> CppParser::internalGetFileUsings(const QString &filename) const
 
 QString CppParser::getHeaderFileName(const QString &relativeTo, const QString &headerName, bool fromNext)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     QString currentDir = includeTrailingPathDelimiter(extractFileDir(relativeTo));
     QStringList includes;
     QStringList projectIncludes;
@@ -859,7 +933,7 @@ QString CppParser::getHeaderFileName(const QString &relativeTo, const QString &h
 
 bool CppParser::isLineVisible(const QString &fileName, int line)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing) {
         return true;
     }
@@ -874,7 +948,7 @@ void CppParser::invalidateFile(const QString &fileName)
     if (!mEnabled)
         return;
     {
-        QMutexLocker locker(&mMutex);
+        TimedMutexLocker locker(this);
         if (mParsing || mLockCount>0)
             return;
         updateSerialId();
@@ -883,6 +957,7 @@ void CppParser::invalidateFile(const QString &fileName)
     QSet<QString> files = calculateFilesToBeReparsed(fileName);
     internalInvalidateFiles(files);
     mParsing = false;
+    notifyParserFree();
 }
 
 bool CppParser::isIncludeLine(const QString &line)
@@ -909,33 +984,41 @@ bool CppParser::isIncludeNextLine(const QString &line)
 
 bool CppParser::isProjectHeaderFile(const QString &fileName)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return ::isSystemHeaderFile(fileName,mPreprocessor.projectIncludePaths());
 }
 
 bool CppParser::isSystemHeaderFile(const QString &fileName)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return ::isSystemHeaderFile(fileName,mPreprocessor.includePaths());
 }
 
-void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
+bool CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
 {
     if (!mEnabled)
-        return;
+        return false;
     {
-        QMutexLocker locker(&mMutex);
+        TimedMutexLocker locker(this);
         if (mParsing || mLockCount>0)
-            return;
+            return false;
         updateSerialId();
         mParsing = true;
+        mProfiler.start();
+        mProfileLockStatistics = mLockStatistics;
+        mSnapshotTime = 0;
         if (updateView)
             emit onBusy();
         emit onStartParsing();
     }
     {
         auto action = finally([&,this]{
+            saveSystemHeaderCache();
+            mStringPool.squeeze();
+            finishProfiling();
             mParsing = false;
+            notifyParserFree();
+            releaseSnapshot();
 
             if (updateView)
                 emit onEndParsing(mFilesScannedCount,1);
@@ -944,23 +1027,38 @@ void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNo
         });
         QString fName = fileName;
         if (onlyIfNotParsed && mPreprocessor.scannedFiles().contains(fName))
-            return;
+            return true;
+        takeSnapshot();
 
         if (inProject) {
             QSet<QString> filesToReparsed = calculateFilesToBeReparsed(fileName);
+            if (mFilesLeftByCancel.isEmpty() && filesToReparsed.count()>1) {
+                bool reparsed = false;
+                if (reparseKeepingDependents(fileName, reparsed))
+                    return true;
+                // the file is parsed the same way as before, keep the result
+                if (reparsed)
+                    filesToReparsed.remove(fileName);
+            }
+            filesToReparsed.unite(mFilesLeftByCancel);
+            mFilesLeftByCancel.clear();
             QStringList files = sortFilesByIncludeRelations(filesToReparsed);
             internalInvalidateFiles(filesToReparsed);
 
             mFilesToScanCount = files.count();
             mFilesScannedCount = 0;
 
-            foreach (const QString& file,files) {
+            int i=0;
+            for (;i<files.count() && !mCancelParse;i++) {
+                const QString& file = files[i];
                 mFilesScannedCount++;
                 emit onProgress(file,mFilesToScanCount,mFilesScannedCount);
                 if (!mPreprocessor.scannedFiles().contains(file)) {
                     internalParse(file);
                 }
             }
+            if (mCancelParse)
+                keepFilesLeftByCancel(files,i-1);
         } else {
             internalInvalidateFile(fileName);
             mFilesToScanCount = 1;
@@ -980,58 +1078,141 @@ void CppParser::parseFile(const QString &fileName, bool inProject, bool onlyIfNo
         // Parse from disk or stream
 
     }
+    return true;
 }
 
-void CppParser::parseFileList(bool updateView)
+bool CppParser::parseFileList(bool updateView)
 {
     if (!mEnabled)
-        return;
+        return false;
     {
-        QMutexLocker locker(&mMutex);
+        TimedMutexLocker locker(this);
         if (mParsing || mLockCount>0)
-            return;
+            return false;
         updateSerialId();
         mParsing = true;
+        mProfiler.start();
+        mProfileLockStatistics = mLockStatistics;
+        mSnapshotTime = 0;
         if (updateView)
             emit onBusy();
         emit onStartParsing();
     }
     {
         auto action = finally([&,this]{
+            saveSystemHeaderCache();
+            mStringPool.squeeze();
+            finishProfiling();
             mParsing = false;
+            notifyParserFree();
+            releaseSnapshot();
             if (updateView)
                 emit onEndParsing(mFilesScannedCount,1);
             else
                 emit onEndParsing(mFilesScannedCount,0);
         });
+        takeSnapshot();
         // Support stopping of parsing when files closes unexpectedly
         mFilesScannedCount = 0;
-        mFilesToScanCount = mFilesToScan.count();
 
-        QStringList files = sortFilesByIncludeRelations(mFilesToScan);
-        // parse header files in the first parse
-        foreach (const QString& file, files) {
-            mFilesScannedCount++;
-            emit onProgress(mCurrentFile,mFilesToScanCount,mFilesScannedCount);
-            if (!mPreprocessor.scannedFiles().contains(file)) {
-                internalParse(file);
+        QSet<QString> filesToScan = mFilesToScan;
+        if (!mFilesLeftByCancel.isEmpty()) {
+            internalInvalidateFiles(mFilesLeftByCancel);
+            filesToScan.unite(mFilesLeftByCancel);
+            mFilesLeftByCancel.clear();
+        }
+        mFilesToScanCount = filesToScan.count();
+        QStringList files = sortFilesByIncludeRelations(filesToScan);
+        if (mParallelParsing && files.count()>1 && QThread::idealThreadCount()>1) {
+            parseFilesInParallel(files);
+        } else {
+            // parse header files in the first parse
+            int i=0;
+            for (;i<files.count() && !mCancelParse;i++) {
+                const QString& file = files[i];
+                mFilesScannedCount++;
+                emit onProgress(mCurrentFile,mFilesToScanCount,mFilesScannedCount);
+                if (!mPreprocessor.scannedFiles().contains(file)) {
+                    internalParse(file);
+                }
             }
+            if (mCancelParse)
+                keepFilesLeftByCancel(files,i-1);
         }
         mFilesToScan.clear();
     }
+    return true;
+}
+
+void CppParser::enqueueParseFile(const QString &fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
+{
+    if (!mEnabled)
+        return;
+    PCppParseJob job = std::make_shared<CppParseJob>();
+    job->type = CppParseJob::Type::File;
+    job->fileName = fileName;
+    job->inProject = inProject;
+    job->onlyIfNotParsed = onlyIfNotParsed;
+    job->updateView = updateView;
+    job->queuedTime = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&mJobMutex);
+    // the running parse of the same file is stale, stop it
+    if (mRunningJob && mRunningJob->type == CppParseJob::Type::File
+            && mRunningJob->fileName == fileName
+            && !onlyIfNotParsed)
+        mCancelParse = true;
+    addParseJob(job);
+}
+
+void CppParser::enqueueParseFileList(bool updateView)
+{
+    if (!mEnabled)
+        return;
+    PCppParseJob job = std::make_shared<CppParseJob>();
+    job->type = CppParseJob::Type::FileList;
+    job->inProject = true;
+    job->onlyIfNotParsed = false;
+    job->updateView = updateView;
+    job->queuedTime = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&mJobMutex);
+    addParseJob(job);
+}
+
+void CppParser::keepFilesLeftByCancel(const QStringList &files, int from)
+{
+    // The file being parsed when the parse was cancelled may be incomplete.
+    // The files after it are already invalidated, and their include edges are
+    // gone, so calculateFilesToBeReparsed() can't find them again.
+    // The next parse takes them over.
+    for (int i=std::max(0,from);i<files.count();i++)
+        mFilesLeftByCancel.insert(files[i]);
+}
+
+int CppParser::parseQueueDepth()
+{
+    QMutexLocker locker(&mJobMutex);
+    return mJobs.count() + (mRunningJob?1:0);
+}
+
+qint64 CppParser::lastParseLatency()
+{
+    QMutexLocker locker(&mJobMutex);
+    return mLastParseLatency;
 }
 
 void CppParser::parseHardDefines()
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     if (mParsing)
         return;
     int oldIsSystemHeader = mIsSystemHeader;
     mIsSystemHeader = true;
     mParsing=true;
+    updateSerialId();
     {
         auto action = finally([&,this]{
             mParsing = false;
+            notifyParserFree();
             mIsSystemHeader=oldIsSystemHeader;
         });
         for (const PDefine& define:mPreprocessor.hardDefines()) {
@@ -1061,7 +1242,7 @@ void CppParser::resetParser()
 {
     while (true) {
         {
-            QMutexLocker locker(&mMutex);
+            TimedMutexLocker locker(this);
             if (!mParsing && mLockCount ==0) {
                 mParsing = true;
                 break;
@@ -1074,8 +1255,12 @@ void CppParser::resetParser()
     {
         auto action = finally([this]{
             mParsing = false;
+            notifyParserFree();
         });
         emit  onBusy();
+        // readers use the old results until the parser is filled again
+        moveResultsToSnapshot();
+        updateSerialId();
         mUniqId = 0;
 
         mParseLocalHeaders = true;
@@ -1089,25 +1274,36 @@ void CppParser::resetParser()
         mCurrentScope.clear();
         mMemberAccessibilities.clear();
         mStatementList.clear();
+        mSnapshotIncludes.clear();
 
         mProjectFiles.clear();
         mBlockBeginSkips.clear(); //list of for/catch block begin token index;
         mBlockEndSkips.clear(); //list of for/catch block end token index;
         mInlineNamespaceEndSkips.clear(); // list for inline namespace end token index;
         mFilesToScan.clear(); // list of base files to scan
+        mFilesLeftByCancel.clear();
         mNamespaces.clear();  // namespace and the statements in its scope
         mInlineNamespaces.clear();
 
         mPreprocessor.clear();
         mTokenizer.clear();
+        mStringPool.clear();
 
+        mSystemHeaderCacheFile.clear();
+        mSystemHeaderCacheKey.clear();
+        mCachedSystemHeaderCount = 0;
     }
 }
 
 void CppParser::unFreeze()
 {
-    QMutexLocker locker(&mMutex);
-    mLockCount--;
+    {
+        TimedMutexLocker locker(this);
+        mLockCount--;
+        if (mLockCount>0)
+            return;
+    }
+    notifyParserFree();
 }
 
 QSet<QString> CppParser::scannedFiles()
@@ -1264,7 +1460,7 @@ int CppParser::getTemplateParamEnd(const QString &s, int startAt) const {
 
 void CppParser::addProjectFile(const QString &fileName, bool needScan)
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     //value.replace('/','\\'); // only accept full file names
 
     // Update project listing
@@ -1359,16 +1555,19 @@ PStatement CppParser::addStatement(const PStatement& parent,
                     }
                 }
                 oldStatement->definitionLine = line;
-                oldStatement->definitionFileName = fileName;
+                oldStatement->definitionFileName = mStringPool.intern(fileName);
+                mStatementList.markChanged(oldStatement);
                 return oldStatement;
             }
         }
     }
     PStatement result = std::make_shared<Statement>();
     result->parentScope = parent;
-    result->type = newType;
+    // locals are thrown away on every edit of their function, they are not worth pooling
+    bool intern = (scope != StatementScope::Local);
+    result->type = intern ? mStringPool.intern(newType) : newType;
     if (!newCommand.isEmpty())
-        result->command = newCommand;
+        result->command = intern ? mStringPool.intern(newCommand) : newCommand;
     else {
         mUniqId++;
         result->command = QString("__STATEMENT__%1").arg(mUniqId);
@@ -1382,8 +1581,8 @@ PStatement CppParser::addStatement(const PStatement& parent,
     result->properties = properties;
     result->line = line;
     result->definitionLine = line;
-    result->fileName = fileName;
-    result->definitionFileName = fileName;
+    result->fileName = mStringPool.intern(fileName);
+    result->definitionFileName = result->fileName;
     if (!fileName.isEmpty()) {
         result->setInProject(mIsProjectFile);
         result->setInSystemHeader(mIsSystemHeader);
@@ -1396,7 +1595,7 @@ PStatement CppParser::addStatement(const PStatement& parent,
     if (scope == StatementScope::Local)
         result->fullName =  newCommand;
     else
-        result->fullName =  getFullStatementName(newCommand, parent);
+        result->fullName =  mStringPool.intern(getFullStatementName(newCommand, parent));
     result->usageCount = -1;
     mStatementList.add(result);
     if (result->kind == StatementKind::skNamespace) {
@@ -1722,6 +1921,265 @@ void CppParser::internalClear()
     mInlineNamespaceEndSkips.clear();
 }
 
+void CppParser::takeSnapshot()
+{
+    // copying the results costs more than waiting for a quick parse
+    if (mStatementList.count()==0
+            || mLastProfile.wallTime() < SNAPSHOT_MIN_PARSE_TIME * 1000000)
+        return;
+    {
+        QMutexLocker locker(&mSnapshotMutex);
+        // results before the parser is reset are still in use
+        if (mSnapshot)
+            return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    std::shared_ptr<CppParser> snapshot = std::make_shared<CppParser>();
+    copyParseSettingsTo(*snapshot);
+    // the copies of unchanged system headers are shared with the last snapshot
+    QSet<QString> changedFiles = mStatementList.takeChangedCloneFiles();
+    const QHash<const Statement*, PStatement>& clones = mStatementList.cloneTo(snapshot->mStatementList);
+    for (auto it=mNamespaces.cbegin();it!=mNamespaces.cend();++it) {
+        PStatementList namespaceStatements = std::make_shared<StatementList>();
+        foreach (const PStatement& statement, *(it.value())) {
+            PStatement clone = clones.value(statement.get());
+            if (clone)
+                namespaceStatements->append(clone);
+        }
+        snapshot->mNamespaces.insert(it.key(), namespaceStatements);
+    }
+    QHash<QString, PFileIncludes>& includesList = snapshot->mPreprocessor.includesList();
+    for (auto it=includesList.begin();it!=includesList.end();++it) {
+        auto cached = mSnapshotIncludes.constFind(it.key());
+        if (cached!=mSnapshotIncludes.constEnd()
+                && cached.value().first.lock() == it.value()
+                && !changedFiles.contains(it.key())) {
+            it.value() = cached.value().second;
+            continue;
+        }
+        PFileIncludes clone = cloneFileIncludes(*(it.value()), clones);
+        // include records of the project files are changed in place by their dependents
+        if (::isSystemHeaderFile(it.key(), mPreprocessor.includePaths()))
+            mSnapshotIncludes.insert(it.key(), qMakePair(std::weak_ptr<FileIncludes>(it.value()), clone));
+        it.value() = clone;
+    }
+    for (auto it=mSnapshotIncludes.begin();it!=mSnapshotIncludes.end();) {
+        if (includesList.contains(it.key()))
+            ++it;
+        else
+            it = mSnapshotIncludes.erase(it);
+    }
+    mSnapshotTime = timer.nsecsElapsed();
+    QMutexLocker locker(&mSnapshotMutex);
+    mSnapshot = snapshot;
+}
+
+PFileIncludes CppParser::cloneFileIncludes(const FileIncludes &fileIncludes, const QHash<const Statement *, PStatement> &clones)
+{
+    PFileIncludes clone = std::make_shared<FileIncludes>();
+    clone->baseFile = fileIncludes.baseFile;
+    clone->includeFiles = fileIncludes.includeFiles;
+    clone->directIncludes = fileIncludes.directIncludes;
+    clone->usings = fileIncludes.usings;
+    clone->branches = fileIncludes.branches;
+    for (auto i=fileIncludes.statements.cbegin();i!=fileIncludes.statements.cend();++i) {
+        PStatement statement = clones.value(i.value().get());
+        if (statement)
+            clone->statements.insert(i.key(), statement);
+    }
+    for (auto i=fileIncludes.declaredStatements.cbegin();i!=fileIncludes.declaredStatements.cend();++i) {
+        PStatement statement = clones.value(i.value().get());
+        if (statement)
+            clone->declaredStatements.insert(i.key(), statement);
+    }
+    foreach (const PCppScope& scope, fileIncludes.scopes.scopes()) {
+        clone->scopes.addScope(scope->startLine,
+                               scope->statement?clones.value(scope->statement.get()):PStatement());
+    }
+    return clone;
+}
+
+void CppParser::moveResultsToSnapshot()
+{
+    QMutexLocker locker(&mSnapshotMutex);
+    // keep the snapshot if the parser is reset again before any parse finishes
+    if (mSnapshot || mStatementList.count()==0)
+        return;
+    // the results are dropped by the reset, so they can be taken without copying
+    std::shared_ptr<CppParser> snapshot = std::make_shared<CppParser>();
+    copyParseSettingsTo(*snapshot);
+    snapshot->mStatementList.swap(mStatementList);
+    snapshot->mNamespaces.swap(mNamespaces);
+    mSnapshot = snapshot;
+}
+
+void CppParser::copyParseSettingsTo(CppParser &snapshot) const
+{
+    snapshot.mLanguage = mLanguage;
+    snapshot.mSerialId = mSerialId;
+    snapshot.mEnabled = mEnabled;
+    snapshot.mParseLocalHeaders = mParseLocalHeaders;
+    snapshot.mParseGlobalHeaders = mParseGlobalHeaders;
+    snapshot.mCppKeywords = mCppKeywords;
+    snapshot.mCppTypeKeywords = mCppTypeKeywords;
+    snapshot.mProjectFiles = mProjectFiles;
+    snapshot.mInlineNamespaces = mInlineNamespaces;
+    snapshot.mPreprocessor.copyParseStateFrom(mPreprocessor);
+}
+
+void CppParser::releaseSnapshot()
+{
+    std::shared_ptr<CppParser> snapshot;
+    {
+        QMutexLocker locker(&mSnapshotMutex);
+        snapshot.swap(mSnapshot);
+    }
+    // the last reference is usually here, don't free it with the lock held
+}
+
+void CppParser::addParseJob(const PCppParseJob &job)
+{
+    // mJobMutex must be locked by the caller
+    if (mStopJobThread)
+        return;
+    foreach (const PCppParseJob& pending, mJobs) {
+        if (pending->type == job->type && pending->fileName == job->fileName) {
+            pending->inProject = pending->inProject || job->inProject;
+            pending->onlyIfNotParsed = pending->onlyIfNotParsed && job->onlyIfNotParsed;
+            pending->updateView = pending->updateView || job->updateView;
+            return;
+        }
+    }
+    mJobs.append(job);
+    if (!mJobThread) {
+        mJobThread = new CppParserJobThread(this);
+        mJobThread->start();
+    }
+    mJobCondition.wakeAll();
+}
+
+void CppParser::notifyParserFree()
+{
+    QMutexLocker locker(&mJobMutex);
+    mParserFreeCount++;
+    mJobCondition.wakeAll();
+}
+
+void CppParser::runParseJobs()
+{
+    while (true) {
+        {
+            QMutexLocker locker(&mJobMutex);
+            while (!mStopJobThread && mJobs.isEmpty())
+                mJobCondition.wait(&mJobMutex);
+            if (mStopJobThread)
+                return;
+        }
+        // wait until the parser is free; requests made meanwhile are coalesced
+        while (true) {
+            quint64 freeCount;
+            {
+                QMutexLocker locker(&mJobMutex);
+                if (mStopJobThread)
+                    return;
+                freeCount = mParserFreeCount;
+            }
+            {
+                TimedMutexLocker locker(this);
+                if (!mParsing && mLockCount == 0)
+                    break;
+            }
+            QMutexLocker locker(&mJobMutex);
+            // notifyParserFree() bumps the count after the parser is freed,
+            // so the parser may be free already if it has changed since the check
+            while (!mStopJobThread && freeCount == mParserFreeCount)
+                mJobCondition.wait(&mJobMutex);
+        }
+        PCppParseJob job;
+        {
+            QMutexLocker locker(&mJobMutex);
+            if (mStopJobThread)
+                return;
+            if (mJobs.isEmpty())
+                continue;
+            job = mJobs.takeFirst();
+            mRunningJob = job;
+            mCancelParse = false;
+        }
+        bool done;
+        if (job->type == CppParseJob::Type::File)
+            done = parseFile(job->fileName, job->inProject, job->onlyIfNotParsed, job->updateView);
+        else
+            done = parseFileList(job->updateView);
+        {
+            QMutexLocker locker(&mJobMutex);
+            mRunningJob.reset();
+            mCancelParse = false;
+            if (!done && mEnabled) {
+                // parser is taken by someone else, retry later
+                mJobs.prepend(job);
+                continue;
+            }
+            mLastParseLatency = QDateTime::currentMSecsSinceEpoch() - job->queuedTime;
+        }
+    }
+}
+
+SystemHeaderCache::ParserData CppParser::systemHeaderCacheData()
+{
+    SystemHeaderCache::ParserData data;
+    data.statementList = &mStatementList;
+    data.namespaces = &mNamespaces;
+    data.includesList = &mPreprocessor.includesList();
+    data.includeGraph = &mPreprocessor.includeGraph();
+    data.fileDefines = &mPreprocessor.fileDefines();
+    data.scannedFiles = &mPreprocessor.scannedFiles();
+    data.uniqId = &mUniqId;
+    data.stringPool = &mStringPool;
+    return data;
+}
+
+CppParserMemoryReport CppParser::doGetMemoryReport() const
+{
+    CppParserMemoryReport report;
+    report.statementCount = mStatementList.count();
+    report.statementBytes = mStatementList.estimateMemoryUsage();
+    report.internedStrings = mStringPool.count();
+    report.processMemory = processResidentMemory();
+    return report;
+}
+
+void CppParser::finishProfiling()
+{
+    mProfiler.finish();
+    if (mProfiler.isEmpty())
+        return;
+    TimedMutexLocker locker(this);
+    mProfiler.setLockWait(mLockStatistics.waitCount - mProfileLockStatistics.waitCount,
+                          mLockStatistics.totalWaitTime - mProfileLockStatistics.totalWaitTime);
+    mProfiler.setSnapshotTime(mSnapshotTime);
+    mLastProfile = mProfiler;
+}
+
+void CppParser::saveSystemHeaderCache()
+{
+    if (mSystemHeaderCacheFile.isEmpty())
+        return;
+    QSet<QString> headers;
+    foreach (const QString& file, mPreprocessor.scannedFiles()) {
+        if (::isSystemHeaderFile(file, mPreprocessor.includePaths()))
+            headers.insert(file);
+    }
+    // only rewrite the cache when new system headers are parsed
+    if (headers.count()<=mCachedSystemHeaderCount)
+        return;
+    if (SystemHeaderCache::save(mSystemHeaderCacheFile, mSystemHeaderCacheKey,
+                                headers, systemHeaderCacheData())) {
+        mCachedSystemHeaderCount = headers.count();
+    }
+}
+
 QStringList CppParser::sortFilesByIncludeRelations(const QSet<QString> &files)
 {
     QStringList result;
@@ -1741,32 +2199,8 @@ QStringList CppParser::sortFilesByIncludeRelations(const QSet<QString> &files)
         mPreprocessor.clearTempResults();
     }
 
-    QSet<QString> fileSet=files;
-    while (!fileSet.isEmpty()) {
-        bool found=false;
-        foreach (const QString& file,fileSet) {
-            PFileIncludes fileIncludes = mPreprocessor.includesList().value(file);
-            bool hasInclude=false;
-            foreach(const QString& inc,fileIncludes->includeFiles.keys()) {
-                if (fileSet.contains(inc)) {
-                    hasInclude=true;
-                    break;
-                }
-            }
-            if (!hasInclude) {
-                result.push_front(file);
-                fileSet.remove(file);
-                found=true;
-                break;
-            }
-        }
-        if (!found) {
-            foreach (const QString& file,fileSet) {
-                result.push_front(file);
-                fileSet.remove(file);
-            }
-        }
-    }
+    //files including others first, the included headers are parsed with them
+    result = mPreprocessor.includeGraph().sortByIncludes(files);
     QSet<QString> newScannedFiles = mPreprocessor.scannedFiles();
     foreach(const QString& file, newScannedFiles) {
         if (!saveScannedFiles.contains(file))
@@ -3106,7 +3540,8 @@ void CppParser::handleMethod(StatementKind functionKind,const QString &sType, co
         } else
             scopelessName = sName;
         //TODO : we should check namespace
-        scopeStatement->friends.insert(scopelessName);
+        scopeStatement->addFriend(scopelessName);
+        mStatementList.markChanged(scopeStatement);
     } else if (isValid) {
         // Use the class the function belongs to as the parent ID if the function is declared outside of the class body
         QString scopelessName;
@@ -3706,7 +4141,8 @@ void CppParser::handleStructs(bool isTypedef)
             if (isFriend) { // friend class
                 PStatement parentStatement = getCurrentScope();
                 if (parentStatement) {
-                    parentStatement->friends.insert(mTokenizer[mIndex]->text);
+                    parentStatement->addFriend(mTokenizer[mIndex]->text);
+                    mStatementList.markChanged(parentStatement);
                 }
             } else {
             // todo: Forward declaration, struct Foo. Don't mention in class browser
@@ -4021,7 +4457,8 @@ void CppParser::handleUsing()
             fullName = usingName;
         }
         if (mNamespaces.contains(fullName)) {
-            scopeStatement->usingList.insert(fullName);
+            scopeStatement->addUsing(fullName);
+            mStatementList.markChanged(scopeStatement);
         }
     } else {
         PFileIncludes fileInfo = mPreprocessor.includesList().value(mCurrentFile);
@@ -4327,7 +4764,7 @@ void CppParser::handleVar(const QString& typePrefix,bool isExtern,bool isStatic)
     mIndex++;
 }
 
-void CppParser::internalParse(const QString &fileName)
+void CppParser::internalParse(const QString &fileName, const DefineMap& macroContext)
 {
     // Perform some validation before we start
     if (!mEnabled)
@@ -4335,15 +4772,18 @@ void CppParser::internalParse(const QString &fileName)
 //    if (!isCfile(fileName) && !isHfile(fileName))  // support only known C/C++ files
 //        return;
 
-    //QElapsedTimer timer;
+    QElapsedTimer timer;
     // Preprocess the file...
     auto action = finally([this]{
         mTokenizer.clear();
     });
-    //timer.start();
+    timer.start();
     // Let the preprocessor augment the include records
     mPreprocessor.setScanOptions(mParseGlobalHeaders, mParseLocalHeaders);
-    mPreprocessor.preprocess(fileName);
+    if (macroContext.isEmpty())
+        mPreprocessor.preprocess(fileName);
+    else
+        mPreprocessor.preprocess(fileName, macroContext);
 
     QStringList preprocessResult = mPreprocessor.result();
 #ifdef QT_DEBUG
@@ -4351,33 +4791,44 @@ void CppParser::internalParse(const QString &fileName)
 //        mPreprocessor.dumpDefinesTo("r:\\defines.txt");
 //        mPreprocessor.dumpIncludesListTo("r:\\includes.txt");
 #endif
-    //qDebug()<<"preprocess"<<timer.elapsed();
     //reduce memory usage
-    //timer.restart();
     mPreprocessor.clearTempResults();
-    //qDebug()<<"preprocess clean"<<timer.elapsed();
+    FileParseProfile& profile = mProfiler.addFile(fileName);
+    profile.phaseTimes[(int)ParsePhase::Preprocess] = timer.nsecsElapsed();
+    profile.lineCount = preprocessResult.count();
 
-    //timer.restart();
+    timer.restart();
     // Tokenize the preprocessed buffer file
     mTokenizer.tokenize(preprocessResult);
     //reduce memory usage
     preprocessResult.clear();
-    //qDebug()<<"tokenize"<<timer.elapsed();
+    profile.phaseTimes[(int)ParsePhase::Tokenize] = timer.nsecsElapsed();
+    profile.tokenCount = mTokenizer.tokenCount();
     if (mTokenizer.tokenCount() == 0)
         return;
 #ifdef QT_DEBUG
 //       mTokenizer.dumpTokens(QString("r:\\tokens-%1.txt").arg(extractFileName(fileName)));
 #endif
+    internalParseTokens(profile);
+}
+
+void CppParser::internalParseTokens(FileParseProfile& profile)
+{
 #ifdef QT_DEBUG
         mLastIndex = -1;
 #endif
-    //    timer.restart();
+    QElapsedTimer timer;
+    timer.start();
+    int oldStatementCount = mStatementList.count();
     // Process the token list
     while(true) {
+        if (mCancelParse)
+            break;
         if (!handleStatement())
             break;
     }
-    //    qDebug()<<"parse"<<timer.elapsed();
+    profile.statementCount = mStatementList.count() - oldStatementCount;
+    profile.phaseTimes[(int)ParsePhase::Parse] = timer.nsecsElapsed();
 #ifdef QT_DEBUG
 //        mStatementList.dumpAll(QString("r:\\all-stats-%1.txt").arg(extractFileName(fileName)));
 //        mStatementList.dump(QString("r:\\stats-%1.txt").arg(extractFileName(fileName)));
@@ -4386,6 +4837,85 @@ void CppParser::internalParse(const QString &fileName)
     internalClear();
 }
 
+void CppParser::parseFilesInParallel(const QStringList &files)
+{
+    int threadCount = std::max(1,QThread::idealThreadCount());
+    int batchSize = threadCount * 2;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    int i=0;
+    // The first file usually brings in the (system) headers shared by all units,
+    // parse it alone so that other units don't have to preprocess them again.
+    while (i<files.count() && !mCancelParse) {
+        const QString& file = files[i];
+        i++;
+        mFilesScannedCount++;
+        emit onProgress(file,mFilesToScanCount,mFilesScannedCount);
+        if (!mPreprocessor.scannedFiles().contains(file)) {
+            internalParse(file);
+            break;
+        }
+    }
+    mPreprocessor.setScanOptions(mParseGlobalHeaders, mParseLocalHeaders);
+    while (i<files.count() && !mCancelParse) {
+        // preprocess and tokenize a batch of units in worker threads,
+        // each worker starts from a snapshot of the current preprocessor state
+        QList<PCppParseUnit> units;
+        while (i<files.count() && units.count()<batchSize) {
+            const QString& file = files[i];
+            i++;
+            if (mPreprocessor.scannedFiles().contains(file)) {
+                mFilesScannedCount++;
+                continue;
+            }
+            PCppParseUnit unit = std::make_shared<CppParseUnit>();
+            unit->fileName = file;
+            unit->preprocessor.copyParseStateFrom(mPreprocessor);
+            unit->preprocessor.beginTrackingChanges();
+            units.append(unit);
+        }
+        foreach (const PCppParseUnit& unit, units) {
+            pool.start(new CppParseUnitTask(unit));
+        }
+        pool.waitForDone();
+
+        // parse the units one by one in the sorted order, so the result is deterministic
+        foreach (const PCppParseUnit& unit, units) {
+            if (mCancelParse)
+                break;
+            mFilesScannedCount++;
+            emit onProgress(unit->fileName,mFilesToScanCount,mFilesScannedCount);
+            if (mPreprocessor.scannedFiles().contains(unit->fileName))
+                continue;
+            // a header scanned by this unit is already parsed by an earlier unit in the batch,
+            // the unit must be preprocessed again with the current state
+            bool conflicted = false;
+            foreach (const QString& scannedFile, unit->preprocessor.newlyScannedFiles()) {
+                if (mPreprocessor.scannedFiles().contains(scannedFile)) {
+                    conflicted = true;
+                    break;
+                }
+            }
+            if (conflicted) {
+                internalParse(unit->fileName);
+                continue;
+            }
+            unit->preprocessor.mergeParseStateTo(mPreprocessor);
+            FileParseProfile& profile = mProfiler.addFile(unit->fileName);
+            profile.preprocessedInWorker = true;
+            profile.phaseTimes[(int)ParsePhase::Preprocess] = unit->preprocessTime;
+            profile.phaseTimes[(int)ParsePhase::Tokenize] = unit->tokenizeTime;
+            profile.lineCount = unit->lineCount;
+            profile.tokenCount = unit->tokenizer.tokenCount();
+            if (unit->tokenizer.tokenCount() == 0)
+                continue;
+            mTokenizer.swap(unit->tokenizer);
+            internalParseTokens(profile);
+            mTokenizer.clear();
+        }
+    }
+}
+
 void CppParser::inheritClassStatement(const PStatement& derived, bool isStruct,
                                       const PStatement& base, StatementAccessibility access)
 {
@@ -4623,6 +5153,38 @@ PEvalStatement CppParser::doEvalExpression(const QString& fileName,
                                    freeScoped);
 }
 
+PEvalStatement CppParser::doEvalExpressionCached(const QString &fileName, const QStringList &phraseExpression, const PStatement &scope) const
+{
+    QStringList expression = phraseExpression;
+    int pos = 0;
+    // the symbol table is changing
+    if (mParsing)
+        return doEvalExpression(fileName, expression, pos, scope, PEvalStatement(), true);
+    if (mEvalCacheSerialId != mSerialId) {
+        mEvalCache.clear();
+        mEvalCacheStatistics.entries = 0;
+        mEvalCacheSerialId = mSerialId;
+    }
+    // scope statements stay alive until the symbol table changes
+    QString key = QString::number((quintptr)scope.get()) + '\n' + phraseExpression.join('\n');
+    QHash<QString, PEvalStatement>& fileCache = mEvalCache[fileName];
+    auto it = fileCache.constFind(key);
+    if (it!=fileCache.constEnd()) {
+        mEvalCacheStatistics.hits++;
+        // callers may change the result
+        return it.value()?std::make_shared<EvalStatement>(*it.value()):PEvalStatement();
+    }
+    mEvalCacheStatistics.misses++;
+    PEvalStatement result = doEvalExpression(fileName, expression, pos, scope, PEvalStatement(), true);
+    if (fileCache.count() >= MAX_EVAL_CACHE_ENTRIES) {
+        mEvalCacheStatistics.entries -= fileCache.count();
+        fileCache.clear();
+    }
+    fileCache.insert(key, result?std::make_shared<EvalStatement>(*result):PEvalStatement());
+    mEvalCacheStatistics.entries++;
+    return result;
+}
+
 PEvalStatement CppParser::doEvalPointerArithmetic(const QString &fileName, QStringList &phraseExpression, int &pos, const PStatement &scope, const PEvalStatement &previousResult, bool freeScoped) const
 {
     if (pos>=phraseExpression.length())
@@ -5792,6 +6354,9 @@ void CppParser::internalInvalidateFile(const QString &fileName)
     if (fileName.isEmpty())
         return;
 
+    mEvalCacheStatistics.entries -= mEvalCache.value(fileName).count();
+    mEvalCache.remove(fileName);
+
     // remove its include files list
     PFileIncludes p = findFileIncludes(fileName, true);
     if (p) {
@@ -5805,6 +6370,7 @@ void CppParser::internalInvalidateFile(const QString &fileName)
                 statement->setHasDefinition(false);
                 statement->definitionFileName = statement->fileName;
                 statement->definitionLine = statement->line;
+                mStatementList.markChanged(statement);
             }
         }
         p->statements.clear();
@@ -5841,15 +6407,174 @@ QSet<QString> CppParser::calculateFilesToBeReparsed(const QString &fileName)
         return QSet<QString>();
     QSet<QString> result;
     result.insert(fileName);
-    foreach (const QString& file, mProjectFiles) {
-        PFileIncludes fileIncludes = mPreprocessor.includesList().value(file,PFileIncludes());
-        if (fileIncludes && fileIncludes->includeFiles.contains(fileName)) {
+    foreach (const QString& file, mPreprocessor.includeGraph().dependents(fileName)) {
+        if (mProjectFiles.contains(file))
             result.insert(file);
-        }
     }
     return result;
 }
 
+bool CppParser::reparseKeepingDependents(const QString &fileName, bool &reparsed)
+{
+    reparsed = false;
+    if (!mPreprocessor.scannedFiles().contains(fileName))
+        return false;
+    // parsed through a file including it, the file may use that file's macros
+    DefineMap macroContext;
+    mPreprocessor.setScanOptions(mParseGlobalHeaders, mParseLocalHeaders);
+    if (!mPreprocessor.lastMacroContext(fileName, macroContext))
+        return false;
+    PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
+    if (!fileIncludes)
+        return false;
+    QByteArray oldSignature = calcDeclarationSignature(fileName);
+    StatementList oldStatements;
+    foreach (const PStatement& statement, fileIncludes->statements) {
+        if (statement->fileName == fileName)
+            oldStatements.append(statement);
+    }
+
+    internalInvalidateFile(fileName);
+    mFilesToScanCount = 1;
+    mFilesScannedCount = 1;
+    emit onProgress(fileName,mFilesToScanCount,mFilesScannedCount);
+    internalParse(fileName, macroContext);
+    reparsed = true;
+
+    if (calcDeclarationSignature(fileName) != oldSignature)
+        return false;
+    relinkDependents(fileName, oldStatements);
+    return true;
+}
+
+QByteArray CppParser::calcDeclarationSignature(const QString &fileName)
+{
+    PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
+    if (!fileIncludes)
+        return QByteArray();
+    QStringList declarations;
+    foreach (const PStatement& statement, fileIncludes->statements) {
+        // definitions of statements declared in other files, and statements copied
+        // from base classes belong to the other files
+        if (statement->fileName != fileName
+                || statement->scope == StatementScope::Local
+                || statement->kind == StatementKind::skBlock
+                || statement->properties.testFlag(StatementProperty::spInherited))
+            continue;
+        StatementProperties properties = statement->properties;
+        properties.setFlag(StatementProperty::spHasDefinition, false);
+        QString declaration = declarationKey(statement)
+                + '\t' + QString::number((int)statement->accessibility)
+                + '\t' + QString::number((int)properties)
+                + '\t' + statement->type
+                + '\t' + statement->value;
+        if (statement->scopeInfo) {
+            QStringList names = statement->friends().values();
+            names.sort();
+            declaration += "\tfriends:" + names.join(',');
+            names = statement->usingList().values();
+            names.sort();
+            declaration += "\tusings:" + names.join(',');
+        }
+        declarations.append(declaration);
+    }
+    PDefineMap defines = mPreprocessor.fileDefines().value(fileName);
+    if (defines) {
+        foreach (const PDefine& define, *defines) {
+            declarations.append("#define " + define->name + define->args + ' ' + define->value);
+        }
+    }
+    foreach (const QString& usingName, fileIncludes->usings) {
+        declarations.append("using namespace " + usingName);
+    }
+    declarations.sort();
+    // the order of includes matters
+    declarations.append(fileIncludes->directIncludes);
+    return QCryptographicHash::hash(declarations.join('\n').toUtf8(), QCryptographicHash::Sha1);
+}
+
+void CppParser::relinkDependents(const QString &fileName, const StatementList &oldStatements)
+{
+    PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName);
+    if (!fileIncludes)
+        return;
+    auto byLine = [](const PStatement& s1, const PStatement& s2) {
+        return s1->line < s2->line;
+    };
+    QHash<QString, StatementList> newStatements;
+    foreach (const PStatement& statement, fileIncludes->statements) {
+        if (statement->fileName == fileName)
+            newStatements[declarationKey(statement)].append(statement);
+    }
+    for (auto it=newStatements.begin();it!=newStatements.end();++it) {
+        std::stable_sort(it.value().begin(), it.value().end(), byLine);
+    }
+    StatementList statements = oldStatements;
+    std::stable_sort(statements.begin(), statements.end(), byLine);
+
+    QHash<const Statement*, PStatement> replacements;
+    foreach (const PStatement& oldStatement, statements) {
+        if (oldStatement->properties.testFlag(StatementProperty::spInherited)) {
+            PStatement parent = oldStatement->parentScope.lock();
+            if (parent && parent->fileName != fileName) {
+                // copied into a derived class of another file, which is not reparsed
+                mStatementList.add(oldStatement);
+                fileIncludes->statements.insert(oldStatement->fullName, oldStatement);
+            }
+            continue;
+        }
+        StatementList& candidates = newStatements[declarationKey(oldStatement)];
+        if (candidates.isEmpty())
+            continue;
+        PStatement newStatement = candidates.takeFirst();
+        replacements.insert(oldStatement.get(), newStatement);
+        if (oldStatement->hasDefinition()
+                && oldStatement->definitionFileName != fileName
+                && !newStatement->hasDefinition()) {
+            newStatement->setHasDefinition(true);
+            newStatement->definitionFileName = oldStatement->definitionFileName;
+            newStatement->definitionLine = oldStatement->definitionLine;
+            mStatementList.markChanged(newStatement);
+        }
+        // statements added by other files, like locals of the member functions defined in them
+        StatementList children = oldStatement->children.values();
+        foreach (const PStatement& child, children) {
+            // members inherited from other files are copied again by the reparse
+            if (child->fileName == fileName
+                    || child->properties.testFlag(StatementProperty::spInherited))
+                continue;
+            mStatementList.deleteStatement(child);
+            child->parentScope = newStatement;
+            mStatementList.add(child);
+        }
+    }
+
+    foreach (const QString& file, mPreprocessor.includeGraph().dependents(fileName)) {
+        PFileIncludes includes = mPreprocessor.includesList().value(file);
+        if (!includes)
+            continue;
+        for (auto it=includes->statements.begin();it!=includes->statements.end();++it) {
+            PStatement statement = replacements.value(it.value().get());
+            if (statement)
+                it.value() = statement;
+        }
+        foreach (const PCppScope& scope, includes->scopes.scopes()) {
+            PStatement statement = replacements.value(scope->statement.get());
+            if (statement)
+                scope->statement = statement;
+        }
+    }
+}
+
+QString CppParser::declarationKey(const PStatement &statement)
+{
+    // names of anonymous structs/enums are generated from a counter
+    static QRegularExpression generatedName("__STATEMENT__\\d+");
+    QString fullName = statement->fullName;
+    fullName.replace(generatedName, "__STATEMENT__");
+    return QString::number((int)statement->kind) + '\t' + fullName + '\t' + statement->noNameArgs;
+}
+
 //int CppParser::calcKeyLenForStruct(const QString &word)
 //{
 //    if (word.startsWith("struct"))
@@ -6143,6 +6868,7 @@ bool CppParser::isTypeStatement(StatementKind kind) const
 
 void CppParser::updateSerialId()
 {
+    mSerialCount++;
     mSerialId = QString("%1 %2").arg(mParserId).arg(mSerialCount);
 }
 
@@ -6426,10 +7152,37 @@ const QSet<QString> &CppParser::projectFiles() const
 
 QList<QString> CppParser::namespaces()
 {
-    QMutexLocker locker(&mMutex);
+    TimedMutexLocker locker(this);
     return mNamespaces.keys();
 }
 
+int CppParser::loadSystemHeaderCache(const QString &cacheDir, const QString &compilerFingerprint)
+{
+    TimedMutexLocker locker(this);
+    if (mParsing)
+        return 0;
+    if (!QDir().mkpath(cacheDir))
+        return 0;
+    mSystemHeaderCacheKey = SystemHeaderCache::calcKey(
+                compilerFingerprint,
+                mLanguage,
+                mPreprocessor.includePathList(),
+                mPreprocessor.hardDefines());
+    mSystemHeaderCacheFile = includeTrailingPathDelimiter(cacheDir)
+            + mSystemHeaderCacheKey + ".cache";
+    mParsing = true;
+    updateSerialId();
+    auto action = finally([this]{
+        mParsing = false;
+        notifyParserFree();
+    });
+    mCachedSystemHeaderCount = SystemHeaderCache::load(
+                mSystemHeaderCacheFile,
+                mSystemHeaderCacheKey,
+                systemHeaderCacheData());
+    return mCachedSystemHeaderCount;
+}
+
 ParserLanguage CppParser::language() const
 {
     return mLanguage;
@@ -6457,6 +7210,52 @@ void CppParser::setLanguage(ParserLanguage newLanguage)
 
 
 
+ParserProfiler CppParser::lastParseProfile()
+{
+    TimedMutexLocker locker(this);
+    return mLastProfile;
+}
+
+CppParserLockStatistics CppParser::lockStatistics()
+{
+    TimedMutexLocker locker(this);
+    return mLockStatistics;
+}
+
+CppParserEvalCacheStatistics CppParser::evalCacheStatistics()
+{
+    TimedMutexLocker locker(this);
+    return mEvalCacheStatistics;
+}
+
+std::shared_ptr<CppParser> CppParser::snapshot()
+{
+    QMutexLocker locker(&mSnapshotMutex);
+    return mSnapshot;
+}
+
+std::shared_ptr<CppParser> CppParser::readableParser(const std::shared_ptr<CppParser> &parser)
+{
+    if (!parser)
+        return parser;
+    std::shared_ptr<CppParser> snapshot = parser->snapshot();
+    return snapshot?snapshot:parser;
+}
+
+CppParserMemoryReport CppParser::memoryReport()
+{
+    TimedMutexLocker locker(this);
+    if (mParsing) {
+        CppParserMemoryReport report;
+        report.statementCount = 0;
+        report.statementBytes = 0;
+        report.internedStrings = 0;
+        report.processMemory = processResidentMemory();
+        return report;
+    }
+    return doGetMemoryReport();
+}
+
 const StatementModel &CppParser::statementList() const
 {
     return mStatementList;
@@ -6517,6 +7316,16 @@ void CppParser::setFilesToScan(const QSet<QString> &newFilesToScan)
     mFilesToScan = newFilesToScan;
 }
 
+bool CppParser::parallelParsing() const
+{
+    return mParallelParsing;
+}
+
+void CppParser::setParallelParsing(bool newParallelParsing)
+{
+    mParallelParsing = newParallelParsing;
+}
+
 bool CppParser::enabled() const
 {
     return mEnabled;
@@ -6532,45 +7341,15 @@ void CppParser::setEnabled(bool newEnabled)
     }
 }
 
-CppFileParserThread::CppFileParserThread(
-        PCppParser parser,
-        QString fileName,
-        bool inProject,
-        bool onlyIfNotParsed,
-        bool updateView,
-        QObject *parent):QThread(parent),
-    mParser(parser),
-    mFileName(fileName),
-    mInProject(inProject),
-    mOnlyIfNotParsed(onlyIfNotParsed),
-    mUpdateView(updateView)
-{
-    connect(this,&QThread::finished,
-            this,&QObject::deleteLater);
-}
-
-void CppFileParserThread::run()
-{
-    if (mParser && !mParser->parsing()) {
-        mParser->parseFile(mFileName,mInProject,mOnlyIfNotParsed,mUpdateView);
-    }
-}
-
-CppFileListParserThread::CppFileListParserThread(PCppParser parser,
-                                                 bool updateView, QObject *parent):
+CppParserJobThread::CppParserJobThread(CppParser *parser, QObject *parent):
     QThread(parent),
-    mParser(parser),
-    mUpdateView(updateView)
+    mParser(parser)
 {
-    connect(this,&QThread::finished,
-            this,&QObject::deleteLater);
 }
 
-void CppFileListParserThread::run()
+void CppParserJobThread::run()
 {
-    if (mParser && !mParser->parsing()) {
-        mParser->parseFileList(mUpdateView);
-    }
+    mParser->runParseJobs();
 }
 
 void parseFile(PCppParser parser, const QString& fileName, bool inProject, bool onlyIfNotParsed, bool updateView)
@@ -6580,13 +7359,7 @@ void parseFile(PCppParser parser, const QString& fileName, bool inProject, bool
     if (!parser->enabled())
         return;
 //    qDebug()<<"parsing "<<fileName;
-    //delete when finished
-    CppFileParserThread* thread = new CppFileParserThread(parser,fileName,inProject,onlyIfNotParsed,updateView);
-    thread->connect(thread,
-                    &QThread::finished,
-                    thread,
-                    &QThread::deleteLater);
-    thread->start();
+    parser->enqueueParseFile(fileName,inProject,onlyIfNotParsed,updateView);
 }
 
 void parseFileList(PCppParser parser, bool updateView)
@@ -6595,11 +7368,26 @@ void parseFileList(PCppParser parser, bool updateView)
         return;
     if (!parser->enabled())
         return;
-    //delete when finished
-    CppFileListParserThread *thread = new CppFileListParserThread(parser,updateView);
-    thread->connect(thread,
-                    &QThread::finished,
-                    thread,
-                    &QThread::deleteLater);
-    thread->start();
+    parser->enqueueParseFileList(updateView);
+}
+
+CppParser::TimedMutexLocker::TimedMutexLocker(CppParser *parser):
+    mParser{parser}
+{
+    if (!mParser->mMutex.tryLock()) {
+        QElapsedTimer timer;
+        timer.start();
+        mParser->mMutex.lock();
+        qint64 waitTime = timer.nsecsElapsed();
+        CppParserLockStatistics& statistics = mParser->mLockStatistics;
+        statistics.waitCount++;
+        statistics.totalWaitTime += waitTime;
+        statistics.maxWaitTime = qMax(statistics.maxWaitTime, waitTime);
+    }
+    mParser->mLockStatistics.lockCount++;
+}
+
+CppParser::TimedMutexLocker::~TimedMutexLocker()
+{
+    mParser->mMutex.unlock();
 }
@@ -21,9 +21,63 @@
 #include <QObject>
 #include <QThread>
 #include <QVector>
+#include <QWaitCondition>
+#include <atomic>
 #include "statementmodel.h"
 #include "cpptokenizer.h"
 #include "cpppreprocessor.h"
+#include "systemheadercache.h"
+#include "parserprofiler.h"
+
+struct CppParserMemoryReport {
+    int statementCount;
+    qint64 statementBytes; // estimated memory used by the statements
+    int internedStrings;
+    qint64 processMemory; // resident memory of the whole process, -1 if unknown
+    qint64 bytesPerStatement() const {
+        return statementCount>0?statementBytes/statementCount:0;
+    }
+};
+
+struct CppParserLockStatistics {
+    qint64 lockCount; // times the parser's mutex is locked
+    qint64 waitCount; // times the lock is held by another thread
+    qint64 totalWaitTime; // nanoseconds
+    qint64 maxWaitTime; // nanoseconds
+};
+
+struct CppParserEvalCacheStatistics {
+    qint64 hits;
+    qint64 misses;
+    int entries;
+};
+
+struct CppParseJob {
+    enum class Type {
+        File,
+        FileList
+    };
+    Type type;
+    QString fileName;
+    bool inProject;
+    bool onlyIfNotParsed;
+    bool updateView;
+    qint64 queuedTime; // msecs since epoch, when the (first coalesced) request is made
+};
+using PCppParseJob = std::shared_ptr<CppParseJob>;
+
+// a translation unit preprocessed and tokenized by a worker thread
+struct CppParseUnit {
+    QString fileName;
+    CppPreprocessor preprocessor;
+    CppTokenizer tokenizer;
+    qint64 preprocessTime; // nanoseconds
+    qint64 tokenizeTime;
+    int lineCount;
+};
+using PCppParseUnit = std::shared_ptr<CppParseUnit>;
+
+class CppParserJobThread;
 
 class CppParser : public QObject
 {
@@ -37,6 +91,7 @@ public:
     ~CppParser();
 
     void addHardDefineByLine(const QString& line);
+    void addHardDefinesByLines(const QStringList& lines);
     void addProjectFile(const QString &fileName, bool needScan);
     void addIncludePath(const QString& value);
     void removeProjectFile(const QString& value);
@@ -99,6 +154,10 @@ public:
     QStringList getClassesList();
     QStringList getFileDirectIncludes(const QString& filename);
     QSet<QString> getFileIncludes(const QString& filename);
+    // files the file includes, directly or indirectly (not including itself)
+    QSet<QString> getFileDependencies(const QString& filename);
+    // files including the file, directly or indirectly (not including itself)
+    QSet<QString> getFileDependents(const QString& filename);
     QSet<QString> getFileUsings(const QString& filename);
 
     QString getHeaderFileName(const QString& relativeTo, const QString& headerName, bool fromNext=false);// both
@@ -109,9 +168,26 @@ public:
     bool isIncludeNextLine(const QString &line);
     bool isProjectHeaderFile(const QString& fileName);
     bool isSystemHeaderFile(const QString& fileName);
-    void parseFile(const QString& fileName, bool inProject,
+    /**
+     * @brief parse the file in the current thread
+     * @return false if the parser is disabled or busy
+     */
+    bool parseFile(const QString& fileName, bool inProject,
                    bool onlyIfNotParsed = false, bool updateView = true);
-    void parseFileList(bool updateView = true);
+    /**
+     * @brief parse files in filesToScan() in the current thread
+     * @return false if the parser is disabled or busy
+     */
+    bool parseFileList(bool updateView = true);
+    /**
+     * @brief queue a parse request, which will be done in the parser's job thread.
+     *   Requests for the same file are coalesced, and a running parse of the same file is cancelled.
+     */
+    void enqueueParseFile(const QString& fileName, bool inProject,
+                   bool onlyIfNotParsed = false, bool updateView = true);
+    void enqueueParseFileList(bool updateView = true);
+    int parseQueueDepth();
+    qint64 lastParseLatency();
     void parseHardDefines();
     bool parsing() const;
     void resetParser();
@@ -125,6 +201,9 @@ public:
     bool enabled() const;
     void setEnabled(bool newEnabled);
 
+    bool parallelParsing() const;
+    void setParallelParsing(bool newParallelParsing);
+
     const QSet<QString> &filesToScan() const;
     void setFilesToScan(const QSet<QString> &newFilesToScan);
 
@@ -144,6 +223,25 @@ public:
     const QSet<QString>& projectIncludePaths();
 
     const StatementModel &statementList() const;
+    CppParserMemoryReport memoryReport();
+    /**
+     * @brief profile of the last finished parseFile()/parseFileList() call
+     *   that parsed at least one file
+     */
+    ParserProfiler lastParseProfile();
+    CppParserLockStatistics lockStatistics();
+    CppParserEvalCacheStatistics evalCacheStatistics();
+    /**
+     * @brief read-only copy of the parse results, taken before the running parse
+     *   (or before the parser is reset). It's released once a parse finishes.
+     * @return nullptr if there is no snapshot
+     */
+    std::shared_ptr<CppParser> snapshot();
+    /**
+     * @brief the parser whose results can be read now: the snapshot of parser
+     *   if it has one, otherwise parser itself
+     */
+    static std::shared_ptr<CppParser> readableParser(const std::shared_ptr<CppParser>& parser);
 
     ParserLanguage language() const;
     void setLanguage(ParserLanguage newLanguage);
@@ -152,6 +250,16 @@ public:
 
     QList<QString> namespaces();
 
+    /**
+     * @brief load parse results of system headers from the cache in cacheDir
+     *   Should be called after include paths and hard defines are set.
+     *   Newly parsed system headers will be saved to the same cache file.
+     * @param cacheDir
+     * @param compilerFingerprint identifies the compiler binary
+     * @return count of the headers loaded from the cache
+     */
+    int loadSystemHeaderCache(const QString& cacheDir, const QString& compilerFingerprint);
+
 signals:
     void onProgress(const QString& fileName, int total, int current);
     void onBusy();
@@ -214,6 +322,19 @@ private:
     }
 
     void internalClear();
+    void takeSnapshot();
+    static PFileIncludes cloneFileIncludes(const FileIncludes& fileIncludes,
+                                           const QHash<const Statement*, PStatement>& clones);
+    void moveResultsToSnapshot();
+    void copyParseSettingsTo(CppParser& snapshot) const;
+    void releaseSnapshot();
+    void addParseJob(const PCppParseJob& job);
+    void keepFilesLeftByCancel(const QStringList& files, int from);
+    void notifyParserFree();
+    void runParseJobs();
+    SystemHeaderCache::ParserData systemHeaderCacheData();
+    void saveSystemHeaderCache();
+    CppParserMemoryReport doGetMemoryReport() const;
 
     QStringList sortFilesByIncludeRelations(const QSet<QString> &files);
 
@@ -322,6 +443,13 @@ private:
                                const PStatement& scope,
                                const PEvalStatement& previousResult,
                                bool freeScoped) const;
+    /**
+     * @brief evaluate the whole expression, reusing the results computed since
+     *   the symbol table last changed
+     */
+    PEvalStatement doEvalExpressionCached(const QString& fileName,
+                               const QStringList& phraseExpression,
+                               const PStatement& scope) const;
 
     PEvalStatement doEvalPointerArithmetic(
             const QString& fileName,
@@ -508,7 +636,13 @@ private:
     void handleStructs(bool isTypedef = false);
     void handleUsing();
     void handleVar(const QString& typePrefix,bool isExtern,bool isStatic);
-    void internalParse(const QString& fileName);
+    /**
+     * @brief parse the file, with the defines in macroContext set as given
+     */
+    void internalParse(const QString& fileName, const DefineMap& macroContext = DefineMap());
+    void internalParseTokens(FileParseProfile& profile);
+    void finishProfiling();
+    void parseFilesInParallel(const QStringList& files);
 //    function FindMacroDefine(const Command: AnsiString): PStatement;
     void inheritClassStatement(
             const PStatement& derived,
@@ -522,6 +656,20 @@ private:
     void internalInvalidateFile(const QString& fileName);
     void internalInvalidateFiles(const QSet<QString>& files);
     QSet<QString> calculateFilesToBeReparsed(const QString& fileName);
+    /**
+     * @brief reparse the file alone, and keep the files including it if the
+     *   declarations it contributes are not changed.
+     *   The file is parsed with the macros it saw in its last parse, which may
+     *   be defined by a file including it.
+     * @param reparsed set to true if the file is parsed again, the result can be
+     *   kept when the files including it are reparsed.
+     * @return false if the declarations are changed, the caller should reparse
+     *   the files including it too.
+     */
+    bool reparseKeepingDependents(const QString& fileName, bool &reparsed);
+    QByteArray calcDeclarationSignature(const QString& fileName);
+    void relinkDependents(const QString& fileName, const StatementList& oldStatements);
+    static QString declarationKey(const PStatement& statement);
 //    int calcKeyLenForStruct(const QString& word);
 //    {
 //    function GetClass(const Phrase: AnsiString): AnsiString;
@@ -680,6 +828,7 @@ private:
     int mSerialCount;
     QString mSerialId;
     int mUniqId;
+    StringPool mStringPool; // file names, types and full names of statements
     bool mEnabled;
     int mIndex;
     bool mIsHeader;
@@ -692,6 +841,8 @@ private:
 
     StatementAccessibility mCurrentMemberAccessibility;
     StatementModel mStatementList;
+    ParserProfiler mProfiler; // the running parse
+    ParserProfiler mLastProfile;
     //It's used in preprocessor, so we can't use fIncludeList instead
 
     CppTokenizer mTokenizer;
@@ -701,6 +852,7 @@ private:
     QVector<int> mBlockEndSkips; //list of for/catch block end token index;
     QVector<int> mInlineNamespaceEndSkips; // list for inline namespace end token index;
     QSet<QString> mFilesToScan; // list of base files to scan
+    QSet<QString> mFilesLeftByCancel; // invalidated files a cancelled parse didn't reparse
     int mFilesScannedCount; // count of files that have been scanned
     int mFilesToScanCount; // count of files and files included in files that have to be scanned
     bool mParseLocalHeaders;
@@ -720,43 +872,64 @@ private:
 #endif
     QMap<QString,KeywordType> mCppKeywords;
     QSet<QString> mCppTypeKeywords;
-};
-using PCppParser = std::shared_ptr<CppParser>;
 
-class CppFileParserThread : public QThread {
-    Q_OBJECT
-public:
-    explicit CppFileParserThread(
-            PCppParser parser,
-            QString fileName,
-            bool inProject,
-            bool onlyIfNotParsed = false,
-            bool updateView = true,
-            QObject *parent = nullptr);
-
-private:
-    PCppParser mParser;
-    QString mFileName;
-    bool mInProject;
-    bool mOnlyIfNotParsed;
-    bool mUpdateView;
+    QMutex mJobMutex;
+    QWaitCondition mJobCondition;
+    QList<PCppParseJob> mJobs;
+    PCppParseJob mRunningJob;
+    CppParserJobThread* mJobThread;
+    bool mStopJobThread;
+    qint64 mLastParseLatency;
+    quint64 mParserFreeCount; // bumped each time the parser becomes free
+    std::atomic<bool> mCancelParse; // stop the running parse at the next statement
+    bool mParallelParsing;
+
+    QString mSystemHeaderCacheFile;
+    QString mSystemHeaderCacheKey;
+    int mCachedSystemHeaderCount;
+
+    QMutex mSnapshotMutex;
+    std::shared_ptr<CppParser> mSnapshot;
+    // copies of the system header include records, shared by successive snapshots
+    QHash<QString, QPair<std::weak_ptr<FileIncludes>, PFileIncludes>> mSnapshotIncludes;
+    qint64 mSnapshotTime; // nanoseconds used to take the snapshot of the running parse
+
+    // results of doEvalExpressionCached() for mEvalCacheSerialId, by file name
+    // and then by scope + expression. Only used when not parsing, protected by mMutex
+    mutable QHash<QString, QHash<QString, PEvalStatement>> mEvalCache;
+    mutable QString mEvalCacheSerialId;
+    mutable CppParserEvalCacheStatistics mEvalCacheStatistics;
+
+    // protected by mMutex
+    CppParserLockStatistics mLockStatistics;
+    CppParserLockStatistics mProfileLockStatistics; // when the running parse started
 
-    // QThread interface
-protected:
-    void run() override;
+    /**
+     * @brief Locks mMutex like QMutexLocker, and records the time spent waiting for it
+     */
+    class TimedMutexLocker {
+    public:
+        explicit TimedMutexLocker(CppParser* parser);
+        TimedMutexLocker(const TimedMutexLocker&)=delete;
+        TimedMutexLocker& operator=(const TimedMutexLocker&)=delete;
+        ~TimedMutexLocker();
+    private:
+        CppParser* mParser;
+    };
+
+    friend class CppParserJobThread;
 };
-using PCppParserThread = std::shared_ptr<CppFileParserThread>;
+using PCppParser = std::shared_ptr<CppParser>;
 
-class CppFileListParserThread: public QThread {
+class CppParserJobThread : public QThread {
     Q_OBJECT
 public:
-    explicit CppFileListParserThread(
-            PCppParser parser,
-            bool updateView = true,
+    explicit CppParserJobThread(
+            CppParser* parser,
             QObject *parent = nullptr);
 private:
-    PCppParser mParser;
-    bool mUpdateView;
+    CppParser* mParser;
+
     // QThread interface
 protected:
     void run() override;
@@ -16,14 +16,18 @@
  */
 #include "cpppreprocessor.h"
 
+#include <QCryptographicHash>
 #include <QFile>
 #include <QTextCodec>
 #include <QDebug>
 #include <QMessageBox>
+#include <QMutex>
 #include "../utils.h"
 
-CppPreprocessor::CppPreprocessor()
+CppPreprocessor::CppPreprocessor():
+    mMacroExpander{[this](const QString& name){ return getDefine(name); }}
 {
+    mTrackChanges = false;
 }
 
 void CppPreprocessor::clear()
@@ -34,8 +38,12 @@ void CppPreprocessor::clear()
     //Result across processings.
     //used by parser even preprocess finished
     mIncludesList.clear();
+    mIncludeGraph.clear();
     mFileDefines.clear(); //dictionary to save defines for each headerfile;
     mScannedFiles.clear();
+    mPreprocessedFiles.clear();
+    mTrackChanges = false;
+    mChanges = ParseStateChanges();
 
     //option data for the parser
     //{ List of current project's include path }
@@ -62,9 +70,8 @@ void CppPreprocessor::clearTempResults()
     mProcessed.clear(); // dictionary to save filename already processed
 }
 
-void CppPreprocessor::addDefineByParts(const QString &name, const QString &args, const QString &value, bool hardCoded)
+PDefine CppPreprocessor::createDefine(const QString &name, const QString &args, const QString &value, bool hardCoded)
 {
-    // Check for duplicates
     PDefine define = std::make_shared<Define>();
     define->name = name;
     define->args = args;
@@ -75,6 +82,14 @@ void CppPreprocessor::addDefineByParts(const QString &name, const QString &args,
     define->hardCoded = hardCoded;
     if (!args.isEmpty())
         parseArgs(define);
+    define->compiled = MacroExpander::compile(*define);
+    return define;
+}
+
+void CppPreprocessor::addDefineByParts(const QString &name, const QString &args, const QString &value, bool hardCoded)
+{
+    // Check for duplicates
+    PDefine define = createDefine(name, args, value, hardCoded);
     if (hardCoded) {
         mHardDefines.insert(name,define);
         mDefines.insert(name,define);
@@ -86,6 +101,8 @@ void CppPreprocessor::addDefineByParts(const QString &name, const QString &args,
         }
         defineMap->insert(define->name,define);
         mDefines.insert(name,define);
+        trackDefineChange(name);
+        recordDefineChange(name,define);
     }
 }
 
@@ -137,6 +154,48 @@ void CppPreprocessor::addHardDefineByLine(const QString &line)
     addDefineByLine(line,true);
 }
 
+void CppPreprocessor::addHardDefinesByLines(const QStringList &lines)
+{
+    PDefineMap defines = compileHardDefines(lines);
+    for (auto it=defines->cbegin();it!=defines->cend();++it) {
+        mHardDefines.insert(it.key(),it.value());
+        mDefines.insert(it.key(),it.value());
+    }
+}
+
+// Parsers of the same compiler set are given the same lines, so they share
+// the parsed (readonly) defines instead of parsing the text again.
+// Only the most recently used ones are kept, the lines change with the
+// compiler set and its options.
+#define HARD_DEFINES_CACHE_SIZE 4
+static QMutex hardDefinesCacheMutex;
+static QList<QPair<QStringList,PDefineMap>> hardDefinesCache; // most recently used first
+
+PDefineMap CppPreprocessor::compileHardDefines(const QStringList &lines)
+{
+    QMutexLocker locker(&hardDefinesCacheMutex);
+    for (int i=0;i<hardDefinesCache.count();i++) {
+        if (hardDefinesCache[i].first == lines) {
+            hardDefinesCache.move(i,0);
+            return hardDefinesCache.front().second;
+        }
+    }
+    constexpr int DEFINE_LEN=6;
+    PDefineMap defines = std::make_shared<DefineMap>();
+    foreach (const QString& line, lines) {
+        QString s = line.trimmed();
+        if (s.startsWith('#'))
+            s = s.mid(1).trimmed();
+        QString name, args, value;
+        getDefineParts(s.mid(DEFINE_LEN).trimmed(), name, args, value);
+        defines->insert(name, createDefine(name, args, value, true));
+    }
+    hardDefinesCache.prepend(qMakePair(lines,defines));
+    while (hardDefinesCache.count()>HARD_DEFINES_CACHE_SIZE)
+        hardDefinesCache.removeLast();
+    return defines;
+}
+
 void CppPreprocessor::addDefineByLine(const QString &line, bool hardCoded)
 {
     // Remove define
@@ -169,6 +228,46 @@ void CppPreprocessor::preprocess(const QString &fileName)
     //    StringsToFile(mResult,"f:\\log.txt");
 }
 
+void CppPreprocessor::preprocess(const QString &fileName, const DefineMap &context)
+{
+    auto setDefine = [this](const QString& name, const PDefine& define) {
+        if (define)
+            mDefines.insert(name,define);
+        else
+            mDefines.remove(name);
+        trackDefineChange(name);
+    };
+    DefineMap oldDefines;
+    for (auto it=context.cbegin();it!=context.cend();++it) {
+        oldDefines.insert(it.key(),mDefines.value(it.key(),PDefine()));
+        setDefine(it.key(),it.value());
+    }
+    preprocess(fileName);
+    for (auto it=context.cbegin();it!=context.cend();++it) {
+        if (mDefines.value(it.key(),PDefine()) == it.value())
+            setDefine(it.key(),oldDefines.value(it.key()));
+    }
+}
+
+bool CppPreprocessor::lastMacroContext(const QString &fileName, DefineMap &context) const
+{
+    PPreprocessedFile file = mPreprocessedFiles.value(
+                preprocessedFileKey(fileName, mParseSystem, mParseLocal),
+                PPreprocessedFile());
+    if (!file)
+        return false;
+    QSet<QString> changedDefines;
+    foreach (const PPreprocessedSegment& segment, file->segments) {
+        for (auto it=segment->usedDefines.cbegin();it!=segment->usedDefines.cend();++it) {
+            if (!changedDefines.contains(it.key()) && !context.contains(it.key()))
+                context.insert(it.key(),it.value());
+        }
+        foreach (const PreprocessedDefineChange& change, segment->defineChanges)
+            changedDefines.insert(change.name);
+    }
+    return true;
+}
+
 void CppPreprocessor::invalidDefinesInFile(const QString &fileName)
 {
     PDefineMap defineMap = mFileDefines.value(fileName,PDefineMap());
@@ -177,6 +276,7 @@ void CppPreprocessor::invalidDefinesInFile(const QString &fileName)
             const PDefine& p = mDefines.value(define->name);
             if (p == define) {
                 mDefines.remove(define->name);
+                trackDefineChange(define->name);
             }
         }
         mFileDefines.remove(fileName);
@@ -307,9 +407,67 @@ void CppPreprocessor::removeScannedFile(const QString &filename)
     invalidDefinesInFile(filename);
     mScannedFiles.remove(filename);
     mIncludesList.remove(filename);
+    mIncludeGraph.removeIncludesOf(filename);
     mFileDefines.remove(filename);
 }
 
+void CppPreprocessor::copyParseStateFrom(const CppPreprocessor &other)
+{
+    clearTempResults();
+    mDefines = other.mDefines;
+    mIncludesList = other.mIncludesList;
+    mIncludeGraph = other.mIncludeGraph;
+    mFileDefines = other.mFileDefines;
+    mScannedFiles = other.mScannedFiles;
+    mPreprocessedFiles = other.mPreprocessedFiles;
+    mMacroExpander.copyCompiledExpressionsFrom(other.mMacroExpander);
+    mHardDefines = other.mHardDefines;
+    mProjectIncludePaths = other.mProjectIncludePaths;
+    mIncludePathList = other.mIncludePathList;
+    mProjectIncludePathList = other.mProjectIncludePathList;
+    mIncludePaths = other.mIncludePaths;
+    mParseSystem = other.mParseSystem;
+    mParseLocal = other.mParseLocal;
+    mOnGetFileStream = other.mOnGetFileStream;
+}
+
+void CppPreprocessor::beginTrackingChanges()
+{
+    mTrackChanges = true;
+    mChanges = ParseStateChanges();
+}
+
+void CppPreprocessor::mergeParseStateTo(CppPreprocessor &other) const
+{
+    foreach (const QString& file, mChanges.scannedFiles) {
+        if (other.mScannedFiles.contains(file))
+            continue;
+        other.mScannedFiles.insert(file);
+        PDefineMap defineMap = mFileDefines.value(file,PDefineMap());
+        if (defineMap)
+            other.mFileDefines.insert(file,defineMap);
+    }
+    foreach (const QString& file, mChanges.includesFiles) {
+        if (!other.mIncludesList.contains(file))
+            other.mIncludesList.insert(file,mIncludesList.value(file));
+    }
+    foreach (const QString& file, mChanges.includeSources) {
+        foreach (const QString& includedFile, mIncludeGraph.directIncludes(file)) {
+            other.mIncludeGraph.addInclude(file, includedFile);
+        }
+    }
+    foreach (const QString& name, mChanges.defines) {
+        PDefine define = mDefines.value(name,PDefine());
+        if (define)
+            other.mDefines.insert(name,define);
+        else
+            other.mDefines.remove(name);
+    }
+    foreach (const QString& key, mChanges.preprocessedFiles) {
+        other.mPreprocessedFiles.insert(key,mPreprocessedFiles.value(key));
+    }
+}
+
 QString CppPreprocessor::getNextPreprocessor()
 {
     skipToPreprocessor(); // skip until # at start of line
@@ -459,8 +617,16 @@ void CppPreprocessor::handleInclude(const QString &line, bool fromNext)
     if (fileName.isEmpty())
         return;
 
-    PFileIncludes oldCurrentIncludes = mCurrentIncludes;
+    // record it even if the file is already included and won't be opened
+    mIncludeGraph.addInclude(file->fileName, fileName);
+    if (mTrackChanges)
+        mChanges.includeSources.insert(file->fileName);
+    if (file->recordingSegment)
+        endCacheSegment(file, line, fromNext);
     openInclude(fileName);
+    // the included file is not opened (already included), go on recording
+    if (mIncludes.back() == file && file->recording && !file->recordingSegment)
+        beginCacheSegment(file);
 }
 
 void CppPreprocessor::handlePreprocessor(const QString &value)
@@ -499,8 +665,10 @@ void CppPreprocessor::handleUndefine(const QString &line)
 //    while (true) {
     PDefine define = getDefine(name);
     if (define) {
+        recordDefineChange(name,PDefine());
         //remove the define from defines set
         mDefines.remove(name);
+        trackDefineChange(name);
         //remove the define form the file where it defines
         if (define->filename == mFileName) {
             PDefineMap defineMap = mFileDefines.value(mFileName);
@@ -511,216 +679,20 @@ void CppPreprocessor::handleUndefine(const QString &line)
     }
 }
 
-QString CppPreprocessor::expandMacros(const QString &line, int depth)
-{
-    //prevent infinit recursion
-    if (depth > MAX_DEFINE_EXPAND_DEPTH)
-        return line;
-    QString word;
-    QString newLine;
-    int lenLine = line.length();
-    int i=0;
-    while (i< lenLine) {
-        QChar ch=line[i];
-        if (isWordChar(ch)) {
-            word += ch;
-        } else {
-            if (!word.isEmpty()) {
-                expandMacro(line,newLine,word,i,depth);
-            }
-            word = "";
-            if (i< lenLine) {
-                newLine += line[i];
-            }
-        }
-        i++;
-    }
-    if (!word.isEmpty()) {
-        expandMacro(line,newLine,word,i,depth);
-    }
-    return newLine;
-}
-
 QString CppPreprocessor::expandMacros()
 {
-    //prevent infinit recursion
-    QString word;
-    QString newLine;
-    QString line = mBuffer[mIndex];
-    int i=0;
-    while (mIndex < mBuffer.size() && i<line.length()) {
-        QChar ch=line[i];
-        if (isWordChar(ch)) {
-            word += ch;
-        } else {
-            if (!word.isEmpty()) {
-                expandMacro(newLine,word,i,1);
-                if (mIndex>=mBuffer.length())
-                    return newLine;
-                line = mBuffer[mIndex];
-            }
-            word = "";
-            if (i< line.length()) {
-                newLine += line[i];
-            }
-        }
-        i++;
-    }
-    if (!word.isEmpty()) {
-        expandMacro(newLine,word,i,1);
-    }
-    return newLine;
-}
-
-void CppPreprocessor::expandMacro(const QString &line, QString &newLine, QString &word, int &i, int depth)
-{
-    int lenLine = line.length();
-        PDefine define = getDefine(word);
-        if (define && define->args=="" ) {
-            if (define->value != word )
-              newLine += expandMacros(define->value,depth+1);
-            else
-              newLine += word;
-
-        } else if (define && (define->args!="")) {
-            while ((i<lenLine) && (line[i] == ' ' || line[i]=='\t'))
-                i++;
-            int argStart=-1;
-            int argEnd=-1;
-            if ((i<lenLine) && (line[i]=='(')) {
-                argStart =i+1;
-                int level=0;
-                bool inString=false;
-                while (i<lenLine) {
-                    switch(line[i].unicode()) {
-                    case '\\':
-                        if (inString)
-                            i++;
-                    break;
-                    case '"':
-                        inString = !inString;
-                    break;
-                    case '(':
-                        if (!inString)
-                            level++;
-                    break;
-                    case ')':
-                        if (!inString)
-                            level--;
-                    }
-                    i++;
-                    if (level==0)
-                        break;
-                }
-                if (level==0) {
-                    argEnd = i-2;
-                    QString args = line.mid(argStart,argEnd-argStart+1).trimmed();
-                    QString formattedValue = expandFunction(define,args);
-                    newLine += expandMacros(formattedValue,depth+1);
-                }
-            }
-        } else {
-            newLine += word;
-        }
-        //    }
-}
-
-void CppPreprocessor::expandMacro(QString &newLine, QString &word, int &i, int depth)
-{
-    QString line = mBuffer[mIndex];
-    PDefine define = getDefine(word);
-//    if (define && define->name == "DEFHOOKPODX")
-//        qDebug()<<define->args<<define->argList<<define->formatValue;
-    if (define && define->args=="" ) {
-        if (define->value != word )
-          newLine += expandMacros(define->value,depth+1);
-        else
-          newLine += word;
-    } else if (define && (define->args!="")) {
-        int origI=i;
-        int origIndex=mIndex;
-        while(true) {
-            while ((i<line.length()) && (line[i] == ' ' || line[i]=='\t'))
-                i++;
-            if (i<line.length())
-                break;
-            mIndex++;
-            if (mIndex>=mBuffer.length())
-                return;
-            line = mBuffer[mIndex];
-            i=0;
-        }
-        int argStart=-1;
-        int argEnd=-1;
-        int argLineStart=mIndex;
-        int argLineEnd=mIndex;
-        if ((i<line.length()) && (line[i]=='(')) {
-            argStart =i+1;
-            int level=0;
-            bool inString=false;
-            while (true) {
-                while (i<line.length()) {
-                    switch(line[i].unicode()) {
-                        case '\\':
-                            if (inString)
-                                i++;
-                        break;
-                        case '"':
-                            inString = !inString;
-                        break;
-                        case '(':
-                            if (!inString)
-                                level++;
-                        break;
-                        case ')':
-                            if (!inString)
-                                level--;
-                        break;
-                    }
-                    i++;
-                    if (level==0)
-                        break;
-                }
-                if (level==0)
-                    break;
-                mIndex++;
-                i=0;
-                if (mIndex>=mBuffer.length())
-                    break;
-                line = mBuffer[mIndex];
-                if (!inString && line.startsWith('#')) {
-                    break;
-                }
-            } ;
-            if (level==0) {
-                argEnd = i-1;
-                argLineEnd = mIndex;
-                QString args;
-                if (argLineStart==argLineEnd) {
-                    args = line.mid(argStart,argEnd-argStart).trimmed();
-                    //qDebug()<<"--"<<args;
-                } else {
-                    args = mBuffer[argLineStart].mid(argStart);
-                    for (int i=argLineStart+1;i<argLineEnd;i++) {
-                        args += mBuffer[i];
-                    }
-                    args += mBuffer[argLineEnd].left(argEnd);
-//                    if (define && define->name == "DEFHOOK")
-//                        qDebug()<<args;
-                }
-                QString formattedValue = expandFunction(define,args);
-//                if (define && define->name == "DEFHOOKPODX")
-//                    qDebug()<<formattedValue;
-                newLine += expandMacros(formattedValue,depth+1);
-            }
-        } else {
-            newLine+=word;
-            i=origI;
-            mIndex=origIndex;
-        }
-    } else {
-        newLine += word;
-    }
+    int linesUsed;
+    QString result = mMacroExpander.expandLine(mBuffer[mIndex],
+                                [this](int offset, QString& line) {
+        // arguments of a macro call may span multiple lines, but not directives
+        int index = mIndex + offset;
+        if (index >= mBuffer.count() || mBuffer[index].startsWith('#'))
+            return false;
+        line = mBuffer[index];
+        return true;
+    }, linesUsed);
+    mIndex += linesUsed;
+    return result;
 }
 
 QString CppPreprocessor::removeGCCAttributes(const QString &line)
@@ -779,6 +751,10 @@ void CppPreprocessor::openInclude(const QString &fileName)
     if (mIncludes.size()>0) {
         PParsedFile topFile = mIncludes.front();
         if (topFile->fileIncludes->includeFiles.contains(fileName)) {
+            // keep the same direct includes as when the file is preprocessed on its own
+            PFileIncludes innerMostIncludes = mIncludes.back()->fileIncludes;
+            if (!innerMostIncludes->directIncludes.contains(fileName))
+                innerMostIncludes->directIncludes.append(fileName);
             return; //already included
         }
         for (PParsedFile& parsedFile:mIncludes) {
@@ -810,6 +786,8 @@ void CppPreprocessor::openInclude(const QString &fileName)
     parsedFile->index = 0;
     parsedFile->fileName = fileName;
     parsedFile->branches = 0;
+    parsedFile->baseBranches = mBranchResults.count();
+    parsedFile->cachedSegment = 0;
     // parsedFile->buffer; it's auto initialized
 
 
@@ -821,6 +799,8 @@ void CppPreprocessor::openInclude(const QString &fileName)
         mCurrentIncludes = std::make_shared<FileIncludes>();
         mCurrentIncludes->baseFile = fileName;
         mIncludesList.insert(fileName,mCurrentIncludes);
+        if (mTrackChanges)
+            mChanges.includesFiles.append(fileName);
     }
 
     parsedFile->fileIncludes = mCurrentIncludes;
@@ -830,6 +810,8 @@ void CppPreprocessor::openInclude(const QString &fileName)
         // Parse ONCE
         //if not Assigned(Stream) then
         mScannedFiles.insert(fileName);
+        if (mTrackChanges)
+            mChanges.scannedFiles.append(fileName);
 
         // Only load up the file if we are allowed to parse it
         bool isSystemFile = isSystemHeaderFile(fileName, mIncludePaths) || isSystemHeaderFile(fileName, mProjectIncludePaths);
@@ -840,6 +822,18 @@ void CppPreprocessor::openInclude(const QString &fileName)
             } else {
                 parsedFile->buffer = readFileToLines(fileName);
             }
+            if (!isSystemFile) {
+                // non system files are often preprocessed again after they or their includes are changed,
+                // so cache the results
+                QByteArray contentHash = calcContentHash(parsedFile->buffer);
+                PPreprocessedFile cached = mPreprocessedFiles.value(
+                            preprocessedFileKey(fileName, mParseSystem, mParseLocal),
+                            PPreprocessedFile());
+                if (cached && cached->contentHash == contentHash)
+                    parsedFile->cached = cached;
+                parsedFile->recording = std::make_shared<PreprocessedFile>();
+                parsedFile->recording->contentHash = contentHash;
+            }
         }
     } else {
         //add defines of already parsed including headers;
@@ -856,7 +850,12 @@ void CppPreprocessor::openInclude(const QString &fileName)
     // Process it
     mIndex = parsedFile->index;
     mFileName = parsedFile->fileName;
-    parsedFile->buffer = removeComments(parsedFile->buffer);
+    if (parsedFile->cached)
+        parsedFile->buffer = parsedFile->cached->buffer;
+    else
+        parsedFile->buffer = removeComments(parsedFile->buffer);
+    if (parsedFile->recording)
+        parsedFile->recording->buffer = parsedFile->buffer;
     mBuffer = parsedFile->buffer;
 
 //    for (int i=0;i<mBuffer.count();i++) {
@@ -870,6 +869,8 @@ void CppPreprocessor::openInclude(const QString &fileName)
     } else {
       mResult.append(includeLine);
     }
+    if (parsedFile->recording && !skipByIncludeGuard(parsedFile))
+        beginCacheSegment(parsedFile);
 }
 
 
@@ -901,6 +902,8 @@ void CppPreprocessor::closeInclude()
     mResult.append(
                 QString("#include %1:%2").arg(parsedFile->fileName)
                 .arg(parsedFile->index+1));
+    if (parsedFile->recording && !parsedFile->recordingSegment)
+        beginCacheSegment(parsedFile);
 }
 
 CppPreprocessor::BranchResult CppPreprocessor::calcElseBranchResult(BranchResult oldResult)
@@ -926,6 +929,7 @@ void CppPreprocessor::addDefinesInFile(const QString &fileName)
     if (defineList) {
         foreach (const PDefine& define, defineList->values()) {
             mDefines.insert(define->name,define);
+            trackDefineChange(define->name);
         }
     }
 
@@ -982,6 +986,259 @@ void CppPreprocessor::parseArgs(PDefine define)
     define->formatValue = formatStr;
 }
 
+QString CppPreprocessor::preprocessedFileKey(const QString &fileName, bool parseSystem, bool parseLocal)
+{
+    return fileName + '|' + QChar(parseSystem?'1':'0') + QChar(parseLocal?'1':'0');
+}
+
+QByteArray CppPreprocessor::calcContentHash(const QStringList &lines)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    foreach (const QString& line, lines) {
+        hash.addData(reinterpret_cast<const char*>(line.constData()), line.length()*sizeof(QChar));
+        hash.addData("\n",1);
+    }
+    return hash.result();
+}
+
+void CppPreprocessor::detectIncludeGuard(const PPreprocessedFile &preprocessedFile)
+{
+    preprocessedFile->includeGuard.clear();
+    preprocessedFile->guardStartIndex = -1;
+    preprocessedFile->guardEndIndex = -1;
+    const QStringList& buffer = preprocessedFile->buffer;
+    QString guard;
+    int startIndex = -1;
+    int endIndex = -1;
+    int level = 0;
+    bool guardDefined = false;
+    for (int i=0;i<buffer.count();i++) {
+        const QString& line = buffer[i];
+        if (line.isEmpty())
+            continue;
+        // anything outside of the guard
+        if (endIndex>=0 || !line.startsWith('#'))
+            return;
+        QString directive = line.mid(1);
+        while (i<buffer.count()-1 && buffer[i].endsWith('\\')) {
+            directive.chop(1);
+            i++;
+            directive += ' ' + buffer[i];
+        }
+        directive = directive.trimmed();
+        if (startIndex<0) {
+            // the first directive must be #ifndef X
+            if (!directive.startsWith("ifndef"))
+                return;
+            guard = directive.mid(6).trimmed();
+            if (guard.isEmpty())
+                return;
+            startIndex = i;
+            level = 1;
+            continue;
+        }
+        if (!guardDefined) {
+            // followed by #define X
+            if (!directive.startsWith("define")
+                    || directive.mid(6).trimmed().section(' ',0,0) != guard)
+                return;
+            guardDefined = true;
+            continue;
+        }
+        if (directive.startsWith("if")) {
+            level++;
+        } else if (directive.startsWith("endif")) {
+            level--;
+            if (level==0)
+                endIndex = i;
+        }
+    }
+    if (startIndex<0 || endIndex<0 || !guardDefined)
+        return;
+    preprocessedFile->includeGuard = guard;
+    preprocessedFile->guardStartIndex = startIndex;
+    preprocessedFile->guardEndIndex = endIndex;
+}
+
+void CppPreprocessor::recordDefineUse(const PPreprocessedSegment &segment, const QString &name, const PDefine &define)
+{
+    // defines changed by the segment itself don't matter
+    if (segment->changedDefines.contains(name) || segment->usedDefines.contains(name))
+        return;
+    segment->usedDefines.insert(name,define);
+}
+
+void CppPreprocessor::recordDefineChange(const QString &name, const PDefine &define)
+{
+    if (mIncludes.isEmpty())
+        return;
+    PPreprocessedSegment segment = mIncludes.back()->recordingSegment;
+    if (!segment)
+        return;
+    segment->changedDefines.insert(name);
+    PreprocessedDefineChange change;
+    change.name = name;
+    change.define = define;
+    segment->defineChanges.append(change);
+}
+
+QVector<int> CppPreprocessor::fileBranchResults(const PParsedFile &file) const
+{
+    QVector<int> result;
+    for (int i=file->baseBranches;i<mBranchResults.count();i++)
+        result.append((int)mBranchResults[i]);
+    return result;
+}
+
+void CppPreprocessor::beginCacheSegment(const PParsedFile &file)
+{
+    PPreprocessedSegment segment = std::make_shared<PreprocessedSegment>();
+    segment->startIndex = mIndex;
+    segment->startBranches = fileBranchResults(file);
+    segment->endIndex = -1;
+    segment->includeNext = false;
+    segment->includeResultIndex = -1;
+    segment->resultStart = mResult.count();
+    file->recordingSegment = segment;
+}
+
+void CppPreprocessor::endCacheSegment(const PParsedFile &file, const QString &includeLine, bool includeNext)
+{
+    PPreprocessedSegment segment = file->recordingSegment;
+    if (!segment)
+        return;
+    file->recordingSegment.reset();
+    segment->result = mResult.mid(segment->resultStart);
+    segment->endBranches = fileBranchResults(file);
+    segment->endIndex = mIndex;
+    segment->includeLine = includeLine;
+    segment->includeNext = includeNext;
+    if (!includeLine.isEmpty())
+        segment->includeResultIndex = mPreProcIndex - segment->resultStart;
+    segment->changedDefines.clear();
+    file->recording->segments.append(segment);
+}
+
+void CppPreprocessor::stopCacheRecording(const PParsedFile &file)
+{
+    file->recording.reset();
+    file->recordingSegment.reset();
+    file->cached.reset();
+}
+
+void CppPreprocessor::finishCacheRecording(const PParsedFile &file)
+{
+    if (!file->recording)
+        return;
+    endCacheSegment(file);
+    detectIncludeGuard(file->recording);
+    QString key = preprocessedFileKey(file->fileName, mParseSystem, mParseLocal);
+    mPreprocessedFiles.insert(key, file->recording);
+    if (mTrackChanges)
+        mChanges.preprocessedFiles.insert(key);
+    file->recording.reset();
+    file->cached.reset();
+}
+
+bool CppPreprocessor::cachedSegmentMatches(const PParsedFile &file, const PPreprocessedSegment &segment) const
+{
+    if (segment->startIndex != mIndex)
+        return false;
+    if (segment->startBranches != fileBranchResults(file))
+        return false;
+    for (auto it=segment->usedDefines.cbegin();it!=segment->usedDefines.cend();++it) {
+        PDefine define = mDefines.value(it.key(),PDefine());
+        const PDefine& usedDefine = it.value();
+        if (define == usedDefine)
+            continue;
+        if (!define || !usedDefine)
+            return false;
+        if (define->args != usedDefine->args
+                || define->value != usedDefine->value
+                || define->filename != usedDefine->filename)
+            return false;
+    }
+    return true;
+}
+
+bool CppPreprocessor::replayCachedSegment()
+{
+    PParsedFile file = mIncludes.back();
+    if (!file->cached)
+        return false;
+    if (file->cachedSegment >= file->cached->segments.count()
+            || !cachedSegmentMatches(file, file->cached->segments[file->cachedSegment])) {
+        // preprocess the rest of the file as usual
+        file->cached.reset();
+        return false;
+    }
+    PPreprocessedSegment segment = file->cached->segments[file->cachedSegment];
+    file->cachedSegment++;
+    // use the cached segment instead of the one being recorded
+    file->recordingSegment.reset();
+    file->recording->segments.append(segment);
+
+    int resultStart = mResult.count();
+    mResult.append(segment->result);
+    foreach (const PreprocessedDefineChange& change, segment->defineChanges) {
+        if (change.define) {
+            PDefineMap defineMap = mFileDefines.value(mFileName,PDefineMap());
+            if (!defineMap) {
+                defineMap = std::make_shared<DefineMap>();
+                mFileDefines.insert(mFileName,defineMap);
+            }
+            defineMap->insert(change.name,change.define);
+            mDefines.insert(change.name,change.define);
+            trackDefineChange(change.name);
+        } else {
+            PDefine define = mDefines.value(change.name,PDefine());
+            if (define) {
+                mDefines.remove(change.name);
+                trackDefineChange(change.name);
+                if (define->filename == mFileName) {
+                    PDefineMap defineMap = mFileDefines.value(mFileName);
+                    if (defineMap) {
+                        defineMap->remove(change.name);
+                    }
+                }
+            }
+        }
+    }
+    for (int i=0;i<segment->branchChanges.count();i++) {
+        mCurrentIncludes->branches.insert(segment->branchChanges[i].first,
+                                          segment->branchChanges[i].second);
+    }
+    while (mBranchResults.count()>file->baseBranches)
+        mBranchResults.pop_back();
+    foreach (int branchResult, segment->endBranches)
+        mBranchResults.append((BranchResult)branchResult);
+    mIndex = segment->endIndex;
+    if (!segment->includeLine.isEmpty()) {
+        mPreProcIndex = resultStart + segment->includeResultIndex;
+        handleInclude(segment->includeLine, segment->includeNext);
+        if (mIncludes.back() == file && file->recording && !file->recordingSegment)
+            beginCacheSegment(file);
+    }
+    return true;
+}
+
+bool CppPreprocessor::skipByIncludeGuard(const PParsedFile &file)
+{
+    if (!file->cached || file->cached->includeGuard.isEmpty())
+        return false;
+    if (!mDefines.contains(file->cached->includeGuard))
+        return false;
+    // All lines are skipped by the guard; produce the same results as preprocessing the file.
+    for (int i=0;i<mBuffer.count();i++)
+        mResult.append("");
+    mCurrentIncludes->branches.insert(file->cached->guardStartIndex+2, false);
+    mCurrentIncludes->branches.insert(file->cached->guardEndIndex+1, true);
+    mIndex = mBuffer.count();
+    file->cached.reset();
+    file->recording.reset();
+    return true;
+}
+
 QList<PDefineArgToken> CppPreprocessor::tokenizeValue(const QString &value)
 {
     int i=0;
@@ -1186,16 +1443,20 @@ QStringList CppPreprocessor::removeComments(const QStringList &text)
 void CppPreprocessor::preprocessBuffer()
 {
     while (mIncludes.count() > 0) {
-        QString s;
-        do {
-            s = getNextPreprocessor();
+        while (true) {
+            if (replayCachedSegment())
+                continue;
+            QString s = getNextPreprocessor();
+            if (s.isEmpty())
+                break;
             if (s.startsWith('#')) {
                 s = s.mid(1).trimmed(); // remove #
                 if (!s.isEmpty()) {
                     handlePreprocessor(s);
                 }
             }
-        } while (!s.isEmpty());
+        }
+        finishCacheRecording(mIncludes.back());
         closeInclude();
     }
 }
@@ -1280,39 +1541,6 @@ bool CppPreprocessor::isSpaceChar(const QChar &ch)
 //    }
 //}
 
-bool CppPreprocessor::isMacroIdentChar(const QChar &ch)
-{
-    //return (ch>='A' && ch<='Z') || (ch>='a' && ch<='z')
-    return ch.isLetter()
-            || ch == '_';
-}
-
-bool CppPreprocessor::isDigit(const QChar &ch)
-{
-    return (ch>='0' && ch<='9');
-}
-
-bool CppPreprocessor::isNumberChar(const QChar &ch)
-{
-    if (ch>='0' && ch<='9')
-        return true;
-    if (ch>='a' && ch<='f')
-        return true;
-    if (ch>='A' && ch<='F')
-        return true;
-    switch(ch.unicode()) {
-    case 'x':
-    case 'X':
-    case 'u':
-    case 'U':
-    case 'l':
-    case 'L':
-        return true;
-    default:
-        return false;
-    }
-}
-
 QString CppPreprocessor::lineBreak()
 {
     return "\n";
@@ -1320,620 +1548,13 @@ QString CppPreprocessor::lineBreak()
 
 bool CppPreprocessor::evaluateIf(const QString &line)
 {
-    QString newLine = expandDefines(line); // replace FOO by numerical value of FOO
-    return  evaluateExpression(newLine);
-}
-
-QString CppPreprocessor::expandDefines(QString line)
-{
-    int searchPos = 0;
-    while (searchPos < line.length()) {
-        // We have found an identifier. It is not a number suffix. Try to expand it
-        if (isMacroIdentChar(line[searchPos]) && (
-                    (searchPos == 0) || !isDigit(line[searchPos - 1]))) {
-            int head = searchPos;
-            int tail = searchPos;
-
-            // Get identifier name (numbers are allowed, but not at the start
-            while ((tail < line.length()) && (isMacroIdentChar(line[tail]) || isDigit(line[head])))
-                tail++;
-//            qDebug()<<"1 "<<head<<tail<<line;
-            QString name = line.mid(head,tail-head);
-            int nameStart = head;
-            int nameEnd = tail;
-
-            if (name == "defined") {
-                //expand define
-                //tail = searchPos + name.length();
-                while ((tail < line.length()) && isSpaceChar(line[tail]))
-                    tail++; // skip spaces
-                int defineStart;
-
-                // Skip over its arguments
-                if ((tail < line.length()) && (line[tail]=='(')) {
-                    //braced argument (next word)
-                    defineStart = tail+1;
-                    if (!skipBraces(line, tail)) {
-                        line = ""; // broken line
-                        break;
-                    }
-                } else {
-                    //none braced argument (next word)
-                    defineStart = tail;
-                    if ((tail>=line.length()) || !isMacroIdentChar(line[defineStart])) {
-                        line = ""; // broken line
-                        break;
-                    }
-                    while ((tail < line.length()) && (isMacroIdentChar(line[tail]) || isDigit(line[tail])))
-                        tail++;
-                }
-//                qDebug()<<"2 "<<defineStart<<tail<<line;
-                name = line.mid(defineStart, tail - defineStart);
-                PDefine define = getDefine(name);
-                QString insertValue;
-                if (!define) {
-                    insertValue = "0";
-                } else {
-                    insertValue = "1";
-                }
-                // Insert found value at place
-                line.remove(searchPos, tail-searchPos+1);
-                line.insert(searchPos,insertValue);
-            } else if ((name == "and") || (name == "or")) {
-                searchPos = tail; // Skip logical operators
-            }  else {
-                 // We have found a regular define. Replace it by its value
-                // Does it exist in the database?
-                PDefine define = getDefine(name);
-                QString insertValue;
-                if (!define) {
-                    insertValue = "0";
-                } else {
-                    while ((tail < line.length()) && isSpaceChar(line[tail]))
-                        tail++;// skip spaces
-                    // It is a function. Expand arguments
-                    if ((tail < line.length()) && (line[tail] == '(')) {
-                        head=tail;
-                        if (skipBraces(line, tail)) {
-//                            qDebug()<<"3 "<<line<<head<<tail;
-                            QString args = line.mid(head,tail-head+1);
-                            insertValue = expandFunction(define,args);
-                            nameEnd = tail+1;
-                        } else {
-                            line = "";// broken line
-                            break;
-                        }
-                        // Replace regular define
-                    } else {
-                        if (!define->value.isEmpty())
-                            insertValue = define->value;
-                        else
-                            insertValue = "0";
-                    }
-                }
-                // Insert found value at place
-                line.remove(nameStart, nameEnd - nameStart);
-                line.insert(searchPos,insertValue);
-            }
-        } else {
-            searchPos ++ ;
-        }
-    }
-    return line;
-}
-
-bool CppPreprocessor::skipBraces(const QString &line, int &index, int step)
-{
-    int level = 0;
-    while ((index >= 0) && (index < line.length())) { // Find the corresponding opening brace
-        if (line[index] == '(') {
-            level++;
-        } else if (line[index] == ')') {
-            level--;
-        }
-        if (level == 0)
-            return true;
-        index+=step;
-    }
-    return false;
-}
-
-QString CppPreprocessor::expandFunction(PDefine define, QString args)
-{
-    // Replace function by this string
-    QString result = define->formatValue;
-    if (args.startsWith('(') && args.endsWith(')')) {
-        args = args.mid(1,args.length()-2);
-    }
-
-    QStringList argValues;
-    int i=0;
-    bool inString = false;
-    int lastSplit=0;
-    while (i<args.length()) {
-        switch(args[i].unicode()) {
-            case '\\':
-                if (inString)
-                    i++;
-            break;
-            case '"':
-                inString = !inString;
-            break;
-            case ',':
-                if (!inString) {
-                    argValues.append(args.mid(lastSplit,i-lastSplit));
-                    lastSplit=i+1;
-                }
-            break;
-        }
-        i++;
-    }
-    argValues.append(args.mid(lastSplit,i-lastSplit));
-    if (argValues.length() == define->argList.length()
-            && argValues.length()>0) {
-        for (int i=0;i<argValues.length();i++) {
-            if (define->argUsed[i]) {
-                QString argValue = argValues[i];
-                result=result.arg(argValue.trimmed());
-            }
-        }
-    }
-    result.replace("%%","%");
-
-    return result;
-}
-
-bool CppPreprocessor::skipSpaces(const QString &expr, int &pos)
-{
-    while (pos<expr.length() && isSpaceChar(expr[pos]))
-        pos++;
-    return pos<expr.length();
-}
-
-bool CppPreprocessor::evalNumber(const QString &expr, int &result, int &pos)
-{
-    if (!skipSpaces(expr,pos))
-        return false;
-    QString s;
-    while (pos<expr.length() && isNumberChar(expr[pos])) {
-        s+=expr[pos];
-        pos++;
-    }
-    bool ok;
-
-    if (s.endsWith("LL",Qt::CaseInsensitive)) {
-        s.remove(s.length()-2,2);
-        result = s.toLongLong(&ok);
-    } else if (s.endsWith("L",Qt::CaseInsensitive)) {
-        s.remove(s.length()-1,1);
-        result = s.toLong(&ok);
-    } else if (s.endsWith("ULL",Qt::CaseInsensitive)) {
-        s.remove(s.length()-3,3);
-        result = s.toULongLong(&ok);
-    } else if (s.endsWith("UL",Qt::CaseInsensitive)) {
-        s.remove(s.length()-2,2);
-        result = s.toULong(&ok);
-    } else if (s.endsWith("U",Qt::CaseInsensitive)) {
-        s.remove(s.length()-1,1);
-        result = s.toUInt(&ok);
-    } else {
-        result = s.toInt(&ok);
-    }
-    return ok;
-}
-
-bool CppPreprocessor::evalTerm(const QString &expr, int &result, int &pos)
-{
-    if (!skipSpaces(expr,pos))
-        return false;
-    if (expr[pos]=='(') {
-        pos++;
-        if (!evalExpr(expr,result,pos))
-            return false;
-        if (!skipSpaces(expr,pos))
-            return false;
-        if (expr[pos]!=')')
-            return false;
-        pos++;
-        return true;
-    } else {
-        return evalNumber(expr,result,pos);
-    }
+    // invalid expressions (-1) are taken as true
+    return mMacroExpander.evaluateIf(line) != 0;
 }
 
-/*
- * unary_expr = term
-     | '+' term
-     | '-' term
-     | '!' term
-     | '~' term
- */
-bool CppPreprocessor::evalUnaryExpr(const QString &expr, int &result, int &pos)
+const MacroExpansionStatistics &CppPreprocessor::macroExpansionStatistics() const
 {
-    if (!skipSpaces(expr,pos))
-        return false;
-    if (expr[pos]=='+') {
-        pos++;
-        if (!evalTerm(expr,result,pos))
-            return false;
-    } else if (expr[pos]=='-') {
-        pos++;
-        if (!evalTerm(expr,result,pos))
-            return false;
-        result = -result;
-    } else if (expr[pos]=='~') {
-        pos++;
-        if (!evalTerm(expr,result,pos))
-            return false;
-        result = ~result;
-    } else if (expr[pos]=='!') {
-        pos++;
-        if (!evalTerm(expr,result,pos))
-            return false;
-        result = !result;
-    } else {
-        return evalTerm(expr,result,pos);
-    }
-    return true;
-}
-
-/*
- * mul_expr = unary_expr
-     | mul_expr '*' unary_expr
-     | mul_expr '/' unary_expr
-     | mul_expr '%' unary_expr
- */
-bool CppPreprocessor::evalMulExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalUnaryExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        int rightResult;
-        if (expr[pos]=='*') {
-            pos++;
-            if (!evalUnaryExpr(expr,rightResult,pos))
-                return false;
-            result *= rightResult;
-        } else if (expr[pos]=='/') {
-            pos++;
-            if (!evalUnaryExpr(expr,rightResult,pos))
-                return false;
-            if (rightResult != 0)
-                result /= rightResult;
-            else
-                result = 0;
-        } else if (expr[pos]=='%') {
-            pos++;
-            if (!evalUnaryExpr(expr,rightResult,pos))
-                return false;
-            if (rightResult != 0)
-                result %= rightResult;
-            else
-                result = 0;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * add_expr = mul_expr
-     | add_expr '+' mul_expr
-     | add_expr '-' mul_expr
- */
-bool CppPreprocessor::evalAddExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalMulExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        int rightResult;
-        if (expr[pos]=='+') {
-            pos++;
-            if (!evalMulExpr(expr,rightResult,pos))
-                return false;
-            result += rightResult;
-        } else if (expr[pos]=='-') {
-            pos++;
-            if (!evalMulExpr(expr,rightResult,pos))
-                return false;
-            result -= rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * shift_expr = add_expr
-     | shift_expr "<<" add_expr
-     | shift_expr ">>" add_expr
- */
-bool CppPreprocessor::evalShiftExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalAddExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        int rightResult;
-        if (pos+1<expr.length() && expr[pos] == '<' && expr[pos+1]=='<') {
-            pos += 2;
-            if (!evalAddExpr(expr,rightResult,pos))
-                return false;
-            result = (result << rightResult);
-        } else if (pos+1<expr.length() && expr[pos] == '>' && expr[pos+1]=='>') {
-            pos += 2;
-            if (!evalAddExpr(expr,rightResult,pos))
-                return false;
-            result = (result >> rightResult);
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * relation_expr = shift_expr
-     | relation_expr ">=" shift_expr
-     | relation_expr ">" shift_expr
-     | relation_expr "<=" shift_expr
-     | relation_expr "<" shift_expr
- */
-bool CppPreprocessor::evalRelationExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalShiftExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        int rightResult;
-        if (expr[pos]=='<') {
-            if (pos+1<expr.length() && expr[pos+1]=='=') {
-                pos+=2;
-                if (!evalShiftExpr(expr,rightResult,pos))
-                    return false;
-                result = (result <= rightResult);
-            } else {
-                pos++;
-                if (!evalShiftExpr(expr,rightResult,pos))
-                    return false;
-                result = (result < rightResult);
-            }
-        } else if (expr[pos]=='>') {
-            if (pos+1<expr.length() && expr[pos+1]=='=') {
-                pos+=2;
-                if (!evalShiftExpr(expr,rightResult,pos))
-                    return false;
-                result = (result >= rightResult);
-            } else {
-                pos++;
-                if (!evalShiftExpr(expr,rightResult,pos))
-                    return false;
-                result = (result > rightResult);
-            }
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * equal_expr = relation_expr
-     | equal_expr "==" relation_expr
-     | equal_expr "!=" relation_expr
- */
-bool CppPreprocessor::evalEqualExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalRelationExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (pos+1<expr.length() && expr[pos]=='!' && expr[pos+1]=='=') {
-            pos+=2;
-            int rightResult;
-            if (!evalRelationExpr(expr,rightResult,pos))
-                return false;
-            result = (result != rightResult);
-        } else if (pos+1<expr.length() && expr[pos]=='=' && expr[pos+1]=='=') {
-            pos+=2;
-            int rightResult;
-            if (!evalRelationExpr(expr,rightResult,pos))
-                return false;
-            result = (result == rightResult);
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * bit_and_expr = equal_expr
-     | bit_and_expr "&" equal_expr
- */
-bool CppPreprocessor::evalBitAndExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalEqualExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (expr[pos]=='&'
-                && (pos == expr.length()
-                || expr[pos+1]!='&')) {
-            pos++;
-            int rightResult;
-            if (!evalEqualExpr(expr,rightResult,pos))
-                return false;
-            result = result & rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * bit_xor_expr = bit_and_expr
-     | bit_xor_expr "^" bit_and_expr
- */
-bool CppPreprocessor::evalBitXorExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalBitAndExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (expr[pos]=='^') {
-            pos++;
-            int rightResult;
-            if (!evalBitAndExpr(expr,rightResult,pos))
-                return false;
-            result = result ^ rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * bit_or_expr = bit_xor_expr
-     | bit_or_expr "|" bit_xor_expr
- */
-bool CppPreprocessor::evalBitOrExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalBitXorExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (expr[pos] == '|'
-                && (pos == expr.length()
-                || expr[pos+1]!='|')) {
-            pos++;
-            int rightResult;
-            if (!evalBitXorExpr(expr,rightResult,pos))
-                return false;
-            result = result | rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * logic_and_expr = bit_or_expr
-    | logic_and_expr "&&" bit_or_expr
- */
-bool CppPreprocessor::evalLogicAndExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalBitOrExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (pos+1<expr.length() && expr[pos]=='&' && expr[pos+1] =='&') {
-            pos+=2;
-            int rightResult;
-            if (!evalBitOrExpr(expr,rightResult,pos))
-                return false;
-            result = result && rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-/*
- * logic_or_expr = logic_and_expr
-    | logic_or_expr "||" logic_and_expr
- */
-bool CppPreprocessor::evalLogicOrExpr(const QString &expr, int &result, int &pos)
-{
-    if (!evalLogicAndExpr(expr,result,pos))
-        return false;
-    while (true) {
-        if (!skipSpaces(expr,pos))
-            break;
-        if (pos+1<expr.length() && expr[pos]=='|' && expr[pos+1] =='|') {
-            pos+=2;
-            int rightResult;
-            if (!evalLogicAndExpr(expr,rightResult,pos))
-                return false;
-            result = result || rightResult;
-        } else {
-            break;
-        }
-    }
-    return true;
-}
-
-bool CppPreprocessor::evalExpr(const QString &expr, int &result, int &pos)
-{
-    return evalLogicOrExpr(expr,result,pos);
-}
-
-/* BNF for C constant expression evaluation
- * term = number
-     | '(' expression ')'
-unary_expr = term
-     | '+' term
-     | '-' term
-     | '!' term
-     | '~' term
-mul_expr = term
-     | mul_expr '*' term
-     | mul_expr '/' term
-     | mul_expr '%' term
-add_expr = mul_expr
-     | add_expr '+' mul_expr
-     | add_expr '-' mul_expr
-shift_expr = add_expr
-     | shift_expr "<<" add_expr
-     | shift_expr ">>" add_expr
-relation_expr = shift_expr
-     | relation_expr ">=" shift_expr
-     | relation_expr ">" shift_expr
-     | relation_expr "<=" shift_expr
-     | relation_expr "<" shift_expr
-equal_expr = relation_expr
-     | equal_expr "==" relation_expr
-     | equal_expr "!=" relation_expr
-bit_and_expr = equal_expr
-     | bit_and_expr "&" equal_expr
-bit_xor_expr = bit_and_expr
-     | bit_xor_expr "^" bit_and_expr
-bit_or_expr = bit_xor_expr
-     | bit_or_expr "|" bit_xor_expr
-logic_and_expr = bit_or_expr
-    | logic_and_expr "&&" bit_or_expr
-logic_or_expr = logic_and_expr
-    | logic_or_expr "||" logic_and_expr
-    */
-
-int CppPreprocessor::evaluateExpression(QString line)
-{
-    int pos = 0;
-    int result;
-    bool ok = evalExpr(line,result,pos);
-    if (!ok)
-        return -1;
-    //expr not finished
-    if (skipSpaces(line,pos))
-        return -1;
-    return result;
+    return mMacroExpander.statistics();
 }
 
 void CppPreprocessor::setOnGetFileStream(const GetFileStreamCallBack &newOnGetFileStream)
@@ -1971,6 +1592,11 @@ QSet<QString> &CppPreprocessor::scannedFiles()
     return mScannedFiles;
 }
 
+QHash<QString, PDefineMap> &CppPreprocessor::fileDefines()
+{
+    return mFileDefines;
+}
+
 QHash<QString, PFileIncludes> &CppPreprocessor::includesList()
 {
     return mIncludesList;
@@ -1980,3 +1606,13 @@ const QHash<QString, PFileIncludes> &CppPreprocessor::includesList() const
 {
     return mIncludesList;
 }
+
+IncludeGraph &CppPreprocessor::includeGraph()
+{
+    return mIncludeGraph;
+}
+
+const IncludeGraph &CppPreprocessor::includeGraph() const
+{
+    return mIncludeGraph;
+}
@@ -20,8 +20,9 @@
 #include <QObject>
 #include <QTextStream>
 #include "parserutils.h"
+#include "macroexpander.h"
+#include "includegraph.h"
 
-#define MAX_DEFINE_EXPAND_DEPTH 20
 enum class DefineArgTokenType{
     Symbol,
     Identifier,
@@ -36,12 +37,60 @@ struct DefineArgToken {
 };
 using PDefineArgToken = std::shared_ptr<DefineArgToken>;
 
+struct PreprocessedDefineChange {
+    QString name;
+    PDefine define; // nullptr for #undef
+};
+
+/**
+ * @brief Preprocess result of a part of a file, from its start or the line after
+ *   an #include, to the next #include or the end of the file.
+ *
+ * It can be replayed instead of preprocessing the lines again, if the defines
+ * it looked up are the same as when it's recorded.
+ */
+struct PreprocessedSegment {
+    int startIndex; // buffer index of the first line
+    QVector<int> startBranches; // branch results of the file when the segment starts
+    DefineMap usedDefines; // defines looked up before the segment changes them (nullptr if undefined)
+    QList<PreprocessedDefineChange> defineChanges;
+    QStringList result; // preprocessed lines
+    QList<QPair<int,bool>> branchChanges; // changes to the file's branch map
+    QVector<int> endBranches; // branch results of the file when the segment ends
+    int endIndex; // buffer index after the segment
+    QString includeLine; // the #include the segment ends with, empty if it ends at the end of file
+    bool includeNext;
+    int includeResultIndex; // index of the #include line in result
+    //only used when recording
+    int resultStart;
+    QSet<QString> changedDefines;
+};
+using PPreprocessedSegment = std::shared_ptr<PreprocessedSegment>;
+
+/**
+ * @brief Cached preprocess results of a (non system) file
+ */
+struct PreprocessedFile {
+    QByteArray contentHash; // hash of the file content before comments are removed
+    QStringList buffer; // file content with comments removed
+    QString includeGuard; // X if the file is wrapped in #ifndef X / #define X ... #endif
+    int guardStartIndex; // buffer index of the guard's #ifndef
+    int guardEndIndex; // buffer index of the guard's #endif
+    QVector<PPreprocessedSegment> segments;
+};
+using PPreprocessedFile = std::shared_ptr<PreprocessedFile>;
+
 struct ParsedFile {
     int index; // 0-based for programming convenience
     QString fileName; // Record filename, but not used now
     QStringList buffer; // do not concat them all
     int branches; //branch levels;
     PFileIncludes fileIncludes; // includes of this file
+    int baseBranches; // branch levels when the file is opened
+    PPreprocessedFile cached; // cached results which can be replayed
+    int cachedSegment; // index of the next cached segment to replay
+    PPreprocessedFile recording; // results of this processing, cached when the file is closed
+    PPreprocessedSegment recordingSegment;
 };
 using PParsedFile = std::shared_ptr<ParsedFile>;
 
@@ -69,8 +118,24 @@ public:
     void clearTempResults();
     void getDefineParts(const QString& input, QString &name, QString &args, QString &value);
     void addHardDefineByLine(const QString& line);
+    /**
+     * @brief add the "#define ..." lines printed by the compiler as hard defines
+     */
+    void addHardDefinesByLines(const QStringList& lines);
     void setScanOptions(bool parseSystem, bool parseLocal);
     void preprocess(const QString& fileName);
+    /**
+     * @brief preprocess the file with the defines in context set as given, like
+     *   it's included at the same place as before. Defines not changed by the
+     *   file are restored afterwards.
+     */
+    void preprocess(const QString& fileName, const DefineMap& context);
+    /**
+     * @brief defines looked up by the file the last time it was preprocessed, with
+     *   the values they had before the file changed them (nullptr if undefined)
+     * @return false if the preprocess results of the file are not cached
+     */
+    bool lastMacroContext(const QString& fileName, DefineMap& context) const;
 
     void dumpDefinesTo(const QString& fileName) const;
     void dumpIncludesListTo(const QString& fileName) const;
@@ -79,6 +144,27 @@ public:
     void clearIncludePaths();
     void clearProjectIncludePaths();
     void removeScannedFile(const QString& filename);
+    /**
+     * @brief take a snapshot of the options and the results across processings of other,
+     *   so this preprocessor can work on a different thread
+     */
+    void copyParseStateFrom(const CppPreprocessor& other);
+    /**
+     * @brief record the changes to the parse state from now on,
+     *   so mergeParseStateTo() doesn't have to go through the whole state
+     */
+    void beginTrackingChanges();
+    /**
+     * @brief add files scanned by this preprocessor since beginTrackingChanges()
+     *   (and the defines) to other
+     */
+    void mergeParseStateTo(CppPreprocessor& other) const;
+    /**
+     * @brief files scanned since beginTrackingChanges()
+     */
+    const QStringList& newlyScannedFiles() const {
+        return mChanges.scannedFiles;
+    }
 
     const QStringList& result() const{
         return mResult;
@@ -88,8 +174,14 @@ public:
 
     const QHash<QString, PFileIncludes> &includesList() const;
 
+    IncludeGraph &includeGraph();
+
+    const IncludeGraph &includeGraph() const;
+
     QSet<QString> &scannedFiles();
 
+    QHash<QString, PDefineMap> &fileDefines();
+
     const QSet<QString> &includePaths();
 
     const QSet<QString> &projectIncludePaths();
@@ -103,6 +195,8 @@ public:
 
     static QList<PDefineArgToken> tokenizeValue(const QString& value);
 
+    const MacroExpansionStatistics& macroExpansionStatistics() const;
+
 private:
 
     enum class BranchResult {
@@ -121,14 +215,14 @@ private:
     void handleInclude(const QString& line, bool fromNext=false);
     void handlePreprocessor(const QString& value);
     void handleUndefine(const QString& line);
-    QString expandMacros(const QString& line, int depth);
     QString expandMacros();
-    void expandMacro(const QString& line, QString& newLine, QString& word, int& i, int depth);
-    void expandMacro(QString& newLine, QString& word, int& i, int depth);
     QString removeGCCAttributes(const QString& line);
     void removeGCCAttribute(const QString&line, QString& newLine, int &i, const QString& word);
-    PDefine getDefine(const QString& name) const{
-        return mDefines.value(name,PDefine());
+    PDefine getDefine(const QString& name) {
+        PDefine define = mDefines.value(name,PDefine());
+        if (!mIncludes.isEmpty() && mIncludes.back()->recordingSegment)
+            recordDefineUse(mIncludes.back()->recordingSegment, name, define);
+        return define;
     }
     // current file stuff
     PParsedFile getInclude(int index) const {
@@ -151,26 +245,39 @@ private:
     }
     void setCurrentBranch(BranchResult value){
         if (!sameResultWithCurrentBranch(value)) {
-            mCurrentIncludes->branches.insert(mIndex+1,value==BranchResult::isTrue);
+            setBranchVisible(mIndex+1,value==BranchResult::isTrue);
         }
         mBranchResults.append(value);
     }
     void removeCurrentBranch(){
         BranchResult value = getCurrentBranch();
+        if (!mIncludes.isEmpty() && mIncludes.back()->recording
+                && mBranchResults.size() <= mIncludes.back()->baseBranches) {
+            // unbalanced #endif, the result depends on the including file
+            stopCacheRecording(mIncludes.back());
+        }
         if (mBranchResults.size()>0) {
             mBranchResults.pop_back();
         }
         if (!sameResultWithCurrentBranch(value)) {
-            mCurrentIncludes->branches.insert(mIndex,getCurrentBranch()==BranchResult::isTrue);
+            setBranchVisible(mIndex,getCurrentBranch()==BranchResult::isTrue);
         }
     }
+    void setBranchVisible(int line, bool visible) {
+        mCurrentIncludes->branches.insert(line,visible);
+        if (!mIncludes.isEmpty() && mIncludes.back()->recordingSegment)
+            mIncludes.back()->recordingSegment->branchChanges.append(qMakePair(line,visible));
+    }
     // include stuff
     PFileIncludes getFileIncludesEntry(const QString& fileName){
         return mIncludesList.value(fileName,PFileIncludes());
     }
     void addDefinesInFile(const QString& fileName);
+    PDefine createDefine(const QString& name, const QString& args,
+                         const QString& value, bool hardCoded);
     void addDefineByParts(const QString& name, const QString& args,
                           const QString& value, bool hardCoded);
+    PDefineMap compileHardDefines(const QStringList& lines);
     void addDefineByLine(const QString& line, bool hardCoded);
     PDefine getHardDefine(const QString& name){
         return mHardDefines.value(name,PDefine());
@@ -179,6 +286,25 @@ private:
 
     void parseArgs(PDefine define);
 
+    // preprocess results cache
+    static QString preprocessedFileKey(const QString& fileName, bool parseSystem, bool parseLocal);
+    static QByteArray calcContentHash(const QStringList& lines);
+    static void detectIncludeGuard(const PPreprocessedFile& preprocessedFile);
+    void recordDefineUse(const PPreprocessedSegment& segment, const QString& name, const PDefine& define);
+    void recordDefineChange(const QString& name, const PDefine& define);
+    void trackDefineChange(const QString& name) {
+        if (mTrackChanges)
+            mChanges.defines.insert(name);
+    }
+    QVector<int> fileBranchResults(const PParsedFile& file) const;
+    void beginCacheSegment(const PParsedFile& file);
+    void endCacheSegment(const PParsedFile& file, const QString& includeLine = QString(), bool includeNext = false);
+    void stopCacheRecording(const PParsedFile& file);
+    void finishCacheRecording(const PParsedFile& file);
+    bool cachedSegmentMatches(const PParsedFile& file, const PPreprocessedSegment& segment) const;
+    bool replayCachedSegment();
+    bool skipByIncludeGuard(const PParsedFile& file);
+
     QStringList removeComments(const QStringList& text);
     /*
      * '_','a'..'z','A'..'Z','0'..'9'
@@ -201,44 +327,9 @@ static  bool isSpaceChar(const QChar& ch);
      */
 //static  bool isOperatorChar(const QChar& ch);
 
-    /*
-     * 'A'..'Z', 'a'..'z', '_'
-     */
-static  bool isMacroIdentChar(const QChar& ch);
-
-    /*
-     * '0'..'9'
-     */
-static  bool isDigit(const QChar& ch);
-
-    /*
-     * '0'..'9','x',X','a'..'f','A'..'F','u','U','l','L'
-     */
-static  bool isNumberChar(const QChar& ch);
-
     QString lineBreak();
 
     bool evaluateIf(const QString& line);
-    QString expandDefines(QString line);
-    bool skipBraces(const QString&line, int& index, int step = 1);
-    QString expandFunction(PDefine define,QString args);
-    bool skipSpaces(const QString &expr, int& pos);
-    bool evalNumber(const QString &expr, int& result, int& pos);
-    bool evalTerm(const QString &expr, int& result, int& pos);
-    bool evalUnaryExpr(const QString &expr, int& result, int& pos);
-    bool evalMulExpr(const QString &expr, int& result, int& pos);
-    bool evalAddExpr(const QString &expr, int& result, int& pos);
-    bool evalShiftExpr(const QString &expr, int& result, int& pos);
-    bool evalRelationExpr(const QString &expr, int& result, int& pos);
-    bool evalEqualExpr(const QString &expr, int& result, int& pos);
-    bool evalBitAndExpr(const QString &expr, int& result, int& pos);
-    bool evalBitXorExpr(const QString &expr, int& result, int& pos);
-    bool evalBitOrExpr(const QString &expr, int& result, int& pos);
-    bool evalLogicAndExpr(const QString &expr, int& result, int& pos);
-    bool evalLogicOrExpr(const QString &expr, int& result, int& pos);
-    bool evalExpr(const QString &expr, int& result, int& pos);
-
-    int evaluateExpression(QString line);
 private:
     //temporary data when preprocessing single file
     int mIndex; // points to current file buffer.
@@ -250,14 +341,17 @@ private:
     QList<PParsedFile> mIncludes; // stack of files we've stepped into. last one is current file, first one is source file
     QList<BranchResult> mBranchResults;// stack of branch results (boolean). last one is current branch, first one is outermost branch
     DefineMap mDefines; // working set, editable
+    MacroExpander mMacroExpander;
     QSet<QString> mProcessed; // dictionary to save filename already processed
 
 
     //Result across processings.
     //used by parser even preprocess finished
     QHash<QString,PFileIncludes> mIncludesList;
+    IncludeGraph mIncludeGraph;
     QHash<QString, PDefineMap> mFileDefines; //dictionary to save defines for each headerfile;
     QSet<QString> mScannedFiles;
+    QHash<QString, PPreprocessedFile> mPreprocessedFiles; // cached results of non system files
 
     //option data for the parser
     //{ List of current project's include path }
@@ -272,6 +366,16 @@ private:
     bool mParseSystem;
     bool mParseLocal;
 
+    struct ParseStateChanges {
+        QStringList scannedFiles;
+        QStringList includesFiles; // files added to mIncludesList
+        QSet<QString> includeSources; // files whose include edges are added
+        QSet<QString> defines; // names defined or undefined
+        QSet<QString> preprocessedFiles; // keys added to mPreprocessedFiles
+    };
+    bool mTrackChanges;
+    ParseStateChanges mChanges;
+
     GetFileStreamCallBack mOnGetFileStream;
 };
 
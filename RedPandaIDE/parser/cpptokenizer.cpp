@@ -49,6 +49,8 @@ void CppTokenizer::tokenize(const QStringList &buffer)
         mBufferStr+='\n';
         mBufferStr+=mBuffer[i];
     }
+    // about one token per 6 chars in preprocessed sources
+    mTokenList.reserve(mBufferStr.length()/6);
     mStart = mBufferStr.data();
     mCurrent = mStart;
     mLineCount = mStart;
@@ -76,14 +78,31 @@ void CppTokenizer::tokenize(const QStringList &buffer)
     }
 }
 
+void CppTokenizer::swap(CppTokenizer &other)
+{
+    // QString::swap() keeps the buffers, so mStart/mCurrent/mLineCount stay valid
+    mBuffer.swap(other.mBuffer);
+    mBufferStr.swap(other.mBufferStr);
+    std::swap(mStart, other.mStart);
+    std::swap(mCurrent, other.mCurrent);
+    std::swap(mLineCount, other.mLineCount);
+    std::swap(mCurrentLine, other.mCurrentLine);
+    mLastToken.swap(other.mLastToken);
+    mTokenList.swap(other.mTokenList);
+    mLambdas.swap(other.mLambdas);
+    mUnmatchedBraces.swap(other.mUnmatchedBraces);
+    mUnmatchedBrackets.swap(other.mUnmatchedBrackets);
+    mUnmatchedParenthesis.swap(other.mUnmatchedParenthesis);
+}
+
 void CppTokenizer::dumpTokens(const QString &fileName)
 {
     QFile file(fileName);
 
     if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         QTextStream stream(&file);
-        foreach (const PToken& token,mTokenList) {
-            stream<<QString("%1,%2,%3").arg(token->line).arg(token->text).arg(token->matchIndex)
+        foreach (const Token& token,mTokenList) {
+            stream<<QString("%1,%2,%3").arg(token.line).arg(token.text).arg(token.matchIndex)
 #if QT_VERSION >= QT_VERSION_CHECK(5,15,0)
                  <<Qt::endl;
 #else
@@ -95,49 +114,47 @@ void CppTokenizer::dumpTokens(const QString &fileName)
 
 void CppTokenizer::addToken(const QString &sText, int iLine, TokenType tokenType)
 {
-    PToken token = std::make_shared<Token>();
-    token->text = sText;
-    token->line = iLine;
-#ifdef Q_DEBUG
-    token->matchIndex = 1000000000;
-#endif
+    Token token;
+    token.text = sText;
+    token.line = iLine;
+    token.matchIndex = 0;
     switch(tokenType) {
     case TokenType::LeftBrace:
-        token->matchIndex=-1;
+        token.matchIndex=-1;
         mUnmatchedBraces.push_back(mTokenList.count());
         break;
     case TokenType::RightBrace:
         if (mUnmatchedBraces.isEmpty()) {
-            token->matchIndex=-1;
+            token.matchIndex=-1;
         } else {
-            token->matchIndex = mUnmatchedBraces.last();
-            mTokenList[token->matchIndex]->matchIndex=mTokenList.count();
+            token.matchIndex = mUnmatchedBraces.last();
+            mTokenList[token.matchIndex].matchIndex=mTokenList.count();
             mUnmatchedBraces.pop_back();
         }
         break;
     case TokenType::LeftBracket:
-        token->matchIndex=-1;
+        token.matchIndex=-1;
         mUnmatchedBrackets.push_back(mTokenList.count());
         break;
     case TokenType::RightBracket:
         if (mUnmatchedBrackets.isEmpty()) {
-            token->matchIndex=-1;
+            token.matchIndex=-1;
         } else {
-            token->matchIndex = mUnmatchedBrackets.last();
-            mTokenList[token->matchIndex]->matchIndex=mTokenList.count();
+            token.matchIndex = mUnmatchedBrackets.last();
+            mTokenList[token.matchIndex].matchIndex=mTokenList.count();
             mUnmatchedBrackets.pop_back();
         }
         break;
     case TokenType::LeftParenthesis:
-        token->matchIndex=-1;
+        token.matchIndex=-1;
         mUnmatchedParenthesis.push_back(mTokenList.count());
         break;
     case TokenType::RightParenthesis:
         if (mUnmatchedParenthesis.isEmpty()) {
-            token->matchIndex=-1;
+            token.matchIndex=-1;
         } else {
-            token->matchIndex = mUnmatchedParenthesis.last();
-            mTokenList[token->matchIndex]->matchIndex=mTokenList.count();
+            token.matchIndex = mUnmatchedParenthesis.last();
+            mTokenList[token.matchIndex].matchIndex=mTokenList.count();
             mUnmatchedParenthesis.pop_back();
         }
         break;
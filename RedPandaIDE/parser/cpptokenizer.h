@@ -40,17 +40,18 @@ public:
       int line;
       int matchIndex;
     };
-    using PToken = std::shared_ptr<Token>;
-    using TokenList = QVector<PToken>;
+    // tokens are stored by value in one contiguous array
+    using TokenList = QVector<Token>;
     explicit CppTokenizer();
     CppTokenizer(const CppTokenizer&)=delete;
     CppTokenizer& operator=(const CppTokenizer&)=delete;
 
     void clear();
     void tokenize(const QStringList& buffer);
+    void swap(CppTokenizer& other);
     void dumpTokens(const QString& fileName);
-    const PToken& operator[](int i) const {
-        return mTokenList[i];
+    const Token* operator[](int i) const {
+        return mTokenList.constData()+i;
     }
     int tokenCount() const {
         return mTokenList.count();
@@ -73,7 +74,6 @@ private:
     void addToken(const QString& sText, int iLine, TokenType tokenType);
     void advance();
     void countLines();
-    PToken getToken(int index);
 
     QString getForInit();
     QString getNextToken(
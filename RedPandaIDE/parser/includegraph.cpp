@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "includegraph.h"
+#include <QVector>
+#include <algorithm>
+
+IncludeGraph::IncludeGraph():
+    mOrderValid{false}
+{
+
+}
+
+void IncludeGraph::addInclude(const QString &fileName, const QString &includedFile)
+{
+    QSet<QString>& includes = mIncludes[fileName];
+    if (includes.contains(includedFile))
+        return;
+    includes.insert(includedFile);
+    mIncludedBy[includedFile].insert(fileName);
+    mOrderValid = false;
+}
+
+void IncludeGraph::removeIncludesOf(const QString &fileName)
+{
+    auto it = mIncludes.find(fileName);
+    if (it == mIncludes.end())
+        return;
+    foreach (const QString& includedFile, it.value()) {
+        auto it2 = mIncludedBy.find(includedFile);
+        if (it2 == mIncludedBy.end())
+            continue;
+        it2.value().remove(fileName);
+        if (it2.value().isEmpty())
+            mIncludedBy.erase(it2);
+    }
+    mIncludes.erase(it);
+    mOrderValid = false;
+}
+
+void IncludeGraph::setIncludes(const QString &fileName, const QStringList &includedFiles)
+{
+    removeIncludesOf(fileName);
+    foreach (const QString& includedFile, includedFiles) {
+        addInclude(fileName, includedFile);
+    }
+}
+
+void IncludeGraph::clear()
+{
+    mIncludes.clear();
+    mIncludedBy.clear();
+    mOrder.clear();
+    mOrderValid = false;
+}
+
+bool IncludeGraph::contains(const QString &fileName) const
+{
+    return mIncludes.contains(fileName) || mIncludedBy.contains(fileName);
+}
+
+QSet<QString> IncludeGraph::directIncludes(const QString &fileName) const
+{
+    return mIncludes.value(fileName);
+}
+
+QSet<QString> IncludeGraph::directDependents(const QString &fileName) const
+{
+    return mIncludedBy.value(fileName);
+}
+
+QSet<QString> IncludeGraph::dependencies(const QString &fileName) const
+{
+    return reachable(mIncludes, fileName);
+}
+
+QSet<QString> IncludeGraph::dependents(const QString &fileName) const
+{
+    return reachable(mIncludedBy, fileName);
+}
+
+QStringList IncludeGraph::sortByIncludes(const QSet<QString> &files) const
+{
+    updateOrder();
+    QStringList result;
+    result.reserve(files.count());
+    foreach (const QString& file, files) {
+        result.append(file);
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [this](const QString& file1, const QString& file2) {
+        return mOrder.value(file1, -1) > mOrder.value(file2, -1);
+    });
+    return result;
+}
+
+void IncludeGraph::updateOrder() const
+{
+    if (mOrderValid)
+        return;
+    mOrder.clear();
+    // iterative depth first search, a file is numbered after all the files it includes
+    QSet<QString> visited;
+    QVector<QPair<QString,QList<QString>>> stack;
+    for (auto it=mIncludes.cbegin();it!=mIncludes.cend();++it) {
+        if (visited.contains(it.key()))
+            continue;
+        visited.insert(it.key());
+        stack.append(qMakePair(it.key(), it.value().values()));
+        while (!stack.isEmpty()) {
+            QList<QString>& pending = stack.back().second;
+            if (pending.isEmpty()) {
+                mOrder.insert(stack.back().first, mOrder.count());
+                stack.pop_back();
+                continue;
+            }
+            QString next = pending.takeLast();
+            if (visited.contains(next))
+                continue;
+            visited.insert(next);
+            stack.append(qMakePair(next, mIncludes.value(next).values()));
+        }
+    }
+    mOrderValid = true;
+}
+
+QSet<QString> IncludeGraph::reachable(const QHash<QString, QSet<QString> > &edges, const QString &fileName)
+{
+    QSet<QString> result;
+    QStringList queue;
+    queue.append(fileName);
+    while (!queue.isEmpty()) {
+        QString file = queue.takeLast();
+        foreach (const QString& next, edges.value(file)) {
+            if (next == fileName || result.contains(next))
+                continue;
+            result.insert(next);
+            queue.append(next);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef INCLUDEGRAPH_H
+#define INCLUDEGRAPH_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief The #include relations between the files scanned by the preprocessor
+ *
+ * Edges are recorded for every #include the preprocessor takes, including the
+ * ones skipped because the header is already included, and they are kept in
+ * both directions so the files depending on a header can be found without
+ * going through all the scanned files.
+ */
+class IncludeGraph
+{
+public:
+    IncludeGraph();
+    void addInclude(const QString& fileName, const QString& includedFile);
+    // remove the edges from the file, edges to it are kept
+    void removeIncludesOf(const QString& fileName);
+    void setIncludes(const QString& fileName, const QStringList& includedFiles);
+    void clear();
+
+    bool contains(const QString& fileName) const;
+    QSet<QString> directIncludes(const QString& fileName) const;
+    QSet<QString> directDependents(const QString& fileName) const;
+    // files included by the file, directly or indirectly
+    QSet<QString> dependencies(const QString& fileName) const;
+    // files including the file, directly or indirectly
+    QSet<QString> dependents(const QString& fileName) const;
+    /**
+     * @brief sort the files so that a file comes before the files it includes
+     *
+     * Files in an include cycle and files not in the graph are put in
+     * no particular order.
+     */
+    QStringList sortByIncludes(const QSet<QString>& files) const;
+private:
+    void updateOrder() const;
+    static QSet<QString> reachable(const QHash<QString,QSet<QString>>& edges,
+                                   const QString& fileName);
+private:
+    QHash<QString,QSet<QString>> mIncludes;
+    QHash<QString,QSet<QString>> mIncludedBy;
+    // position of the files in the topological order, updated on demand
+    mutable QHash<QString,int> mOrder;
+    mutable bool mOrderValid;
+};
+
+#endif // INCLUDEGRAPH_H
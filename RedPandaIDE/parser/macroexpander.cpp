@@ -0,0 +1,1047 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "macroexpander.h"
+
+#include <QStringList>
+
+// max count of macro invocations replaced when expanding a line,
+// guards against exponential growing expansions
+#define MAX_MACRO_REPLACEMENTS 100000
+// max count of compiled #if expressions kept
+#define MAX_COMPILED_EXPRESSIONS 20000
+
+namespace {
+
+int symbolLength(const QString& text, int i)
+{
+    int len = text.length();
+    QChar c2 = (i+1<len) ? text[i+1] : QChar();
+    QChar c3 = (i+2<len) ? text[i+2] : QChar();
+    switch (text[i].unicode()) {
+    case '<':
+        if (c2 == '<')
+            return (c3 == '=') ? 3 : 2;
+        if (c2 == '=')
+            return (c3 == '>') ? 3 : 2;
+        return 1;
+    case '>':
+        if (c2 == '>')
+            return (c3 == '=') ? 3 : 2;
+        return (c2 == '=') ? 2 : 1;
+    case '.':
+        if (c2 == '.' && c3 == '.')
+            return 3;
+        return (c2 == '*') ? 2 : 1;
+    case '-':
+        if (c2 == '>')
+            return (c3 == '*') ? 3 : 2;
+        return (c2 == '-' || c2 == '=') ? 2 : 1;
+    case '+':
+        return (c2 == '+' || c2 == '=') ? 2 : 1;
+    case '&':
+        return (c2 == '&' || c2 == '=') ? 2 : 1;
+    case '|':
+        return (c2 == '|' || c2 == '=') ? 2 : 1;
+    case '#':
+        return (c2 == '#') ? 2 : 1;
+    case ':':
+        return (c2 == ':') ? 2 : 1;
+    case '=':
+    case '!':
+    case '*':
+    case '/':
+    case '%':
+    case '^':
+        return (c2 == '=') ? 2 : 1;
+    default:
+        return 1;
+    }
+}
+
+const QStringList LiteralPrefixes {
+    "L", "u", "U", "u8", "R", "LR", "uR", "UR", "u8R"
+};
+
+int binaryPrecedence(const QString& op)
+{
+    if (op == "*" || op == "/" || op == "%")
+        return 10;
+    if (op == "+" || op == "-")
+        return 9;
+    if (op == "<<" || op == ">>")
+        return 8;
+    if (op == "<" || op == ">" || op == "<=" || op == ">=")
+        return 7;
+    if (op == "==" || op == "!=")
+        return 6;
+    if (op == "&")
+        return 5;
+    if (op == "^")
+        return 4;
+    if (op == "|")
+        return 3;
+    if (op == "&&")
+        return 2;
+    if (op == "||")
+        return 1;
+    return -1;
+}
+
+bool evalNumber(QString text, qint64& result)
+{
+    text.remove('\'');
+    while (!text.isEmpty()) {
+        QChar ch = text.back();
+        if (ch == 'u' || ch == 'U' || ch == 'l' || ch == 'L' || ch == 'z' || ch == 'Z')
+            text.chop(1);
+        else
+            break;
+    }
+    bool ok;
+    if (text.startsWith("0b", Qt::CaseInsensitive)) {
+        result = (qint64)text.mid(2).toULongLong(&ok, 2);
+        return ok;
+    }
+    result = text.toLongLong(&ok, 0);
+    if (!ok)
+        result = (qint64)text.toULongLong(&ok, 0);
+    return ok;
+}
+
+bool evalCharacter(const QString& text, qint64& result)
+{
+    int start = text.indexOf('\'');
+    if (start < 0 || start + 1 >= text.length())
+        return false;
+    QString s = text.mid(start + 1);
+    if (s.endsWith('\''))
+        s.chop(1);
+    if (s.isEmpty())
+        return false;
+    if (s[0] != '\\') {
+        result = s[0].unicode();
+        return true;
+    }
+    if (s.length() < 2)
+        return false;
+    QChar ch = s[1];
+    switch (ch.unicode()) {
+    case 'n': result = '\n'; return true;
+    case 't': result = '\t'; return true;
+    case 'r': result = '\r'; return true;
+    case 'a': result = '\a'; return true;
+    case 'b': result = '\b'; return true;
+    case 'f': result = '\f'; return true;
+    case 'v': result = '\v'; return true;
+    case 'x': {
+        bool ok;
+        result = s.mid(2).toLongLong(&ok, 16);
+        return ok;
+    }
+    default:
+        if (ch >= '0' && ch <= '7') {
+            bool ok;
+            result = s.mid(1).toLongLong(&ok, 8);
+            return ok;
+        }
+        result = ch.unicode();
+        return true;
+    }
+}
+
+/*
+ * conditional_expr = logic_or_expr
+ *    | logic_or_expr '?' conditional_expr ':' conditional_expr
+ * binary operators are parsed by precedence climbing
+ * unary_expr = primary
+ *    | ('+' | '-' | '!' | '~') unary_expr
+ * primary = number | character | identifier (0, 'true' is 1)
+ *    | '(' conditional_expr ')'
+ */
+class ExpressionCompiler {
+public:
+    explicit ExpressionCompiler(const MacroTokenList& tokens):
+        mPos{0},
+        mOps{nullptr} {
+        foreach (const MacroToken& token, tokens) {
+            if (token.type == MacroTokenType::Space || token.type == MacroTokenType::Placemarker)
+                continue;
+            MacroToken t = token;
+            // alternative operator representations
+            if (t.type == MacroTokenType::Identifier) {
+                if (t.text == "and") {
+                    t.text = "&&";
+                } else if (t.text == "or") {
+                    t.text = "||";
+                } else if (t.text == "not") {
+                    t.text = "!";
+                } else if (t.text == "not_eq") {
+                    t.text = "!=";
+                } else if (t.text == "bitand") {
+                    t.text = "&";
+                } else if (t.text == "bitor") {
+                    t.text = "|";
+                } else if (t.text == "xor") {
+                    t.text = "^";
+                } else if (t.text == "compl") {
+                    t.text = "~";
+                }
+                if (t.text != token.text)
+                    t.type = MacroTokenType::Symbol;
+            }
+            mTokens.append(t);
+        }
+    }
+
+    bool compile(MacroExpression& expression) {
+        mOps = &expression.ops;
+        mPos = 0;
+        if (!parseConditional())
+            return false;
+        return mPos == mTokens.length();
+    }
+private:
+    bool isSymbol(const QString& text) const {
+        return mPos < mTokens.length()
+                && mTokens[mPos].type == MacroTokenType::Symbol
+                && mTokens[mPos].text == text;
+    }
+
+    void addOp(MacroExpression::OpType type, const QString& op, qint64 value = 0) {
+        mOps->append(MacroExpression::Op{type, op, value});
+    }
+
+    bool parseConditional() {
+        if (!parseBinary(1))
+            return false;
+        if (!isSymbol("?"))
+            return true;
+        mPos++;
+        if (!parseConditional())
+            return false;
+        if (!isSymbol(":"))
+            return false;
+        mPos++;
+        if (!parseConditional())
+            return false;
+        addOp(MacroExpression::OpType::Conditional, "?:");
+        return true;
+    }
+
+    bool parseBinary(int minPrecedence) {
+        if (!parseUnary())
+            return false;
+        while (mPos < mTokens.length() && mTokens[mPos].type == MacroTokenType::Symbol) {
+            QString op = mTokens[mPos].text;
+            int precedence = binaryPrecedence(op);
+            if (precedence < minPrecedence)
+                break;
+            mPos++;
+            if (!parseBinary(precedence + 1))
+                return false;
+            addOp(MacroExpression::OpType::Binary, op);
+        }
+        return true;
+    }
+
+    bool parseUnary() {
+        if (isSymbol("+") || isSymbol("-") || isSymbol("!") || isSymbol("~")) {
+            QString op = mTokens[mPos].text;
+            mPos++;
+            if (!parseUnary())
+                return false;
+            addOp(MacroExpression::OpType::Unary, op);
+            return true;
+        }
+        return parsePrimary();
+    }
+
+    bool parsePrimary() {
+        if (mPos >= mTokens.length())
+            return false;
+        const MacroToken& token = mTokens[mPos];
+        qint64 value;
+        switch (token.type) {
+        case MacroTokenType::Number:
+            if (!evalNumber(token.text, value))
+                return false;
+            break;
+        case MacroTokenType::Literal:
+            if (!token.text.endsWith('\'') || !evalCharacter(token.text, value))
+                return false;
+            break;
+        case MacroTokenType::Identifier:
+            // identifiers remaining after macro expansion are 0
+            value = (token.text == "true") ? 1 : 0;
+            break;
+        case MacroTokenType::Symbol:
+            if (token.text == "(") {
+                mPos++;
+                if (!parseConditional())
+                    return false;
+                if (!isSymbol(")"))
+                    return false;
+                mPos++;
+                return true;
+            }
+            return false;
+        default:
+            return false;
+        }
+        mPos++;
+        addOp(MacroExpression::OpType::Value, QString(), value);
+        return true;
+    }
+private:
+    MacroTokenList mTokens;
+    int mPos;
+    QVector<MacroExpression::Op>* mOps;
+};
+
+}
+
+MacroExpander::MacroExpander(const DefineGetter &getDefine):
+    mGetDefine{getDefine},
+    mReplacementBudget{MAX_MACRO_REPLACEMENTS}
+{
+    resetStatistics();
+}
+
+QString MacroExpander::expandLine(const QString &line, const LineGetter &nextLine, int &linesUsed)
+{
+    mStatistics.lines++;
+    mReplacementBudget = MAX_MACRO_REPLACEMENTS;
+    int oldReplacements = mStatistics.replacements;
+    LineContext context{&nextLine, 0};
+    MacroTokenList tokens = tokenize(line);
+    MacroTokenList stack;
+    stack.reserve(tokens.length());
+    for (int i=tokens.length()-1;i>=0;i--)
+        stack.append(tokens[i]);
+    MacroTokenList output;
+    output.reserve(tokens.length());
+    expand(stack, output, &context, 0);
+    linesUsed = context.linesUsed;
+    // nothing replaced, keep the line as it is
+    if (oldReplacements == mStatistics.replacements && linesUsed == 0)
+        return line;
+    return toString(output);
+}
+
+QString MacroExpander::expandLine(const QString &line)
+{
+    int linesUsed;
+    return expandLine(line, LineGetter(), linesUsed);
+}
+
+qint64 MacroExpander::evaluateIf(const QString &expression)
+{
+    mStatistics.expressions++;
+    mReplacementBudget = MAX_MACRO_REPLACEMENTS;
+    MacroTokenList tokens = tokenize(expression);
+    // operands of defined must not be expanded
+    resolveDefined(tokens);
+    tokens = expandTokens(tokens, 0);
+    // defined produced by macro expansion
+    resolveDefined(tokens);
+
+    QString key;
+    foreach (const MacroToken& token, tokens) {
+        if (token.type == MacroTokenType::Space)
+            continue;
+        if (!key.isEmpty())
+            key += ' ';
+        key += token.text;
+    }
+    PMacroExpression compiled;
+    auto it = mCompiledExpressions.constFind(key);
+    if (it != mCompiledExpressions.constEnd()) {
+        compiled = it.value();
+        mStatistics.compiledExpressionHits++;
+    } else {
+        compiled = compileExpression(tokens);
+        if (mCompiledExpressions.count() >= MAX_COMPILED_EXPRESSIONS)
+            mCompiledExpressions.clear();
+        mCompiledExpressions.insert(key, compiled);
+    }
+    qint64 result;
+    if (!compiled || !evalExpression(*compiled, result))
+        return -1;
+    return result;
+}
+
+void MacroExpander::clearCompiledExpressions()
+{
+    mCompiledExpressions.clear();
+}
+
+void MacroExpander::copyCompiledExpressionsFrom(const MacroExpander &other)
+{
+    mCompiledExpressions = other.mCompiledExpressions;
+}
+
+const MacroExpansionStatistics &MacroExpander::statistics() const
+{
+    return mStatistics;
+}
+
+void MacroExpander::resetStatistics()
+{
+    mStatistics.lines = 0;
+    mStatistics.replacements = 0;
+    mStatistics.expressions = 0;
+    mStatistics.compiledExpressionHits = 0;
+}
+
+std::shared_ptr<const CompiledMacro> MacroExpander::compile(const Define &define)
+{
+    std::shared_ptr<CompiledMacro> macro = std::make_shared<CompiledMacro>();
+    macro->functionLike = !define.args.isEmpty();
+    macro->variadic = false;
+    macro->paramCount = 0;
+
+    QStringList params;
+    if (macro->functionLike) {
+        QString args = define.args.trimmed();
+        if (args.startsWith('('))
+            args.remove(0,1);
+        if (args.endsWith(')'))
+            args.chop(1);
+        args = args.trimmed();
+        if (!args.isEmpty()) {
+            params = args.split(',');
+            for (int i=0;i<params.length();i++) {
+                params[i] = params[i].trimmed();
+            }
+            QString last = params.back();
+            if (last == "...") {
+                macro->variadic = true;
+                params.back() = "__VA_ARGS__";
+            } else if (last.endsWith("...")) {
+                macro->variadic = true;
+                params.back() = last.left(last.length()-3).trimmed();
+            }
+        }
+        macro->paramCount = params.length();
+    }
+
+    MacroTokenList tokens = trimSpaces(tokenize(define.value));
+    QVector<MacroBodyItem> &items = macro->items;
+    for (int i=0;i<tokens.length();i++) {
+        const MacroToken& token = tokens[i];
+        if (token.type == MacroTokenType::Space) {
+            // spaces around ## are not kept
+            if (!items.isEmpty() && items.back().kind == MacroBodyItem::Kind::Paste)
+                continue;
+            if (i+1<tokens.length() && tokens[i+1].type == MacroTokenType::Symbol
+                    && tokens[i+1].text == "##")
+                continue;
+            items.append(MacroBodyItem{MacroBodyItem::Kind::Token, MacroToken{" ", MacroTokenType::Space, MacroHideSet()}, -1});
+            continue;
+        }
+        if (token.type == MacroTokenType::Symbol) {
+            if (token.text == "##" && !items.isEmpty() && i+1<tokens.length()) {
+                items.append(MacroBodyItem{MacroBodyItem::Kind::Paste, token, -1});
+                continue;
+            }
+            if (token.text == "#" && macro->functionLike) {
+                int j = i+1;
+                if (j<tokens.length() && tokens[j].type == MacroTokenType::Space)
+                    j++;
+                if (j<tokens.length() && tokens[j].type == MacroTokenType::Identifier) {
+                    int param = params.indexOf(tokens[j].text);
+                    if (param>=0) {
+                        items.append(MacroBodyItem{MacroBodyItem::Kind::Stringify, tokens[j], param});
+                        i = j;
+                        continue;
+                    }
+                }
+            }
+        } else if (token.type == MacroTokenType::Identifier && macro->functionLike) {
+            int param = params.indexOf(token.text);
+            if (param>=0) {
+                items.append(MacroBodyItem{MacroBodyItem::Kind::Param, token, param});
+                continue;
+            }
+        }
+        items.append(MacroBodyItem{MacroBodyItem::Kind::Token, token, -1});
+    }
+    return macro;
+}
+
+MacroTokenList MacroExpander::tokenize(const QString &text)
+{
+    MacroTokenList tokens;
+    int len = text.length();
+    int i = 0;
+    while (i<len) {
+        QChar ch = text[i];
+        int start = i;
+        MacroTokenType type;
+        if (ch == ' ' || ch == '\t') {
+            while (i<len && (text[i] == ' ' || text[i] == '\t'))
+                i++;
+            type = MacroTokenType::Space;
+        } else if ((ch >= '0' && ch <= '9')
+                   || (ch == '.' && i+1<len && text[i+1] >= '0' && text[i+1] <= '9')) {
+            i++;
+            while (i<len) {
+                QChar c = text[i];
+                QChar prev = text[i-1];
+                if ((c == '+' || c == '-')
+                        && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P')) {
+                    i++;
+                } else if (isIdentChar(c) || c == '.') {
+                    i++;
+                } else if (c == '\'' && i+1<len && isIdentChar(text[i+1])) {
+                    // digit separator
+                    i++;
+                } else {
+                    break;
+                }
+            }
+            type = MacroTokenType::Number;
+        } else if (isIdentChar(ch) || ch == '"' || ch == '\'') {
+            while (i<len && isIdentChar(text[i]))
+                i++;
+            type = MacroTokenType::Identifier;
+            if (i<len && (text[i] == '"' || text[i] == '\'')
+                    && (i == start || LiteralPrefixes.contains(text.mid(start, i-start)))) {
+                QChar quote = text[i];
+                bool raw = (i>start && text[i-1] == 'R' && quote == '"');
+                i++;
+                if (raw) {
+                    int delimiterEnd = text.indexOf('(', i);
+                    int end = -1;
+                    if (delimiterEnd>=0) {
+                        QString terminator = ')' + text.mid(i, delimiterEnd-i) + '"';
+                        end = text.indexOf(terminator, delimiterEnd+1);
+                        if (end>=0)
+                            end += terminator.length();
+                    }
+                    i = (end>=0) ? end : len;
+                } else {
+                    while (i<len) {
+                        if (text[i] == '\\') {
+                            i+=2;
+                        } else if (text[i] == quote) {
+                            i++;
+                            break;
+                        } else {
+                            i++;
+                        }
+                    }
+                    if (i>len)
+                        i = len;
+                }
+                type = MacroTokenType::Literal;
+            }
+        } else {
+            type = MacroTokenType::Symbol;
+            i += symbolLength(text, i);
+        }
+        tokens.append(MacroToken{text.mid(start, i-start), type, MacroHideSet()});
+    }
+    return tokens;
+}
+
+QString MacroExpander::toString(const MacroTokenList &tokens)
+{
+    QString result;
+    foreach (const MacroToken& token, tokens) {
+        result += token.text;
+    }
+    return result;
+}
+
+void MacroExpander::expand(MacroTokenList &stack, MacroTokenList &output, LineContext *context, int depth)
+{
+    // the stack is reversed: its last token is the next one to be handled
+    while (!stack.isEmpty()) {
+        MacroToken token = stack.takeLast();
+        if (token.type != MacroTokenType::Identifier
+                || mReplacementBudget <= 0
+                || (token.hideSet && token.hideSet->contains(token.text))) {
+            output.append(token);
+            continue;
+        }
+        PDefine define = mGetDefine(token.text);
+        if (!define || !define->compiled) {
+            output.append(token);
+            continue;
+        }
+        const CompiledMacro& macro = *(define->compiled);
+        MacroTokenList replacement;
+        if (macro.functionLike) {
+            QVector<MacroTokenList> args;
+            MacroHideSet rightParenHideSet;
+            if (!collectArgs(stack, context, macro, args, rightParenHideSet)) {
+                output.append(token);
+                continue;
+            }
+            replacement = substitute(macro, args,
+                                     unite(intersect(token.hideSet, rightParenHideSet), token.text),
+                                     depth);
+        } else {
+            replacement = substitute(macro, QVector<MacroTokenList>(),
+                                     unite(token.hideSet, token.text),
+                                     depth);
+        }
+        mReplacementBudget--;
+        mStatistics.replacements++;
+        // rescan the replacement together with the rest tokens
+        for (int i=replacement.length()-1;i>=0;i--)
+            stack.append(replacement[i]);
+    }
+}
+
+MacroTokenList MacroExpander::expandTokens(const MacroTokenList &tokens, int depth)
+{
+    if (depth > MAX_DEFINE_EXPAND_DEPTH)
+        return tokens;
+    MacroTokenList stack;
+    stack.reserve(tokens.length());
+    for (int i=tokens.length()-1;i>=0;i--)
+        stack.append(tokens[i]);
+    MacroTokenList output;
+    output.reserve(tokens.length());
+    expand(stack, output, nullptr, depth);
+    return output;
+}
+
+bool MacroExpander::fetchLine(MacroTokenList &stack, LineContext *context, int &fetchedTokens)
+{
+    if (!context || !context->nextLine || !(*context->nextLine))
+        return false;
+    QString line;
+    if (!(*context->nextLine)(context->linesUsed+1, line))
+        return false;
+    context->linesUsed++;
+    // tokens of the new line come after all tokens in the stack,
+    // so they are put at its bottom
+    MacroTokenList tokens = tokenize(line);
+    MacroTokenList newStack;
+    newStack.reserve(tokens.length()+1+stack.length());
+    for (int i=tokens.length()-1;i>=0;i--)
+        newStack.append(tokens[i]);
+    newStack.append(MacroToken{" ", MacroTokenType::Space, MacroHideSet()});
+    newStack.append(stack);
+    stack.swap(newStack);
+    fetchedTokens += tokens.length()+1;
+    return true;
+}
+
+bool MacroExpander::collectArgs(MacroTokenList &stack, LineContext *context, const CompiledMacro &macro, QVector<MacroTokenList> &args, MacroHideSet &rightParenHideSet)
+{
+    int oldLinesUsed = context ? context->linesUsed : 0;
+    int fetchedTokens = 0;
+    // tokens are not popped until the whole call is found,
+    // so pos is counted from the top of the stack
+    int pos = 0;
+    bool found = false;
+    while (true) {
+        if (pos >= stack.length()) {
+            if (!fetchLine(stack, context, fetchedTokens))
+                break;
+            continue;
+        }
+        const MacroToken& token = stack[stack.length()-1-pos];
+        if (token.type == MacroTokenType::Space) {
+            pos++;
+            continue;
+        }
+        found = (token.type == MacroTokenType::Symbol && token.text == "(");
+        break;
+    }
+    if (found) {
+        found = false;
+        pos++;
+        int level = 0;
+        MacroTokenList current;
+        while (true) {
+            if (pos >= stack.length()) {
+                if (!fetchLine(stack, context, fetchedTokens))
+                    break;
+                continue;
+            }
+            const MacroToken& token = stack[stack.length()-1-pos];
+            pos++;
+            if (token.type == MacroTokenType::Symbol) {
+                if (token.text == "(") {
+                    level++;
+                } else if (token.text == ")") {
+                    if (level == 0) {
+                        rightParenHideSet = token.hideSet;
+                        args.append(trimSpaces(current));
+                        found = true;
+                        break;
+                    }
+                    level--;
+                } else if (token.text == "," && level == 0
+                           && !(macro.variadic && args.length() == macro.paramCount-1)) {
+                    args.append(trimSpaces(current));
+                    current.clear();
+                    continue;
+                }
+            }
+            current.append(token);
+        }
+    }
+    if (found) {
+        if (macro.paramCount == 0 && args.length() == 1 && args[0].isEmpty())
+            args.clear();
+        if (macro.variadic && args.length() == macro.paramCount-1)
+            args.append(MacroTokenList());
+        found = (args.length() == macro.paramCount);
+    }
+    if (!found) {
+        // not a call, drop the lines fetched
+        stack.remove(0, fetchedTokens);
+        if (context)
+            context->linesUsed = oldLinesUsed;
+        args.clear();
+        return false;
+    }
+    stack.resize(stack.length()-pos);
+    return true;
+}
+
+MacroTokenList MacroExpander::substitute(const CompiledMacro &macro, const QVector<MacroTokenList> &args, const MacroHideSet &hideSet, int depth)
+{
+    MacroTokenList result;
+    QVector<MacroTokenList> expandedArgs(args.length());
+    QVector<bool> argExpanded(args.length(), false);
+    const QVector<MacroBodyItem>& items = macro.items;
+    for (int i=0;i<items.length();i++) {
+        const MacroBodyItem& item = items[i];
+        switch (item.kind) {
+        case MacroBodyItem::Kind::Token:
+            result.append(item.token);
+            break;
+        case MacroBodyItem::Kind::Stringify:
+            result.append(stringify(args[item.param]));
+            break;
+        case MacroBodyItem::Kind::Param:
+            if (i+1<items.length() && items[i+1].kind == MacroBodyItem::Kind::Paste) {
+                // operands of ## are not expanded
+                if (args[item.param].isEmpty())
+                    result.append(MacroToken{QString(), MacroTokenType::Placemarker, MacroHideSet()});
+                else
+                    result.append(args[item.param]);
+            } else {
+                if (!argExpanded[item.param]) {
+                    expandedArgs[item.param] = expandTokens(args[item.param], depth+1);
+                    argExpanded[item.param] = true;
+                }
+                result.append(expandedArgs[item.param]);
+            }
+            break;
+        case MacroBodyItem::Kind::Paste: {
+            if (i+1>=items.length())
+                break;
+            i++;
+            const MacroBodyItem& next = items[i];
+            MacroTokenList right;
+            switch (next.kind) {
+            case MacroBodyItem::Kind::Param:
+                right = args[next.param];
+                // gcc extension: the comma in ", ## __VA_ARGS__" is removed if __VA_ARGS__ is empty
+                if (macro.variadic && next.param == macro.paramCount-1
+                        && !result.isEmpty()
+                        && result.back().type == MacroTokenType::Symbol
+                        && result.back().text == ",") {
+                    if (right.isEmpty())
+                        result.removeLast();
+                    else
+                        result.append(right);
+                    continue;
+                }
+                break;
+            case MacroBodyItem::Kind::Stringify:
+                right.append(stringify(args[next.param]));
+                break;
+            default:
+                right.append(next.token);
+            }
+            paste(result, right);
+        }
+            break;
+        }
+    }
+
+    MacroTokenList output;
+    output.reserve(result.length());
+    // tokens sharing a hide set usually get the same new one
+    QHash<const QSet<QString>*, MacroHideSet> unitedSets;
+    foreach (MacroToken token, result) {
+        if (token.type == MacroTokenType::Placemarker)
+            continue;
+        if (!token.hideSet) {
+            token.hideSet = hideSet;
+        } else if (token.hideSet != hideSet) {
+            MacroHideSet& united = unitedSets[token.hideSet.get()];
+            if (!united)
+                united = unite(token.hideSet, hideSet);
+            token.hideSet = united;
+        }
+        output.append(token);
+    }
+    return output;
+}
+
+void MacroExpander::paste(MacroTokenList &output, const MacroTokenList &right)
+{
+    if (right.isEmpty())
+        return;
+    if (output.isEmpty()) {
+        output.append(right);
+        return;
+    }
+    MacroToken left = output.takeLast();
+    if (left.type == MacroTokenType::Placemarker) {
+        output.append(right);
+        return;
+    }
+    MacroTokenList pasted = tokenize(left.text + right.front().text);
+    if (pasted.length() == 1) {
+        output.append(pasted.front());
+    } else {
+        // not a valid token, keep them as they are
+        output.append(left);
+        output.append(right.front());
+    }
+    output.append(right.mid(1));
+}
+
+void MacroExpander::resolveDefined(MacroTokenList &tokens)
+{
+    int i = 0;
+    while (i<tokens.length()) {
+        if (tokens[i].type != MacroTokenType::Identifier || tokens[i].text != "defined") {
+            i++;
+            continue;
+        }
+        int j = i+1;
+        while (j<tokens.length() && tokens[j].type == MacroTokenType::Space)
+            j++;
+        bool braced = (j<tokens.length() && tokens[j].type == MacroTokenType::Symbol
+                && tokens[j].text == "(");
+        if (braced) {
+            j++;
+            while (j<tokens.length() && tokens[j].type == MacroTokenType::Space)
+                j++;
+        }
+        if (j>=tokens.length() || tokens[j].type != MacroTokenType::Identifier) {
+            // broken expression
+            i++;
+            continue;
+        }
+        QString name = tokens[j].text;
+        if (braced) {
+            j++;
+            while (j<tokens.length() && tokens[j].type == MacroTokenType::Space)
+                j++;
+            if (j>=tokens.length() || tokens[j].type != MacroTokenType::Symbol
+                    || tokens[j].text != ")") {
+                i++;
+                continue;
+            }
+        }
+        tokens.remove(i+1, j-i);
+        tokens[i].text = mGetDefine(name) ? "1" : "0";
+        tokens[i].type = MacroTokenType::Number;
+        i++;
+    }
+}
+
+bool MacroExpander::isIdentChar(const QChar &ch)
+{
+    return ch == '_'
+            || ch.isLetter()
+            || (ch >= '0' && ch <= '9');
+}
+
+MacroToken MacroExpander::stringify(const MacroTokenList &tokens)
+{
+    QString s = "\"";
+    bool space = false;
+    foreach (const MacroToken& token, tokens) {
+        if (token.type == MacroTokenType::Space) {
+            space = true;
+            continue;
+        }
+        if (space && s.length()>1)
+            s += ' ';
+        space = false;
+        if (token.type == MacroTokenType::Literal) {
+            foreach (const QChar& ch, token.text) {
+                if (ch == '"' || ch == '\\')
+                    s += '\\';
+                s += ch;
+            }
+        } else {
+            s += token.text;
+        }
+    }
+    s += '"';
+    return MacroToken{s, MacroTokenType::Literal, MacroHideSet()};
+}
+
+MacroTokenList MacroExpander::trimSpaces(const MacroTokenList &tokens)
+{
+    int start = 0;
+    int end = tokens.length();
+    while (start<end && tokens[start].type == MacroTokenType::Space)
+        start++;
+    while (end>start && tokens[end-1].type == MacroTokenType::Space)
+        end--;
+    if (start == 0 && end == tokens.length())
+        return tokens;
+    return tokens.mid(start, end-start);
+}
+
+MacroHideSet MacroExpander::unite(const MacroHideSet &hideSet, const QString &name)
+{
+    if (hideSet && hideSet->contains(name))
+        return hideSet;
+    std::shared_ptr<QSet<QString>> result = hideSet ?
+                std::make_shared<QSet<QString>>(*hideSet)
+              : std::make_shared<QSet<QString>>();
+    result->insert(name);
+    return result;
+}
+
+MacroHideSet MacroExpander::unite(const MacroHideSet &hideSet1, const MacroHideSet &hideSet2)
+{
+    if (!hideSet1 || hideSet1 == hideSet2)
+        return hideSet2;
+    if (!hideSet2)
+        return hideSet1;
+    if (hideSet1->contains(*hideSet2))
+        return hideSet1;
+    if (hideSet2->contains(*hideSet1))
+        return hideSet2;
+    std::shared_ptr<QSet<QString>> result = std::make_shared<QSet<QString>>(*hideSet1);
+    result->unite(*hideSet2);
+    return result;
+}
+
+MacroHideSet MacroExpander::intersect(const MacroHideSet &hideSet1, const MacroHideSet &hideSet2)
+{
+    if (!hideSet1 || !hideSet2)
+        return MacroHideSet();
+    if (hideSet1 == hideSet2)
+        return hideSet1;
+    std::shared_ptr<QSet<QString>> result = std::make_shared<QSet<QString>>(*hideSet1);
+    result->intersect(*hideSet2);
+    if (result->isEmpty())
+        return MacroHideSet();
+    return result;
+}
+
+PMacroExpression MacroExpander::compileExpression(const MacroTokenList &tokens)
+{
+    std::shared_ptr<MacroExpression> expression = std::make_shared<MacroExpression>();
+    ExpressionCompiler compiler(tokens);
+    if (!compiler.compile(*expression))
+        return PMacroExpression();
+    return expression;
+}
+
+bool MacroExpander::evalExpression(const MacroExpression &expression, qint64 &result)
+{
+    QVector<qint64> stack;
+    foreach (const MacroExpression::Op& op, expression.ops) {
+        switch (op.type) {
+        case MacroExpression::OpType::Value:
+            stack.append(op.value);
+            break;
+        case MacroExpression::OpType::Unary: {
+            if (stack.isEmpty())
+                return false;
+            qint64 value = stack.takeLast();
+            if (op.op == "-")
+                value = -value;
+            else if (op.op == "!")
+                value = !value;
+            else if (op.op == "~")
+                value = ~value;
+            stack.append(value);
+        }
+            break;
+        case MacroExpression::OpType::Binary: {
+            if (stack.length()<2)
+                return false;
+            qint64 right = stack.takeLast();
+            qint64 left = stack.takeLast();
+            qint64 value = 0;
+            const QString& s = op.op;
+            if (s == "*")
+                value = left * right;
+            else if (s == "/")
+                value = (right != 0) ? left / right : 0;
+            else if (s == "%")
+                value = (right != 0) ? left % right : 0;
+            else if (s == "+")
+                value = left + right;
+            else if (s == "-")
+                value = left - right;
+            else if (s == "<<")
+                value = (right >= 0 && right < 64) ? left << right : 0;
+            else if (s == ">>")
+                value = (right >= 0 && right < 64) ? left >> right : 0;
+            else if (s == "<")
+                value = left < right;
+            else if (s == ">")
+                value = left > right;
+            else if (s == "<=")
+                value = left <= right;
+            else if (s == ">=")
+                value = left >= right;
+            else if (s == "==")
+                value = left == right;
+            else if (s == "!=")
+                value = left != right;
+            else if (s == "&")
+                value = left & right;
+            else if (s == "^")
+                value = left ^ right;
+            else if (s == "|")
+                value = left | right;
+            else if (s == "&&")
+                value = left && right;
+            else if (s == "||")
+                value = left || right;
+            stack.append(value);
+        }
+            break;
+        case MacroExpression::OpType::Conditional: {
+            if (stack.length()<3)
+                return false;
+            qint64 falseValue = stack.takeLast();
+            qint64 trueValue = stack.takeLast();
+            qint64 condition = stack.takeLast();
+            stack.append(condition ? trueValue : falseValue);
+        }
+            break;
+        }
+    }
+    if (stack.length() != 1)
+        return false;
+    result = stack.front();
+    return true;
+}
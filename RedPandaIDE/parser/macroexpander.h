@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MACROEXPANDER_H
+#define MACROEXPANDER_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include "parserutils.h"
+
+#define MAX_DEFINE_EXPAND_DEPTH 20
+
+enum class MacroTokenType {
+    Identifier,
+    Number, // preprocessing number, like 10, 0x1FUL or 1.5e+3
+    Literal, // string or character literal
+    Symbol,
+    Space,
+    Placemarker // empty argument of ##, only used while substituting
+};
+
+// names of the macros that must not be expanded again in a token
+using MacroHideSet = std::shared_ptr<const QSet<QString>>;
+
+struct MacroToken {
+    QString text;
+    MacroTokenType type;
+    MacroHideSet hideSet;
+};
+
+using MacroTokenList = QVector<MacroToken>;
+
+struct MacroBodyItem {
+    enum class Kind {
+        Token,
+        Param, // replaced by the (expanded) argument
+        Stringify, // # param
+        Paste // ##
+    };
+    Kind kind;
+    MacroToken token;
+    int param;
+};
+
+/**
+ * @brief Pre-tokenized value of a define, built once when the define is added.
+ */
+struct CompiledMacro {
+    bool functionLike;
+    bool variadic; // the last param is "..." or "name..."
+    int paramCount;
+    QVector<MacroBodyItem> items;
+};
+
+/**
+ * @brief Compiled #if expression, in reverse polish notation
+ */
+struct MacroExpression {
+    enum class OpType {
+        Value,
+        Unary,
+        Binary,
+        Conditional // ?:
+    };
+    struct Op {
+        OpType type;
+        QString op;
+        qint64 value;
+    };
+    QVector<Op> ops;
+};
+using PMacroExpression = std::shared_ptr<const MacroExpression>;
+
+struct MacroExpansionStatistics {
+    int lines; // source lines expanded
+    int replacements; // macro invocations replaced
+    int expressions; // #if expressions evaluated
+    int compiledExpressionHits; // #if expressions reusing a compiled one
+};
+
+/**
+ * @brief Token based macro expander.
+ *
+ * Follows the hide set algorithm (Dave Prosser's) used by the C standard:
+ * each token carries the set of macro names it has been produced from, and
+ * a name in its own hide set is never expanded again. That replaces the
+ * textual rescans limited by MAX_DEFINE_EXPAND_DEPTH.
+ */
+class MacroExpander
+{
+public:
+    using DefineGetter = std::function<PDefine (const QString& name)>;
+    /**
+     * get the text of the line after the current one by offset (1 for the next line)
+     * @return false if there's no more lines to be used in the expansion
+     */
+    using LineGetter = std::function<bool (int offset, QString& line)>;
+
+    explicit MacroExpander(const DefineGetter& getDefine);
+
+    /**
+     * @brief expand macros in a source line
+     * @param nextLine used to collect arguments of a macro call spanning multiple lines
+     * @param linesUsed count of the following lines consumed by the expansion
+     */
+    QString expandLine(const QString& line, const LineGetter& nextLine, int& linesUsed);
+    QString expandLine(const QString& line);
+    /**
+     * @brief evaluate the expression of #if / #elif
+     * @return -1 if the expression is invalid
+     */
+    qint64 evaluateIf(const QString& expression);
+
+    void clearCompiledExpressions();
+    void copyCompiledExpressionsFrom(const MacroExpander& other);
+    const MacroExpansionStatistics& statistics() const;
+    void resetStatistics();
+
+    static std::shared_ptr<const CompiledMacro> compile(const Define& define);
+    static MacroTokenList tokenize(const QString& text);
+    static QString toString(const MacroTokenList& tokens);
+private:
+    struct LineContext {
+        const LineGetter* nextLine;
+        int linesUsed;
+    };
+
+    void expand(MacroTokenList& stack, MacroTokenList& output, LineContext* context, int depth);
+    MacroTokenList expandTokens(const MacroTokenList& tokens, int depth);
+    bool fetchLine(MacroTokenList& stack, LineContext* context, int& fetchedTokens);
+    bool collectArgs(MacroTokenList& stack, LineContext* context, const CompiledMacro& macro,
+                     QVector<MacroTokenList>& args, MacroHideSet& rightParenHideSet);
+    MacroTokenList substitute(const CompiledMacro& macro, const QVector<MacroTokenList>& args,
+                              const MacroHideSet& hideSet, int depth);
+    static void paste(MacroTokenList& output, const MacroTokenList& right);
+    void resolveDefined(MacroTokenList& tokens);
+
+    static bool isIdentChar(const QChar& ch);
+    static MacroToken stringify(const MacroTokenList& tokens);
+    static MacroTokenList trimSpaces(const MacroTokenList& tokens);
+    static MacroHideSet unite(const MacroHideSet& hideSet, const QString& name);
+    static MacroHideSet unite(const MacroHideSet& hideSet1, const MacroHideSet& hideSet2);
+    static MacroHideSet intersect(const MacroHideSet& hideSet1, const MacroHideSet& hideSet2);
+    static PMacroExpression compileExpression(const MacroTokenList& tokens);
+    static bool evalExpression(const MacroExpression& expression, qint64& result);
+private:
+    DefineGetter mGetDefine;
+    QHash<QString, PMacroExpression> mCompiledExpressions; // expanded #if expression -> compiled
+    MacroExpansionStatistics mStatistics;
+    int mReplacementBudget;
+};
+
+#endif // MACROEXPANDER_H
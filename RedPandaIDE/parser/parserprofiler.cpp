@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "parserprofiler.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+qint64 FileParseProfile::totalTime() const
+{
+    qint64 total = 0;
+    for (int i=0;i<PARSE_PHASE_COUNT;i++)
+        total += phaseTimes[i];
+    return total;
+}
+
+ParserProfiler::ParserProfiler():
+    mStartTime{0},
+    mWallTime{0},
+    mLockWaitCount{0},
+    mLockWaitTime{0},
+    mSnapshotTime{0}
+{
+
+}
+
+void ParserProfiler::start()
+{
+    mFiles.clear();
+    mStartTime = QDateTime::currentMSecsSinceEpoch();
+    mWallTime = 0;
+    mLockWaitCount = 0;
+    mLockWaitTime = 0;
+    mSnapshotTime = 0;
+    mTimer.start();
+}
+
+void ParserProfiler::finish()
+{
+    if (mTimer.isValid())
+        mWallTime = mTimer.nsecsElapsed();
+}
+
+void ParserProfiler::clear()
+{
+    mFiles.clear();
+    mStartTime = 0;
+    mWallTime = 0;
+    mLockWaitCount = 0;
+    mLockWaitTime = 0;
+    mSnapshotTime = 0;
+    mTimer.invalidate();
+}
+
+FileParseProfile &ParserProfiler::addFile(const QString &fileName)
+{
+    FileParseProfile profile;
+    profile.fileName = fileName;
+    for (int i=0;i<PARSE_PHASE_COUNT;i++)
+        profile.phaseTimes[i] = 0;
+    profile.lineCount = 0;
+    profile.tokenCount = 0;
+    profile.statementCount = 0;
+    profile.preprocessedInWorker = false;
+    mFiles.append(profile);
+    return mFiles.last();
+}
+
+const QVector<FileParseProfile> &ParserProfiler::files() const
+{
+    return mFiles;
+}
+
+qint64 ParserProfiler::phaseTime(ParsePhase phase) const
+{
+    qint64 total = 0;
+    foreach (const FileParseProfile& profile, mFiles) {
+        total += profile.phaseTimes[(int)phase];
+    }
+    return total;
+}
+
+int ParserProfiler::lineCount() const
+{
+    int total = 0;
+    foreach (const FileParseProfile& profile, mFiles) {
+        total += profile.lineCount;
+    }
+    return total;
+}
+
+int ParserProfiler::tokenCount() const
+{
+    int total = 0;
+    foreach (const FileParseProfile& profile, mFiles) {
+        total += profile.tokenCount;
+    }
+    return total;
+}
+
+int ParserProfiler::statementCount() const
+{
+    int total = 0;
+    foreach (const FileParseProfile& profile, mFiles) {
+        total += profile.statementCount;
+    }
+    return total;
+}
+
+qint64 ParserProfiler::wallTime() const
+{
+    return mWallTime;
+}
+
+qint64 ParserProfiler::startTime() const
+{
+    return mStartTime;
+}
+
+bool ParserProfiler::isEmpty() const
+{
+    return mFiles.isEmpty();
+}
+
+void ParserProfiler::setLockWait(qint64 waitCount, qint64 waitTime)
+{
+    mLockWaitCount = waitCount;
+    mLockWaitTime = waitTime;
+}
+
+qint64 ParserProfiler::lockWaitCount() const
+{
+    return mLockWaitCount;
+}
+
+qint64 ParserProfiler::lockWaitTime() const
+{
+    return mLockWaitTime;
+}
+
+void ParserProfiler::setSnapshotTime(qint64 snapshotTime)
+{
+    mSnapshotTime = snapshotTime;
+}
+
+qint64 ParserProfiler::snapshotTime() const
+{
+    return mSnapshotTime;
+}
+
+QJsonObject ParserProfiler::toJson() const
+{
+    QJsonObject root;
+    root["startTime"] = QDateTime::fromMSecsSinceEpoch(mStartTime).toString(Qt::ISODate);
+    root["timeUnit"] = "ns";
+    root["wallTime"] = mWallTime;
+    root["lockWaitCount"] = mLockWaitCount;
+    root["lockWaitTime"] = mLockWaitTime;
+    root["snapshotTime"] = mSnapshotTime;
+    QJsonObject total;
+    for (int i=0;i<PARSE_PHASE_COUNT;i++)
+        total[phaseName((ParsePhase)i)] = phaseTime((ParsePhase)i);
+    total["lines"] = lineCount();
+    total["tokens"] = tokenCount();
+    total["statements"] = statementCount();
+    root["total"] = total;
+    QJsonArray files;
+    foreach (const FileParseProfile& profile, mFiles) {
+        QJsonObject file;
+        file["fileName"] = profile.fileName;
+        for (int i=0;i<PARSE_PHASE_COUNT;i++)
+            file[phaseName((ParsePhase)i)] = profile.phaseTimes[i];
+        file["lines"] = profile.lineCount;
+        file["tokens"] = profile.tokenCount;
+        file["statements"] = profile.statementCount;
+        file["worker"] = profile.preprocessedInWorker;
+        files.append(file);
+    }
+    root["files"] = files;
+    return root;
+}
+
+bool ParserProfiler::saveAsJson(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QJsonDocument doc(toJson());
+    return file.write(doc.toJson()) >= 0;
+}
+
+QString ParserProfiler::phaseName(ParsePhase phase)
+{
+    switch(phase) {
+    case ParsePhase::Preprocess:
+        return "preprocess";
+    case ParsePhase::Tokenize:
+        return "tokenize";
+    case ParsePhase::Parse:
+        return "parse";
+    }
+    return "";
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PARSERPROFILER_H
+#define PARSERPROFILER_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+enum class ParsePhase {
+    Preprocess,
+    Tokenize,
+    Parse
+};
+
+#define PARSE_PHASE_COUNT 3
+
+struct FileParseProfile {
+    QString fileName;
+    qint64 phaseTimes[PARSE_PHASE_COUNT]; // nanoseconds
+    int lineCount; // lines after preprocessing, including the included headers
+    int tokenCount;
+    int statementCount; // statements added by the file and the headers it includes
+    bool preprocessedInWorker; // preprocessed and tokenized by a worker thread
+    qint64 totalTime() const;
+};
+
+/**
+ * @brief Times and sizes of each phase of the files parsed in a parse run
+ */
+class ParserProfiler
+{
+public:
+    ParserProfiler();
+    void start();
+    void finish();
+    void clear();
+    FileParseProfile& addFile(const QString& fileName);
+
+    const QVector<FileParseProfile>& files() const;
+    qint64 phaseTime(ParsePhase phase) const;
+    int lineCount() const;
+    int tokenCount() const;
+    int statementCount() const;
+    qint64 wallTime() const;
+    qint64 startTime() const;
+    bool isEmpty() const;
+    /**
+     * @brief record the times other threads waited for the parser's lock
+     *   during the run
+     */
+    void setLockWait(qint64 waitCount, qint64 waitTime);
+    qint64 lockWaitCount() const;
+    qint64 lockWaitTime() const;
+    void setSnapshotTime(qint64 snapshotTime);
+    qint64 snapshotTime() const;
+
+    QJsonObject toJson() const;
+    bool saveAsJson(const QString& fileName) const;
+    static QString phaseName(ParsePhase phase);
+private:
+    QVector<FileParseProfile> mFiles;
+    qint64 mStartTime; // msecs since epoch
+    qint64 mWallTime; // nanoseconds, 0 if the run is not finished
+    qint64 mLockWaitCount;
+    qint64 mLockWaitTime; // nanoseconds
+    qint64 mSnapshotTime; // nanoseconds used to copy the results for readers
+    QElapsedTimer mTimer;
+};
+
+#endif // PARSERPROFILER_H
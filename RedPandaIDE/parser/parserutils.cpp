@@ -777,3 +777,75 @@ bool FileIncludes::isLineVisible(int line)
     }
     return lastI<0?true:branches[lastI];
 }
+
+Q_GLOBAL_STATIC(QSet<QString>,EmptyStringSet)
+
+const QSet<QString> &Statement::friends() const
+{
+    if (scopeInfo)
+        return scopeInfo->friends;
+    return *EmptyStringSet;
+}
+
+void Statement::addFriend(const QString &name)
+{
+    if (!scopeInfo)
+        scopeInfo = std::unique_ptr<StatementScopeInfo>(new StatementScopeInfo);
+    scopeInfo->friends.insert(name);
+}
+
+const QSet<QString> &Statement::usingList() const
+{
+    if (scopeInfo)
+        return scopeInfo->usingList;
+    return *EmptyStringSet;
+}
+
+void Statement::addUsing(const QString &fullName)
+{
+    if (!scopeInfo)
+        scopeInfo = std::unique_ptr<StatementScopeInfo>(new StatementScopeInfo);
+    scopeInfo->usingList.insert(fullName);
+}
+
+QString StringPool::intern(const QString &s)
+{
+    if (s.isEmpty())
+        return s;
+    QSet<QString>::const_iterator it = mStrings.constFind(s);
+    if (it != mStrings.constEnd())
+        return *it;
+    mStrings.insert(s);
+    return s;
+}
+
+void StringPool::clear()
+{
+    mStrings.clear();
+    mSqueezedCount = 0;
+}
+
+int StringPool::count() const
+{
+    return mStrings.count();
+}
+
+void StringPool::swap(StringPool &other)
+{
+    mStrings.swap(other.mStrings);
+    std::swap(mSqueezedCount, other.mSqueezedCount);
+}
+
+void StringPool::squeeze()
+{
+    if (mStrings.count() < 2*mSqueezedCount || mStrings.count() < 1024)
+        return;
+    for (auto it=mStrings.begin();it!=mStrings.end();) {
+        // the pool holds the only reference
+        if (it->isDetached())
+            it = mStrings.erase(it);
+        else
+            ++it;
+    }
+    mSqueezedCount = mStrings.count();
+}
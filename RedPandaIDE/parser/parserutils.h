@@ -42,6 +42,8 @@ struct CodeSnippet {
 
 using PCodeSnippet = std::shared_ptr<CodeSnippet>;
 
+struct CompiledMacro;
+
 // preprocess/ macro define
 struct Define {
     QString name;
@@ -52,6 +54,7 @@ struct Define {
     QStringList argList; // args list to format values
     QList<bool> argUsed;
     QString formatValue; // format template to format values
+    std::shared_ptr<const CompiledMacro> compiled; // tokenized value used by MacroExpander
 };
 
 using PDefine = std::shared_ptr<Define>;
@@ -140,11 +143,6 @@ enum class EvalStatementKind {
     Function
 };
 
-struct StatementMatchPosition{
-    int start;
-    int end;
-};
-
 enum StatementProperty {
     spNone =                0x0,
     spStatic =              0x0001,
@@ -166,13 +164,25 @@ Q_DECLARE_OPERATORS_FOR_FLAGS(StatementProperties)
 
 
 
-using PStatementMathPosition = std::shared_ptr<StatementMatchPosition>;
-
 struct Statement;
 using PStatement = std::shared_ptr<Statement>;
 using StatementList = QList<PStatement>;
 using PStatementList = std::shared_ptr<StatementList>;
 using StatementMap = QMultiMap<QString, PStatement>;
+
+struct StatementNameIndex;
+using PStatementNameIndex = std::shared_ptr<StatementNameIndex>;
+
+/**
+ * @brief Fields only set on a few scope statements (classes/namespaces/blocks),
+ * kept out of Statement to save memory.
+ */
+struct StatementScopeInfo {
+    QSet<QString> friends; // friend class / functions
+    QSet<QString> usingList; // using namespaces
+    PStatementNameIndex nameIndex; // index of the children, maintained by StatementModel
+};
+
 struct Statement {
 //    Statement();
 //    ~Statement();
@@ -181,27 +191,24 @@ struct Statement {
     QString command; // identifier/name of statement "foo"
     QString args; // args "(int a,float b)"
     QString value; // Used for macro defines/typedef, "100" in "#defin COUNT 100"
-    StatementKind kind; // kind of statement class/variable/function/etc
-    StatementScope scope; // global/local/classlocal
-    StatementAccessibility accessibility; // protected/private/public
-    int line; // declaration
-    int definitionLine; // definition
     QString fileName; // declaration
     QString definitionFileName; // definition
-    StatementMap children; // functions can be overloaded,so we use list to save children with the same name
-    QSet<QString> friends; // friend class / functions
     QString fullName; // fullname(including class and namespace), ClassA::foo
-    QSet<QString> usingList; // using namespaces
     QString noNameArgs;// Args without name
+    StatementMap children; // functions can be overloaded,so we use list to save children with the same name
+    std::unique_ptr<StatementScopeInfo> scopeInfo; // friends / usings, created on demand
+    StatementKind kind; // kind of statement class/variable/function/etc
+    StatementScope scope; // global/local/classlocal
+    StatementAccessibility accessibility; // protected/private/public
     StatementProperties properties;
+    int line; // declaration
+    int definitionLine; // definition
+    int usageCount; //Usage Count, used by code completion
 
-    // fields for code completion
-    int usageCount; //Usage Count
-    int matchPosTotal; // total of matched positions
-    int matchPosSpan; // distance between the first match pos and the last match pos;
-    int firstMatchLength; // length of first match;
-    int caseMatched; // if match with case
-    QList<PStatementMathPosition> matchPositions;
+    const QSet<QString>& friends() const;
+    void addFriend(const QString& name);
+    const QSet<QString>& usingList() const;
+    void addUsing(const QString& fullName);
 
     // definiton line/filename is valid
     bool hasDefinition() {
@@ -236,6 +243,30 @@ struct Statement {
 
 };
 
+/**
+ * @brief Interned string table.
+ *
+ * Equal strings returned by intern() share the same QString data, so that
+ * the file names, types and full names held by many statements are stored once.
+ */
+class StringPool {
+public:
+    QString intern(const QString& s);
+    void clear();
+    int count() const;
+    void swap(StringPool& other);
+    /**
+     * @brief Drops the strings no longer used outside the pool.
+     *
+     * It only scans the table once it has doubled since the last squeeze,
+     * so calling it after every parse is cheap.
+     */
+    void squeeze();
+private:
+    QSet<QString> mStrings;
+    int mSqueezedCount = 0;
+};
+
 struct EvalStatement;
 using PEvalStatement = std::shared_ptr<EvalStatement>;
 /**
@@ -288,6 +319,9 @@ public:
     PStatement lastScope();
     void removeLastScope();
     void clear();
+    const QVector<PCppScope>& scopes() const {
+        return mScopes;
+    }
 private:
     QVector<PCppScope> mScopes;
 };
@@ -19,6 +19,9 @@
 #include <QFile>
 #include <QTextStream>
 
+// scopes with fewer children are searched without an index
+#define MIN_INDEXED_CHILDREN 64
+
 StatementModel::StatementModel(QObject *parent) : QObject(parent)
 {
     mCount = 0;
@@ -32,9 +35,12 @@ void StatementModel::add(const PStatement& statement)
     PStatement parent = statement->parentScope.lock();
     if (parent) {
         addMember(parent->children,statement);
+        addToIndex(parent,parent->children,statement);
     } else {
         addMember(mGlobalStatements,statement);
+        addToIndex(parent,mGlobalStatements,statement);
     }
+    markChanged(statement);
     mCount++;
 #ifdef QT_DEBUG
     mAllStatements.append(statement);
@@ -47,6 +53,7 @@ void StatementModel::deleteStatement(const PStatement& statement)
     if (!statement) {
         return ;
     }
+    markChanged(statement);
     PStatement parent = statement->parentScope.lock();
     int count = 0;
     if (parent) {
@@ -54,6 +61,8 @@ void StatementModel::deleteStatement(const PStatement& statement)
     } else {
         count = deleteMember(mGlobalStatements,statement);
     }
+    if (count>0)
+        removeFromIndex(parent,statement);
     mCount -= count;
 #ifdef QT_DEBUG
     mAllStatements.removeOne(statement);
@@ -76,14 +85,253 @@ const StatementMap &StatementModel::childrenStatements(std::weak_ptr<Statement>
     return childrenStatements(s);
 }
 
+StatementList StatementModel::matchChildren(const PStatement &scope, const QString &phrase, StatementMatchType matchType) const
+{
+    StatementList result;
+    QString foldedPhrase = phrase.toCaseFolded();
+    quint64 phraseMask = nameCharMask(foldedPhrase);
+    const StatementNameIndex* index = nameIndex(scope);
+    if (!index) {
+        // small scope, the mask check would cost as much as the match itself
+        foreach (const PStatement& child, childrenStatements(scope)) {
+            if (nameMatches(child->command, phraseMask, foldedPhrase, phraseMask, matchType))
+                result.append(child);
+        }
+        return result;
+    }
+    if (matchType == StatementMatchType::Prefix || foldedPhrase.isEmpty()) {
+        // names are sorted ignoring case, so all matches are adjacent
+        for (auto it=index->sortedEntries.lowerBound(StatementNameKey{phrase});
+             it!=index->sortedEntries.cend() && it.key().name.startsWith(phrase, Qt::CaseInsensitive);
+             ++it) {
+            result.append(index->entries[it.value()].statement);
+        }
+        return result;
+    }
+    // every match uses all chars of the phrase, scan the names using the rarest one
+    const QVector<int>* candidates = nullptr;
+    for (int i=0;i<STATEMENT_NAME_INDEX_CHAR_BUCKETS;i++) {
+        if ((phraseMask & ((quint64)1 << i))
+                && (!candidates || index->charEntries[i].count() < candidates->count()))
+            candidates = &(index->charEntries[i]);
+    }
+    foreach (int i, *candidates) {
+        const StatementNameIndexEntry& entry = index->entries[i];
+        if (entry.statement
+                && nameMatches(entry.statement->command, entry.charMask, foldedPhrase, phraseMask, matchType))
+            result.append(entry.statement);
+    }
+    return result;
+}
+
 void StatementModel::clear() {
     mCount=0;
     mGlobalStatements.clear();
+    mGlobalIndex = StatementNameIndex();
+    mCloneCache = StatementCloneCache();
 #ifdef QT_DEBUG
     mAllStatements.clear();
 #endif
 }
 
+int StatementModel::count() const
+{
+    return mCount;
+}
+
+void StatementModel::swap(StatementModel &other)
+{
+    std::swap(mCount, other.mCount);
+    mGlobalStatements.swap(other.mGlobalStatements);
+    std::swap(mGlobalIndex, other.mGlobalIndex);
+    std::swap(mCloneCache, other.mCloneCache);
+#ifdef QT_DEBUG
+    mAllStatements.swap(other.mAllStatements);
+#endif
+}
+
+const QHash<const Statement *, PStatement> &StatementModel::cloneTo(StatementModel &target)
+{
+    target.clear();
+    foreach (const Statement* statement, mCloneCache.uncached)
+        mCloneCache.clones.remove(statement);
+    mCloneCache.uncached.clear();
+    target.mGlobalStatements = mGlobalStatements;
+    for (auto it=target.mGlobalStatements.begin(); it!=target.mGlobalStatements.end(); ++it) {
+        const PStatement& statement = it.value();
+        PStatement clone = mCloneCache.clones.value(statement.get());
+        if (!clone) {
+            QVector<const Statement*> cloned;
+            clone = cloneStatement(statement.get(), PStatement(), cloned);
+            // statements of the project files change with nearly every parse
+            if (statement->inSystemHeader())
+                mCloneCache.subtrees.insert(statement.get(), cloned);
+            else
+                mCloneCache.uncached.append(cloned);
+        }
+        it.value() = clone;
+    }
+    cloneIndex(target.mGlobalIndex, mGlobalIndex, mCloneCache.clones);
+    target.mCount = mCount;
+    return mCloneCache.clones;
+}
+
+void StatementModel::markChanged(const PStatement &statement)
+{
+    if (mCloneCache.subtrees.isEmpty() || !statement)
+        return;
+    PStatement top = statement;
+    PStatement parent = top->parentScope.lock();
+    while (parent) {
+        top = parent;
+        parent = top->parentScope.lock();
+    }
+    auto it = mCloneCache.subtrees.find(top.get());
+    if (it == mCloneCache.subtrees.end())
+        return;
+    foreach (const Statement* cloned, it.value()) {
+        PStatement clone = mCloneCache.clones.take(cloned);
+        if (clone) {
+            mCloneCache.changedFiles.insert(clone->fileName);
+            mCloneCache.changedFiles.insert(clone->definitionFileName);
+        }
+    }
+    mCloneCache.subtrees.erase(it);
+}
+
+QSet<QString> StatementModel::takeChangedCloneFiles()
+{
+    QSet<QString> files;
+    files.swap(mCloneCache.changedFiles);
+    return files;
+}
+
+PStatement StatementModel::cloneStatement(const Statement *statement, const PStatement &parent, QVector<const Statement *> &cloned)
+{
+    PStatement clone = std::make_shared<Statement>();
+    clone->parentScope = parent;
+    clone->type = statement->type;
+    clone->command = statement->command;
+    clone->args = statement->args;
+    clone->value = statement->value;
+    clone->fileName = statement->fileName;
+    clone->definitionFileName = statement->definitionFileName;
+    clone->fullName = statement->fullName;
+    clone->noNameArgs = statement->noNameArgs;
+    clone->kind = statement->kind;
+    clone->scope = statement->scope;
+    clone->accessibility = statement->accessibility;
+    clone->properties = statement->properties;
+    clone->line = statement->line;
+    clone->definitionLine = statement->definitionLine;
+    clone->usageCount = statement->usageCount;
+    mCloneCache.clones.insert(statement, clone);
+    cloned.append(statement);
+    clone->children = cloneChildren(statement->children, clone, cloned);
+    if (statement->scopeInfo) {
+        clone->scopeInfo = std::unique_ptr<StatementScopeInfo>(new StatementScopeInfo);
+        clone->scopeInfo->friends = statement->scopeInfo->friends;
+        clone->scopeInfo->usingList = statement->scopeInfo->usingList;
+        if (statement->scopeInfo->nameIndex) {
+            clone->scopeInfo->nameIndex = std::make_shared<StatementNameIndex>();
+            cloneIndex(*(clone->scopeInfo->nameIndex), *(statement->scopeInfo->nameIndex), mCloneCache.clones);
+        }
+    }
+    return clone;
+}
+
+StatementMap StatementModel::cloneChildren(const StatementMap &children, const PStatement &parent, QVector<const Statement *> &cloned)
+{
+    // keep the order of the overloads by replacing the values in place
+    StatementMap result = children;
+    for (auto it=result.begin(); it!=result.end(); ++it) {
+        const Statement* statement = it.value().get();
+        PStatement clone = mCloneCache.clones.value(statement);
+        if (!clone)
+            clone = cloneStatement(statement, parent, cloned);
+        it.value() = clone;
+    }
+    return result;
+}
+
+void StatementModel::cloneIndex(StatementNameIndex &index, const StatementNameIndex &other, const QHash<const Statement *, PStatement> &clones)
+{
+    index = other;
+    for (StatementNameIndexEntry& entry : index.entries) {
+        if (entry.statement)
+            entry.statement = clones.value(entry.statement.get());
+    }
+}
+
+static qint64 estimateStringMemoryUsage(const QString& s, QSet<const void*>& countedStrings)
+{
+    if (s.isEmpty())
+        return 0;
+    const void* data = s.constData();
+    if (countedStrings.contains(data))
+        return 0;
+    countedStrings.insert(data);
+    // string data plus the array header
+    return s.capacity()*sizeof(QChar) + 3 * sizeof(void*);
+}
+
+static qint64 estimateStringSetMemoryUsage(const QSet<QString>& set, QSet<const void*>& countedStrings)
+{
+    qint64 size = 0;
+    foreach (const QString& s, set) {
+        size += sizeof(QString) + 2 * sizeof(void*);
+        size += estimateStringMemoryUsage(s, countedStrings);
+    }
+    return size;
+}
+
+static qint64 estimateIndexMemoryUsage(const StatementNameIndex& index)
+{
+    // the keys share the statements' names, which are counted with the statements
+    qint64 size = sizeof(StatementNameIndex);
+    size += index.entries.capacity() * sizeof(StatementNameIndexEntry);
+    size += index.sortedEntries.count() * (sizeof(StatementNameKey) + sizeof(int) + 3 * sizeof(void*));
+    for (int i=0;i<STATEMENT_NAME_INDEX_CHAR_BUCKETS;i++)
+        size += index.charEntries[i].capacity() * sizeof(int);
+    return size;
+}
+
+qint64 StatementModel::estimateMemoryUsage() const
+{
+    QSet<const void*> countedStrings;
+    return estimateMapMemoryUsage(mGlobalStatements, countedStrings)
+            + estimateIndexMemoryUsage(mGlobalIndex);
+}
+
+qint64 StatementModel::estimateMapMemoryUsage(const StatementMap &map, QSet<const void *> &countedStrings) const
+{
+    qint64 size = 0;
+    for (auto it=map.cbegin(); it!=map.cend(); ++it) {
+        const PStatement& statement = it.value();
+        // map node (key, value, links) + statement and its shared_ptr control block
+        size += sizeof(QString) + sizeof(PStatement) + 3 * sizeof(void*);
+        size += sizeof(Statement) + 2 * sizeof(void*);
+        size += estimateStringMemoryUsage(it.key(), countedStrings);
+        size += estimateStringMemoryUsage(statement->type, countedStrings);
+        size += estimateStringMemoryUsage(statement->command, countedStrings);
+        size += estimateStringMemoryUsage(statement->args, countedStrings);
+        size += estimateStringMemoryUsage(statement->value, countedStrings);
+        size += estimateStringMemoryUsage(statement->fileName, countedStrings);
+        size += estimateStringMemoryUsage(statement->definitionFileName, countedStrings);
+        size += estimateStringMemoryUsage(statement->fullName, countedStrings);
+        size += estimateStringMemoryUsage(statement->noNameArgs, countedStrings);
+        if (statement->scopeInfo) {
+            size += sizeof(StatementScopeInfo);
+            size += estimateStringSetMemoryUsage(statement->scopeInfo->friends, countedStrings);
+            size += estimateStringSetMemoryUsage(statement->scopeInfo->usingList, countedStrings);
+            if (statement->scopeInfo->nameIndex)
+                size += estimateIndexMemoryUsage(*(statement->scopeInfo->nameIndex));
+        }
+        size += estimateMapMemoryUsage(statement->children, countedStrings);
+    }
+    return size;
+}
+
 #ifdef QT_DEBUG
 void StatementModel::dump(const QString &logFile)
 {
@@ -139,6 +387,121 @@ int StatementModel::deleteMember(StatementMap &map, const PStatement& statement)
     return map.remove(statement->command,statement);
 }
 
+void StatementModel::addToIndex(const PStatement &scope, const StatementMap &children, const PStatement &statement)
+{
+    if (!scope) {
+        addIndexEntry(mGlobalIndex, statement);
+        return;
+    }
+    if (scope->scopeInfo && scope->scopeInfo->nameIndex) {
+        addIndexEntry(*(scope->scopeInfo->nameIndex), statement);
+        return;
+    }
+    if (children.count() < MIN_INDEXED_CHILDREN)
+        return;
+    // the scope has grown large, index all of its children
+    if (!scope->scopeInfo)
+        scope->scopeInfo = std::unique_ptr<StatementScopeInfo>(new StatementScopeInfo);
+    scope->scopeInfo->nameIndex = std::make_shared<StatementNameIndex>();
+    foreach (const PStatement& child, children) {
+        addIndexEntry(*(scope->scopeInfo->nameIndex), child);
+    }
+}
+
+void StatementModel::removeFromIndex(const PStatement &scope, const PStatement &statement)
+{
+    StatementNameIndex* index;
+    if (!scope)
+        index = &mGlobalIndex;
+    else if (scope->scopeInfo && scope->scopeInfo->nameIndex)
+        index = scope->scopeInfo->nameIndex.get();
+    else
+        return;
+    StatementNameKey key{statement->command};
+    auto it = index->sortedEntries.lowerBound(key);
+    while (it!=index->sortedEntries.end() && !(key < it.key())) {
+        StatementNameIndexEntry& entry = index->entries[it.value()];
+        if (entry.statement == statement) {
+            entry.statement.reset();
+            index->removedCount++;
+            it = index->sortedEntries.erase(it);
+        } else
+            ++it;
+    }
+    if (index->removedCount > MIN_INDEXED_CHILDREN
+            && index->removedCount * 2 > index->entries.count())
+        compactIndex(*index);
+}
+
+const StatementNameIndex *StatementModel::nameIndex(const PStatement &scope) const
+{
+    if (!scope)
+        return &mGlobalIndex;
+    if (scope->scopeInfo)
+        return scope->scopeInfo->nameIndex.get();
+    return nullptr;
+}
+
+void StatementModel::addIndexEntry(StatementNameIndex &index, const PStatement &statement)
+{
+    StatementNameIndexEntry entry;
+    entry.charMask = nameCharMask(statement->command.toCaseFolded());
+    entry.statement = statement;
+    int i = index.entries.count();
+    index.entries.append(entry);
+    index.sortedEntries.insert(StatementNameKey{statement->command}, i);
+    addCharEntries(index, entry.charMask, i);
+}
+
+void StatementModel::addCharEntries(StatementNameIndex &index, quint64 charMask, int entry)
+{
+    for (int i=0;i<STATEMENT_NAME_INDEX_CHAR_BUCKETS;i++) {
+        if (charMask & ((quint64)1 << i))
+            index.charEntries[i].append(entry);
+    }
+}
+
+void StatementModel::compactIndex(StatementNameIndex &index)
+{
+    QVector<StatementNameIndexEntry> entries;
+    entries.reserve(index.entries.count() - index.removedCount);
+    for (int i=0;i<STATEMENT_NAME_INDEX_CHAR_BUCKETS;i++)
+        index.charEntries[i].clear();
+    for (auto it=index.sortedEntries.begin(); it!=index.sortedEntries.end(); ++it) {
+        int i = entries.count();
+        entries.append(index.entries[it.value()]);
+        it.value() = i;
+        addCharEntries(index, entries[i].charMask, i);
+    }
+    index.entries.swap(entries);
+    index.removedCount = 0;
+}
+
+quint64 StatementModel::nameCharMask(const QString &foldedName)
+{
+    quint64 mask = 0;
+    foreach (const QChar& ch, foldedName) {
+        mask |= (quint64)1 << (ch.unicode() % STATEMENT_NAME_INDEX_CHAR_BUCKETS);
+    }
+    return mask;
+}
+
+bool StatementModel::nameMatches(const QString &name, quint64 charMask, const QString &foldedPhrase, quint64 phraseMask, StatementMatchType matchType)
+{
+    if (matchType == StatementMatchType::Prefix)
+        return name.startsWith(foldedPhrase, Qt::CaseInsensitive);
+    if ((charMask & phraseMask) != phraseMask)
+        return false;
+    int pos = 0;
+    foreach (const QChar& ch, foldedPhrase) {
+        pos = name.indexOf(ch, pos, Qt::CaseInsensitive);
+        if (pos<0)
+            return false;
+        pos++;
+    }
+    return true;
+}
+
 void StatementModel::dumpStatementMap(StatementMap &map, QTextStream &out, int level)
 {
     QString indent(level,'\t');
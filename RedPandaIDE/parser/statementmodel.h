@@ -17,10 +17,64 @@
 #ifndef STATEMENTMODEL_H
 #define STATEMENTMODEL_H
 
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QSet>
+#include <QVector>
 #include <QTextStream>
 #include "parserutils.h"
 
+enum class StatementMatchType {
+    Prefix, // name starts with the phrase
+    Subsequence // all chars of the phrase appear in the name in order
+};
+
+struct StatementNameIndexEntry {
+    quint64 charMask; // chars used in the name, to quickly reject subsequence matches
+    PStatement statement; // null if the statement is removed
+};
+
+/**
+ * @brief Key ordering names ignoring case. It shares the statement's interned
+ *   name, so the index doesn't keep a case folded copy of each name.
+ */
+struct StatementNameKey {
+    QString name;
+    bool operator<(const StatementNameKey& other) const {
+        return QString::compare(name, other.name, Qt::CaseInsensitive) < 0;
+    }
+};
+
+#define STATEMENT_NAME_INDEX_CHAR_BUCKETS 64
+
+/**
+ * @brief Index of the children of a scope.
+ *   sortedEntries orders the names ignoring case for prefix matches.
+ *   charEntries lists, for each bit of the char mask, the entries whose names
+ *   use it, so a subsequence match only scans the list of its rarest char.
+ *   Removed entries stay in place (with a null statement) until the index is
+ *   compacted.
+ */
+struct StatementNameIndex {
+    QVector<StatementNameIndexEntry> entries;
+    QMultiMap<StatementNameKey, int> sortedEntries;
+    QVector<int> charEntries[STATEMENT_NAME_INDEX_CHAR_BUCKETS];
+    int removedCount = 0;
+};
+
+/**
+ * @brief Clones of the statement subtrees of system header scopes. A model
+ *   keeps them between snapshots, so successive snapshots share the subtrees
+ *   that haven't changed instead of copying them again.
+ */
+struct StatementCloneCache {
+    QHash<const Statement*, PStatement> clones; // every cloned statement
+    QHash<const Statement*, QVector<const Statement*>> subtrees; // cached top level statement -> statements cloned with it
+    QVector<const Statement*> uncached; // statements cloned by the last snapshot, but not kept
+    QSet<QString> changedFiles; // files of the statements in the subtrees dropped since the last snapshot
+};
+
 class StatementModel : public QObject
 {
     Q_OBJECT
@@ -35,18 +89,66 @@ public:
     void deleteStatement(const PStatement& statement);
     const StatementMap& childrenStatements(const PStatement& statement = PStatement()) const;
     const StatementMap& childrenStatements(std::weak_ptr<Statement> statement) const;
+    /**
+     * @brief children of the scope whose names match the phrase, ignoring case.
+     *   Return all children if the phrase is empty.
+     */
+    StatementList matchChildren(const PStatement& scope,
+                                const QString& phrase,
+                                StatementMatchType matchType = StatementMatchType::Subsequence) const;
     void clear();
+    int count() const;
+    void swap(StatementModel& other);
+    /**
+     * @brief replace target's statements with copies of the statements.
+     *   The copies of unchanged system header scopes are reused from the last call.
+     * @return maps each statement to its copy
+     */
+    const QHash<const Statement*, PStatement>& cloneTo(StatementModel& target);
+    /**
+     * @brief the statement (or its children) is changed, its scope must be
+     *   copied again by the next cloneTo()
+     */
+    void markChanged(const PStatement& statement);
+    /**
+     * @brief files whose statements are copied again by the next cloneTo()
+     */
+    QSet<QString> takeChangedCloneFiles();
+    /**
+     * @brief estimated heap memory used by the statements, the strings shared
+     *   by several statements are only counted once.
+     */
+    qint64 estimateMemoryUsage() const;
 #ifdef QT_DEBUG
     void dump(const QString& logFile);
     void dumpAll(const QString& logFile);
 #endif
 private:
     void addMember(StatementMap& map, const PStatement& statement);
+    PStatement cloneStatement(const Statement* statement, const PStatement& parent,
+                              QVector<const Statement*>& cloned);
+    StatementMap cloneChildren(const StatementMap& children, const PStatement& parent,
+                               QVector<const Statement*>& cloned);
+    static void cloneIndex(StatementNameIndex& index, const StatementNameIndex& other,
+                           const QHash<const Statement*, PStatement>& clones);
     int deleteMember(StatementMap& map, const PStatement& statement);
+    void addToIndex(const PStatement& scope, const StatementMap& children, const PStatement& statement);
+    void removeFromIndex(const PStatement& scope, const PStatement& statement);
+    const StatementNameIndex* nameIndex(const PStatement& scope) const;
+    static void addIndexEntry(StatementNameIndex& index, const PStatement& statement);
+    static void addCharEntries(StatementNameIndex& index, quint64 charMask, int entry);
+    static void compactIndex(StatementNameIndex& index);
+    static quint64 nameCharMask(const QString& foldedName);
+    static bool nameMatches(const QString& name, quint64 charMask,
+                            const QString& foldedPhrase, quint64 phraseMask,
+                            StatementMatchType matchType);
     void dumpStatementMap(StatementMap& map, QTextStream& out, int level);
+    qint64 estimateMapMemoryUsage(const StatementMap& map, QSet<const void*>& countedStrings) const;
 private:
     int mCount;
     StatementMap mGlobalStatements;  //may have overloaded functions, so use PStatementList to store
+    StatementNameIndex mGlobalIndex;
+    StatementCloneCache mCloneCache;
 #ifdef QT_DEBUG
     StatementList mAllStatements;
 #endif
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "systemheadercache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "../utils.h"
+#include "macroexpander.h"
+
+#define SYSTEM_HEADER_CACHE_MAGIC 0x52505343 // "RPSC"
+#define SYSTEM_HEADER_CACHE_VERSION 1
+
+QString SystemHeaderCache::calcKey(const QString &compilerFingerprint,
+                                   ParserLanguage language,
+                                   const QList<QString> &includePathList,
+                                   const DefineMap &hardDefines)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QString("%1\n%2\n%3\n")
+                 .arg(SYSTEM_HEADER_CACHE_VERSION)
+                 .arg(compilerFingerprint)
+                 .arg((int)language).toUtf8());
+    foreach (const QString& path, includePathList) {
+        hash.addData(path.toUtf8());
+        hash.addData("\n");
+    }
+    QStringList defines;
+    foreach (const PDefine& define, hardDefines) {
+        defines.append(QString("%1 %2 %3").arg(define->name,define->args,define->value));
+    }
+    defines.sort();
+    foreach (const QString& define, defines) {
+        hash.addData(define.toUtf8());
+        hash.addData("\n");
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+int SystemHeaderCache::load(const QString &cacheFile, const QString &key, const ParserData &data)
+{
+    QFile file(cacheFile);
+    if (!file.open(QFile::ReadOnly))
+        return 0;
+    qint64 fileSize = file.size();
+    uchar* mapped = file.map(0, fileSize);
+    QByteArray buffer;
+    if (mapped)
+        buffer = QByteArray::fromRawData((const char*)mapped, fileSize);
+    else
+        buffer = file.readAll();
+    auto action = finally([&file,mapped]{
+        if (mapped)
+            file.unmap(mapped);
+    });
+
+    QDataStream stream(buffer);
+    stream.setVersion(QDataStream::Qt_5_12);
+    quint32 magic, version;
+    QString fileKey;
+    stream >> magic >> version >> fileKey;
+    if (magic != SYSTEM_HEADER_CACHE_MAGIC
+            || version != SYSTEM_HEADER_CACHE_VERSION
+            || fileKey != key)
+        return 0;
+    qint32 uniqId;
+    stream >> uniqId;
+
+    // headers and their timestamps
+    qint32 headerCount;
+    stream >> headerCount;
+    QStringList headers;
+    QSet<QString> changedHeaders;
+    for (int i=0;i<headerCount;i++) {
+        QString fileName;
+        qint64 mtime, size;
+        stream >> fileName >> mtime >> size;
+        headers.append(fileName);
+        QFileInfo info(fileName);
+        if (!info.exists()
+                || info.lastModified().toMSecsSinceEpoch()!=mtime
+                || info.size()!=size
+                || data.scannedFiles->contains(fileName))
+            changedHeaders.insert(fileName);
+    }
+
+    // include records
+    QVector<PFileIncludes> fileIncludesList;
+    for (int i=0;i<headerCount;i++) {
+        PFileIncludes fileIncludes = std::make_shared<FileIncludes>();
+        stream >> fileIncludes->baseFile
+               >> fileIncludes->includeFiles
+               >> fileIncludes->directIncludes
+               >> fileIncludes->usings
+               >> fileIncludes->branches;
+        fileIncludesList.append(fileIncludes);
+    }
+    if (stream.status()!=QDataStream::Ok)
+        return 0;
+
+    // headers including a changed (or not cached) header must be reparsed too
+    // (includeFiles contains indirect includes, so this is transitive)
+    QSet<QString> headerSet;
+    foreach (const QString& header, headers)
+        headerSet.insert(header);
+    QSet<QString> validHeaders;
+    for (int i=0;i<headerCount;i++) {
+        const QString& header = headers[i];
+        if (changedHeaders.contains(header))
+            continue;
+        bool valid = true;
+        foreach (const QString& includeFile, fileIncludesList[i]->includeFiles.keys()) {
+            if (changedHeaders.contains(includeFile) || !headerSet.contains(includeFile)) {
+                valid = false;
+                break;
+            }
+        }
+        if (valid)
+            validHeaders.insert(header);
+    }
+
+    // defines
+    QVector<PDefineMap> defineMaps;
+    for (int i=0;i<headerCount;i++) {
+        qint32 defineCount;
+        stream >> defineCount;
+        PDefineMap defineMap = std::make_shared<DefineMap>();
+        for (int j=0;j<defineCount;j++) {
+            PDefine define = readDefine(stream);
+            defineMap->insert(define->name,define);
+        }
+        defineMaps.append(defineMap);
+    }
+
+    // statements, parents are always saved before their children
+    qint32 statementCount;
+    stream >> statementCount;
+    QVector<PStatement> statements;
+    statements.reserve(statementCount);
+    for (int i=0;i<statementCount;i++) {
+        int parentId;
+        PStatement statement = readStatement(stream, parentId, *data.stringPool);
+        if (stream.status()!=QDataStream::Ok)
+            return 0;
+        PStatement parent;
+        if (parentId>=0) {
+            parent = statements[parentId];
+            if (!parent) {
+                statements.append(PStatement());
+                continue;
+            }
+        }
+        if (!validHeaders.contains(statement->fileName)) {
+            statements.append(PStatement());
+            continue;
+        }
+        if (statement->hasDefinition()
+                && statement->definitionFileName!=statement->fileName
+                && !validHeaders.contains(statement->definitionFileName)) {
+            statement->setHasDefinition(false);
+            statement->definitionFileName = statement->fileName;
+            statement->definitionLine = statement->line;
+        }
+        statement->parentScope = parent;
+        statements.append(statement);
+    }
+
+    // statements of each file
+    for (int i=0;i<headerCount;i++) {
+        PFileIncludes fileIncludes = fileIncludesList[i];
+        qint32 count;
+        stream >> count;
+        for (int j=0;j<count;j++) {
+            QString fullName;
+            qint32 id;
+            stream >> fullName >> id;
+            if (id>=0 && id<statements.count() && statements[id])
+                fileIncludes->statements.insert(fullName,statements[id]);
+        }
+        stream >> count;
+        for (int j=0;j<count;j++) {
+            QString fullName;
+            qint32 id;
+            stream >> fullName >> id;
+            if (id>=0 && id<statements.count() && statements[id])
+                fileIncludes->declaredStatements.insert(fullName,statements[id]);
+        }
+        stream >> count;
+        for (int j=0;j<count;j++) {
+            qint32 line, id;
+            stream >> line >> id;
+            if (id>=0 && id<statements.count())
+                fileIncludes->scopes.addScope(line, statements[id]);
+            else
+                fileIncludes->scopes.addScope(line, PStatement());
+        }
+    }
+
+    // namespaces
+    qint32 namespaceCount;
+    stream >> namespaceCount;
+    QHash<QString, StatementList> namespaces;
+    for (int i=0;i<namespaceCount;i++) {
+        QString name;
+        qint32 count;
+        stream >> name >> count;
+        for (int j=0;j<count;j++) {
+            qint32 id;
+            stream >> id;
+            if (id<0 || id>=statements.count() || !statements[id])
+                continue;
+            namespaces[name].append(statements[id]);
+        }
+    }
+    if (stream.status()!=QDataStream::Ok)
+        return 0;
+
+    // everything is read, now merge it into the parser
+    foreach (const PStatement& statement, statements) {
+        if (statement)
+            data.statementList->add(statement);
+    }
+    for (auto it=namespaces.cbegin();it!=namespaces.cend();++it) {
+        PStatementList namespaceList = data.namespaces->value(it.key(),PStatementList());
+        if (!namespaceList) {
+            namespaceList=std::make_shared<StatementList>();
+            data.namespaces->insert(it.key(),namespaceList);
+        }
+        namespaceList->append(it.value());
+    }
+    for (int i=0;i<headerCount;i++) {
+        const QString& header = headers[i];
+        if (!validHeaders.contains(header))
+            continue;
+        data.includesList->insert(header,fileIncludesList[i]);
+        data.includeGraph->setIncludes(header,fileIncludesList[i]->directIncludes);
+        if (!defineMaps[i]->isEmpty())
+            data.fileDefines->insert(header,defineMaps[i]);
+        data.scannedFiles->insert(header);
+    }
+    *data.uniqId = std::max(*data.uniqId, uniqId);
+    return validHeaders.count();
+}
+
+bool SystemHeaderCache::save(const QString &cacheFile, const QString &key,
+                             const QSet<QString> &headers, const ParserData &data)
+{
+    QSaveFile file(cacheFile);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << (quint32)SYSTEM_HEADER_CACHE_MAGIC
+           << (quint32)SYSTEM_HEADER_CACHE_VERSION
+           << key
+           << (qint32)*data.uniqId;
+
+    QStringList headerList;
+    foreach (const QString& header, headers) {
+        if (data.includesList->contains(header))
+            headerList.append(header);
+    }
+    stream << (qint32)headerList.count();
+    foreach (const QString& header, headerList) {
+        QFileInfo info(header);
+        stream << header
+               << (qint64)info.lastModified().toMSecsSinceEpoch()
+               << (qint64)info.size();
+    }
+    foreach (const QString& header, headerList) {
+        PFileIncludes fileIncludes = data.includesList->value(header);
+        stream << fileIncludes->baseFile
+               << fileIncludes->includeFiles
+               << fileIncludes->directIncludes
+               << fileIncludes->usings
+               << fileIncludes->branches;
+    }
+    foreach (const QString& header, headerList) {
+        PDefineMap defineMap = data.fileDefines->value(header,PDefineMap());
+        if (!defineMap) {
+            stream << (qint32)0;
+            continue;
+        }
+        stream << (qint32)defineMap->count();
+        foreach (const PDefine& define, *defineMap) {
+            writeDefine(stream,define);
+        }
+    }
+
+    // collect statements declared in the headers, parents first
+    QHash<const Statement*,int> statementIds;
+    QList<QPair<PStatement,int>> statements;
+    QList<PStatement> queue;
+    foreach (const PStatement& statement, data.statementList->childrenStatements()) {
+        if (headers.contains(statement->fileName)) {
+            statementIds.insert(statement.get(),statements.count());
+            statements.append(QPair<PStatement,int>(statement,-1));
+            queue.append(statement);
+        }
+    }
+    while (!queue.isEmpty()) {
+        PStatement parent = queue.takeFirst();
+        int parentId = statementIds.value(parent.get());
+        foreach (const PStatement& statement, parent->children) {
+            if (statementIds.contains(statement.get())
+                    || !headers.contains(statement->fileName))
+                continue;
+            statementIds.insert(statement.get(),statements.count());
+            statements.append(QPair<PStatement,int>(statement,parentId));
+            queue.append(statement);
+        }
+    }
+    stream << (qint32)statements.count();
+    for (const QPair<PStatement,int>& pair:statements) {
+        writeStatement(stream,pair.first,pair.second);
+    }
+
+    foreach (const QString& header, headerList) {
+        PFileIncludes fileIncludes = data.includesList->value(header);
+        QList<QPair<QString,int>> fileStatements;
+        for (auto it=fileIncludes->statements.cbegin();it!=fileIncludes->statements.cend();++it) {
+            int id = statementIds.value(it.value().get(),-1);
+            if (id>=0)
+                fileStatements.append(QPair<QString,int>(it.key(),id));
+        }
+        stream << (qint32)fileStatements.count();
+        for (const QPair<QString,int>& pair:fileStatements) {
+            stream << pair.first << (qint32)pair.second;
+        }
+        fileStatements.clear();
+        for (auto it=fileIncludes->declaredStatements.cbegin();it!=fileIncludes->declaredStatements.cend();++it) {
+            int id = statementIds.value(it.value().get(),-1);
+            if (id>=0)
+                fileStatements.append(QPair<QString,int>(it.key(),id));
+        }
+        stream << (qint32)fileStatements.count();
+        for (const QPair<QString,int>& pair:fileStatements) {
+            stream << pair.first << (qint32)pair.second;
+        }
+        const QVector<PCppScope>& scopes = fileIncludes->scopes.scopes();
+        stream << (qint32)scopes.count();
+        foreach (const PCppScope& scope, scopes) {
+            stream << (qint32)scope->startLine
+                   << (qint32)(scope->statement?statementIds.value(scope->statement.get(),-1):-1);
+        }
+    }
+
+    stream << (qint32)data.namespaces->count();
+    for (auto it=data.namespaces->cbegin();it!=data.namespaces->cend();++it) {
+        QList<int> ids;
+        foreach (const PStatement& statement, *(it.value())) {
+            int id = statementIds.value(statement.get(),-1);
+            if (id>=0)
+                ids.append(id);
+        }
+        stream << it.key() << (qint32)ids.count();
+        foreach (int id, ids) {
+            stream << (qint32)id;
+        }
+    }
+    if (stream.status()!=QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+void SystemHeaderCache::writeStatement(QDataStream &stream, const PStatement &statement, int parentId)
+{
+    stream << (qint32)parentId
+           << statement->type
+           << statement->command
+           << statement->args
+           << statement->value
+           << (qint32)statement->kind
+           << (qint32)statement->scope
+           << (qint32)statement->accessibility
+           << (qint32)statement->line
+           << (qint32)statement->definitionLine
+           << statement->fileName
+           << statement->definitionFileName
+           << statement->friends()
+           << statement->fullName
+           << statement->usingList()
+           << statement->noNameArgs
+           << (qint32)statement->properties;
+}
+
+PStatement SystemHeaderCache::readStatement(QDataStream &stream, int &parentId, StringPool& stringPool)
+{
+    PStatement statement = std::make_shared<Statement>();
+    qint32 id, kind, scope, accessibility, line, definitionLine, properties;
+    QSet<QString> friends, usingList;
+    stream >> id
+           >> statement->type
+           >> statement->command
+           >> statement->args
+           >> statement->value
+           >> kind
+           >> scope
+           >> accessibility
+           >> line
+           >> definitionLine
+           >> statement->fileName
+           >> statement->definitionFileName
+           >> friends
+           >> statement->fullName
+           >> usingList
+           >> statement->noNameArgs
+           >> properties;
+    parentId = id;
+    statement->kind = (StatementKind)kind;
+    statement->scope = (StatementScope)scope;
+    statement->accessibility = (StatementAccessibility)accessibility;
+    statement->line = line;
+    statement->definitionLine = definitionLine;
+    statement->properties = StatementProperties(QFlag(properties));
+    statement->usageCount = -1;
+    statement->type = stringPool.intern(statement->type);
+    statement->command = stringPool.intern(statement->command);
+    statement->fileName = stringPool.intern(statement->fileName);
+    statement->definitionFileName = stringPool.intern(statement->definitionFileName);
+    statement->fullName = stringPool.intern(statement->fullName);
+    foreach (const QString& name, friends)
+        statement->addFriend(name);
+    foreach (const QString& name, usingList)
+        statement->addUsing(name);
+    return statement;
+}
+
+void SystemHeaderCache::writeDefine(QDataStream &stream, const PDefine &define)
+{
+    stream << define->name
+           << define->args
+           << define->value
+           << define->filename
+           << define->argList
+           << define->argUsed
+           << define->formatValue;
+}
+
+PDefine SystemHeaderCache::readDefine(QDataStream &stream)
+{
+    PDefine define = std::make_shared<Define>();
+    stream >> define->name
+           >> define->args
+           >> define->value
+           >> define->filename
+           >> define->argList
+           >> define->argUsed
+           >> define->formatValue;
+    define->hardCoded = false;
+    define->compiled = MacroExpander::compile(*define);
+    return define;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SYSTEMHEADERCACHE_H
+#define SYSTEMHEADERCACHE_H
+
+#include <QDataStream>
+#include <QHash>
+#include <QSet>
+#include "statementmodel.h"
+#include "includegraph.h"
+
+/**
+ * @brief On-disk cache of the parse results of system headers.
+ *
+ * The cache file stores the statements, include records and macro defines
+ * contributed by the compiler's system headers. It's keyed by a fingerprint of
+ * the compiler binary, the include path list and the hard defines, so a cache
+ * file is only reused by a parser configured exactly the same way.
+ * Headers whose mtime/size changed since the cache was written (and all headers
+ * including them) are not loaded, and will be reparsed as usual.
+ */
+class SystemHeaderCache
+{
+public:
+    struct ParserData {
+        StatementModel* statementList;
+        QHash<QString,PStatementList>* namespaces;
+        QHash<QString, PFileIncludes>* includesList;
+        IncludeGraph* includeGraph;
+        QHash<QString, PDefineMap>* fileDefines;
+        QSet<QString>* scannedFiles;
+        int* uniqId;
+        StringPool* stringPool;
+    };
+
+    static QString calcKey(const QString& compilerFingerprint,
+                           ParserLanguage language,
+                           const QList<QString>& includePathList,
+                           const DefineMap& hardDefines);
+
+    /**
+     * @brief load cached results of system headers into the parser's data
+     * @return count of the headers loaded
+     */
+    static int load(const QString& cacheFile, const QString& key, const ParserData& data);
+    /**
+     * @brief save results of the parsed system headers
+     * @param headers system headers to be saved
+     * @return true if succeeded
+     */
+    static bool save(const QString& cacheFile, const QString& key,
+                     const QSet<QString>& headers, const ParserData& data);
+private:
+    static void writeStatement(QDataStream& stream, const PStatement& statement, int parentId);
+    static PStatement readStatement(QDataStream& stream, int& parentId, StringPool& stringPool);
+    static void writeDefine(QDataStream& stream, const PDefine& define);
+    static PDefine readDefine(QDataStream& stream);
+};
+
+#endif // SYSTEMHEADERCACHE_H
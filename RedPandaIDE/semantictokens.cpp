@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "semantictokens.h"
+#include "editor.h"
+#include "qsynedit/syntaxer/cpp.h"
+#include <algorithm>
+
+struct ExpressionToken {
+    QString text;
+    int start;
+    bool identifier;
+};
+
+SemanticTokenMap::SemanticTokenMap(int lineCount):
+    mLines(lineCount)
+{
+
+}
+
+bool SemanticTokenMap::find(int line, int ch, const QString &lineText, StatementKind &kind) const
+{
+    int index = line-1;
+    if (index<0 || index>=mLines.count())
+        return false;
+    const SemanticTokenLine& tokenLine = mLines[index];
+    //unchanged lines still share their data with the document
+    if (tokenLine.text.constData()!=lineText.constData()
+            && tokenLine.text!=lineText)
+        return false;
+    const QVector<SemanticToken>& tokens = tokenLine.tokens;
+    auto it = std::lower_bound(tokens.begin(), tokens.end(), ch,
+                               [](const SemanticToken& token, int ch) {
+        return token.start < ch;
+    });
+    if (it == tokens.end() || it->start != ch)
+        return false;
+    kind = it->kind;
+    return true;
+}
+
+void SemanticTokenMap::setLine(int index, const QString &text, const QVector<SemanticToken> &tokens)
+{
+    if (index<0 || index>=mLines.count())
+        return;
+    mLines[index].text = text;
+    mLines[index].tokens = tokens;
+}
+
+void SemanticTokenMap::insertLines(int index, int count)
+{
+    if (index<0 || index>mLines.count() || count<=0)
+        return;
+    mLines.insert(index, count, SemanticTokenLine());
+}
+
+void SemanticTokenMap::deleteLines(int index, int count)
+{
+    if (index<0 || index>=mLines.count() || count<=0)
+        return;
+    mLines.remove(index, std::min(count, mLines.count()-index));
+}
+
+void SemanticTokenMap::clear()
+{
+    mLines.clear();
+}
+
+int SemanticTokenMap::count() const
+{
+    return mLines.count();
+}
+
+SemanticTokenThread::SemanticTokenThread(const PCppParser &parser,
+                                         const QString &filename,
+                                         const QSynedit::PDocumentSnapshot &lines,
+                                         QObject *parent):
+    QThread(parent),
+    mParser(parser),
+    mFilename(filename),
+    mLines(lines)
+{
+
+}
+
+const PSemanticTokenMap &SemanticTokenThread::result() const
+{
+    return mResult;
+}
+
+void SemanticTokenThread::run()
+{
+    PSemanticTokenMap map = std::make_shared<SemanticTokenMap>(mLines->count());
+    QSynedit::CppSyntaxer syntaxer;
+    QVector<ExpressionToken> tokens;
+    syntaxer.resetState();
+    for (int i=0;i<mLines->count();i++) {
+        if (isInterruptionRequested() || mParser->parsing())
+            return;
+        const QString& line = mLines->at(i);
+        int lineStart = tokens.count();
+        syntaxer.setLine(line, i);
+        while (!syntaxer.eol()) {
+            QSynedit::PTokenAttribute attr = syntaxer.getTokenAttribute();
+            if (attr && attr->tokenType() != QSynedit::TokenType::Comment
+                    && attr->tokenType() != QSynedit::TokenType::Space) {
+                tokens.append(ExpressionToken{
+                                  syntaxer.getToken(),
+                                  syntaxer.getTokenPos(),
+                                  attr->tokenType() == QSynedit::TokenType::Identifier});
+            }
+            syntaxer.next();
+        }
+        QVector<SemanticToken> semanticTokens;
+        for (int j=lineStart;j<tokens.count();j++) {
+            if (!tokens[j].identifier)
+                continue;
+            // same as Editor::getExpressionAtPosition()
+            QStringList expression;
+            Editor::LastSymbolType lastSymbolType = Editor::LastSymbolType::None;
+            int symbolMatchingLevel = 0;
+            for (int k=j;k>=0;k--) {
+                if (!Editor::matchExpressionToken(syntaxer, tokens[k].text,
+                                                  lastSymbolType, symbolMatchingLevel,
+                                                  expression))
+                    break;
+            }
+            PStatement statement = mParser->findStatementOf(mFilename, expression, i+1);
+            semanticTokens.append(SemanticToken{
+                                      tokens[j].start+1,
+                                      tokens[j].text.length(),
+                                      getKindOfStatement(statement)});
+        }
+        map->setLine(i, line, semanticTokens);
+    }
+    //the statements found may be from an unfinished parse
+    if (mParser->parsing())
+        return;
+    mResult = map;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SEMANTICTOKENS_H
+#define SEMANTICTOKENS_H
+
+#include <QThread>
+#include <QVector>
+#include "parser/cppparser.h"
+#include "qsynedit/document.h"
+
+struct SemanticToken {
+    int start; // position of the token's first char, starts from 1
+    int length;
+    StatementKind kind;
+};
+
+struct SemanticTokenLine {
+    QString text; // the line the tokens are computed from
+    QVector<SemanticToken> tokens; // ordered by start
+};
+
+/**
+ * @brief Kinds of the identifiers in a file, as resolved by the parser.
+ *
+ * It's computed by SemanticTokenThread after the file is parsed, so the editor
+ * doesn't need to query the parser for each identifier it paints.
+ */
+class SemanticTokenMap
+{
+public:
+    explicit SemanticTokenMap(int lineCount=0);
+    /**
+     * @brief find the kind of the identifier starting at ch in the line (starts from 1)
+     * @return false if the line has been changed since the map is computed
+     */
+    bool find(int line, int ch, const QString& lineText, StatementKind& kind) const;
+    void setLine(int index, const QString& text, const QVector<SemanticToken>& tokens);
+    void insertLines(int index, int count);
+    void deleteLines(int index, int count);
+    void clear();
+    int count() const;
+private:
+    QVector<SemanticTokenLine> mLines;
+};
+
+using PSemanticTokenMap = std::shared_ptr<SemanticTokenMap>;
+
+class SemanticTokenThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit SemanticTokenThread(const PCppParser& parser,
+                                 const QString& filename,
+                                 const QSynedit::PDocumentSnapshot& lines,
+                                 QObject* parent = nullptr);
+    // nullptr if the parser starts parsing or the thread is interrupted before it's done
+    const PSemanticTokenMap& result() const;
+
+    // QThread interface
+protected:
+    void run() override;
+private:
+    PCppParser mParser;
+    QString mFilename;
+    QSynedit::PDocumentSnapshot mLines;
+    PSemanticTokenMap mResult;
+};
+
+#endif // SEMANTICTOKENS_H
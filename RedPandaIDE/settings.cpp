@@ -30,6 +30,10 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QMutex>
+#include <QSaveFile>
 #ifdef Q_OS_LINUX
 #include <sys/sysinfo.h>
 #endif
@@ -2335,6 +2339,59 @@ void Settings::CompilerSet::setSDCCProperties(const QString& binDir, const QStri
 }
 #endif
 
+static QString compilerDefinesCacheFile(const QString& slot)
+{
+    QString hash = QCryptographicHash::hash(slot.toUtf8(),QCryptographicHash::Sha1).toHex();
+    return includeTrailingPathDelimiter(pSettings->dirs().config())
+            + DEV_PARSER_CACHE_DIR + QDir::separator()
+            + "defines-" + hash + ".cache";
+}
+
+// Each slot (a compiler and the arguments it's probed with) only keeps its
+// last probe, which is replaced when the compiler binary changes. Compiler
+// sets sharing a compiler but using other standards or params get own slots.
+static QMutex compilerDefinesMutex;
+static QHash<QString,QPair<QString,QStringList>> compilerDefinesCache;
+
+static QStringList cachedCompilerDefines(const QString& slot, const QString& key)
+{
+    QMutexLocker locker(&compilerDefinesMutex);
+    auto it = compilerDefinesCache.constFind(slot);
+    if (it!=compilerDefinesCache.constEnd() && it.value().first == key)
+        return it.value().second;
+    QFile file(compilerDefinesCacheFile(slot));
+    if (!file.open(QFile::ReadOnly))
+        return QStringList();
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    QString savedKey;
+    QStringList defines;
+    stream >> savedKey >> defines;
+    if (stream.status()!=QDataStream::Ok || savedKey!=key)
+        return QStringList();
+    compilerDefinesCache.insert(slot,qMakePair(key,defines));
+    return defines;
+}
+
+static void cacheCompilerDefines(const QString& slot, const QString& key, const QStringList& defines)
+{
+    // don't remember failed probes
+    if (defines.isEmpty())
+        return;
+    QMutexLocker locker(&compilerDefinesMutex);
+    compilerDefinesCache.insert(slot,qMakePair(key,defines));
+    QString cacheFile = compilerDefinesCacheFile(slot);
+    if (!QDir().mkpath(QFileInfo(cacheFile).absolutePath()))
+        return;
+    QSaveFile file(cacheFile);
+    if (!file.open(QFile::WriteOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << key << defines;
+    file.commit();
+}
+
 QStringList Settings::CompilerSet::defines(bool isCpp) {
     // get default defines
     QStringList arguments;
@@ -2342,9 +2399,11 @@ QStringList Settings::CompilerSet::defines(bool isCpp) {
     arguments.append("-E");
     arguments.append("-x");
     QString key;
+    QString language;
 #ifdef ENABLE_SDCC
     if (mCompilerType==CompilerType::SDCC) {
-        arguments.append("c");
+        language = "c";
+        arguments.append(language);
         arguments.append("-V");
         key=SDCC_CMD_OPT_PROCESSOR;
         //language standard
@@ -2363,12 +2422,13 @@ QStringList Settings::CompilerSet::defines(bool isCpp) {
     } else {
 #endif
         if (isCpp) {
-            arguments.append("c++");
+            language = "c++";
             key=CC_CMD_OPT_STD;
         } else {
-            arguments.append("c");
+            language = "c";
             key=C_CMD_OPT_STD;
         }
+        arguments.append(language);
         //language standard
         PCompilerOption pOption = CompilerInfoManager::getCompilerOption(compilerType(), key);
         if (pOption) {
@@ -2386,10 +2446,23 @@ QStringList Settings::CompilerSet::defines(bool isCpp) {
     arguments.append(NULL_FILE);
 
     QFileInfo ccompiler(mCCompiler);
+    // the output only changes with the compiler binary and the arguments
+    // (language, standard and custom compile params)
+    QString cacheKey = QString("%1 %2 %3\n%4")
+            .arg(ccompiler.absoluteFilePath())
+            .arg(ccompiler.lastModified().toMSecsSinceEpoch())
+            .arg(ccompiler.size())
+            .arg(arguments.join('\n'));
+    QString cacheSlot = QString("%1\n%2\n%3")
+            .arg(ccompiler.absoluteFilePath())
+            .arg(language)
+            .arg(arguments.join('\n'));
+    QStringList result = cachedCompilerDefines(cacheSlot, cacheKey);
+    if (!result.isEmpty())
+        return result;
     QByteArray output = getCompilerOutput(ccompiler.absolutePath(),ccompiler.fileName(),arguments);
     // 'cpp.exe -dM -E -x c++ -std=c++17 NUL'
 //    qDebug()<<"------------------";
-    QStringList result;
 #ifdef ENABLE_SDCC
     if (mCompilerType==CompilerType::SDCC) {
         QList<QByteArray> lines = output.split('\n');
@@ -2426,6 +2499,7 @@ QStringList Settings::CompilerSet::defines(bool isCpp) {
             }
         }
     }
+    cacheCompilerDefines(cacheSlot,cacheKey,result);
     return result;
 }
 
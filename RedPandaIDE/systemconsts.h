@@ -88,6 +88,7 @@
 #define DEV_DEBUGGER_FILE "debugger.json"
 #define DEV_HISTORY_FILE "history.json"
 #define DEV_PROBLEM_SET_FILE "problemset.json"
+#define DEV_PARSER_CACHE_DIR "parsercache"
 
 
 #ifdef Q_OS_WIN
@@ -334,18 +334,28 @@ void resetCppParser(std::shared_ptr<CppParser> parser, int compilerSetIndex)
             parser->addIncludePath(file);
         }
         // Set defines
-        for (QString define:compilerSet->defines(parser->language()==ParserLanguage::CPlusPlus)) {
-            parser->addHardDefineByLine(define);
-        }
+        QStringList defines = compilerSet->defines(isCpp);
 //        // add a Red Pand C++ 's own macro
-//        parser->addHardDefineByLine("#define EGE_FOR_AUTO_CODE_COMPLETETION_ONLY");
+//        defines.append("#define EGE_FOR_AUTO_CODE_COMPLETETION_ONLY");
         // add C/C++ default macro
-        parser->addHardDefineByLine("#define __FILE__  1");
-        parser->addHardDefineByLine("#define __LINE__  1");
-        parser->addHardDefineByLine("#define __DATE__  1");
-        parser->addHardDefineByLine("#define __TIME__  1");
+        defines.append("#define __FILE__  1");
+        defines.append("#define __LINE__  1");
+        defines.append("#define __DATE__  1");
+        defines.append("#define __TIME__  1");
+        parser->addHardDefinesByLines(defines);
     }
     parser->parseHardDefines();
+    if (compilerSet) {
+        // reuse parse results of the system headers from previous sessions
+        QFileInfo compilerInfo(isCpp?compilerSet->cppCompiler():compilerSet->CCompiler());
+        QString compilerFingerprint = QString("%1 %2 %3")
+                .arg(compilerInfo.absoluteFilePath())
+                .arg(compilerInfo.lastModified().toMSecsSinceEpoch())
+                .arg(compilerInfo.size());
+        parser->loadSystemHeaderCache(
+                    includeTrailingPathDelimiter(pSettings->dirs().config())+DEV_PARSER_CACHE_DIR,
+                    compilerFingerprint);
+    }
     pMainWindow->disconnect(parser.get(),
                             &CppParser::onStartParsing,
                             pMainWindow,
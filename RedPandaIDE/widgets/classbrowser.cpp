@@ -245,6 +245,12 @@ void ClassBrowserModel::fillStatements()
             return;
         if (!mParser->enabled())
             return;
+        // while the parser is busy, show the snapshot of its last results
+        PCppParser parser = mParser;
+        mParser = CppParser::readableParser(parser);
+        auto restoreParser = finally([this,parser]{
+            mParser = parser;
+        });
         if (!mParser->freeze())
             return;
         QString mParserSerialId = mParser->serialId();
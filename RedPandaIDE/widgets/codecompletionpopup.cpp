@@ -39,7 +39,7 @@ CodeCompletionPopup::CodeCompletionPopup(QWidget *parent) :
 {
     setWindowFlags(Qt::Popup);
     mListView = new CodeCompletionListView(this);
-    mModel=new CodeCompletionListModel(&mCompletionStatementList);
+    mModel=new CodeCompletionListModel(&mCompletionStatementList, &mMatchInfos);
     mDelegate = new CodeCompletionListItemDelegate(mModel,this);
     QItemSelectionModel *m=mListView->selectionModel();
     mListView->setModel(mModel);
@@ -58,6 +58,8 @@ CodeCompletionPopup::CodeCompletionPopup(QWidget *parent) :
     mShowCodeSnippets = true;
 
     mIgnoreCase = false;
+    mLine = 0;
+    mCompletionType = CodeCompletionType::Normal;
 
     mHideSymbolsStartWithTwoUnderline = false;
     mHideSymbolsStartWithUnderline = false;
@@ -87,35 +89,56 @@ void CodeCompletionPopup::prepareSearch(
     QMutexLocker locker(&mMutex);
     if (!isEnabled())
         return;
+    mPreWord = preWord;
+    mOwnerExpression = ownerExpression;
+    mMemberExpression = memberExpression;
+    mFileName = filename;
+    mLine = line;
+    mCompletionType = type;
+    mCustomKeywords = customKeywords;
+    mMemberPhrase = memberExpression.join("");
+    mMemberOperator = memberOperator;
+    collectStatements(mMemberPhrase);
+}
+
+void CodeCompletionPopup::collectStatements(const QString &phrase)
+{
     //Screen.Cursor := crHourglass;
     QCursor oldCursor = cursor();
     setCursor(Qt::CursorShape::WaitCursor);
 
-    mMemberPhrase = memberExpression.join("");
-    mMemberOperator = memberOperator;
-    switch(type) {
+    // while the parser is busy, collect from the snapshot of its last results
+    PCppParser parser = mParser;
+    mParser = CppParser::readableParser(parser);
+    auto action = finally([this,parser]{
+        mParser = parser;
+    });
+
+    // only statements matching the phrase are collected from the parser
+    mCollectedPhrase = phrase;
+    switch(mCompletionType) {
     case CodeCompletionType::ComplexKeyword:
-        getCompletionListForComplexKeyword(preWord);
+        getCompletionListForComplexKeyword(mPreWord);
         break;
     case CodeCompletionType::Types:
-        mIncludedFiles = mParser->getFileIncludes(filename);
-        getCompletionListForTypes(preWord,filename,line);
+        mIncludedFiles = mParser->getFileIncludes(mFileName);
+        getCompletionListForTypes(mPreWord,mFileName,mLine);
         break;
     case CodeCompletionType::FunctionWithoutDefinition:
-        mIncludedFiles = mParser->getFileIncludes(filename);
-        getCompletionForFunctionWithoutDefinition(preWord, ownerExpression,memberOperator,memberExpression, filename,line);
+        mIncludedFiles = mParser->getFileIncludes(mFileName);
+        getCompletionForFunctionWithoutDefinition(mPreWord, mOwnerExpression,mMemberOperator,mMemberExpression, mFileName,mLine);
         break;
     case CodeCompletionType::Namespaces:
-        mIncludedFiles = mParser->getFileIncludes(filename);
-        getCompletionListForNamespaces(preWord,filename,line);
+        mIncludedFiles = mParser->getFileIncludes(mFileName);
+        getCompletionListForNamespaces(mPreWord,mFileName,mLine);
         break;
     case CodeCompletionType::KeywordsOnly:
         mIncludedFiles.clear();
-        getKeywordCompletionFor(customKeywords);
+        getKeywordCompletionFor(mCustomKeywords);
         break;
     default:
-        mIncludedFiles = mParser->getFileIncludes(filename);
-        getCompletionFor(ownerExpression,memberOperator,memberExpression, filename,line, customKeywords);
+        mIncludedFiles = mParser->getFileIncludes(mFileName);
+        getCompletionFor(mOwnerExpression,mMemberOperator,mMemberExpression, mFileName,mLine, mCustomKeywords);
     }
     setCursor(oldCursor);
 }
@@ -131,6 +154,13 @@ bool CodeCompletionPopup::search(const QString &memberPhrase, bool autoHideOnSin
         return false;
     }
 
+    // chars typed before the popup is shown are deleted, collect again
+    if (mParser && !memberPhrase.startsWith(mCollectedPhrase, Qt::CaseInsensitive)) {
+        mFullCompletionStatementList.clear();
+        mAddedStatements.clear();
+        collectStatements(memberPhrase);
+    }
+
     QCursor oldCursor = cursor();
     setCursor(Qt::CursorShape::WaitCursor);
 
@@ -196,7 +226,7 @@ void CodeCompletionPopup::addChildren(const PStatement& scopeStatement,
     if (scopeStatement && !isIncluded(scopeStatement->fileName)
       && !isIncluded(scopeStatement->definitionFileName))
         return;
-    const StatementMap& children = mParser->statementList().childrenStatements(scopeStatement);
+    const StatementList children = mParser->statementList().matchChildren(scopeStatement, mCollectedPhrase);
     if (children.isEmpty())
         return;
 
@@ -251,7 +281,7 @@ void CodeCompletionPopup::addFunctionWithoutDefinitionChildren(const PStatement&
     if (scopeStatement && !isIncluded(scopeStatement->fileName)
       && !isIncluded(scopeStatement->definitionFileName))
         return;
-    const StatementMap& children = mParser->statementList().childrenStatements(scopeStatement);
+    const StatementList children = mParser->statementList().matchChildren(scopeStatement, mCollectedPhrase);
     if (children.isEmpty())
         return;
 
@@ -303,15 +333,24 @@ static bool nameComparator(PStatement statement1,PStatement statement2) {
     return statement1->command < statement2->command;
 }
 
-static bool defaultComparator(PStatement statement1,PStatement statement2) {
-    if (statement1->matchPosSpan!=statement2->matchPosSpan)
-        return statement1->matchPosSpan < statement2->matchPosSpan;
-    if (statement1->firstMatchLength != statement2->firstMatchLength)
-        return statement1->firstMatchLength > statement2->firstMatchLength;
-    if (statement1->matchPosTotal != statement2->matchPosTotal)
-        return statement1->matchPosTotal < statement2->matchPosTotal;
-    if (statement1->caseMatched != statement2->caseMatched)
-        return statement1->caseMatched > statement2->caseMatched;
+namespace {
+struct StatementMatch {
+    PStatement statement;
+    const StatementMatchInfo* info;
+};
+}
+
+static bool defaultComparator(const StatementMatch& match1, const StatementMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
+    if (match1.info->matchPosSpan!=match2.info->matchPosSpan)
+        return match1.info->matchPosSpan < match2.info->matchPosSpan;
+    if (match1.info->firstMatchLength != match2.info->firstMatchLength)
+        return match1.info->firstMatchLength > match2.info->firstMatchLength;
+    if (match1.info->matchPosTotal != match2.info->matchPosTotal)
+        return match1.info->matchPosTotal < match2.info->matchPosTotal;
+    if (match1.info->caseMatched != match2.info->caseMatched)
+        return match1.info->caseMatched > match2.info->caseMatched;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -331,15 +370,17 @@ static bool defaultComparator(PStatement statement1,PStatement statement2) {
         return nameComparator(statement1,statement2);
 }
 
-static bool sortByScopeComparator(PStatement statement1,PStatement statement2){
-    if (statement1->matchPosSpan!=statement2->matchPosSpan)
-        return statement1->matchPosSpan < statement2->matchPosSpan;
-    if (statement1->firstMatchLength != statement2->firstMatchLength)
-        return statement1->firstMatchLength > statement2->firstMatchLength;
-    if (statement1->matchPosTotal != statement2->matchPosTotal)
-        return statement1->matchPosTotal < statement2->matchPosTotal;
-    if (statement1->caseMatched != statement2->caseMatched)
-        return statement1->caseMatched > statement2->caseMatched;
+static bool sortByScopeComparator(const StatementMatch& match1, const StatementMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
+    if (match1.info->matchPosSpan!=match2.info->matchPosSpan)
+        return match1.info->matchPosSpan < match2.info->matchPosSpan;
+    if (match1.info->firstMatchLength != match2.info->firstMatchLength)
+        return match1.info->firstMatchLength > match2.info->firstMatchLength;
+    if (match1.info->matchPosTotal != match2.info->matchPosTotal)
+        return match1.info->matchPosTotal < match2.info->matchPosTotal;
+    if (match1.info->caseMatched != match2.info->caseMatched)
+        return match1.info->caseMatched > match2.info->caseMatched;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -375,15 +416,17 @@ static bool sortByScopeComparator(PStatement statement1,PStatement statement2){
         return nameComparator(statement1,statement2);
 }
 
-static bool sortWithUsageComparator(PStatement statement1,PStatement statement2) {
-    if (statement1->matchPosSpan!=statement2->matchPosSpan)
-        return statement1->matchPosSpan < statement2->matchPosSpan;
-    if (statement1->firstMatchLength != statement2->firstMatchLength)
-        return statement1->firstMatchLength > statement2->firstMatchLength;
-    if (statement1->matchPosTotal != statement2->matchPosTotal)
-        return statement1->matchPosTotal < statement2->matchPosTotal;
-    if (statement1->caseMatched != statement2->caseMatched)
-        return statement1->caseMatched > statement2->caseMatched;
+static bool sortWithUsageComparator(const StatementMatch& match1, const StatementMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
+    if (match1.info->matchPosSpan!=match2.info->matchPosSpan)
+        return match1.info->matchPosSpan < match2.info->matchPosSpan;
+    if (match1.info->firstMatchLength != match2.info->firstMatchLength)
+        return match1.info->firstMatchLength > match2.info->firstMatchLength;
+    if (match1.info->matchPosTotal != match2.info->matchPosTotal)
+        return match1.info->matchPosTotal < match2.info->matchPosTotal;
+    if (match1.info->caseMatched != match2.info->caseMatched)
+        return match1.info->caseMatched > match2.info->caseMatched;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -407,15 +450,17 @@ static bool sortWithUsageComparator(PStatement statement1,PStatement statement2)
         return nameComparator(statement1,statement2);
 }
 
-static bool sortByScopeWithUsageComparator(PStatement statement1,PStatement statement2){
-    if (statement1->matchPosSpan!=statement2->matchPosSpan)
-        return statement1->matchPosSpan < statement2->matchPosSpan;
-    if (statement1->firstMatchLength != statement2->firstMatchLength)
-        return statement1->firstMatchLength > statement2->firstMatchLength;
-    if (statement1->matchPosTotal != statement2->matchPosTotal)
-        return statement1->matchPosTotal < statement2->matchPosTotal;
-    if (statement1->caseMatched != statement2->caseMatched)
-        return statement1->caseMatched > statement2->caseMatched;
+static bool sortByScopeWithUsageComparator(const StatementMatch& match1, const StatementMatch& match2) {
+    const PStatement& statement1 = match1.statement;
+    const PStatement& statement2 = match2.statement;
+    if (match1.info->matchPosSpan!=match2.info->matchPosSpan)
+        return match1.info->matchPosSpan < match2.info->matchPosSpan;
+    if (match1.info->firstMatchLength != match2.info->firstMatchLength)
+        return match1.info->firstMatchLength > match2.info->firstMatchLength;
+    if (match1.info->matchPosTotal != match2.info->matchPosTotal)
+        return match1.info->matchPosTotal < match2.info->matchPosTotal;
+    if (match1.info->caseMatched != match2.info->caseMatched)
+        return match1.info->caseMatched > match2.info->caseMatched;
     // Show user template first
     if (statement1->kind == StatementKind::skUserCodeSnippet) {
         if (statement2->kind != StatementKind::skUserCodeSnippet)
@@ -460,6 +505,7 @@ void CodeCompletionPopup::filterList(const QString &member)
 {
     QMutexLocker locker(&mMutex);
     mCompletionStatementList.clear();
+    mMatchInfos.clear();
 //    if (!mParser)
 //        return;
 //    if (!mParser->enabled())
@@ -467,11 +513,12 @@ void CodeCompletionPopup::filterList(const QString &member)
     //we don't need to freeze here since we use smart pointers
     //  and data have been retrieved from the parser
 
-    mCompletionStatementList.clear();
     mCompletionStatementList.reserve(mFullCompletionStatementList.size());
+    mMatchInfos.reserve(mFullCompletionStatementList.size());
     bool hideSymbolsTwoUnderline = mHideSymbolsStartWithTwoUnderline && !member.startsWith("__") ;
     bool hideSymbolsUnderline = mHideSymbolsStartWithUnderline && !member.startsWith("_") ;
     int len = member.length();
+    StatementMatchInfo matchInfo;
     foreach (const PStatement& statement, mFullCompletionStatementList) {
 
         int matched = 0;
@@ -480,7 +527,7 @@ void CodeCompletionPopup::filterList(const QString &member)
         int pos = 0;
         int lastPos = -10;
         int totalPos = 0;
-        statement->matchPositions.clear();
+        matchInfo.matchPositions.clear();
         if (hideSymbolsTwoUnderline && statement->command.startsWith("__")) {
             continue;
         } else if (hideSymbolsUnderline && statement->command.startsWith("_")) {
@@ -495,12 +542,12 @@ void CodeCompletionPopup::filterList(const QString &member)
                     break;
                 }
                 if (pos == lastPos+1) {
-                    statement->matchPositions.last()->end++;
+                    matchInfo.matchPositions.last().end++;
                 } else {
-                    PStatementMathPosition matchPosition=std::make_shared<StatementMatchPosition>();
-                    matchPosition->start = pos;
-                    matchPosition->end = pos+1;
-                    statement->matchPositions.append(matchPosition);
+                    StatementMatchPosition matchPosition;
+                    matchPosition.start = pos;
+                    matchPosition.end = pos+1;
+                    matchInfo.matchPositions.append(matchPosition);
                 }
                 if (ch==command[pos])
                     caseMatched++;
@@ -511,30 +558,19 @@ void CodeCompletionPopup::filterList(const QString &member)
             }
         }
 
-        if (mIgnoreCase && matched== len) {
-            statement->caseMatched = caseMatched;
-            statement->matchPosTotal = totalPos;
-            if (member.length()>0) {
-                statement->firstMatchLength = statement->matchPositions.front()->end - statement->matchPositions.front()->start;
-                statement->matchPosSpan = statement->matchPositions.last()->end - statement->matchPositions.front()->start;
-            } else
-                statement->firstMatchLength = 0;
-            mCompletionStatementList.append(statement);
-        } else if (caseMatched == len) {
-            statement->caseMatched = caseMatched;
-            statement->matchPosTotal = totalPos;
+        if ((mIgnoreCase && matched== len)
+                || caseMatched == len) {
+            matchInfo.caseMatched = caseMatched;
+            matchInfo.matchPosTotal = totalPos;
             if (member.length()>0) {
-                statement->firstMatchLength = statement->matchPositions.front()->end - statement->matchPositions.front()->start;
-                statement->matchPosSpan = statement->matchPositions.last()->end - statement->matchPositions.front()->start;
-            } else
-                statement->firstMatchLength = 0;
+                matchInfo.firstMatchLength = matchInfo.matchPositions.front().end - matchInfo.matchPositions.front().start;
+                matchInfo.matchPosSpan = matchInfo.matchPositions.last().end - matchInfo.matchPositions.front().start;
+            } else {
+                matchInfo.firstMatchLength = 0;
+                matchInfo.matchPosSpan = 0;
+            }
+            mMatchInfos.insert(statement.get(), matchInfo);
             mCompletionStatementList.append(statement);
-        } else {
-            statement->matchPositions.clear();
-            statement->caseMatched = 0;
-            statement->matchPosTotal = 0;
-            statement->firstMatchLength = 0;
-            statement->matchPosSpan = 0;
         }
     }
     if (mRecordUsage) {
@@ -550,24 +586,36 @@ void CodeCompletionPopup::filterList(const QString &member)
                 statement->usageCount = usageCount;
             }
         }
+    }
+    QVector<StatementMatch> matches;
+    matches.reserve(mCompletionStatementList.size());
+    foreach (const PStatement& statement,mCompletionStatementList) {
+        StatementMatch match;
+        match.statement = statement;
+        match.info = &mMatchInfos[statement.get()];
+        matches.append(match);
+    }
+    if (mRecordUsage) {
         if (mSortByScope) {
-            std::sort(mCompletionStatementList.begin(),
-                      mCompletionStatementList.end(),
+            std::sort(matches.begin(),
+                      matches.end(),
                       sortByScopeWithUsageComparator);
         } else {
-            std::sort(mCompletionStatementList.begin(),
-                      mCompletionStatementList.end(),
+            std::sort(matches.begin(),
+                      matches.end(),
                       sortWithUsageComparator);
         }
     } else if (mSortByScope) {
-        std::sort(mCompletionStatementList.begin(),
-                  mCompletionStatementList.end(),
+        std::sort(matches.begin(),
+                  matches.end(),
                   sortByScopeComparator);
     } else {
-        std::sort(mCompletionStatementList.begin(),
-                  mCompletionStatementList.end(),
+        std::sort(matches.begin(),
+                  matches.end(),
                   defaultComparator);
     }
+    for (int i=0;i<matches.count();i++)
+        mCompletionStatementList[i] = matches[i].statement;
     //    }
 }
 
@@ -671,7 +719,7 @@ void CodeCompletionPopup::getCompletionFor(
                 }
 
                 // add members of all usings (in current scope ) and not added before
-                foreach (const QString& namespaceName,scopeStatement->usingList) {
+                foreach (const QString& namespaceName,scopeStatement->usingList()) {
                     PStatementList namespaceStatementsList =
                             mParser->findNamespace(namespaceName);
                     if (!namespaceStatementsList)
@@ -809,7 +857,7 @@ void CodeCompletionPopup::getCompletionFor(
                     //we can use all members
                     addChildren(classTypeStatement,fileName,-1);
                 } else { // we can only use public members
-                    const StatementMap& children = mParser->statementList().childrenStatements(classTypeStatement);
+                    const StatementList children = mParser->statementList().matchChildren(classTypeStatement, mCollectedPhrase);
                     if (children.isEmpty())
                         return;
                     foreach (const PStatement& childStatement, children) {
@@ -834,8 +882,8 @@ void CodeCompletionPopup::getCompletionFor(
                     return;
                 if (classTypeStatement->kind == StatementKind::skEnumType
                         || classTypeStatement->kind == StatementKind::skEnumClassType) {
-                    const StatementMap& children =
-                            mParser->statementList().childrenStatements(classTypeStatement);
+                    const StatementList children =
+                            mParser->statementList().matchChildren(classTypeStatement, mCollectedPhrase);
                     foreach (const PStatement& child,children) {
                         addStatement(child,fileName,line);
                     }
@@ -843,8 +891,8 @@ void CodeCompletionPopup::getCompletionFor(
                     //class
                     if (classTypeStatement == scopeTypeStatement) {
                         //we can use all static members
-                        const StatementMap& children =
-                                mParser->statementList().childrenStatements(classTypeStatement);
+                        const StatementList children =
+                                mParser->statementList().matchChildren(classTypeStatement, mCollectedPhrase);
                         foreach (const PStatement& childStatement, children) {
                             if (
                               (childStatement->isStatic())
@@ -859,8 +907,8 @@ void CodeCompletionPopup::getCompletionFor(
                         }
                     } else {
                         // we can only use public static members
-                        const StatementMap& children =
-                                mParser->statementList().childrenStatements(classTypeStatement);
+                        const StatementList children =
+                                mParser->statementList().matchChildren(classTypeStatement, mCollectedPhrase);
                         foreach (const PStatement& childStatement,children) {
                             if (
                               (childStatement->isStatic())
@@ -1202,6 +1250,7 @@ void CodeCompletionPopup::hideEvent(QHideEvent *event)
     QMutexLocker locker(&mMutex);
     mListView->setKeypressedCallback(nullptr);
     mCompletionStatementList.clear();
+    mMatchInfos.clear();
 //    foreach (PStatement statement, mFullCompletionStatementList) {
 //        statement->matchPositions.clear();
 //    }
@@ -1224,9 +1273,10 @@ bool CodeCompletionPopup::event(QEvent *event)
     return result;
 }
 
-CodeCompletionListModel::CodeCompletionListModel(const StatementList *statements, QObject *parent):
+CodeCompletionListModel::CodeCompletionListModel(const StatementList *statements, const StatementMatchInfoMap *matchInfos, QObject *parent):
     QAbstractListModel(parent),
-    mStatements(statements)
+    mStatements(statements),
+    mMatchInfos(matchInfos)
 {
 
 }
@@ -1264,6 +1314,14 @@ PStatement CodeCompletionListModel::statement(const QModelIndex &index) const
     return mStatements->at(index.row());
 }
 
+const StatementMatchInfo *CodeCompletionListModel::matchInfo(const PStatement &statement) const
+{
+    auto it = mMatchInfos->constFind(statement.get());
+    if (it == mMatchInfos->constEnd())
+        return nullptr;
+    return &(it.value());
+}
+
 QPixmap CodeCompletionListModel::statementIcon(const QModelIndex &index) const
 {
     if (!index.isValid())
@@ -1303,18 +1361,21 @@ void CodeCompletionListItemDelegate::paint(QPainter *painter, const QStyleOption
         QString text = statement->command;
         int pos=0;
         int y=option.rect.bottom()-painter->fontMetrics().descent();
-        foreach (const PStatementMathPosition& matchPosition, statement->matchPositions) {
-            if (pos<matchPosition->start) {
-                QString t = text.mid(pos,matchPosition->start-pos);
-                painter->setPen(normalColor);
+        const StatementMatchInfo* matchInfo = mModel->matchInfo(statement);
+        if (matchInfo) {
+            foreach (const StatementMatchPosition& matchPosition, matchInfo->matchPositions) {
+                if (pos<matchPosition.start) {
+                    QString t = text.mid(pos,matchPosition.start-pos);
+                    painter->setPen(normalColor);
+                    painter->drawText(x,y,t);
+                    x+=painter->fontMetrics().horizontalAdvance(t);
+                }
+                QString t = text.mid(matchPosition.start, matchPosition.end-matchPosition.start);
+                painter->setPen(mMatchedColor);
                 painter->drawText(x,y,t);
                 x+=painter->fontMetrics().horizontalAdvance(t);
+                pos=matchPosition.end;
             }
-            QString t = text.mid(matchPosition->start, matchPosition->end-matchPosition->start);
-            painter->setPen(mMatchedColor);
-            painter->drawText(x,y,t);
-            x+=painter->fontMetrics().horizontalAdvance(t);
-            pos=matchPosition->end;
         }
         if (pos<text.length()) {
             QString t = text.mid(pos,text.length()-pos);
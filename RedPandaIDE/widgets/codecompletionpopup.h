@@ -22,19 +22,41 @@
 #include "parser/cppparser.h"
 #include "codecompletionlistview.h"
 
+struct StatementMatchPosition{
+    int start;
+    int end;
+};
+
+/**
+ * @brief how a statement's name matches the typed phrase
+ */
+struct StatementMatchInfo {
+    int matchPosTotal; // total of matched positions
+    int matchPosSpan; // distance between the first match pos and the last match pos;
+    int firstMatchLength; // length of first match;
+    int caseMatched; // if match with case
+    QVector<StatementMatchPosition> matchPositions;
+};
+
+using StatementMatchInfoMap = QHash<const Statement*, StatementMatchInfo>;
+
 class ColorSchemeItem;
 class CodeCompletionListModel : public QAbstractListModel {
     Q_OBJECT
 public:
-    explicit CodeCompletionListModel(const StatementList* statements,QObject *parent = nullptr);
+    explicit CodeCompletionListModel(const StatementList* statements,
+                                     const StatementMatchInfoMap* matchInfos,
+                                     QObject *parent = nullptr);
     int rowCount(const QModelIndex &parent) const override;
     QVariant data(const QModelIndex &index, int role) const override;
     PStatement statement(const QModelIndex &index) const;
+    const StatementMatchInfo* matchInfo(const PStatement& statement) const;
     QPixmap statementIcon(const QModelIndex &index) const;
     void notifyUpdated();
 
 private:
     const StatementList* mStatements;
+    const StatementMatchInfoMap* mMatchInfos;
 };
 
 enum class CodeCompletionType {
@@ -129,6 +151,7 @@ public:
     const QList<PCodeSnippet> &codeSnippets() const;
     void setCodeSnippets(const QList<PCodeSnippet> &newCodeSnippets);
 private:
+    void collectStatements(const QString& phrase);
     void addChildren(const PStatement& scopeStatement, const QString& fileName,
                      int line, bool onlyTypes=false);
     void addFunctionWithoutDefinitionChildren(const PStatement& scopeStatement, const QString& fileName,
@@ -168,11 +191,20 @@ private:
     //QList<PStatement> mCodeInsStatements; //temporary (user code template) statements created when show code suggestion
     StatementList mFullCompletionStatementList;
     StatementList mCompletionStatementList;
+    StatementMatchInfoMap mMatchInfos;
     QSet<QString> mIncludedFiles;
     QSet<QString> mUsings;
     QSet<QString> mAddedStatements;
     QString mMemberPhrase;
     QString mMemberOperator;
+    QString mCollectedPhrase;
+    QString mPreWord;
+    QStringList mOwnerExpression;
+    QStringList mMemberExpression;
+    QString mFileName;
+    int mLine;
+    CodeCompletionType mCompletionType;
+    QSet<QString> mCustomKeywords;
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
     QRecursiveMutex mMutex;
 #else
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "parserprofiledialog.h"
+#include "ui_parserprofiledialog.h"
+
+#include <QDateTime>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+
+static QTableWidgetItem* createNumberItem(double value)
+{
+    QTableWidgetItem* item = new QTableWidgetItem();
+    // store numbers instead of texts so the columns are sorted by value
+    item->setData(Qt::DisplayRole, value);
+    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+
+static double nsToMs(qint64 nsecs)
+{
+    return qRound(nsecs / 10000.0) / 100.0;
+}
+
+ParserProfileDialog::ParserProfileDialog(const ParserProfiler& profiler, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ParserProfileDialog),
+    mProfiler(profiler)
+{
+    ui->setupUi(this);
+    showProfile();
+}
+
+ParserProfileDialog::~ParserProfileDialog()
+{
+    delete ui;
+}
+
+void ParserProfileDialog::on_btnExport_clicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Export"), QString(), tr("JSON files (*.json)"));
+    if (fileName.isEmpty())
+        return;
+    if (!mProfiler.saveAsJson(fileName)) {
+        QMessageBox::critical(this,
+                              tr("Error"),
+                              tr("Write to file '%1' failed.").arg(fileName));
+    }
+}
+
+void ParserProfileDialog::on_btnClose_clicked()
+{
+    close();
+}
+
+void ParserProfileDialog::showProfile()
+{
+    ui->btnExport->setEnabled(!mProfiler.isEmpty());
+    if (mProfiler.isEmpty()) {
+        ui->lblSummary->setText(tr("No files are parsed yet."));
+        return;
+    }
+    ui->lblSummary->setText(
+                tr("Parsed %1 files in %2 ms, started at %3.<br/>"
+                   "Preprocess: %4 ms, Tokenize: %5 ms, Parse: %6 ms.<br/>"
+                   "Lines: %7, Tokens: %8, Statements: %9.<br/>"
+                   "Lock waits: %10 (%11 ms), Snapshot: %12 ms.")
+                .arg(mProfiler.files().count())
+                .arg(nsToMs(mProfiler.wallTime()))
+                .arg(QDateTime::fromMSecsSinceEpoch(mProfiler.startTime()).toString("hh:mm:ss"))
+                .arg(nsToMs(mProfiler.phaseTime(ParsePhase::Preprocess)))
+                .arg(nsToMs(mProfiler.phaseTime(ParsePhase::Tokenize)))
+                .arg(nsToMs(mProfiler.phaseTime(ParsePhase::Parse)))
+                .arg(mProfiler.lineCount())
+                .arg(mProfiler.tokenCount())
+                .arg(mProfiler.statementCount())
+                .arg(mProfiler.lockWaitCount())
+                .arg(nsToMs(mProfiler.lockWaitTime()))
+                .arg(nsToMs(mProfiler.snapshotTime())));
+
+    ui->tblFiles->setSortingEnabled(false);
+    ui->tblFiles->setRowCount(mProfiler.files().count());
+    int row = 0;
+    foreach (const FileParseProfile& profile, mProfiler.files()) {
+        QTableWidgetItem* item = new QTableWidgetItem(profile.fileName);
+        if (profile.preprocessedInWorker)
+            item->setToolTip(tr("Preprocessed and tokenized in a worker thread"));
+        ui->tblFiles->setItem(row, 0, item);
+        ui->tblFiles->setItem(row, 1, createNumberItem(nsToMs(profile.totalTime())));
+        ui->tblFiles->setItem(row, 2, createNumberItem(nsToMs(profile.phaseTimes[(int)ParsePhase::Preprocess])));
+        ui->tblFiles->setItem(row, 3, createNumberItem(nsToMs(profile.phaseTimes[(int)ParsePhase::Tokenize])));
+        ui->tblFiles->setItem(row, 4, createNumberItem(nsToMs(profile.phaseTimes[(int)ParsePhase::Parse])));
+        ui->tblFiles->setItem(row, 5, createNumberItem(profile.lineCount));
+        ui->tblFiles->setItem(row, 6, createNumberItem(profile.tokenCount));
+        ui->tblFiles->setItem(row, 7, createNumberItem(profile.statementCount));
+        row++;
+    }
+    ui->tblFiles->setSortingEnabled(true);
+    ui->tblFiles->sortByColumn(1, Qt::DescendingOrder);
+    ui->tblFiles->resizeColumnsToContents();
+}
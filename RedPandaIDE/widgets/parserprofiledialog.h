@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PARSERPROFILEDIALOG_H
+#define PARSERPROFILEDIALOG_H
+
+#include <QDialog>
+#include "../parser/parserprofiler.h"
+
+namespace Ui {
+class ParserProfileDialog;
+}
+
+class ParserProfileDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ParserProfileDialog(const ParserProfiler& profiler, QWidget *parent = nullptr);
+    ~ParserProfileDialog();
+
+private slots:
+    void on_btnExport_clicked();
+    void on_btnClose_clicked();
+
+private:
+    void showProfile();
+private:
+    Ui::ParserProfileDialog *ui;
+    ParserProfiler mProfiler;
+};
+
+#endif // PARSERPROFILEDIALOG_H
@@ -21,6 +21,27 @@ APP_VERSION = 2.25
 RedPandaIDE.depends = astyle consolepauser qsynedit
 qsynedit.depends = redpanda_qt_utils
 
+# The benchmarks in tools/*bench are only built with "qmake CONFIG+=benchmarks"
+benchmarks: {
+SUBDIRS += \
+    documentbench \
+    foldbench \
+    loadbench \
+    macrobench \
+    parserbench
+
+documentbench.subdir = tools/documentbench
+foldbench.subdir = tools/foldbench
+loadbench.subdir = tools/loadbench
+macrobench.subdir = tools/macrobench
+parserbench.subdir = tools/parserbench
+
+documentbench.depends = qsynedit redpanda_qt_utils
+foldbench.depends = qsynedit redpanda_qt_utils
+loadbench.depends = qsynedit redpanda_qt_utils
+parserbench.depends = qsynedit redpanda_qt_utils
+}
+
 win32: {
 SUBDIRS += \
 	redpanda-win-git-askpass
@@ -30,9 +30,11 @@ msvc {
 SOURCES += qsynedit/codefolding.cpp \
     qsynedit/constants.cpp \
     qsynedit/document.cpp \
+    qsynedit/documentlines.cpp \
     qsynedit/formatter/cppformatter.cpp \
     qsynedit/formatter/formatter.cpp \
     qsynedit/keystrokes.cpp \
+    qsynedit/mappedfile.cpp \
     qsynedit/miscprocs.cpp \
     qsynedit/exporter/exporter.cpp \
     qsynedit/exporter/htmlexporter.cpp \
@@ -56,9 +58,11 @@ HEADERS += \
     qsynedit/codefolding.h \
     qsynedit/constants.h \
     qsynedit/document.h \
+    qsynedit/documentlines.h \
     qsynedit/formatter/cppformatter.h \
     qsynedit/formatter/formatter.h \
     qsynedit/keystrokes.h \
+    qsynedit/mappedfile.h \
     qsynedit/miscprocs.h \
     qsynedit/types.h \
     qsynedit/exporter/exporter.h \
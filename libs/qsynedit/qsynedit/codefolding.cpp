@@ -16,6 +16,7 @@
  */
 #include "codefolding.h"
 #include "constants.h"
+#include <algorithm>
 
 
 namespace QSynedit {
@@ -49,6 +50,16 @@ void CodeFoldingRange::move(int count)
 {
     fromLine += count;
     toLine += count;
+    if (closingLine > 0)
+        closingLine += count;
+}
+
+void CodeFoldingRange::moveEnd(int count)
+{
+    toLine += count;
+    closingLine += count;
+    if (collapsed)
+        linesCollapsed = toLine - fromLine;
 }
 
 CodeFoldingRange::CodeFoldingRange(PCodeFoldingRange parent,
@@ -56,6 +67,7 @@ CodeFoldingRange::CodeFoldingRange(PCodeFoldingRange parent,
                                    int toLine):
     fromLine(fromLine),
     toLine(toLine),
+    closingLine(0),
     linesCollapsed(0),
     collapsed(false),
     parent(parent)
@@ -112,6 +124,11 @@ void CodeFoldingRanges::add(PCodeFoldingRange foldRange)
     mRanges.push_back(foldRange);
 }
 
+void CodeFoldingRanges::replace(int index, int count, const QVector<PCodeFoldingRange> &ranges)
+{
+    mRanges = mRanges.mid(0, index) + ranges + mRanges.mid(index + count);
+}
+
 PCodeFoldingRange CodeFoldingRanges::operator[](int index) const
 {
     return mRanges[index];
@@ -122,4 +139,68 @@ const QVector<PCodeFoldingRange> &CodeFoldingRanges::ranges() const
     return mRanges;
 }
 
+CollapsedFoldIndex::CollapsedFoldIndex():
+    mLinesHidden(0),
+    mValid(true)
+{
+
+}
+
+void CollapsedFoldIndex::invalidate()
+{
+    mValid = false;
+}
+
+bool CollapsedFoldIndex::isValid() const
+{
+    return mValid;
+}
+
+void CollapsedFoldIndex::rebuild(const CodeFoldingRanges &allFoldRanges)
+{
+    mSpans.clear();
+    mLinesHidden = 0;
+    // allFoldRanges is sorted by fromLine, and visible collapsed folds don't overlap
+    foreach (const PCodeFoldingRange& range, allFoldRanges.ranges()) {
+        if (!range->collapsed || range->parentCollapsed())
+            continue;
+        CollapsedSpan span;
+        span.fromLine = range->fromLine;
+        span.toLine = range->toLine;
+        span.fromRow = range->fromLine - mLinesHidden;
+        span.linesHiddenBefore = mLinesHidden;
+        mSpans.append(span);
+        mLinesHidden += range->linesCollapsed;
+    }
+    mValid = true;
+}
+
+int CollapsedFoldIndex::rowToLine(int row) const
+{
+    // lines hidden by the folds starting before the row
+    auto it = std::lower_bound(mSpans.begin(), mSpans.end(), row,
+                               [](const CollapsedSpan& span, int row) {
+        return span.fromRow < row;
+    });
+    if (it == mSpans.end())
+        return row + mLinesHidden;
+    return row + it->linesHiddenBefore;
+}
+
+int CollapsedFoldIndex::lineToRow(int line) const
+{
+    // first fold not ending before the line
+    auto it = std::lower_bound(mSpans.begin(), mSpans.end(), line,
+                               [](const CollapsedSpan& span, int line) {
+        return span.toLine < line;
+    });
+    if (it == mSpans.end())
+        return line - mLinesHidden;
+    int result = line - it->linesHiddenBefore;
+    // Inside fold
+    if (it->fromLine < line)
+        result -= line - it->fromLine;
+    return result;
+}
+
 }
@@ -53,6 +53,7 @@ public:
     void insert(int index, PCodeFoldingRange range);
     void remove(int index);
     void add(PCodeFoldingRange foldRange);
+    void replace(int index, int count, const QVector<PCodeFoldingRange>& ranges);
     PCodeFoldingRange operator[](int index) const;
     const QVector<PCodeFoldingRange> &ranges() const;
 
@@ -68,12 +69,42 @@ public:
     CodeFoldingRange& operator=(const CodeFoldingRange&)=delete;
     int fromLine; // Beginning line
     int toLine; // End line
+    int closingLine; // Line of the closing mark, 0 if not closed
     int linesCollapsed; // Number of collapsed lines
     PCodeFoldingRanges subFoldRanges; // Sub fold ranges
     bool collapsed; // Is collapsed?
     std::weak_ptr<CodeFoldingRange> parent;
     bool parentCollapsed();
     void move(int count);
+    void moveEnd(int count);
+};
+
+/**
+ * @brief Row <-> line mapping over the visible collapsed folds.
+ *
+ * Keeps the collapsed folds that are not inside another collapsed fold,
+ * sorted by line, with the number of lines hidden before each of them, so
+ * both mappings are a binary search. It's rebuilt lazily from the fold
+ * ranges after they are changed (see invalidate()).
+ */
+class CollapsedFoldIndex {
+public:
+    explicit CollapsedFoldIndex();
+    void invalidate();
+    bool isValid() const;
+    void rebuild(const CodeFoldingRanges& allFoldRanges);
+    int rowToLine(int row) const;
+    int lineToRow(int line) const;
+private:
+    struct CollapsedSpan {
+        int fromLine;
+        int toLine;
+        int fromRow;
+        int linesHiddenBefore;
+    };
+    QVector<CollapsedSpan> mSpans;
+    int mLinesHidden;
+    bool mValid;
 };
 
 }
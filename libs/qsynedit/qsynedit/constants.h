@@ -51,6 +51,18 @@ extern const QChar SoftBreakGlyph;
 #define SYNS_AttrVariable "Variable"
 #define SYNS_AttrSpace "Space"
 
+// documents with more lines are lexed lazily: the lines up to the viewport
+// first, and the rest in the background
+#define SYN_LAZY_SCAN_MIN_LINES 10000
+// max time (in milliseconds) used by each slice of the background lexing
+#define SYN_LAZY_SCAN_SLICE_TIME 20
+
+// max count of lines whose lexed tokens are kept for repainting
+#define SYN_PAINTED_LINES_CACHE_SIZE 1000
+
+// larger files are opened as read-only mapped documents
+#define SYN_MAPPED_FILE_MIN_SIZE (64*1024*1024)
+
 // names of exporter output formats
 #define SYNS_ExporterFormatHTML "HTML"
 #define SYNS_ExporterFormatRTF "RTF"
@@ -19,13 +19,14 @@
 #include <QDataStream>
 #include <QFile>
 #include <QTextCodec>
-#include <QTextStream>
 #include <QMutexLocker>
 #include <stdexcept>
 #include "qsynedit.h"
 #include <QMessageBox>
 #include <cmath>
+#include <cstring>
 #include "qt_utils/charsetinfo.h"
+#include "constants.h"
 #include <QDebug>
 
 namespace QSynedit {
@@ -44,8 +45,10 @@ Document::Document(const QFont& font, const QFont& nonAsciiFont, QObject *parent
     mAppendNewLineAtEOF = true;
     mNewlineType = NewlineType::Windows;
     mIndexOfLongestLine = -1;
+    mLongestLineColumns = -1;
     mUpdateCount = 0;
     mCharWidth =  mFontMetrics.horizontalAdvance("M");
+    resetCharColumns();
 }
 
 static void listIndexOutOfBounds(int index) {
@@ -57,8 +60,8 @@ static void listIndexOutOfBounds(int index) {
 int Document::parenthesisLevel(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState.parenthesisLevel;
+    if (index>=0 && index < mLines.count()) {
+        return mLines[index].syntaxState->parenthesisLevel;
     } else
         return 0;
 }
@@ -66,8 +69,8 @@ int Document::parenthesisLevel(int index)
 int Document::bracketLevel(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState.bracketLevel;
+    if (index>=0 && index < mLines.count()) {
+        return mLines[index].syntaxState->bracketLevel;
     } else
         return 0;
 }
@@ -75,8 +78,8 @@ int Document::bracketLevel(int index)
 int Document::braceLevel(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState.braceLevel;
+    if (index>=0 && index < mLines.count()) {
+        return mLines[index].syntaxState->braceLevel;
     } else
         return 0;
 }
@@ -84,11 +87,16 @@ int Document::braceLevel(int index)
 int Document::lineColumns(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        if (mLines[index]->columns == -1) {
+    if (mMappedFile) {
+        if (index>=0 && index < mMappedFile->lineCount())
+            return stringColumns(mMappedFile->line(index),0);
+        return 0;
+    }
+    if (index>=0 && index < mLines.count()) {
+        if (mLines[index].columns == -1) {
             return calculateLineColumns(index);
         } else
-            return mLines[index]->columns;
+            return mLines[index].columns;
     } else
         return 0;
 }
@@ -96,8 +104,8 @@ int Document::lineColumns(int index)
 int Document::blockLevel(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState.blockLevel;
+    if (index>=0 && index < mLines.count()) {
+        return mLines[index].syntaxState->blockLevel;
     } else
         return 0;
 }
@@ -105,8 +113,8 @@ int Document::blockLevel(int index)
 int Document::blockStarted(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState.blockStarted;
+    if (index>=0 && index < mLines.count()) {
+        return mLines[index].syntaxState->blockStarted;
     } else
         return 0;
 }
@@ -114,9 +122,9 @@ int Document::blockStarted(int index)
 int Document::blockEnded(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        int result = mLines[index]->syntaxState.blockEnded;
-//        if (index+1 < mLines.size())
+    if (index>=0 && index < mLines.count()) {
+        int result = mLines[index].syntaxState->blockEnded;
+//        if (index+1 < mLines.count())
 //            result += mLines[index+1]->syntaxState.blockEndedLastLine;
         return result;
     } else
@@ -125,11 +133,17 @@ int Document::blockEnded(int index)
 
 int Document::lengthOfLongestLine() {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile) {
+        // the longest line in bytes, good enough for the scroll bar
+        if (mLongestLineColumns < 0)
+            mLongestLineColumns = stringColumns(mMappedFile->line(mMappedFile->longestLine()),0);
+        return mLongestLineColumns;
+    }
     if (mIndexOfLongestLine < 0) {
         int MaxLen = -1;
         mIndexOfLongestLine = -1;
         if (mLines.count() > 0 ) {
-            for (int i=0;i<mLines.size();i++) {
+            for (int i=0;i<mLines.count();i++) {
                 int len = lineColumns(i);
                 if (len > MaxLen) {
                     MaxLen = len;
@@ -139,7 +153,7 @@ int Document::lengthOfLongestLine() {
         }
     }
     if (mIndexOfLongestLine >= 0)
-        return mLines[mIndexOfLongestLine]->columns;
+        return mLines[mIndexOfLongestLine].columns;
     else
         return 0;
 }
@@ -160,8 +174,11 @@ QString Document::lineBreak() const
 SyntaxState Document::getSyntaxState(int index)
 {
     QMutexLocker locker(&mMutex);
-    if (index>=0 && index < mLines.size()) {
-        return mLines[index]->syntaxState;
+    // mapped files are not highlighted
+    if (mMappedFile && index>=0 && index < mMappedFile->lineCount())
+        return SyntaxState();
+    if (index>=0 && index < mLines.count()) {
+        return *mLines[index].syntaxState;
     } else {
          listIndexOutOfBounds(index);
     }
@@ -171,20 +188,16 @@ SyntaxState Document::getSyntaxState(int index)
 void Document::insertItem(int Index, const QString &s)
 {
     beginUpdate();
-    PDocumentLine line = std::make_shared<DocumentLine>();
-    line->lineText = s;
     mIndexOfLongestLine = -1;
-    mLines.insert(Index,line);
+    mLines.insert(Index,s);
     endUpdate();
 }
 
 void Document::addItem(const QString &s)
 {
     beginUpdate();
-    PDocumentLine line = std::make_shared<DocumentLine>();
-    line->lineText = s;
     mIndexOfLongestLine = -1;
-    mLines.append(line);
+    mLines.append(s);
     endUpdate();
 }
 
@@ -203,27 +216,53 @@ void Document::setAppendNewLineAtEOF(bool appendNewLineAtEOF)
 void Document::setSyntaxState(int Index, const SyntaxState& range)
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return;
     if (Index<0 || Index>=mLines.count()) {
         listIndexOutOfBounds(Index);
     }
     //beginUpdate();
-    mLines[Index]->syntaxState = range;
+    DocumentLine& line = mLines[Index];
+    if (*line.syntaxState == range
+            && line.syntaxState->hasTrailingSpaces == range.hasTrailingSpaces)
+        return;
+    // share the state with the previous line if possible
+    if (Index>0) {
+        const PSyntaxState& lastState = mLines[Index-1].syntaxState;
+        if (*lastState == range
+                && lastState->hasTrailingSpaces == range.hasTrailingSpaces) {
+            line.syntaxState = lastState;
+            return;
+        }
+    }
+    line.syntaxState = std::make_shared<const SyntaxState>(range);
     //endUpdate();
 }
 
 QString Document::getLine(int Index)
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile) {
+        if (Index<0 || Index>=mMappedFile->lineCount())
+            return QString();
+        return mMappedFile->line(Index);
+    }
     if (Index<0 || Index>=mLines.count()) {
         return QString();
     }
-    return mLines[Index]->lineText;
+    return mLines[Index].lineText;
 }
 
 int Document::count()
 {
     QMutexLocker locker(&mMutex);
-    return mLines.count();
+    return internalLineCount();
+}
+
+bool Document::isMapped()
+{
+    QMutexLocker locker(&mMutex);
+    return mMappedFile!=nullptr;
 }
 
 QString Document::text()
@@ -258,18 +297,36 @@ void Document::setContents(const QStringList &text)
 }
 
 QStringList Document::contents()
+{
+    return *snapshot();
+}
+
+PDocumentSnapshot Document::snapshot()
 {
     QMutexLocker locker(&mMutex);
-    QStringList result;
-    DocumentLines list = mLines;
-    foreach (const PDocumentLine& line, list) {
-        result.append(line->lineText);
+    if (!mSnapshot) {
+        std::shared_ptr<QStringList> lines = std::make_shared<QStringList>();
+        int lineCount = internalLineCount();
+        lines->reserve(lineCount);
+        for (int i=0;i<lineCount;i++) {
+            lines->append(internalLine(i));
+        }
+        mSnapshot = lines;
     }
-    return result;
+    return mSnapshot;
+}
+
+void Document::invalidateSnapshot()
+{
+    //lines are being changed, snapshots taken before are still valid,
+    //but later calls to snapshot() must see the new contents
+    QMutexLocker locker(&mMutex);
+    mSnapshot.reset();
 }
 
 void Document::beginUpdate()
 {
+    invalidateSnapshot();
     if (mUpdateCount == 0) {
         setUpdateState(true);
     }
@@ -278,6 +335,7 @@ void Document::beginUpdate()
 
 void Document::endUpdate()
 {
+    invalidateSnapshot();
     mUpdateCount--;
     if (mUpdateCount == 0) {
         setUpdateState(false);
@@ -288,6 +346,7 @@ void Document::endUpdate()
 int Document::addLine(const QString &s)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     beginUpdate();
     int Result = mLines.count();
     insertItem(Result, s);
@@ -299,6 +358,7 @@ int Document::addLine(const QString &s)
 void Document::addLines(const QStringList &strings)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if (strings.count() > 0) {
         mIndexOfLongestLine = -1;
         beginUpdate();
@@ -318,8 +378,9 @@ int Document::getTextLength()
 {
     QMutexLocker locker(&mMutex);
     int Result = 0;
-    foreach (const PDocumentLine& line, mLines ) {
-        Result += line->lineText.length();
+    int lineCount = internalLineCount();
+    for (int i=0;i<lineCount;i++) {
+        Result += internalLine(i).length();
         if (mNewlineType == NewlineType::Windows) {
             Result += 2;
         } else {
@@ -338,6 +399,7 @@ void Document::clear()
 void Document::deleteLines(int index, int numLines)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if (numLines<=0)
         return;
     if ((index < 0) || (index >= mLines.count())) {
@@ -365,6 +427,7 @@ void Document::deleteLines(int index, int numLines)
 void Document::exchange(int index1, int index2)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if ((index1 < 0) || (index1 >= mLines.count())) {
         listIndexOutOfBounds(index1);
     }
@@ -372,9 +435,7 @@ void Document::exchange(int index1, int index2)
         listIndexOutOfBounds(index2);
     }
     beginUpdate();
-    PDocumentLine temp = mLines[index1];
-    mLines[index1]=mLines[index2];
-    mLines[index2]=temp;
+    std::swap(mLines[index1], mLines[index2]);
     //mList.swapItemsAt(Index1,Index2);
     if (mIndexOfLongestLine == index1) {
         mIndexOfLongestLine = index2;
@@ -387,6 +448,7 @@ void Document::exchange(int index1, int index2)
 void Document::insertLine(int index, const QString &s)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if ((index < 0) || (index > mLines.count())) {
         listIndexOutOfBounds(index);
     }
@@ -399,6 +461,7 @@ void Document::insertLine(int index, const QString &s)
 void Document::deleteAt(int index)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if ((index < 0) || (index >= mLines.count())) {
         listIndexOutOfBounds(index);
     }
@@ -407,7 +470,7 @@ void Document::deleteAt(int index)
         mIndexOfLongestLine = -1;
     else if (mIndexOfLongestLine>index)
         mIndexOfLongestLine -= 1;
-    mLines.removeAt(index);
+    mLines.remove(index,1);
     emit deleted(index,1);
     endUpdate();
 }
@@ -415,19 +478,20 @@ void Document::deleteAt(int index)
 QString Document::getTextStr() const
 {
     QString result;
-    for (int i=0;i<mLines.count()-1;i++) {
-        const PDocumentLine& line = mLines[i];
-        result.append(line->lineText);
+    int lineCount = internalLineCount();
+    for (int i=0;i<lineCount-1;i++) {
+        result.append(internalLine(i));
         result.append(lineBreak());
     }
-    if (mLines.length()>0) {
-        result.append(mLines.back()->lineText);
+    if (lineCount>0) {
+        result.append(internalLine(lineCount-1));
     }
     return result;
 }
 
 void Document::putLine(int index, const QString &s, bool notify) {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if (index == mLines.count()) {
         addLine(s);
     } else {
@@ -435,14 +499,14 @@ void Document::putLine(int index, const QString &s, bool notify) {
             listIndexOutOfBounds(index);
         }
         beginUpdate();
-        int oldColumns = mLines[index]->columns;
-        mLines[index]->lineText = s;
+        int oldColumns = mLines[index].columns;
+        mLines[index].lineText = s;
         calculateLineColumns(index);
-        if (mIndexOfLongestLine == index && oldColumns>mLines[index]->columns )
+        if (mIndexOfLongestLine == index && oldColumns>mLines[index].columns )
             mIndexOfLongestLine = -1;
         else if (mIndexOfLongestLine>=0
                  && mIndexOfLongestLine<mLines.count()
-                 && mLines[index]->columns > mLines[mIndexOfLongestLine]->columns)
+                 && mLines[index].columns > mLines[mIndexOfLongestLine].columns)
             mIndexOfLongestLine = index;
         if (notify)
             emit putted(index,1);
@@ -460,15 +524,16 @@ void Document::setUpdateState(bool Updating)
 
 int Document::calculateLineColumns(int Index)
 {
-    PDocumentLine line = mLines[Index];
+    DocumentLine& line = mLines[Index];
 
-    line->columns = stringColumns(line->lineText,0);
-    return line->columns;
+    line.columns = stringColumns(line.lineText,0);
+    return line.columns;
 }
 
 void Document::insertLines(int index, int numLines)
 {
     QMutexLocker locker(&mMutex);
+    unmapFile();
     if (index<0 || index>mLines.count()) {
         listIndexOutOfBounds(index);
     }
@@ -479,70 +544,153 @@ void Document::insertLines(int index, int numLines)
         endUpdate();
     });
     mIndexOfLongestLine = -1;
-    PDocumentLine line;
-    mLines.insert(index,numLines,line);
-    for (int i=index;i<index+numLines;i++) {
-        line = std::make_shared<DocumentLine>();
-        mLines[i]=line;
-    }
+    mLines.insert(index,numLines);
     emit inserted(index,numLines);
 }
 
 
-bool Document::tryLoadFileByEncoding(QByteArray encodingName, QFile& file) {
-    QTextCodec* codec = QTextCodec::codecForName(encodingName);
-    if (!codec)
-        return false;
-    file.reset();
-    internalClear();
-    QTextCodec::ConverterState state;
-    while (true) {
-        if (file.atEnd()){
-            break;
+namespace {
+struct LineRange {
+    int start;
+    int length;
+};
+}
+
+static bool isControlChar(uchar ch)
+{
+    return ch<' ' && ch!='\t' && ch!='\n' && ch!='\r';
+}
+
+/**
+ * @brief check in one pass if the content is all ascii, and if it's binary
+ *  (has control chars other than tabs and line breaks, like isBinaryContent())
+ *
+ * 8 bytes are tested at a time, only the words having a byte less than
+ * 0x20 are checked byte by byte.
+ */
+static void scanContent(const char* data, int size, bool& allAscii, bool& binary)
+{
+    const quint64 highBits = 0x8080808080808080ULL;
+    const quint64 spaces = 0x2020202020202020ULL;
+    quint64 orBits = 0;
+    binary = false;
+    allAscii = false;
+    int i=0;
+    for (;i+8<=size;i+=8) {
+        quint64 v;
+        std::memcpy(&v, data+i, 8);
+        orBits |= v;
+        if ((v - spaces) & ~v & highBits) {
+            for (int j=i;j<i+8;j++) {
+                if (isControlChar(data[j])) {
+                    binary = true;
+                    return;
+                }
+            }
         }
-        QByteArray line = file.readLine();
-        if (line.endsWith("\r\n")) {
-            line.remove(line.length()-2,2);
-        } else if (line.endsWith("\r")) {
-            line.remove(line.length()-1,1);
-        } else if (line.endsWith("\n")){
-            line.remove(line.length()-1,1);
+    }
+    for (;i<size;i++) {
+        if (isControlChar(data[i])) {
+            binary = true;
+            return;
         }
-        QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
-        if (state.invalidChars>0) {
-            return false;
+        orBits |= (uchar)data[i];
+    }
+    allAscii = (orBits & highBits) == 0;
+}
+
+/**
+ * @brief find the lines of the content, and the type of its line breaks
+ *
+ * Lines end at '\n' (a '\r' before it is removed), or at '\r' if there is
+ * no '\n' in the content. The line breaks are found by memchr(), which is
+ * vectorized by the C runtime.
+ */
+static QVector<LineRange> splitLines(const char* data, int start, int size, NewlineType& newlineType)
+{
+    QVector<LineRange> lines;
+    const char* p = data + start;
+    const char* end = data + size;
+    char lineBreak = '\n';
+    const char* firstBreak = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (firstBreak) {
+        if (firstBreak > p && firstBreak[-1] == '\r')
+            newlineType = NewlineType::Windows;
+        else
+            newlineType = NewlineType::Unix;
+    } else if (std::memchr(p, '\r', end - p)) {
+        newlineType = NewlineType::MacOld;
+        lineBreak = '\r';
+    }
+    while (p < end) {
+        const char* next = static_cast<const char*>(std::memchr(p, lineBreak, end - p));
+        const char* lineEnd = next ? next : end;
+        int length = lineEnd - p;
+        if (lineBreak == '\n' && length > 0 && lineEnd[-1] == '\r')
+            length--;
+        lines.append(LineRange{int(p - data), length});
+        if (!next)
             break;
+        p = next + 1;
+    }
+    return lines;
+}
+
+/**
+ * @brief decode the lines of the content
+ * @param codec nullptr if the content is all ascii
+ * @param stopAtInvalidChars if set, return false at the first line having
+ *  chars invalid for the codec
+ */
+static bool decodeLines(const char* data, const QVector<LineRange>& ranges,
+                        QTextCodec* codec, bool stopAtInvalidChars, QStringList& lines)
+{
+    lines.clear();
+    lines.reserve(ranges.count());
+    if (!codec) {
+        foreach (const LineRange& range, ranges) {
+            lines.append(QString::fromLatin1(data + range.start, range.length));
         }
-        addItem(newLine);
+        return true;
+    }
+    QTextCodec::ConverterState state;
+    foreach (const LineRange& range, ranges) {
+        lines.append(codec->toUnicode(data + range.start, range.length, &state));
+        if (stopAtInvalidChars && state.invalidChars>0)
+            return false;
     }
     return true;
 }
 
-void Document::loadUTF16BOMFile(QFile &file)
+void Document::appendLines(const QStringList &lines)
+{
+    mLines.reserve(mLines.count() + lines.count());
+    foreach (const QString& line, lines) {
+        mLines.append(line);
+    }
+}
+
+void Document::loadUTF16BOMFile(const QByteArray &content)
 {
     QTextCodec* codec=QTextCodec::codecForName(ENCODING_UTF16);
     if (!codec)
         return;
-    file.reset();
     internalClear();
-    QByteArray buf = file.readAll();
-    if (buf.length()<2)
+    if (content.length()<2)
         return;
-    QString text = codec->toUnicode(buf.mid(2));
+    QString text = codec->toUnicode(content.mid(2));
     this->setText(text);
 }
 
-void Document::loadUTF32BOMFile(QFile &file)
+void Document::loadUTF32BOMFile(const QByteArray &content)
 {
     QTextCodec* codec=QTextCodec::codecForName(ENCODING_UTF32);
     if (!codec)
         return;
-    file.reset();
     internalClear();
-    QByteArray buf = file.readAll();
-    if (buf.length()<4)
+    if (content.length()<4)
         return;
-    QString text = codec->toUnicode(buf.mid(4));
+    QString text = codec->toUnicode(content.mid(4));
     this->setText(text);
 }
 
@@ -572,6 +720,7 @@ void Document::setFontMetrics(const QFont &newFont, const QFont& newNonAsciiFont
     mFontMetrics = QFontMetrics(newFont);
     mCharWidth =  mFontMetrics.horizontalAdvance("M");
     mNonAsciiFontMetrics = QFontMetrics(newNonAsciiFont);
+    resetCharColumns();
 }
 
 void Document::setTabWidth(int newTabWidth)
@@ -591,87 +740,70 @@ void Document::loadFromFile(const QString& filename, const QByteArray& encoding,
     beginUpdate();
     internalClear();
     auto action = finally([this]{
-        if (mLines.count()>0)
-            emit inserted(0,mLines.count());
+        if (internalLineCount()>0)
+            emit inserted(0,internalLineCount());
         endUpdate();
     });
     mIndexOfLongestLine = -1;
+    if (file.size() >= SYN_MAPPED_FILE_MIN_SIZE) {
+        PMappedFile mappedFile = std::make_shared<MappedFile>(filename);
+        if (mappedFile->open(encoding, realEncoding)) {
+            mMappedFile = mappedFile;
+            mNewlineType = mappedFile->newlineType();
+            return;
+        }
+    }
+    // read the whole file at once, then split and decode it in memory
+    QByteArray content = file.readAll();
+    const char* data = content.constData();
+    int start = 0;
+    QStringList lines;
     //test for utf8 / utf 8 bom
     if (encoding == ENCODING_AUTO_DETECT) {
-        if (file.atEnd()) {
+        if (content.isEmpty()) {
             realEncoding = ENCODING_ASCII;
             return;
         }
-        QByteArray line = file.readLine();
-        QTextCodec* codec;
-        QTextCodec::ConverterState state;
-        bool needReread = false;
-        bool allAscii = true;
         //test for BOM
-        if ((line.length()>=3) && ((unsigned char)line[0]==0xEF) && ((unsigned char)line[1]==0xBB) && ((unsigned char)line[2]==0xBF) ) {
+        if ((content.length()>=3) && ((unsigned char)data[0]==0xEF) && ((unsigned char)data[1]==0xBB) && ((unsigned char)data[2]==0xBF) ) {
             realEncoding = ENCODING_UTF8_BOM;
-            line = line.mid(3);
-            codec = QTextCodec::codecForName(ENCODING_UTF8);
-        } else if ((line.length()>=4) && ((unsigned char)line[0]==0xFF) && ((unsigned char)line[1]==0xFE)
-                   && ((unsigned char)line[2]==0x00)
-                   && ((unsigned char)line[3]==0x00)) {
+            start = 3;
+        } else if ((content.length()>=4) && ((unsigned char)data[0]==0xFF) && ((unsigned char)data[1]==0xFE)
+                   && ((unsigned char)data[2]==0x00)
+                   && ((unsigned char)data[3]==0x00)) {
             realEncoding = ENCODING_UTF32_BOM;
-            loadUTF32BOMFile(file);
+            loadUTF32BOMFile(content);
             return;
-        } else if ((line.length()>=2) && ((unsigned char)line[0]==0xFF) && ((unsigned char)line[1]==0xFE)) {
+        } else if ((content.length()>=2) && ((unsigned char)data[0]==0xFF) && ((unsigned char)data[1]==0xFE)) {
             realEncoding = ENCODING_UTF16_BOM;
-            loadUTF16BOMFile(file);
+            loadUTF16BOMFile(content);
             return;
         } else {
             realEncoding = ENCODING_UTF8;
-            codec = QTextCodec::codecForName(ENCODING_UTF8);
         }
+        QTextCodec* codec = QTextCodec::codecForName(ENCODING_UTF8);
         if (!codec)
             throw FileError(tr("Can't load codec '%1'!").arg(QString(realEncoding)));
-        if (line.endsWith("\r\n")) {
-            mNewlineType = NewlineType::Windows;
-        } else if (line.endsWith("\n")) {
-            mNewlineType = NewlineType::Unix;
-        } else if (line.endsWith("\r")) {
-            mNewlineType = NewlineType::MacOld;
-        }
-
-        internalClear();
-        while (true) {
-            if (line.endsWith("\r\n")) {
-                line.remove(line.length()-2,2);
-            } else if (line.endsWith("\r")) {
-                line.remove(line.length()-1,1);
-            } else if (line.endsWith("\n")){
-                line.remove(line.length()-1,1);
-            }
-            if (isBinaryContent(line))
-                throw BinaryFileError(tr("'%1' is a binaray File!").arg(filename));
-            if (allAscii) {
-                allAscii = isTextAllAscii(line);
-            }
-            if (allAscii) {
-                addItem(QString::fromLatin1(line));
-            } else {
-                QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
-                if (state.invalidChars>0) {
-                    needReread = true;
-                    break;
-                }
-                addItem(newLine);
-            }
-            if (file.atEnd()){
-                break;
-            }
-            line = file.readLine();
+        bool allAscii;
+        bool binary;
+        scanContent(data + start, content.length() - start, allAscii, binary);
+        if (binary)
+            throw BinaryFileError(tr("'%1' is a binaray File!").arg(filename));
+        QVector<LineRange> ranges = splitLines(data, start, content.length(), mNewlineType);
+        if (allAscii) {
+            decodeLines(data, ranges, nullptr, false, lines);
+            appendLines(lines);
+            realEncoding = ENCODING_ASCII;
+            return;
         }
-        if (!needReread) {
-            if (allAscii)
-                realEncoding = ENCODING_ASCII;
+        if (decodeLines(data, ranges, codec, true, lines)) {
+            appendLines(lines);
             return;
         }
         realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
-        if (tryLoadFileByEncoding(realEncoding,file)) {
+        codec = QTextCodec::codecForName(realEncoding);
+        if (codec && decodeLines(data, ranges, codec, true, lines)) {
+            appendLines(lines);
             return;
         }
         QList<PCharsetInfo> charsets = pCharsetInfoManager->findCharsetByLocale(pCharsetInfoManager->localeName());
@@ -685,9 +817,11 @@ void Document::loadFromFile(const QString& filename, const QByteArray& encoding,
             foreach (const QByteArray& encodingName,encodingSet) {
                 if (encodingName == ENCODING_UTF8)
                     continue;
-                if (tryLoadFileByEncoding(encodingName,file)) {
+                codec = QTextCodec::codecForName(encodingName);
+                if (codec && decodeLines(data, ranges, codec, true, lines)) {
                     //qDebug()<<encodingName;
                     realEncoding = encodingName;
+                    appendLines(lines);
                     return;
                 }
             }
@@ -699,27 +833,34 @@ void Document::loadFromFile(const QString& filename, const QByteArray& encoding,
     if (realEncoding == ENCODING_SYSTEM_DEFAULT) {
         realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
     }
-    file.reset();
-    QTextStream textStream(&file);
+    if (realEncoding == ENCODING_UTF16_BOM) {
+        loadUTF16BOMFile(content);
+        return;
+    } else if (realEncoding == ENCODING_UTF32_BOM) {
+        loadUTF32BOMFile(content);
+        return;
+    } else if (realEncoding == ENCODING_UTF16 || realEncoding == ENCODING_UTF32) {
+        // '\n' bytes may be a part of a char, decode the whole content
+        QTextCodec* codec = QTextCodec::codecForName(realEncoding);
+        if (codec)
+            setText(codec->toUnicode(content));
+        return;
+    }
+    QTextCodec* codec;
     if (realEncoding == ENCODING_UTF8_BOM) {
-        textStream.setAutoDetectUnicode(true);
-        textStream.setCodec(ENCODING_UTF8);
+        codec = QTextCodec::codecForName(ENCODING_UTF8);
+        if ((content.length()>=3) && ((unsigned char)data[0]==0xEF) && ((unsigned char)data[1]==0xBB) && ((unsigned char)data[2]==0xBF) )
+            start = 3;
+    } else if (realEncoding == ENCODING_ASCII) {
+        codec = nullptr;
     } else {
-        textStream.setAutoDetectUnicode(false);
-        textStream.setCodec(realEncoding);
-    }
-    QString line;
-    internalClear();
-    while (textStream.readLineInto(&line)) {
-        if (line.endsWith("\r\n")) {
-            line.remove(line.length()-2,2);
-        } else if (line.endsWith("\r")) {
-            line.remove(line.length()-1,1);
-        } else if (line.endsWith("\n")){
-            line.remove(line.length()-1,1);
-        }
-        addItem(line);
+        codec = QTextCodec::codecForName(realEncoding);
+        if (!codec)
+            codec = QTextCodec::codecForLocale();
     }
+    decodeLines(data, splitLines(data, start, content.length(), mNewlineType),
+                codec, false, lines);
+    appendLines(lines);
 }
 
 
@@ -754,7 +895,7 @@ void Document::saveToFile(QFile &file, const QByteArray& encoding,
 
     if (!file.open(QFile::WriteOnly | QFile::Truncate))
         throw FileError(tr("Can't open file '%1' for save!").arg(file.fileName()));
-    if (mLines.isEmpty())
+    if (internalLineCount()==0)
         return;
     if (realEncoding == ENCODING_UTF16) {
         saveUTF16File(file,codec);
@@ -769,8 +910,9 @@ void Document::saveToFile(QFile &file, const QByteArray& encoding,
     }
     bool allAscii = true;
     QByteArray data;
-    for (PDocumentLine& line:mLines) {
-        QString text = line->lineText+lineBreak();
+    int lineCount = internalLineCount();
+    for (int i=0;i<lineCount;i++) {
+        QString text = internalLine(i)+lineBreak();
         data = codec->fromUnicode(text);
         if (allAscii) {
             allAscii = (data==text.toLatin1());
@@ -789,9 +931,41 @@ void Document::saveToFile(QFile &file, const QByteArray& encoding,
     }
 }
 
+// tests 4 chars at a time
+static bool isAsciiString(const QString& s)
+{
+    const ushort* data = reinterpret_cast<const ushort*>(s.constData());
+    int len = s.length();
+    int i=0;
+    for (;i+4<=len;i+=4) {
+        quint64 chars;
+        memcpy(&chars, data+i, sizeof(chars));
+        if (chars & Q_UINT64_C(0xFF80FF80FF80FF80))
+            return false;
+    }
+    for (;i<len;i++) {
+        if (data[i]>=0x80)
+            return false;
+    }
+    return true;
+}
+
 int Document::stringColumns(const QString &line, int colsBefore) const
 {
     int columns = std::max(0,colsBefore);
+    if (mAsciiSingleColumn && isAsciiString(line)
+            && (mLatin1Columns[0x7F]==1 || !line.contains(QChar(0x7F)))) {
+        // only the tabs are wider than one column
+        int start = 0;
+        int tabPos;
+        while ((tabPos = line.indexOf('\t', start))>=0) {
+            columns += tabPos - start;
+            columns += mTabWidth - columns % mTabWidth;
+            start = tabPos + 1;
+        }
+        columns += line.length() - start;
+        return columns-colsBefore;
+    }
     int charCols;
     for (int i=0;i<line.length();i++) {
         QChar ch = line[i];
@@ -806,6 +980,18 @@ int Document::stringColumns(const QString &line, int colsBefore) const
 }
 
 int Document::charColumns(QChar ch) const
+{
+    if (ch.unicode()<256)
+        return mLatin1Columns[ch.unicode()];
+    auto it = mCharColumns.constFind(ch.unicode());
+    if (it != mCharColumns.constEnd())
+        return it.value();
+    int columns = calculateCharColumns(ch);
+    mCharColumns.insert(ch.unicode(), columns);
+    return columns;
+}
+
+int Document::calculateCharColumns(QChar ch) const
 {
     if (ch.unicode()<=32)
         return 1;
@@ -818,6 +1004,17 @@ int Document::charColumns(QChar ch) const
     return std::ceil(width / (double)mCharWidth);
 }
 
+void Document::resetCharColumns()
+{
+    mCharColumns.clear();
+    mAsciiSingleColumn = true;
+    for (int i=0;i<256;i++) {
+        mLatin1Columns[i] = calculateCharColumns(QChar(i));
+        if (i<0x7F && i!='\t' && mLatin1Columns[i]!=1)
+            mAsciiSingleColumn = false;
+    }
+}
+
 void Document::putTextStr(const QString &text)
 {
     beginUpdate();
@@ -847,9 +1044,11 @@ void Document::putTextStr(const QString &text)
 
 void Document::internalClear()
 {
-    if (!mLines.isEmpty()) {
+    int oldCount = internalLineCount();
+    mMappedFile.reset();
+    mLongestLineColumns = -1;
+    if (oldCount>0) {
         beginUpdate();
-        int oldCount = mLines.count();
         mIndexOfLongestLine = -1;
         mLines.clear();
         emit deleted(0,oldCount);
@@ -857,6 +1056,40 @@ void Document::internalClear()
     }
 }
 
+int Document::internalLineCount() const
+{
+    if (mMappedFile)
+        return mMappedFile->lineCount();
+    return mLines.count();
+}
+
+QString Document::internalLine(int index) const
+{
+    if (mMappedFile)
+        return mMappedFile->line(index);
+    return mLines[index].lineText;
+}
+
+void Document::unmapFile()
+{
+    if (!mMappedFile)
+        return;
+    // the document is being edited, keep all its lines in memory from now on
+    PMappedFile mappedFile = mMappedFile;
+    mMappedFile.reset();
+    mLongestLineColumns = -1;
+    mIndexOfLongestLine = -1;
+    // lines cut off by another process can't be read any more, they are kept
+    // empty so the line count doesn't change
+    int readableCount = mappedFile->readableLineCount();
+    for (int i=0;i<mappedFile->lineCount();i++) {
+        if (i < readableCount)
+            mLines.append(mappedFile->line(i));
+        else
+            mLines.append(QString());
+    }
+}
+
 NewlineType Document::getNewlineType()
 {
     QMutexLocker locker(&mMutex);
@@ -872,16 +1105,17 @@ void Document::setNewlineType(const NewlineType &fileEndingType)
 bool Document::empty()
 {
     QMutexLocker locker(&mMutex);
-    return mLines.count()==0;
+    return internalLineCount()==0;
 }
 
 void Document::resetColumns()
 {
     QMutexLocker locker(&mMutex);
     mIndexOfLongestLine = -1;
+    mLongestLineColumns = -1;
     if (mLines.count() > 0 ) {
-        for (int i=0;i<mLines.size();i++) {
-            mLines[i]->columns = -1;
+        for (int i=0;i<mLines.count();i++) {
+            mLines[i].columns = -1;
         }
     }
 }
@@ -890,18 +1124,12 @@ void Document::invalidAllLineColumns()
 {
     QMutexLocker locker(&mMutex);
     mIndexOfLongestLine = -1;
-    for (PDocumentLine& line:mLines) {
-        line->columns = -1;
+    mLongestLineColumns = -1;
+    for (int i=0;i<mLines.count();i++) {
+        mLines[i].columns = -1;
     }
 }
 
-DocumentLine::DocumentLine():
-    lineText(),
-    syntaxState(),
-    columns(-1)
-{
-}
-
 
 UndoList::UndoList():QObject()
 {
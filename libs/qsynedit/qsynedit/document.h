@@ -22,34 +22,27 @@
 #include <QFontMetrics>
 #include <QMutex>
 #include <QVector>
+#include <QHash>
 #include <memory>
 #include <QFile>
 #include "miscprocs.h"
 #include "types.h"
 #include "qt_utils/utils.h"
+#include "documentlines.h"
+#include "mappedfile.h"
 
 namespace QSynedit {
 
-struct DocumentLine {
-  QString lineText;
-  SyntaxState syntaxState;
-  int columns;  //
-public:
-  explicit DocumentLine();
-  DocumentLine(const DocumentLine&)=delete;
-  DocumentLine& operator=(const DocumentLine&)=delete;
-};
-
-typedef std::shared_ptr<DocumentLine> PDocumentLine;
-
-typedef QVector<PDocumentLine> DocumentLines;
-
-typedef std::shared_ptr<DocumentLines> PDocumentLines;
-
 class Document;
 
 typedef std::shared_ptr<Document> PDocument;
 
+/**
+ * Immutable copy of the lines of a document. The line strings are implicitly
+ * shared with the document, so taking a snapshot doesn't copy any text.
+ */
+typedef std::shared_ptr<const QStringList> PDocumentSnapshot;
+
 class BinaryFileError : public FileError {
 public:
     explicit BinaryFileError (const QString& reason);
@@ -76,10 +69,25 @@ public:
     void setSyntaxState(int index, const SyntaxState& range);
     QString getLine(int index);
     int count();
+    /**
+     * @brief Is the document a read-only view of a large file?
+     *
+     * Files larger than SYN_MAPPED_FILE_MIN_SIZE are memory mapped by
+     * loadFromFile(), and their lines are decoded when requested. The lines
+     * are loaded into memory if the document is modified.
+     */
+    bool isMapped();
     QString text();
     void setText(const QString& text);
     void setContents(const QStringList& text);
     QStringList contents();
+    /**
+     * @brief The lines of the document at this moment.
+     *
+     * Safe to be called from other threads. The same snapshot is returned
+     * until the document is modified.
+     */
+    PDocumentSnapshot snapshot();
 
     void putLine(int index, const QString& s, bool notify=true);
 
@@ -138,14 +146,21 @@ protected:
     void putTextStr(const QString& text);
     void internalClear();
 private:
-    bool tryLoadFileByEncoding(QByteArray encodingName, QFile& file);
-    void loadUTF16BOMFile(QFile& file);
-    void loadUTF32BOMFile(QFile& file);
+    void invalidateSnapshot();
+    int internalLineCount() const;
+    QString internalLine(int index) const;
+    void unmapFile();
+    void appendLines(const QStringList& lines);
+    void loadUTF16BOMFile(const QByteArray& content);
+    void loadUTF32BOMFile(const QByteArray& content);
     void saveUTF16File(QFile& file, QTextCodec* codec);
     void saveUTF32File(QFile& file, QTextCodec* codec);
+    int calculateCharColumns(QChar ch) const;
+    void resetCharColumns();
 
 private:
     DocumentLines mLines;
+    PMappedFile mMappedFile;
 
     //SynEdit* mEdit;
 
@@ -153,11 +168,18 @@ private:
     QFontMetrics mNonAsciiFontMetrics;
     int mTabWidth;
     int mCharWidth;
+    // columns of the latin-1 chars
+    int mLatin1Columns[256];
+    // all ascii chars but tab and DEL take one column
+    bool mAsciiSingleColumn;
+    // columns of the other chars, added when they are used
+    mutable QHash<ushort,int> mCharColumns;
     //int mCount;
     //int mCapacity;
     NewlineType mNewlineType;
     bool mAppendNewLineAtEOF;
     int mIndexOfLongestLine;
+    int mLongestLineColumns; // only used by mapped files
     int mUpdateCount;
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
     QRecursiveMutex mMutex;
@@ -165,6 +187,8 @@ private:
     QMutex mMutex;
 #endif
 
+    PDocumentSnapshot mSnapshot;
+
     int calculateLineColumns(int Index);
 };
 
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "documentlines.h"
+#include <algorithm>
+
+namespace QSynedit {
+
+static const PSyntaxState& emptySyntaxState()
+{
+    static const PSyntaxState state = std::make_shared<const SyntaxState>();
+    return state;
+}
+
+DocumentLine::DocumentLine():
+    lineText(),
+    syntaxState(emptySyntaxState()),
+    columns(-1)
+{
+}
+
+DocumentLine::DocumentLine(const QString &text):
+    lineText(text),
+    syntaxState(emptySyntaxState()),
+    columns(-1)
+{
+}
+
+DocumentLines::DocumentLines():
+    mFirstInvalidChunkStart{0},
+    mLastChunk{0},
+    mCount{0}
+{
+}
+
+DocumentLine &DocumentLines::operator[](int index)
+{
+    int chunk, offset;
+    locate(index, chunk, offset);
+    return mChunks[chunk][offset];
+}
+
+const DocumentLine &DocumentLines::operator[](int index) const
+{
+    int chunk, offset;
+    locate(index, chunk, offset);
+    return mChunks[chunk][offset];
+}
+
+void DocumentLines::append(const QString &lineText)
+{
+    if (mChunks.isEmpty() || mChunks.back().count() >= MaxChunkSize) {
+        if (mFirstInvalidChunkStart == mChunks.count())
+            mFirstInvalidChunkStart++;
+        mChunkStarts.append(mCount);
+        mChunks.append(QVector<DocumentLine>());
+        mChunks.back().reserve(MaxChunkSize);
+    }
+    mChunks.back().append(DocumentLine(lineText));
+    mCount++;
+}
+
+void DocumentLines::insert(int index, const QString &lineText)
+{
+    if (index >= mCount) {
+        append(lineText);
+        return;
+    }
+    int chunk, offset;
+    locate(index, chunk, offset);
+    mChunks[chunk].insert(offset, DocumentLine(lineText));
+    mCount++;
+    invalidateChunkStarts(chunk+1);
+    if (mChunks[chunk].count() > MaxChunkSize)
+        splitChunk(chunk);
+}
+
+void DocumentLines::insert(int index, int count)
+{
+    if (count<=0)
+        return;
+    if (index >= mCount) {
+        for (int i=0;i<count;i++)
+            append(QString());
+        return;
+    }
+    int chunk, offset;
+    locate(index, chunk, offset);
+    mChunks[chunk].insert(offset, count, DocumentLine());
+    mCount += count;
+    invalidateChunkStarts(chunk+1);
+    if (mChunks[chunk].count() > MaxChunkSize)
+        splitChunk(chunk);
+}
+
+void DocumentLines::remove(int index, int count)
+{
+    count = std::min(count, mCount - index);
+    if (index < 0 || count <= 0)
+        return;
+    int chunk, offset;
+    locate(index, chunk, offset);
+    mCount -= count;
+    // lines at the end of the first chunk
+    int n = std::min(count, mChunks[chunk].count() - offset);
+    mChunks[chunk].remove(offset, n);
+    count -= n;
+    if (!mChunks[chunk].isEmpty())
+        chunk++;
+    // chunks removed as a whole (including the first one if it's emptied)
+    int last = chunk;
+    while (last < mChunks.count() && count >= mChunks[last].count()) {
+        count -= mChunks[last].count();
+        last++;
+    }
+    mChunks.remove(chunk, last - chunk);
+    mChunkStarts.remove(chunk, last - chunk);
+    // lines at the start of the last chunk
+    if (count > 0)
+        mChunks[chunk].remove(0, count);
+    invalidateChunkStarts(chunk);
+
+    // don't leave small chunks around after the lines are deleted
+    if (chunk > 0 && chunk < mChunks.count()
+            && mChunks[chunk-1].count() + mChunks[chunk].count() <= MaxChunkSize / 2) {
+        mChunks[chunk-1].append(mChunks[chunk]);
+        mChunks.remove(chunk);
+        mChunkStarts.remove(chunk);
+    }
+}
+
+void DocumentLines::clear()
+{
+    mChunks.clear();
+    mChunkStarts.clear();
+    mFirstInvalidChunkStart = 0;
+    mLastChunk = 0;
+    mCount = 0;
+}
+
+void DocumentLines::reserve(int count)
+{
+    int chunkCount = (count + MaxChunkSize - 1) / MaxChunkSize;
+    mChunks.reserve(chunkCount);
+    mChunkStarts.reserve(chunkCount);
+}
+
+void DocumentLines::locate(int index, int &chunk, int &offset) const
+{
+    Q_ASSERT(index >= 0 && index < mCount);
+    updateChunkStarts();
+    chunk = mLastChunk;
+    if (chunk >= mChunks.count()
+            || index < mChunkStarts[chunk]
+            || index >= mChunkStarts[chunk] + mChunks[chunk].count()) {
+        // lines are mostly visited in order
+        if (chunk + 1 < mChunks.count()
+                && index >= mChunkStarts[chunk+1]
+                && index < mChunkStarts[chunk+1] + mChunks[chunk+1].count()) {
+            chunk++;
+        } else {
+            chunk = std::upper_bound(mChunkStarts.cbegin(), mChunkStarts.cend(), index)
+                    - mChunkStarts.cbegin() - 1;
+        }
+        mLastChunk = chunk;
+    }
+    offset = index - mChunkStarts[chunk];
+}
+
+void DocumentLines::updateChunkStarts() const
+{
+    if (mFirstInvalidChunkStart >= mChunks.count())
+        return;
+    int i = mFirstInvalidChunkStart;
+    int start = 0;
+    if (i > 0)
+        start = mChunkStarts[i-1] + mChunks[i-1].count();
+    for (;i<mChunks.count();i++) {
+        mChunkStarts[i] = start;
+        start += mChunks[i].count();
+    }
+    mFirstInvalidChunkStart = mChunks.count();
+}
+
+void DocumentLines::splitChunk(int chunk)
+{
+    // leave room in the new chunks for the following insertions
+    const int pieceSize = MaxChunkSize / 2;
+    const QVector<DocumentLine> lines = mChunks[chunk];
+    QVector<QVector<DocumentLine>> chunks;
+    chunks.reserve(mChunks.count() + lines.count() / pieceSize);
+    chunks.append(mChunks.mid(0, chunk));
+    for (int i=0;i<lines.count();i+=pieceSize)
+        chunks.append(lines.mid(i, pieceSize));
+    chunks.append(mChunks.mid(chunk + 1));
+    mChunks = chunks;
+    mChunkStarts.resize(mChunks.count());
+    invalidateChunkStarts(chunk + 1);
+}
+
+void DocumentLines::invalidateChunkStarts(int chunk)
+{
+    mFirstInvalidChunkStart = std::min(mFirstInvalidChunkStart, chunk);
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DOCUMENTLINES_H
+#define DOCUMENTLINES_H
+
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "syntaxer/syntaxer.h"
+
+namespace QSynedit {
+
+/**
+ * Syntax states are immutable once stored, so lines with equal states
+ * (most lines inside a block) share the same instance.
+ */
+typedef std::shared_ptr<const SyntaxState> PSyntaxState;
+
+struct DocumentLine {
+  QString lineText;
+  PSyntaxState syntaxState;
+  int columns;  //
+public:
+  explicit DocumentLine();
+  explicit DocumentLine(const QString& text);
+};
+
+/**
+ * @brief Lines of a document, stored in chunks of at most MaxChunkSize lines.
+ *
+ * Inserting or deleting lines only moves the lines in the changed chunk and
+ * the start indexes of the chunks after it, instead of the whole document.
+ * Access by index is a binary search over the chunk starts, and is O(1) when
+ * the lines are visited in order.
+ */
+class DocumentLines
+{
+public:
+    explicit DocumentLines();
+    int count() const {
+        return mCount;
+    }
+    bool isEmpty() const {
+        return mCount == 0;
+    }
+    DocumentLine& operator[](int index);
+    const DocumentLine& operator[](int index) const;
+
+    void append(const QString& lineText);
+    void insert(int index, const QString& lineText);
+    /**
+     * @brief insert count empty lines before index
+     */
+    void insert(int index, int count);
+    void remove(int index, int count);
+    void clear();
+    /**
+     * @brief allocate the chunk list for count lines in advance
+     */
+    void reserve(int count);
+private:
+    void locate(int index, int& chunk, int& offset) const;
+    void updateChunkStarts() const;
+    void splitChunk(int chunk);
+    void invalidateChunkStarts(int chunk);
+private:
+    static const int MaxChunkSize = 512;
+    QVector<QVector<DocumentLine>> mChunks;
+    mutable QVector<int> mChunkStarts;
+    mutable int mFirstInvalidChunkStart;
+    mutable int mLastChunk; // chunk found by the last lookup
+    int mCount;
+};
+
+}
+
+#endif // DOCUMENTLINES_H
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "mappedfile.h"
+#include <QRunnable>
+#include <QTextCodec>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstring>
+
+namespace QSynedit {
+
+// bytes checked for binary content and line breaks before the file is indexed
+static const qint64 ProbeSize = 64*1024;
+// files smaller than this are indexed in one thread
+static const qint64 MinParallelScanSize = 4*1024*1024;
+
+namespace {
+/**
+ * @brief check the characters starting in data[from, to)
+ *
+ * The last character may end after to. Bytes continuing a character started
+ * before from are skipped, they are checked with that character.
+ */
+bool isValidUtf8(const uchar* data, qint64 from, qint64 to, qint64 size, bool skipContinuation)
+{
+    const uchar* p = data + from;
+    const uchar* end = data + to;
+    const uchar* dataEnd = data + size;
+    if (skipContinuation) {
+        while (p < end && (*p & 0xC0) == 0x80)
+            p++;
+    }
+    while (p < end) {
+        if (*p < 0x80) {
+            // skip ASCII text 8 bytes at a time
+            quint64 word;
+            while (end - p >= 8) {
+                std::memcpy(&word, p, 8);
+                if (word & Q_UINT64_C(0x8080808080808080))
+                    break;
+                p += 8;
+            }
+            while (p < end && *p < 0x80)
+                p++;
+            continue;
+        }
+        int length;
+        uint ch;
+        if (*p >= 0xC2 && *p <= 0xDF) {
+            length = 2;
+            ch = *p & 0x1F;
+        } else if ((*p & 0xF0) == 0xE0) {
+            length = 3;
+            ch = *p & 0x0F;
+        } else if (*p >= 0xF0 && *p <= 0xF4) {
+            length = 4;
+            ch = *p & 0x07;
+        } else {
+            return false;
+        }
+        if (dataEnd - p < length)
+            return false;
+        for (int i=1;i<length;i++) {
+            if ((p[i] & 0xC0) != 0x80)
+                return false;
+            ch = (ch << 6) | (p[i] & 0x3F);
+        }
+        // overlong forms, surrogates and code points after U+10FFFF
+        if (length == 3 && (ch < 0x800 || (ch >= 0xD800 && ch <= 0xDFFF)))
+            return false;
+        if (length == 4 && (ch < 0x10000 || ch > 0x10FFFF))
+            return false;
+        p += length;
+    }
+    // a stray continuation byte after the last character
+    return p >= dataEnd || (*p & 0xC0) != 0x80;
+}
+
+class LineScanTask : public QRunnable {
+public:
+    LineScanTask(const uchar* data, qint64 from, qint64 to, qint64 size, bool checkUtf8, bool skipContinuation):
+        validUtf8{true},
+        mData{data},
+        mFrom{from},
+        mTo{to},
+        mSize{size},
+        mCheckUtf8{checkUtf8},
+        mSkipContinuation{skipContinuation}
+    {
+        setAutoDelete(false);
+    }
+    // start offsets of the lines beginning in [from, to]
+    QVector<qint64> lineStarts;
+    bool validUtf8;
+protected:
+    void run() override {
+        if (mCheckUtf8) {
+            validUtf8 = isValidUtf8(mData, mFrom, mTo, mSize, mSkipContinuation);
+            if (!validUtf8)
+                return;
+        }
+        // memchr() is vectorized by the C runtime
+        const uchar* p = mData + mFrom;
+        const uchar* end = mData + mTo;
+        while (p < end) {
+            p = static_cast<const uchar*>(std::memchr(p, '\n', end - p));
+            if (!p)
+                break;
+            p++;
+            if (p - mData < mSize)
+                lineStarts.append(p - mData);
+        }
+    }
+private:
+    const uchar* mData;
+    qint64 mFrom;
+    qint64 mTo;
+    qint64 mSize;
+    bool mCheckUtf8;
+    bool mSkipContinuation;
+};
+}
+
+MappedFile::MappedFile(const QString &filename):
+    mFile{filename},
+    mData{nullptr},
+    mSize{0},
+    mCodec{nullptr},
+    mNewlineType{NewlineType::Unix},
+    mLongestLine{0}
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+        mFile.unmap(const_cast<uchar*>(mData));
+}
+
+bool MappedFile::open(const QByteArray &encoding, QByteArray &realEncoding)
+{
+    if (!mFile.open(QFile::ReadOnly))
+        return false;
+    mSize = mFile.size();
+    mData = mFile.map(0, mSize);
+    if (!mData)
+        return false;
+    qint64 start = 0;
+    bool checkUtf8 = false;
+    if (mSize>=3 && mData[0]==0xEF && mData[1]==0xBB && mData[2]==0xBF) {
+        if (encoding != ENCODING_AUTO_DETECT && encoding != ENCODING_UTF8 && encoding != ENCODING_UTF8_BOM)
+            return false;
+        realEncoding = ENCODING_UTF8_BOM;
+        mCodec = QTextCodec::codecForName(ENCODING_UTF8);
+        start = 3;
+    } else if (mSize>=2 && mData[0]==0xFF && mData[1]==0xFE) {
+        return false;
+    } else if (encoding == ENCODING_AUTO_DETECT) {
+        // detecting the encoding would decode the whole file, it's validated
+        // as UTF-8 while the lines are indexed instead
+        realEncoding = ENCODING_UTF8;
+        mCodec = QTextCodec::codecForName(ENCODING_UTF8);
+        checkUtf8 = true;
+    } else if (encoding == ENCODING_UTF16 || encoding == ENCODING_UTF32) {
+        return false;
+    } else if (encoding == ENCODING_SYSTEM_DEFAULT) {
+        realEncoding = encoding;
+        mCodec = QTextCodec::codecForLocale();
+    } else {
+        realEncoding = encoding;
+        mCodec = QTextCodec::codecForName(encoding);
+    }
+    if (!mCodec)
+        return false;
+
+    QByteArray probe = QByteArray::fromRawData(reinterpret_cast<const char*>(mData + start),
+                                               std::min(mSize - start, ProbeSize));
+    if (isBinaryContent(probe))
+        return false;
+    int lf = probe.indexOf('\n');
+    int cr = probe.indexOf('\r');
+    if (cr>=0 && cr+1<probe.length() && probe[cr+1]!='\n')
+        return false;
+    if (lf>0 && probe[lf-1]=='\r')
+        mNewlineType = NewlineType::Windows;
+    else
+        mNewlineType = NewlineType::Unix;
+    return indexLines(start, checkUtf8);
+}
+
+int MappedFile::readableLineCount() const
+{
+    qint64 size = mFile.size();
+    if (size >= mSize)
+        return mLineStarts.count();
+    // lines ending after the new end of the file
+    auto it = std::upper_bound(mLineStarts.begin(), mLineStarts.end(), size);
+    return std::max(0, int(it - mLineStarts.begin()) - 1);
+}
+
+QString MappedFile::line(int index) const
+{
+    qint64 start = mLineStarts[index];
+    qint64 end = (index + 1 < mLineStarts.count()) ? mLineStarts[index+1] : mSize;
+    if (end > start && mData[end-1] == '\n')
+        end--;
+    if (end > start && mData[end-1] == '\r')
+        end--;
+    return mCodec->toUnicode(reinterpret_cast<const char*>(mData + start), end - start);
+}
+
+bool MappedFile::indexLines(qint64 start, bool checkUtf8)
+{
+    int threadCount = 1;
+    if (mSize - start >= MinParallelScanSize)
+        threadCount = std::max(1, QThread::idealThreadCount());
+    qint64 sliceSize = (mSize - start + threadCount - 1) / threadCount;
+    QList<LineScanTask*> tasks;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    for (qint64 from = start; from < mSize; from += sliceSize) {
+        LineScanTask* task = new LineScanTask(mData, from, std::min(from + sliceSize, mSize), mSize,
+                                              checkUtf8, from > start);
+        tasks.append(task);
+        pool.start(task);
+    }
+    pool.waitForDone();
+    foreach (const LineScanTask* task, tasks) {
+        if (!task->validUtf8) {
+            qDeleteAll(tasks);
+            return false;
+        }
+    }
+
+    int count = 1;
+    foreach (const LineScanTask* task, tasks) {
+        count += task->lineStarts.count();
+    }
+    mLineStarts.reserve(count);
+    mLineStarts.append(start);
+    foreach (const LineScanTask* task, tasks) {
+        mLineStarts.append(task->lineStarts);
+    }
+    qDeleteAll(tasks);
+
+    qint64 longestLength = 0;
+    mLongestLine = 0;
+    for (int i=0;i<mLineStarts.count();i++) {
+        qint64 length = ((i + 1 < mLineStarts.count()) ? mLineStarts[i+1] : mSize) - mLineStarts[i];
+        if (length > longestLength) {
+            longestLength = length;
+            mLongestLine = i;
+        }
+    }
+    return true;
+}
+
+}
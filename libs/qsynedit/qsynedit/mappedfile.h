@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "qt_utils/utils.h"
+
+class QTextCodec;
+
+namespace QSynedit {
+
+/**
+ * @brief Read-only view of a large file, used by Document instead of loading
+ *  all the lines.
+ *
+ * The file is memory mapped and only the start offset of each line is kept,
+ * lines are decoded when they are requested.
+ *
+ * The file must not be truncated while it's viewed. On Unix, reading the
+ * pages cut off by another process raises SIGBUS (Windows doesn't allow
+ * truncating a mapped file). The IDE reloads files changed on disk, and
+ * readableLineCount() is checked before all the lines are copied.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const QString& filename);
+    MappedFile(const MappedFile&)=delete;
+    MappedFile& operator=(const MappedFile&)=delete;
+    ~MappedFile();
+
+    /**
+     * @brief map the file and index its lines
+     * @return false if the file can't be viewed this way (can't be mapped,
+     *  binary content, UTF-16/32 encoded, not valid UTF-8 when the encoding
+     *  is auto detected, or old Mac OS line breaks), it should be loaded
+     *  normally then.
+     */
+    bool open(const QByteArray& encoding, QByteArray& realEncoding);
+
+    int lineCount() const {
+        return mLineStarts.count();
+    }
+    /**
+     * @brief count of the leading lines still in the file, if it's truncated
+     *  by another process after it's mapped
+     */
+    int readableLineCount() const;
+    QString line(int index) const;
+    int longestLine() const {
+        return mLongestLine;
+    }
+    NewlineType newlineType() const {
+        return mNewlineType;
+    }
+private:
+    bool indexLines(qint64 start, bool checkUtf8);
+private:
+    QFile mFile;
+    const uchar* mData;
+    qint64 mSize;
+    QVector<qint64> mLineStarts;
+    QTextCodec* mCodec;
+    NewlineType mNewlineType;
+    int mLongestLine;
+};
+
+using PMappedFile = std::shared_ptr<MappedFile>;
+
+}
+
+#endif // MAPPEDFILE_H
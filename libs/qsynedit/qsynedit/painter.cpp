@@ -594,7 +594,7 @@ void QSynEditPainter::paintHighlightToken(bool bFillToEOL)
 // record. This will paint any chars already stored if there is
 // a (visible) change in the attributes.
 void QSynEditPainter::addHighlightToken(const QString &token, int columnsBefore,
-                                           int tokenColumns, int cLine, PTokenAttribute attri, bool showGlyphs)
+                                           int tokenColumns, int cLine, int aChar, PTokenAttribute attri, bool showGlyphs)
 {
     bool bCanAppend;
     QColor foreground, background;
@@ -620,7 +620,7 @@ void QSynEditPainter::addHighlightToken(const QString &token, int columnsBefore,
         foreground = edit->mForegroundColor;
     }
 
-    edit->onPreparePaintHighlightToken(cLine,edit->mSyntaxer->getTokenPos()+1,
+    edit->onPreparePaintHighlightToken(cLine,aChar,
         token,attri,style,foreground,background);
 
     // Do we have to paint the old chars first, or can we just append?
@@ -789,6 +789,90 @@ void QSynEditPainter::getBraceColorAttr(int level, PTokenAttribute &attr)
         attr = oldAttr;
 }
 
+const PaintedLine *QSynEditPainter::getPaintedLine(const QString &sLine, int vLine, int lastChar)
+{
+    SyntaxState startState;
+    if (vLine == 1) {
+        edit->mSyntaxer->resetState();
+        startState = edit->mSyntaxer->getState();
+    } else {
+        startState = edit->mDocument->getSyntaxState(vLine-2);
+    }
+    PaintedLine* line = edit->mPaintedLines.object(vLine-1);
+    if (line && (line->eol || line->lexedColumns >= lastChar)
+            && line->startState == startState
+            && line->text == sLine)
+        return line;
+    line = new PaintedLine();
+    line->text = sLine;
+    line->startState = startState;
+    lexLine(*line, vLine, lastChar);
+    edit->mPaintedLines.insert(vLine-1, line);
+    return line;
+}
+
+void QSynEditPainter::lexLine(PaintedLine &line, int vLine, int lastChar)
+{
+    QString sToken;
+    int nTokenColumnsBefore = 0;
+    if (vLine == 1) {
+        edit->mSyntaxer->resetState();
+    } else {
+        edit->mSyntaxer->setState(line.startState);
+    }
+    edit->mSyntaxer->setLine(line.text, vLine - 1);
+    line.tokens.clear();
+    while (!edit->mSyntaxer->eol()) {
+        sToken = edit->mSyntaxer->getToken();
+        // Work-around buggy highlighters which return empty tokens.
+        if (sToken.isEmpty())  {
+            edit->mSyntaxer->next();
+            if (edit->mSyntaxer->eol())
+                break;
+            sToken = edit->mSyntaxer->getToken();
+            // Maybe should also test whether GetTokenPos changed...
+            if (sToken.isEmpty()) {
+                //qDebug()<<QSynEdit::tr("The highlighter seems to be in an infinite loop");
+                throw BaseError(QSynEdit::tr("The syntaxer seems to be in an infinite loop"));
+            }
+        }
+        // the rest of the line is not visible
+        if (nTokenColumnsBefore >= lastChar)
+            break;
+        PaintedToken token;
+        token.text = sToken;
+        token.pos = edit->mSyntaxer->getTokenPos();
+        token.columnsBefore = nTokenColumnsBefore;
+        token.columns = edit->stringColumns(sToken, nTokenColumnsBefore);
+        token.attr = edit->mSyntaxer->getTokenAttribute();
+        token.braceLevel = -1;
+        if (sToken == "["
+                || sToken == "("
+                || sToken == "{"
+                ) {
+            SyntaxState rangeState = edit->mSyntaxer->getState();
+            token.braceLevel = rangeState.bracketLevel
+                    +rangeState.braceLevel
+                    +rangeState.parenthesisLevel;
+        } else if (sToken == "]"
+                   || sToken == ")"
+                   || sToken == "}"
+                   ){
+            SyntaxState rangeState = edit->mSyntaxer->getState();
+            token.braceLevel = rangeState.bracketLevel
+                    +rangeState.braceLevel
+                    +rangeState.parenthesisLevel+1;
+        }
+        line.tokens.append(token);
+        nTokenColumnsBefore+=token.columns;
+        // Let the highlighter scan the next token.
+        edit->mSyntaxer->next();
+    }
+    line.lexedColumns = nTokenColumnsBefore;
+    line.eol = edit->mSyntaxer->eol();
+    line.braceLevel = edit->mSyntaxer->getState().braceLevel;
+}
+
 void QSynEditPainter::paintLines()
 {
     int cRow; // row index for the loop
@@ -936,96 +1020,65 @@ void QSynEditPainter::paintLines()
                   paintEditAreas(areaList);
               }
         } else {
-            // Initialize highlighter with line text and range info. It is
-            // necessary because we probably did not scan to the end of the last
-            // line - the internal highlighter range might be wrong.
-            if (vLine == 1) {
-                edit->mSyntaxer->resetState();
+            // Tokens lexed by the last paints are reused if the line didn't
+            // change. The line with the input method's preedit string is
+            // lexed each time, and not cached.
+            PaintedLine preeditLine;
+            const PaintedLine* paintedLine;
+            int lastLexedChar = std::max(vLastChar, edit->mLeftChar + edit->mCharsInWindow + 1);
+            if (bCurrentLine && edit->mInputPreeditString.length()>0) {
+                preeditLine.text = sLine;
+                if (vLine > 1)
+                    preeditLine.startState = edit->mDocument->getSyntaxState(vLine-2);
+                lexLine(preeditLine, vLine, lastLexedChar);
+                paintedLine = &preeditLine;
             } else {
-                edit->mSyntaxer->setState(
-                            edit->mDocument->getSyntaxState(vLine-2));
+                paintedLine = getPaintedLine(sLine, vLine, lastLexedChar);
             }
-            edit->mSyntaxer->setLine(sLine, vLine - 1);
             // Try to concatenate as many tokens as possible to minimize the count
             // of ExtTextOut calls necessary. This depends on the selection state
             // or the line having special colors. For spaces the foreground color
             // is ignored as well.
             mTokenAccu.columns = 0;
-            nTokenColumnsBefore = 0;
-            // Test first whether anything of this token is visible.
-            while (!edit->mSyntaxer->eol()) {
-                sToken = edit->mSyntaxer->getToken();
-                // Work-around buggy highlighters which return empty tokens.
-                if (sToken.isEmpty())  {
-                    edit->mSyntaxer->next();
-                    if (edit->mSyntaxer->eol())
-                        break;
-                    sToken = edit->mSyntaxer->getToken();
-                    // Maybe should also test whether GetTokenPos changed...
-                    if (sToken.isEmpty()) {
-                        //qDebug()<<QSynEdit::tr("The highlighter seems to be in an infinite loop");
-                        throw BaseError(QSynEdit::tr("The syntaxer seems to be in an infinite loop"));
-                    }
-                }
-                //nTokenColumnsBefore = edit->charToColumn(sLine,edit->mHighlighter->getTokenPos()+1)-1;
-                nTokenColumnLen = edit->stringColumns(sToken, nTokenColumnsBefore);
-                if (nTokenColumnsBefore + nTokenColumnLen >= vFirstChar) {
-                    if (nTokenColumnsBefore + nTokenColumnLen >= vLastChar) {
-                        if (nTokenColumnsBefore >= vLastChar)
-                            break; //*** BREAK ***
-                        nTokenColumnLen = vLastChar - nTokenColumnsBefore;
-                    }
-                    // It's at least partially visible. Get the token attributes now.
-                    attr = edit->mSyntaxer->getTokenAttribute();
-                    if (sToken == "["
-                            || sToken == "("
-                            || sToken == "{"
-                            ) {
-                        SyntaxState rangeState = edit->mSyntaxer->getState();
-                        getBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel
-                                          ,attr);
-                    } else if (sToken == "]"
-                               || sToken == ")"
-                               || sToken == "}"
-                               ){
-                        SyntaxState rangeState = edit->mSyntaxer->getState();
-                        getBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel+1,
-                                          attr);
-                    }
-                    if (bCurrentLine && edit->mInputPreeditString.length()>0) {
-                        int startPos = edit->mSyntaxer->getTokenPos()+1;
-                        int endPos = edit->mSyntaxer->getTokenPos() + sToken.length();
-                        //qDebug()<<startPos<<":"<<endPos<<" - "+sToken+" - "<<edit->mCaretX<<":"<<edit->mCaretX+edit->mInputPreeditString.length();
-                        if (!(endPos < edit->mCaretX
-                                || startPos >= edit->mCaretX+edit->mInputPreeditString.length())) {
-                            if (!preeditAttr) {
-                                preeditAttr = attr;
-                            } else {
-                                attr = preeditAttr;
-                            }
-                        }
-                    }
-                    bool showGlyph=false;
-                    if (attr && attr->tokenType() == TokenType::Space) {
-                        int pos = edit->mSyntaxer->getTokenPos();
-                        if (pos==0) {
-                            showGlyph = edit->mOptions.testFlag(eoShowLeadingSpaces);
-                        } else if (pos+sToken.length()==sLine.length()) {
-                            showGlyph = edit->mOptions.testFlag(eoShowTrailingSpaces);
+            foreach (const PaintedToken& token, paintedLine->tokens) {
+                nTokenColumnsBefore = token.columnsBefore;
+                nTokenColumnLen = token.columns;
+                // Test first whether anything of this token is visible.
+                if (nTokenColumnsBefore + nTokenColumnLen < vFirstChar)
+                    continue;
+                if (nTokenColumnsBefore >= vLastChar)
+                    break; //*** BREAK ***
+                if (nTokenColumnsBefore + nTokenColumnLen >= vLastChar)
+                    nTokenColumnLen = vLastChar - nTokenColumnsBefore;
+                // It's at least partially visible. Get the token attributes now.
+                attr = token.attr;
+                if (token.braceLevel>=0)
+                    getBraceColorAttr(token.braceLevel, attr);
+                if (bCurrentLine && edit->mInputPreeditString.length()>0) {
+                    int startPos = token.pos+1;
+                    int endPos = token.pos + token.text.length();
+                    //qDebug()<<startPos<<":"<<endPos<<" - "+sToken+" - "<<edit->mCaretX<<":"<<edit->mCaretX+edit->mInputPreeditString.length();
+                    if (!(endPos < edit->mCaretX
+                            || startPos >= edit->mCaretX+edit->mInputPreeditString.length())) {
+                        if (!preeditAttr) {
+                            preeditAttr = attr;
                         } else {
-                            showGlyph = edit->mOptions.testFlag(eoShowInnerSpaces);
+                            attr = preeditAttr;
                         }
                     }
-                    addHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-                      nTokenColumnLen, vLine,attr, showGlyph);
                 }
-                nTokenColumnsBefore+=nTokenColumnLen;
-                // Let the highlighter scan the next token.
-                edit->mSyntaxer->next();
+                bool showGlyph=false;
+                if (attr && attr->tokenType() == TokenType::Space) {
+                    if (token.pos==0) {
+                        showGlyph = edit->mOptions.testFlag(eoShowLeadingSpaces);
+                    } else if (token.pos+token.text.length()==sLine.length()) {
+                        showGlyph = edit->mOptions.testFlag(eoShowTrailingSpaces);
+                    } else {
+                        showGlyph = edit->mOptions.testFlag(eoShowInnerSpaces);
+                    }
+                }
+                addHighlightToken(token.text, nTokenColumnsBefore - (vFirstChar - FirstCol),
+                  nTokenColumnLen, vLine, token.pos+1, attr, showGlyph);
             }
 //            // Don't assume HL.GetTokenPos is valid after HL.GetEOL == True.
 //            //nTokenColumnsBefore += edit->stringColumns(sToken,nTokenColumnsBefore);
@@ -1039,7 +1092,7 @@ void QSynEditPainter::paintLines()
 //                    if (nTokenColumnLen > 0) {
 //                        sToken = edit->substringByColumns(sLine,nTokenColumnsBefore+1,nTokenColumnLen);
 //                        addHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-//                            nTokenColumnLen, vLine, PTokenAttribute(),false);
+//                            nTokenColumnLen, vLine, nTokenColumnsBefore+1, PTokenAttribute(),false);
 //                    }
 //                }
 //            }
@@ -1050,9 +1103,9 @@ void QSynEditPainter::paintLines()
                 sFold = edit->syntaxer()->foldString(sLine);
                 nFold = edit->stringColumns(sFold,edit->mDocument->lineColumns(vLine-1));
                 attr = edit->mSyntaxer->symbolAttribute();
-                getBraceColorAttr(edit->mSyntaxer->getState().braceLevel,attr);
+                getBraceColorAttr(paintedLine->braceLevel,attr);
                 addHighlightToken(sFold,edit->mDocument->lineColumns(vLine-1) - (vFirstChar - FirstCol)
-                  , nFold, vLine, attr,false);
+                  , nFold, vLine, sLine.length()+1, attr,false);
             } else  {
                 // Draw LineBreak glyph.
                 if (edit->mOptions.testFlag(eoShowLineBreaks)
@@ -1061,7 +1114,7 @@ void QSynEditPainter::paintLines()
                         && (edit->mDocument->lineColumns(vLine-1) < vLastChar)) {
                     addHighlightToken(LineBreakGlyph,
                       edit->mDocument->lineColumns(vLine-1)  - (vFirstChar - FirstCol),
-                      edit->charColumns(LineBreakGlyph),vLine, edit->mSyntaxer->whitespaceAttribute(),false);
+                      edit->charColumns(LineBreakGlyph),vLine, sLine.length()+1, edit->mSyntaxer->whitespaceAttribute(),false);
                 }
             }
             // Draw anything that's left in the TokenAccu record. Fill to the end
@@ -20,12 +20,37 @@
 #include <QColor>
 #include <QPainter>
 #include <QString>
+#include <QVector>
 #include "types.h"
 #include "syntaxer/syntaxer.h"
 #include "gutter.h"
 
 namespace QSynedit {
 class QSynEdit;
+
+struct PaintedToken {
+    QString text;
+    int pos; // 0-based char position in the line
+    int columnsBefore;
+    int columns;
+    PTokenAttribute attr;
+    int braceLevel; // rainbow color level if the token is a brace, else -1
+};
+
+/**
+ * @brief The tokens of a line lexed by the painter. They are reused by the
+ *  next paints while the text and the start syntax state of the line are
+ *  unchanged, so scrolling doesn't lex the lines again.
+ */
+struct PaintedLine {
+    QString text;
+    SyntaxState startState;
+    QVector<PaintedToken> tokens;
+    int lexedColumns; // columns covered by tokens
+    bool eol; // the whole line is lexed
+    int braceLevel; // brace level of the syntaxer when lexing stopped
+};
+
 class QSynEditPainter
 {
     struct SynTokenAccu {
@@ -58,7 +83,9 @@ private:
     void paintEditAreas(const EditingAreaList& areaList);
     void paintHighlightToken(bool bFillToEOL);
     void addHighlightToken(const QString& token, int columnsBefore, int tokenColumns,
-                           int cLine, PTokenAttribute p_Attri, bool showGlyphs);
+                           int cLine, int aChar, PTokenAttribute p_Attri, bool showGlyphs);
+    const PaintedLine* getPaintedLine(const QString& sLine, int vLine, int lastChar);
+    void lexLine(PaintedLine& line, int vLine, int lastChar);
 
     void paintFoldAttributes();
     void getBraceColorAttr(int level, PTokenAttribute &attr);
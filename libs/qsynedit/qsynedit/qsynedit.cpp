@@ -24,6 +24,7 @@
 #include <QPaintEvent>
 #include <QPainter>
 #include <QTimerEvent>
+#include <QElapsedTimer>
 #include "syntaxer/syntaxer.h"
 #include "constants.h"
 #include "painter.h"
@@ -43,7 +44,13 @@
 
 namespace QSynedit {
 QSynEdit::QSynEdit(QWidget *parent) : QAbstractScrollArea(parent),
+    mPaintedLines{SYN_PAINTED_LINES_CACHE_SIZE},
     mEditingCount{0},
+    mEditedFirstLine{-1},
+    mEditedLastLine{-1},
+    mEditedLineCountChanged{false},
+    mSyntaxScannedCount{0},
+    mFoldUpdateLine{INT_MAX},
     mDropped{false},
     mWheelAccumulatedDeltaX{0},
     mWheelAccumulatedDeltaY{0}
@@ -138,6 +145,10 @@ QSynEdit::QSynEdit(QWidget *parent) : QAbstractScrollArea(parent),
     //mScrollTimer->setInterval(100);
     connect(mScrollTimer, &QTimer::timeout,this, &QSynEdit::onScrollTimeout);
 
+    mSyntaxScanTimer = new QTimer(this);
+    mSyntaxScanTimer->setInterval(0);
+    connect(mSyntaxScanTimer, &QTimer::timeout,this, &QSynEdit::onSyntaxScanTimeout);
+
     qreal dpr=devicePixelRatioF();
     mContentImage = std::make_shared<QImage>(clientWidth()*dpr,clientHeight()*dpr,QImage::Format_ARGB32);
     mContentImage->setDevicePixelRatio(dpr);
@@ -348,6 +359,7 @@ bool QSynEdit::getTokenAttriAtRowCol(const BufferCoord &pos, QString &token, boo
     QString line;
     posY = pos.line - 1;
     if (mSyntaxer && (posY >= 0) && (posY < mDocument->count())) {
+        ensureSyntaxStateValid(posY);
         line = mDocument->getLine(posY);
         if (posY == 0) {
             mSyntaxer->resetState();
@@ -385,6 +397,7 @@ bool QSynEdit::getTokenAttriAtRowColEx(const BufferCoord &pos, QString &token, i
     QString line;
     posY = pos.line - 1;
     if (mSyntaxer && (posY >= 0) && (posY < mDocument->count())) {
+        ensureSyntaxStateValid(posY);
         line = mDocument->getLine(posY);
         if (posY == 0) {
             mSyntaxer->resetState();
@@ -440,6 +453,9 @@ void QSynEdit::doTrimTrailingSpaces()
 {
     if (mDocument->count()<=0)
         return;
+    // lines left to the background scan are lexed now, it's skipped in editing blocks
+    if (mSyntaxer)
+        ensureSyntaxStateValid(mDocument->count()-1);
     beginEditing();
     auto action=finally([this](){
         endEditing();
@@ -920,31 +936,16 @@ int QSynEdit::lineToRow(int aLine) const
 
 int QSynEdit::foldRowToLine(int Row) const
 {
-    int result = Row;
-    for (int i=0;i<mAllFoldRanges->count();i++) {
-        PCodeFoldingRange range = (*mAllFoldRanges)[i];
-        if (range->collapsed && !range->parentCollapsed() && range->fromLine < result) {
-            result += range->linesCollapsed;
-        }
-    }
-    return result;
+    if (!mCollapsedFoldIndex.isValid())
+        mCollapsedFoldIndex.rebuild(*mAllFoldRanges);
+    return mCollapsedFoldIndex.rowToLine(Row);
 }
 
 int QSynEdit::foldLineToRow(int Line) const
 {
-    int result = Line;
-    for (int i=mAllFoldRanges->count()-1;i>=0;i--) {
-        PCodeFoldingRange range =(*mAllFoldRanges)[i];
-        if (range->collapsed && !range->parentCollapsed()) {
-            // Line is found after fold
-            if (range->toLine < Line)
-                result -= range->linesCollapsed;
-            // Inside fold
-            else if (range->fromLine < Line && Line <= range->toLine)
-                result -= Line - range->fromLine;
-        }
-    }
-    return result;
+    if (!mCollapsedFoldIndex.isValid())
+        mCollapsedFoldIndex.rebuild(*mAllFoldRanges);
+    return mCollapsedFoldIndex.lineToRow(Line);
 }
 
 void QSynEdit::setDefaultKeystrokes()
@@ -1055,6 +1056,12 @@ void QSynEdit::invalidate()
     viewport()->update();
 }
 
+void QSynEdit::invalidatePaintedLines()
+{
+    mPaintedLines.clear();
+    invalidate();
+}
+
 void QSynEdit::lockPainter()
 {
     mPainterLock++;
@@ -1198,9 +1205,21 @@ bool QSynEdit::inputMethodOn()
 void QSynEdit::collapseAll()
 {
     incPaintLock();
+    // Redraw once when done, instead of once for each fold
+    // Inner folds first, so the caret is extracted to the outermost one
     for (int i = mAllFoldRanges->count()-1;i>=0;i--){
-        collapse((*mAllFoldRanges)[i]);
+        PCodeFoldingRange range = (*mAllFoldRanges)[i];
+        range->linesCollapsed = range->toLine - range->fromLine;
+        range->collapsed = true;
+        if ((mCaretY > range->fromLine) && (mCaretY <= range->toLine)) {
+            mCollapsedFoldIndex.invalidate();
+            setCaretXY(BufferCoord{mDocument->getLine(range->fromLine - 1).length() + 1,
+                                   range->fromLine});
+        }
     }
+    mCollapsedFoldIndex.invalidate();
+    invalidate();
+    updateScrollbars();
     decPaintLock();
 }
 
@@ -1208,8 +1227,13 @@ void QSynEdit::unCollpaseAll()
 {
     incPaintLock();
     for (int i = mAllFoldRanges->count()-1;i>=0;i--){
-        uncollapse((*mAllFoldRanges)[i]);
+        PCodeFoldingRange range = (*mAllFoldRanges)[i];
+        range->linesCollapsed = 0;
+        range->collapsed = false;
     }
+    mCollapsedFoldIndex.invalidate();
+    invalidate();
+    updateScrollbars();
     decPaintLock();
 }
 
@@ -1817,7 +1841,7 @@ void QSynEdit::endEditing()
     if (mEditingCount==0) {
         if (!mUndoing)
             mUndoList->endBlock();
-        reparseDocument();
+        scanEditedLines();
     }
     decPaintLock();
 }
@@ -3274,31 +3298,99 @@ void QSynEdit::updateModifiedStatus()
         emit statusChanged(StatusChange::scModifyChanged);
 }
 
-void QSynEdit::scanFrom(int index)
+int QSynEdit::scanFrom(int index, int canStopIndex, bool lineCountChanged)
 {
-    if (mEditingCount>0)
-        return;
+    // mapped documents are not highlighted
+    if (mEditingCount>0 || mDocument->isMapped())
+        return mDocument->count()-1;
 
     SyntaxState state;
     int idx = std::max(0,index);
     if (idx >= mDocument->count())
-        return;
+        return mDocument->count()-1;
+    // lines not scanned yet will be lexed when they are needed
+    if (idx >= mSyntaxScannedCount)
+        return std::min(canStopIndex, mDocument->count()-1);
 
     if (idx == 0) {
         mSyntaxer->resetState();
     } else {
         mSyntaxer->setState(mDocument->getSyntaxState(idx-1));
     }
+    int lastVisibleIndex = rowToLine(mTopLine + mLinesInWindow) - 1;
+    // folds containing inserted/deleted lines must be adjusted
+    bool foldsChanged = lineCountChanged;
+    // folds starting on the line before deleted lines are changed too
+    int foldFirstLine = lineCountChanged ? std::max(0, index - 1) : index;
     do {
+        SyntaxState oldState = mDocument->getSyntaxState(idx);
         mSyntaxer->setLine(mDocument->getLine(idx), idx);
         mSyntaxer->nextToEol();
         state = mSyntaxer->getState();
         mDocument->setSyntaxState(idx,state);
+        if (oldState.blockStarted != state.blockStarted
+                || oldState.blockEnded != state.blockEnded)
+            foldsChanged = true;
+        // lines after this one start from the same state as before, so their
+        // stored states are still valid
+        if (idx >= canStopIndex && state == oldState)
+            break;
+        // leave the lines below the viewport to the background scan
+        if (idx - index >= SYN_LAZY_SCAN_MIN_LINES && idx > lastVisibleIndex) {
+            mSyntaxScannedCount = idx + 1;
+            mFoldUpdateLine = std::min(mFoldUpdateLine, foldFirstLine);
+            mSyntaxScanTimer->start();
+            return mDocument->count()-1;
+        }
         idx ++ ;
-    } while (idx < mDocument->count());
-    if (mUseCodeFolding)
-        rescanFolds();
-    return ;
+    } while (idx < mSyntaxScannedCount);
+    idx = std::min(idx, mDocument->count()-1);
+    if (mUseCodeFolding && foldsChanged) {
+        if (mSyntaxScannedCount >= mDocument->count()) {
+            updateFoldRanges(foldFirstLine, idx);
+            invalidateGutter();
+        } else {
+            // folds are updated when the background scan is finished
+            mFoldUpdateLine = std::min(mFoldUpdateLine, foldFirstLine);
+        }
+    }
+    return idx;
+}
+
+void QSynEdit::ensureSyntaxStateValid(int index)
+{
+    if (!mSyntaxer || mEditingCount>0 || mDocument->isMapped())
+        return;
+    index = std::min(index, mDocument->count()-1);
+    if (index < mSyntaxScannedCount)
+        return;
+    int idx = mSyntaxScannedCount;
+    if (idx == 0) {
+        mSyntaxer->resetState();
+    } else {
+        mSyntaxer->setState(mDocument->getSyntaxState(idx-1));
+    }
+    while (idx <= index) {
+        mSyntaxer->setLine(mDocument->getLine(idx), idx);
+        mSyntaxer->nextToEol();
+        mDocument->setSyntaxState(idx, mSyntaxer->getState());
+        idx++;
+    }
+    mSyntaxScannedCount = idx;
+    if (mSyntaxScannedCount >= mDocument->count() && mSyntaxScanTimer->isActive()) {
+        mSyntaxScanTimer->stop();
+        int foldUpdateLine = mFoldUpdateLine;
+        mFoldUpdateLine = INT_MAX;
+        if (mUseCodeFolding) {
+            if (foldUpdateLine == 0) {
+                rescanFolds();
+            } else if (foldUpdateLine < mDocument->count()) {
+                // the lines after it are lexed again, their block marks may change
+                updateFoldRanges(foldUpdateLine, mDocument->count()-1);
+                invalidateGutter();
+            }
+        }
+    }
 }
 
 void QSynEdit::reparseLine(int line)
@@ -3323,26 +3415,61 @@ void QSynEdit::reparseLine(int line)
 
 void QSynEdit::reparseDocument()
 {
-    if (mSyntaxer && !mDocument->empty()) {
+    mPaintedLines.clear();
+    mSyntaxScanTimer->stop();
+    mSyntaxScannedCount = 0;
+    mFoldUpdateLine = 0;
+    if (mSyntaxer && !mDocument->empty() && !mDocument->isMapped()) {
+        if (mDocument->count() > SYN_LAZY_SCAN_MIN_LINES) {
+            // lex the lines up to the viewport now, and the rest on idle
+            ensureSyntaxStateValid(rowToLine(mTopLine + mLinesInWindow) - 1);
+            if (mSyntaxScannedCount < mDocument->count()) {
+                mSyntaxScanTimer->start();
+                return;
+            }
+        } else {
 //        qint64 begin=QDateTime::currentMSecsSinceEpoch();
-        mSyntaxer->resetState();
-        for (int i =0;i<mDocument->count();i++) {
-            mSyntaxer->setLine(mDocument->getLine(i), i);
-            mSyntaxer->nextToEol();
-            mDocument->setSyntaxState(i, mSyntaxer->getState());
-        }
+            mSyntaxer->resetState();
+            for (int i =0;i<mDocument->count();i++) {
+                mSyntaxer->setLine(mDocument->getLine(i), i);
+                mSyntaxer->nextToEol();
+                mDocument->setSyntaxState(i, mSyntaxer->getState());
+            }
 //        qint64 diff= QDateTime::currentMSecsSinceEpoch() - begin;
 
 //        qDebug()<<diff<<mDocument->count();
+        }
     }
+    mSyntaxScannedCount = mDocument->count();
+    mFoldUpdateLine = INT_MAX;
     if (mUseCodeFolding)
         rescanFolds();
 }
 
+void QSynEdit::scanEditedLines()
+{
+    if (mEditedFirstLine<0)
+        return;
+    int first = std::min(mEditedFirstLine, mDocument->count()-1);
+    int last = std::min(mEditedLastLine, mDocument->count()-1);
+    bool lineCountChanged = mEditedLineCountChanged;
+    mEditedFirstLine = -1;
+    mEditedLastLine = -1;
+    mEditedLineCountChanged = false;
+    if (mSyntaxer && mDocument->count() > 0) {
+        int lastLine = scanFrom(first, std::max(first, last), lineCountChanged);
+        if (lineCountChanged)
+            invalidateLines(first + 1, INT_MAX);
+        else
+            invalidateLines(first + 1, lastLine + 1);
+    }
+}
+
 void QSynEdit::uncollapse(PCodeFoldingRange FoldRange)
 {
     FoldRange->linesCollapsed = 0;
     FoldRange->collapsed = false;
+    mCollapsedFoldIndex.invalidate();
 
     // Redraw the collapsed line
     invalidateLines(FoldRange->fromLine, INT_MAX);
@@ -3356,6 +3483,7 @@ void QSynEdit::collapse(PCodeFoldingRange FoldRange)
 {
     FoldRange->linesCollapsed = FoldRange->toLine - FoldRange->fromLine;
     FoldRange->collapsed = true;
+    mCollapsedFoldIndex.invalidate();
 
     // Extract caret from fold
     if ((mCaretY > FoldRange->fromLine) && (mCaretY <= FoldRange->toLine)) {
@@ -3377,34 +3505,47 @@ void QSynEdit::foldOnListInserted(int Line, int Count)
     // Delete collapsed inside selection
     for (int i = mAllFoldRanges->count()-1;i>=0;i--) {
         PCodeFoldingRange range = (*mAllFoldRanges)[i];
-        if (range->fromLine == Line - 1) {// insertion starts at fold line
-            if (range->collapsed)
-                uncollapse(range);
-        } else if (range->fromLine >= Line) // insertion of count lines above FromLine
+        if (range->fromLine >= Line) { // insertion of count lines above FromLine
             range->move(Count);
+            continue;
+        }
+        if (range->fromLine == Line - 1 && range->collapsed) // insertion starts at fold line
+            uncollapse(range);
+        if (range->closingLine >= Line) // insertion inside the fold
+            range->moveEnd(Count);
     }
+    mCollapsedFoldIndex.invalidate();
 }
 
 void QSynEdit::foldOnListDeleted(int Line, int Count)
 {
-    // Delete collapsed inside selection
+    // Folds in the affected area are kept in place, with their lines inside it,
+    // until they are rescanned
     for (int i = mAllFoldRanges->count()-1;i>=0;i--) {
         PCodeFoldingRange range = (*mAllFoldRanges)[i];
-        if (range->fromLine == Line && Count == 1)  {// open up because we are messing with the starting line
+        if (range->fromLine >= Line + Count) { // Move after affected area
+            range->move(-Count);
+            continue;
+        }
+        if (range->fromLine >= Line - 1) { // open up because we are messing with the starting line
             if (range->collapsed)
                 uncollapse(range);
-        } else if (range->fromLine >= Line - 1 && range->fromLine < Line + Count) // delete inside affectec area
-            mAllFoldRanges->remove(i);
-        else if (range->fromLine >= Line + Count) // Move after affected area
-            range->move(-Count);
-
+            range->fromLine = std::min(range->fromLine, Line);
+        }
+        if (range->closingLine >= Line + Count) {
+            range->moveEnd(-Count);
+        } else if (range->closingLine >= Line) { // ends inside affected area
+            range->closingLine = Line;
+            range->toLine = std::max(range->fromLine, std::min(range->toLine, Line));
+        }
     }
-
+    mCollapsedFoldIndex.invalidate();
 }
 
 void QSynEdit::foldOnListCleared()
 {
     mAllFoldRanges->clear();
+    mCollapsedFoldIndex.invalidate();
 }
 
 void QSynEdit::rescanFolds()
@@ -3420,139 +3561,198 @@ void QSynEdit::rescanFolds()
     invalidateGutter();
 }
 
-void QSynEdit::rescanForFoldRanges()
-{
-    // Delete all uncollapsed folds
-//    for (int i=mAllFoldRanges.count()-1;i>=0;i--) {
-//        PSynEditFoldRange range =mAllFoldRanges[i];
-//        if (!range->collapsed && !range->parentCollapsed())
-//            mAllFoldRanges.remove(i);
-//    }
-
-    // Did we leave any collapsed folds and are we viewing a code file?
-    if (mAllFoldRanges->count() > 0) {
-        QMap<QString,PCodeFoldingRange> rangeIndexes;
-        foreach(const PCodeFoldingRange& r, mAllFoldRanges->ranges()) {
-            if (r->collapsed)
-                rangeIndexes.insert(QString("%1-%2").arg(r->fromLine).arg(r->toLine),r);
-        }
-        mAllFoldRanges->clear();
-        // Add folds to a separate list
-        PCodeFoldingRanges temporaryAllFoldRanges = std::make_shared<CodeFoldingRanges>();
-        scanForFoldRanges(temporaryAllFoldRanges);
-
-        PCodeFoldingRange tempFoldRange;
-        PCodeFoldingRange r2;
-        // Combine new with old folds, preserve parent order
-        for (int i = 0; i< temporaryAllFoldRanges->count();i++) {
-            tempFoldRange=temporaryAllFoldRanges->range(i);
-            r2=rangeIndexes.value(QString("%1-%2").arg(tempFoldRange->fromLine).arg(tempFoldRange->toLine),
-                                  PCodeFoldingRange());
-            if (r2) {
-                tempFoldRange->collapsed=true;
-                tempFoldRange->linesCollapsed=r2->linesCollapsed;
-            }
-            mAllFoldRanges->add(tempFoldRange);
-        }
-    } else {
-        // We ended up with no folds after deleting, just pass standard data...
-        PCodeFoldingRanges temp{mAllFoldRanges};
-        scanForFoldRanges(temp);
-    }
-}
+struct ScannedFold {
+    int fromLine;
+    int toLine;
+    int closingLine;
+    int parent; // index in the scanned folds, -1 for the parent of the scan
+    PCodeFoldingRange oldRange;
+};
 
-void QSynEdit::scanForFoldRanges(PCodeFoldingRanges topFoldRanges)
+// index of the last fold started before line index (0-based), -1 if none
+static int lastFoldStartingBefore(const CodeFoldingRanges& foldRanges, int index)
 {
-    PCodeFoldingRanges parentFoldRanges = topFoldRanges;
-//    qint64 begin=QDateTime::currentMSecsSinceEpoch();
-
-    findSubFoldRange(topFoldRanges, parentFoldRanges,PCodeFoldingRange());
-//    qint64 diff= QDateTime::currentMSecsSinceEpoch() - begin;
-//    qDebug()<<"?"<<diff;
+    const QVector<PCodeFoldingRange>& ranges = foldRanges.ranges();
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), index,
+                               [](const PCodeFoldingRange& range, int index) {
+        return range->fromLine - 1 < index;
+    });
+    return (it - ranges.begin()) - 1;
 }
 
-//this func should only be used in findSubFoldRange
-int QSynEdit::lineHasChar(int Line, int startChar, QChar character, const QString& tokenAttrName) {
-    QString CurLine = mDocument->getLine(Line);
-    if (!mSyntaxer){
-        for (int i=startChar; i<CurLine.length();i++) {
-            if (CurLine[i]==character) {
-                return i;
-            }
-        }
-
+void QSynEdit::rescanForFoldRanges()
+{
+    // folds in the lines not lexed yet are found after the background scan
+    rescanFoldRanges(PCodeFoldingRange(), 0, mSyntaxScannedCount - 1);
+    mCollapsedFoldIndex.invalidate();
+}
+
+void QSynEdit::updateFoldRanges(int first, int last)
+{
+    // Innermost fold around the changed lines
+    PCodeFoldingRange parent;
+    int i = lastFoldStartingBefore(*mAllFoldRanges, first);
+    if (i>=0) {
+        parent = (*mAllFoldRanges)[i];
+        while (parent && !(parent->closingLine > 0 && parent->closingLine - 1 > last))
+            parent = parent->parent.lock();
+    }
+    while (!rescanFoldRanges(parent, first, last))
+        parent = parent->parent.lock();
+    mCollapsedFoldIndex.invalidate();
+}
+
+bool QSynEdit::rescanFoldRanges(PCodeFoldingRange parent, int first, int last)
+{
+    // Start from a line where no fold under parent is open
+    int startLine = first;
+    PCodeFoldingRange openFold = foldOpenAtLine(parent, startLine);
+    while (openFold) {
+        startLine = openFold->fromLine - 1;
+        openFold = foldOpenAtLine(parent, startLine);
+    }
+    int startPos;
+    int skippedStarts = 0;
+    if (parent && startLine == parent->fromLine - 1) {
+        // Folds started after parent on its line are rescanned
+        startPos = lastFoldStartingBefore(*mAllFoldRanges, startLine) + 1;
+        while ((*mAllFoldRanges)[startPos] != parent)
+            startPos++;
+        startPos++;
+        skippedStarts = 1;
+        for (PCodeFoldingRange p = parent->parent.lock(); p && p->fromLine == parent->fromLine; p = p->parent.lock())
+            skippedStarts++;
     } else {
-        /*
-        mHighlighter->setState(mLines->ranges(Line),
-                               mLines->braceLevel(Line),
-                               mLines->bracketLevel(Line),
-                               mLines->parenthesisLevel(Line));
-        mHighlighter->setLine(CurLine,Line);
-        */
-        QString token;
-        while (!mSyntaxer->eol()) {
-            token = mSyntaxer->getToken();
-            PTokenAttribute attr = mSyntaxer->getTokenAttribute();
-            if (token == character && attr->name()==tokenAttrName)
-                return mSyntaxer->getTokenPos();
-            mSyntaxer->next();
-        }
-    }
-    return -1;
-}
-
-void QSynEdit::findSubFoldRange(PCodeFoldingRanges topFoldRanges, PCodeFoldingRanges& parentFoldRanges, PCodeFoldingRange parent)
-{
-    PCodeFoldingRange  collapsedFold;
-    int line = 0;
-    QString curLine;
-    if (!mSyntaxer)
-        return;
-
-    while (line < mDocument->count()) { // index is valid for LinesToScan and fLines
-        // If there is a collapsed fold over here, skip it
-//        collapsedFold = collapsedFoldStartAtLine(line + 1); // only collapsed folds remain
-//        if (collapsedFold) {
-//            line = collapsedFold->toLine;
-//            continue;
-//        }
+        startPos = lastFoldStartingBefore(*mAllFoldRanges, startLine) + 1;
+    }
 
-        // Find an opening character on this line
-        curLine = mDocument->getLine(line);
-        int blockEnded=mDocument->blockEnded(line);
-        int blockStarted=mDocument->blockStarted(line);
-        if (blockEnded>0) {
+    QVector<ScannedFold> folds;
+    QVector<int> openFolds;
+    int oldPos = startPos;
+    int stopLine = INT_MAX;
+    int line = startLine;
+    while (line < mSyntaxScannedCount) {
+        // parent ends on another line now
+        if (parent && parent->closingLine > 0 && line >= parent->closingLine)
+            return false;
+        // The folds below are unchanged if no fold is open here, before and after the change
+        if (skippedStarts == 0 && line > last && openFolds.isEmpty() && !foldOpenAtLine(parent, line)) {
+            stopLine = line;
+            break;
+        }
+        int blockEnded = mDocument->blockEnded(line);
+        int blockStarted = mDocument->blockStarted(line);
+        if (skippedStarts == 0) {
             for (int i=0; i<blockEnded;i++) {
-                // Stop the recursion if we find a closing char, and return to our parent
-                if (parent) {
+                if (!openFolds.isEmpty()) {
+                    ScannedFold& fold = folds[openFolds.takeLast()];
                     if (blockStarted>0)
-                        parent->toLine = line;
+                        fold.toLine = line;
                     else
-                        parent->toLine = line + 1;
-                    parent = parent->parent.lock();
-                    if (!parent) {
-                        parentFoldRanges = topFoldRanges;
-                    } else {
-                        parentFoldRanges = parent->subFoldRanges;
+                        fold.toLine = line + 1;
+                    fold.closingLine = line + 1;
+                } else if (parent) {
+                    // parent must be closed on the same line, after the same folds
+                    if (line != parent->closingLine - 1)
+                        return false;
+                    int closedFolds = 0;
+                    for (int j=startPos;j<mAllFoldRanges->count() && (*mAllFoldRanges)[j]->fromLine - 1 < line;j++) {
+                        if ((*mAllFoldRanges)[j]->closingLine - 1 == line)
+                            closedFolds++;
                     }
+                    if (i != closedFolds)
+                        return false;
+                    stopLine = line;
+                    break;
                 }
             }
+            if (stopLine == line)
+                break;
         }
-        if (blockStarted>0) {
-            for (int i=0; i<blockStarted;i++) {
-                // Add it to the top list of folds
-                parent = parentFoldRanges->addByParts(
-                  parent,
-                  topFoldRanges,
-                  line + 1,
-                  line + 1);
-                parentFoldRanges = parent->subFoldRanges;
+        for (int i=skippedStarts; i<blockStarted;i++) {
+            ScannedFold fold;
+            fold.fromLine = line + 1;
+            fold.toLine = line + 1;
+            fold.closingLine = 0;
+            fold.parent = openFolds.isEmpty() ? -1 : openFolds.last();
+            // Reuse the old fold started here, to keep its collapsed state
+            PCodeFoldingRange foldParent = (fold.parent < 0) ? parent : folds[fold.parent].oldRange;
+            while (oldPos < mAllFoldRanges->count() && (*mAllFoldRanges)[oldPos]->fromLine - 1 < line)
+                oldPos++;
+            if ((fold.parent < 0 || foldParent)
+                    && oldPos < mAllFoldRanges->count()
+                    && (*mAllFoldRanges)[oldPos]->fromLine - 1 == line
+                    && (*mAllFoldRanges)[oldPos]->parent.lock() == foldParent) {
+                fold.oldRange = (*mAllFoldRanges)[oldPos];
+                oldPos++;
             }
+            openFolds.append(folds.count());
+            folds.append(fold);
         }
+        skippedStarts = 0;
         line++;
     }
+    // parent is not closed now
+    if (stopLine == INT_MAX && parent && parent->closingLine > 0)
+        return false;
 
+    QVector<PCodeFoldingRange> ranges;
+    QVector<PCodeFoldingRange> children;
+    ranges.reserve(folds.count());
+    foreach (const ScannedFold& fold, folds) {
+        PCodeFoldingRange foldParent = (fold.parent < 0) ? parent : ranges[fold.parent];
+        PCodeFoldingRange range = fold.oldRange;
+        if (range) {
+            // It stays collapsed if it ends at the same line
+            if (range->collapsed && range->toLine != fold.toLine) {
+                range->collapsed = false;
+                range->linesCollapsed = 0;
+            }
+            range->toLine = fold.toLine;
+            range->closingLine = fold.closingLine;
+            if (range->collapsed)
+                range->linesCollapsed = range->toLine - range->fromLine;
+            range->subFoldRanges->clear();
+        } else {
+            range = std::make_shared<CodeFoldingRange>(foldParent, fold.fromLine, fold.toLine);
+            range->closingLine = fold.closingLine;
+        }
+        if (fold.parent < 0)
+            children.append(range);
+        else
+            foldParent->subFoldRanges->add(range);
+        ranges.append(range);
+    }
+    int endPos = mAllFoldRanges->count();
+    if (stopLine != INT_MAX)
+        endPos = lastFoldStartingBefore(*mAllFoldRanges, stopLine) + 1;
+    mAllFoldRanges->replace(startPos, endPos - startPos, ranges);
+    if (parent) {
+        int childStart = lastFoldStartingBefore(*parent->subFoldRanges, startLine) + 1;
+        int childEnd = parent->subFoldRanges->count();
+        if (stopLine != INT_MAX)
+            childEnd = lastFoldStartingBefore(*parent->subFoldRanges, stopLine) + 1;
+        parent->subFoldRanges->replace(childStart, childEnd - childStart, children);
+    }
+    return true;
+}
 
+PCodeFoldingRange QSynEdit::foldOpenAtLine(PCodeFoldingRange parent, int index) const
+{
+    int i = lastFoldStartingBefore(*mAllFoldRanges, index);
+    if (i<0)
+        return PCodeFoldingRange();
+    // the fold under parent containing the last fold started before the line
+    PCodeFoldingRange range = (*mAllFoldRanges)[i];
+    while (range) {
+        PCodeFoldingRange rangeParent = range->parent.lock();
+        if (rangeParent == parent)
+            break;
+        range = rangeParent;
+    }
+    if (range && (range->closingLine == 0 || range->closingLine - 1 >= index))
+        return range;
+    return PCodeFoldingRange();
 }
 
 PCodeFoldingRange QSynEdit::collapsedFoldStartAtLine(int Line)
@@ -3860,6 +4060,7 @@ void QSynEdit::setFontForNonAscii(const QFont &newFontForNonAscii)
     mFontForNonAscii.setStyleStrategy(QFont::PreferAntialias);
     if (mDocument)
         mDocument->setFontMetrics(font(),mFontForNonAscii);
+    mPaintedLines.clear();
 }
 
 const QColor &QSynEdit::backgroundColor() const
@@ -4046,6 +4247,7 @@ void QSynEdit::setTabWidth(int newTabWidth)
 {
     if (newTabWidth!=tabWidth()) {
         mDocument->setTabWidth(newTabWidth);
+        mPaintedLines.clear();
         invalidate();
     }
 }
@@ -4703,6 +4905,7 @@ void QSynEdit::setSyntaxer(const PSyntaxer &syntaxer)
 {
     PSyntaxer oldSyntaxer = mSyntaxer;
     mSyntaxer = syntaxer;
+    mPaintedLines.clear();
     if (oldSyntaxer  && mSyntaxer &&
             oldSyntaxer ->language() == syntaxer->language()) {
     } else {
@@ -4930,6 +5133,7 @@ void QSynEdit::doGotoBlockStart(bool isSelection)
 {
     if (mCaretY<0 || mCaretY>document()->count())
         return;
+    ensureSyntaxStateValid(mCaretY-1);
     SyntaxState state = document()->getSyntaxState(mCaretY-1);
     //todo: handle block other than {}
     if (document()->braceLevel(mCaretY-1)==0) {
@@ -4952,6 +5156,7 @@ void QSynEdit::doGotoBlockEnd(bool isSelection)
 {
     if (mCaretY<0 || mCaretY>document()->count())
         return;
+    ensureSyntaxStateValid(document()->count()-1);
     SyntaxState state = document()->getSyntaxState(mCaretY-1);
     //todo: handle block other than {}
     if (document()->blockLevel(mCaretY-1)==0) {
@@ -5932,7 +6137,7 @@ void QSynEdit::endEditingWithoutUndo()
 {
     mEditingCount--;
     if (mEditingCount==0)
-        reparseDocument();
+        scanEditedLines();
 }
 
 bool QSynEdit::isIdentChar(const QChar &ch)
@@ -6049,6 +6254,7 @@ void QSynEdit::paintEvent(QPaintEvent *event)
         nL2 = minMax(mTopLine + (rcClip.bottom() + mTextHeight - 1) / mTextHeight, 1, displayLineCount());
 
         //qDebug()<<"Paint:"<<nL1<<nL2<<nC1<<nC2;
+        ensureSyntaxStateValid(rowToLine(nL2)-1);
 
         QPainter cachePainter(mContentImage.get());
         cachePainter.setFont(font());
@@ -6125,6 +6331,7 @@ bool QSynEdit::event(QEvent *event)
         synFontChanged();
         if (mDocument)
             mDocument->setFontMetrics(font(),mFontForNonAscii);
+        mPaintedLines.clear();
         break;
     case QEvent::MouseMove: {
         updateMouseCursor();
@@ -6655,6 +6862,15 @@ void QSynEdit::onLinesChanging()
 
 void QSynEdit::onLinesCleared()
 {
+    mSyntaxScanTimer->stop();
+    mSyntaxScannedCount = 0;
+    mFoldUpdateLine = INT_MAX;
+    if (mEditingCount>0) {
+        // all lines added in the block are rescanned
+        mEditedFirstLine = 0;
+        mEditedLastLine = INT_MAX;
+        mEditedLineCountChanged = true;
+    }
     if (mUseCodeFolding)
         foldOnListCleared();
     clearUndo();
@@ -6673,8 +6889,28 @@ void QSynEdit::onLinesDeleted(int index, int count)
 {
     if (mUseCodeFolding)
         foldOnListDeleted(index + 1, count);
-    if (mSyntaxer && mDocument->count() > 0) {
-        scanFrom(index);
+    if (index < mSyntaxScannedCount)
+        mSyntaxScannedCount = std::max(index, mSyntaxScannedCount - count);
+    if (index <= mFoldUpdateLine && mFoldUpdateLine != INT_MAX)
+        mFoldUpdateLine = std::max(0, index - 1);
+    if (mEditingCount>0) {
+        if (mEditedFirstLine<0) {
+            mEditedFirstLine = index;
+            mEditedLastLine = index;
+        } else {
+            if (mEditedFirstLine >= index + count)
+                mEditedFirstLine -= count;
+            else
+                mEditedFirstLine = std::min(mEditedFirstLine, index);
+            // the line after the deleted ones is rescanned
+            if (mEditedLastLine < index + count)
+                mEditedLastLine = index;
+            else if (mEditedLastLine != INT_MAX)
+                mEditedLastLine -= count;
+        }
+        mEditedLineCountChanged = true;
+    } else if (mSyntaxer && mDocument->count() > 0) {
+        scanFrom(index, index, true);
     }
     invalidateLines(index + 1, INT_MAX);
     invalidateGutterLines(index + 1, INT_MAX);
@@ -6684,19 +6920,44 @@ void QSynEdit::onLinesInserted(int index, int count)
 {
     if (mUseCodeFolding)
         foldOnListInserted(index + 1, count);
-    if (mSyntaxer && mDocument->count() > 0) {
-          scanFrom(index);
+    // the inserted lines are lexed with the lines before them, unless those
+    // are still waiting for the background scan
+    if (index < mSyntaxScannedCount || mSyntaxScannedCount == mDocument->count() - count)
+        mSyntaxScannedCount += count;
+    if (mEditingCount>0) {
+        if (mEditedFirstLine<0) {
+            mEditedFirstLine = index;
+            mEditedLastLine = index + count - 1;
+        } else {
+            if (mEditedFirstLine >= index)
+                mEditedFirstLine = index;
+            if (mEditedLastLine != INT_MAX && mEditedLastLine >= index)
+                mEditedLastLine += count;
+            mEditedLastLine = std::max(mEditedLastLine, index + count - 1);
+        }
+        mEditedLineCountChanged = true;
+    } else if (mSyntaxer && mDocument->count() > 0) {
+        scanFrom(index, index + count - 1, true);
     }
     invalidateLines(index + 1, INT_MAX);
     invalidateGutterLines(index + 1, INT_MAX);
 }
 
-void QSynEdit::onLinesPutted(int index, int /*count*/)
+void QSynEdit::onLinesPutted(int index, int count)
 {
-    if (mSyntaxer) {
-        scanFrom(index);
-    }
-    invalidateLines(index + 1, INT_MAX);
+    if (mEditingCount>0) {
+        if (mEditedFirstLine<0) {
+            mEditedFirstLine = index;
+            mEditedLastLine = index + count - 1;
+        } else {
+            mEditedFirstLine = std::min(mEditedFirstLine, index);
+            mEditedLastLine = std::max(mEditedLastLine, index + count - 1);
+        }
+    } else if (mSyntaxer) {
+        int lastLine = scanFrom(index, index + count - 1, false);
+        invalidateLines(index + 1, lastLine + 1);
+    } else
+        invalidateLines(index + 1, index + count);
 }
 
 void QSynEdit::onUndoAdded()
@@ -6982,4 +7243,20 @@ void QSynEdit::onDraggingScrollTimeout()
     computeScroll(true);
     //doMouseScroll(true);
 }
+
+void QSynEdit::onSyntaxScanTimeout()
+{
+    if (!mSyntaxer || mDocument->isMapped()) {
+        mSyntaxScanTimer->stop();
+        return;
+    }
+    if (mEditingCount>0)
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    while (mSyntaxScannedCount < mDocument->count()
+           && timer.elapsed() < SYN_LAZY_SCAN_SLICE_TIME) {
+        ensureSyntaxStateValid(mSyntaxScannedCount + 1000);
+    }
+}
 }
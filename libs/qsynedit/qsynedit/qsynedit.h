@@ -18,6 +18,7 @@
 #define QSYNEDIT_H
 
 #include <QAbstractScrollArea>
+#include <QCache>
 #include <QCursor>
 #include <QDateTime>
 #include <QFrame>
@@ -28,6 +29,7 @@
 #include "codefolding.h"
 #include "types.h"
 #include "document.h"
+#include "painter.h"
 #include "keystrokes.h"
 #include "searcher/baseseacher.h"
 #include "formatter/formatter.h"
@@ -191,6 +193,11 @@ public:
     void invalidateSelection();
     void invalidateRect(const QRect& rect);
     void invalidate();
+    /**
+     * @brief drop the tokens cached by the painter. Call it when the syntaxer
+     *  is reconfigured in a way that changes lexing results.
+     */
+    void invalidatePaintedLines();
     void lockPainter();
     void unlockPainter();
     bool selAvail() const;
@@ -508,9 +515,25 @@ private:
     void recalcCharExtent();
     QString expandAtWideGlyphs(const QString& S);
     void updateModifiedStatus();
-    void scanFrom(int index);
+    /**
+     * @brief rescan syntax states from line index (0-based)
+     *
+     * Stops at the first line not before canStopIndex whose new state equals
+     * the stored one. Folds are rescanned only if lineCountChanged is set or
+     * the block marks of the rescanned lines changed.
+     * @return index of the last rescanned line
+     */
+    int scanFrom(int index, int canStopIndex, bool lineCountChanged);
+    /**
+     * @brief lex the lines not scanned yet, up to line index (0-based)
+     */
+    void ensureSyntaxStateValid(int index);
     void reparseLine(int line);
     void reparseDocument();
+    /**
+     * @brief rescan the lines changed in the editing block that just ended
+     */
+    void scanEditedLines();
     void uncollapse(PCodeFoldingRange FoldRange);
     void collapse(PCodeFoldingRange FoldRange);
 
@@ -519,9 +542,22 @@ private:
     void foldOnListCleared();
     void rescanFolds(); // rescan for folds
     void rescanForFoldRanges();
-    void scanForFoldRanges(PCodeFoldingRanges topFoldRanges);
-    int lineHasChar(int Line, int startChar, QChar character, const QString& tokenAttrName);
-    void findSubFoldRange(PCodeFoldingRanges topFoldRanges,PCodeFoldingRanges& parentFoldRanges, PCodeFoldingRange Parent);
+    /**
+     * @brief update the folds after the block marks of lines first..last (0-based) changed
+     *
+     * Only the innermost fold around the changed lines is rescanned, or its
+     * parents if the end of that fold is changed.
+     */
+    void updateFoldRanges(int first, int last);
+    /**
+     * @brief rescan the folds under parent (top level folds if null) around lines first..last
+     * @return false if parent doesn't end at the same place as before
+     */
+    bool rescanFoldRanges(PCodeFoldingRange parent, int first, int last);
+    /**
+     * @brief the fold under parent that is open at the start of line index (0-based)
+     */
+    PCodeFoldingRange foldOpenAtLine(PCodeFoldingRange parent, int index) const;
     PCodeFoldingRange collapsedFoldStartAtLine(int Line);
     void initializeCaret();
     PCodeFoldingRange foldStartAtLine(int Line) const;
@@ -637,6 +673,7 @@ private slots:
     //void onRedoAdded();
     void onScrollTimeout();
     void onDraggingScrollTimeout();
+    void onSyntaxScanTimeout();
     void onUndoAdded();
     void onSizeOrFontChanged(bool bFont);
     void onChanged();
@@ -645,8 +682,19 @@ private slots:
 private:
     std::shared_ptr<QImage> mContentImage;
     PCodeFoldingRanges mAllFoldRanges;
+    mutable CollapsedFoldIndex mCollapsedFoldIndex;
+    QCache<int,PaintedLine> mPaintedLines; // lexed tokens of lines, keyed by line index
     CodeFoldingOptions mCodeFolding;
     int mEditingCount;
+    // lines (0-based) changed in the current editing block, they are rescanned when it ends
+    int mEditedFirstLine; // -1 if no line is changed
+    int mEditedLastLine;
+    bool mEditedLineCountChanged;
+    int mSyntaxScannedCount; // count of the leading lines whose syntax states are valid
+    // folds from this line (0-based) are updated when the background scan is finished,
+    // 0 to rescan all folds, INT_MAX if none is changed
+    int mFoldUpdateLine;
+    QTimer* mSyntaxScanTimer;
     bool mUseCodeFolding;
     bool  mAlwaysShowCaret;
     BufferCoord mBlockBegin;
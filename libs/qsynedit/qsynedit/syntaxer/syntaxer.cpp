@@ -282,7 +282,7 @@ TokenAttribute::TokenAttribute(const QString &name, TokenType tokenType):
 
 }
 
-bool SyntaxState::operator==(const SyntaxState &s2)
+bool SyntaxState::operator==(const SyntaxState &s2) const
 {
     // indents contains the information of brace/parenthesis/brackets embedded levels
     return (state == s2.state)
@@ -63,7 +63,7 @@ struct SyntaxState {
 //                              but not started at this line
 //                                (need by auto indent) */
     bool hasTrailingSpaces;
-    bool operator==(const SyntaxState& s2);
+    bool operator==(const SyntaxState& s2) const;
     IndentInfo getLastIndent();
     IndentType getLastIndentType();
     SyntaxState();
@@ -39,6 +39,10 @@
 #include <QFontMetrics>
 #include <QMimeDatabase>
 #include <windows.h>
+#include <psapi.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <unistd.h>
 #endif
 #include "charsetinfo.h"
 
@@ -754,3 +758,27 @@ int compareFileModifiedTime(const QString &filename, qint64 timestamp)
         return -1;
     return 0;
 }
+
+qint64 processResidentMemory()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counter;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counter, sizeof(counter)))
+        return counter.WorkingSetSize;
+    return -1;
+#elif defined(Q_OS_LINUX)
+    QFile file("/proc/self/statm");
+    if (!file.open(QFile::ReadOnly))
+        return -1;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.count()<2)
+        return -1;
+    bool ok;
+    qint64 pages = fields[1].toLongLong(&ok);
+    if (!ok)
+        return -1;
+    return pages * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
@@ -161,6 +161,9 @@ float pixelToPoint(float pixel);
 
 void decodeKey(int combinedKey, int& key, Qt::KeyboardModifiers& modifiers);
 
+// resident memory of the current process in bytes, -1 if not available
+qint64 processResidentMemory();
+
 
 /**
  * from https://github.com/Microsoft/GSL
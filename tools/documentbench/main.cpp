@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loads a document of the given number of lines, lexes it with the C++
+ * syntaxer, then inserts and deletes lines at random positions, for both
+ * QSynedit::Document and the storage it used before DocumentLines (one
+ * shared_ptr per line, each line holding a full SyntaxState).
+ *
+ * usage: documentbench [--lines N] [--edits N] [file]
+ *   e.g. documentbench -platform offscreen --lines 2000000 qsynedit.cpp
+ *
+ * documentbench --check [--seed N] [--edits N] runs random edits (100000 by
+ * default) on QSynedit::DocumentLines and a QStringList side by side instead,
+ * and fails at the first line they don't agree on.
+ *
+ * The lines of the file (or some generated code if no file is given) are
+ * repeated until the document has N lines. Memory is the heap in use
+ * reported by glibc, it's not available on other platforms.
+ */
+#include <QGuiApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <algorithm>
+#include "qsynedit/document.h"
+#include "qsynedit/documentlines.h"
+#include "qsynedit/syntaxer/cpp.h"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+struct LegacyLine {
+    QString lineText;
+    QSynedit::SyntaxState syntaxState;
+    int columns;
+};
+
+using PLegacyLine = std::shared_ptr<LegacyLine>;
+
+struct BenchResult {
+    qint64 memory;
+    qint64 loadTime;
+    qint64 lexTime;
+    qint64 editTime;
+};
+
+static qint64 heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (unsigned int)mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static QStringList generateCode()
+{
+    QStringList lines;
+    lines << "#include <stdio.h>"
+          << ""
+          << "struct Point {"
+          << "    int x; /* horizontal */"
+          << "    int y;"
+          << "};"
+          << ""
+          << "static int distance(const struct Point* p1, const struct Point* p2)"
+          << "{"
+          << "    int dx = p1->x - p2->x;"
+          << "    int dy = p1->y - p2->y;"
+          << "    // no sqrt, it's only compared"
+          << "    if (dx < 0) {"
+          << "        dx = -dx;"
+          << "    }"
+          << "    printf(\"%d %d\\n\", dx, dy);"
+          << "    return dx * dx + dy * dy;"
+          << "}";
+    return lines;
+}
+
+template <typename SetLine>
+static qint64 lex(const QStringList& lines, int count, SetLine setLine)
+{
+    QSynedit::CppSyntaxer syntaxer;
+    QElapsedTimer timer;
+    timer.start();
+    syntaxer.resetState();
+    for (int i=0;i<count;i++) {
+        syntaxer.setLine(lines[i % lines.count()], i);
+        syntaxer.nextToEol();
+        setLine(i, syntaxer.getState());
+    }
+    return timer.nsecsElapsed();
+}
+
+static BenchResult benchDocument(const QStringList& lines, int count, const QList<int>& positions)
+{
+    BenchResult result;
+    qint64 heap = heapInUse();
+    QElapsedTimer timer;
+    {
+        QSynedit::Document document(QFont("monospace"), QFont("monospace"));
+        timer.start();
+        for (int i=0;i<count;i++)
+            document.addLine(lines[i % lines.count()]);
+        result.loadTime = timer.nsecsElapsed();
+        result.lexTime = lex(lines, count, [&document](int i, const QSynedit::SyntaxState& state){
+            document.setSyntaxState(i, state);
+        });
+        result.memory = heapInUse() - heap;
+        timer.restart();
+        foreach (int pos, positions) {
+            document.insertLine(pos, "    int z = x + y;");
+            document.deleteAt(pos + 1);
+        }
+        result.editTime = timer.nsecsElapsed();
+    }
+    return result;
+}
+
+static BenchResult benchLegacy(const QStringList& lines, int count, const QList<int>& positions)
+{
+    BenchResult result;
+    qint64 heap = heapInUse();
+    QElapsedTimer timer;
+    {
+        QVector<PLegacyLine> document;
+        timer.start();
+        for (int i=0;i<count;i++) {
+            PLegacyLine line = std::make_shared<LegacyLine>();
+            line->lineText = lines[i % lines.count()];
+            line->columns = -1;
+            document.append(line);
+        }
+        result.loadTime = timer.nsecsElapsed();
+        result.lexTime = lex(lines, count, [&document](int i, const QSynedit::SyntaxState& state){
+            document[i]->syntaxState = state;
+        });
+        result.memory = heapInUse() - heap;
+        timer.restart();
+        foreach (int pos, positions) {
+            PLegacyLine line = std::make_shared<LegacyLine>();
+            line->lineText = "    int z = x + y;";
+            line->columns = -1;
+            document.insert(pos, line);
+            document.removeAt(pos + 1);
+        }
+        result.editTime = timer.nsecsElapsed();
+    }
+    return result;
+}
+
+static void printResult(QTextStream& out, const QString& name, const BenchResult& result, int count, int edits)
+{
+    out << QString("%1: load %2 ms, lex %3 ms, %4 edits in %5 ms (%6 us/edit)")
+           .arg(name)
+           .arg(result.loadTime / 1000000.0, 0, 'f', 1)
+           .arg(result.lexTime / 1000000.0, 0, 'f', 1)
+           .arg(edits)
+           .arg(result.editTime / 1000000.0, 0, 'f', 1)
+           .arg(result.editTime / 1000.0 / std::max(edits, 1), 0, 'f', 2);
+    if (result.memory > 0)
+        out << QString(", %1 MB (%2 bytes/line)")
+               .arg(result.memory / 1024.0 / 1024.0, 0, 'f', 1)
+               .arg(result.memory / count);
+    out << "\n";
+}
+
+static bool compareLines(QTextStream& out, const QSynedit::DocumentLines& lines,
+                         const QStringList& expected, int step)
+{
+    if (lines.count() != expected.count()) {
+        out << QString("step %1: %2 lines, expected %3\n")
+               .arg(step).arg(lines.count()).arg(expected.count());
+        return false;
+    }
+    for (int i=0;i<expected.count();i++) {
+        if (lines[i].lineText != expected[i]) {
+            out << QString("step %1: line %2 is \"%3\", expected \"%4\"\n")
+                   .arg(step).arg(i).arg(lines[i].lineText, expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int checkDocumentLines(QTextStream& out, quint32 seed, int steps)
+{
+    QRandomGenerator random(seed);
+    QSynedit::DocumentLines lines;
+    QStringList expected;
+    int serial = 0;
+    for (int step=0;step<steps;step++) {
+        // grow to a few chunks, then keep the size around there
+        int op = random.bounded(expected.count() > 5000 ? 8 : 6);
+        int index = random.bounded(expected.count() + 1);
+        switch (op) {
+        case 0: {
+            QString text = QString::number(serial++);
+            lines.append(text);
+            expected.append(text);
+            break;
+        }
+        case 1:
+        case 2: {
+            QString text = QString::number(serial++);
+            lines.insert(index, text);
+            expected.insert(index, text);
+            break;
+        }
+        case 3: {
+            int count = random.bounded(1, 1200);
+            lines.insert(index, count);
+            for (int i=0;i<count;i++)
+                expected.insert(index, QString());
+            // give the inserted lines their own text, so moved lines are told apart
+            for (int i=0;i<count;i++) {
+                QString text = QString::number(serial++);
+                lines[index + i].lineText = text;
+                expected[index + i] = text;
+            }
+            break;
+        }
+        case 4: {
+            // lookups after random jumps
+            if (expected.isEmpty())
+                break;
+            int i = std::min(index, expected.count() - 1);
+            if (lines[i].lineText != expected[i]) {
+                out << QString("step %1: line %2 is \"%3\", expected \"%4\"\n")
+                       .arg(step).arg(i).arg(lines[i].lineText, expected[i]);
+                return 1;
+            }
+            break;
+        }
+        default: {
+            int count = random.bounded(1, 1200);
+            count = std::min(count, expected.count() - index);
+            if (count <= 0)
+                break;
+            lines.remove(index, count);
+            expected.erase(expected.begin() + index, expected.begin() + index + count);
+            break;
+        }
+        }
+        if (random.bounded(1000) == 0) {
+            lines.clear();
+            expected.clear();
+        }
+        if (step % 100 == 0 && !compareLines(out, lines, expected, step))
+            return 1;
+    }
+    if (!compareLines(out, lines, expected, steps))
+        return 1;
+    out << QString("DocumentLines check passed: %1 random edits, seed %2\n").arg(steps).arg(seed);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList args = app.arguments();
+    int count = 1000000;
+    int edits = -1;
+    bool check = false;
+    quint32 seed = QRandomGenerator::global()->generate();
+    QStringList lines;
+    for (int i=1;i<args.length();i++) {
+        if (args[i] == "--check") {
+            check = true;
+        } else if (args[i] == "--seed" && i+1<args.length()) {
+            seed = args[++i].toUInt();
+        } else if (args[i] == "--lines" && i+1<args.length()) {
+            count = std::max(1, args[++i].toInt());
+        } else if (args[i] == "--edits" && i+1<args.length()) {
+            edits = std::max(0, args[++i].toInt());
+        } else {
+            QFile file(args[i]);
+            if (!file.open(QFile::ReadOnly)) {
+                out << "Can't open " << args[i] << "\n";
+                out << "usage: documentbench [--lines N] [--edits N] [file]\n"
+                    << "       documentbench --check [--seed N] [--edits N]\n";
+                return 1;
+            }
+            lines = QString::fromUtf8(file.readAll()).split('\n');
+        }
+    }
+    if (check)
+        return checkDocumentLines(out, seed, edits < 0 ? 100000 : edits);
+    if (edits < 0)
+        edits = 1000;
+    if (lines.isEmpty())
+        lines = generateCode();
+
+    QList<int> positions;
+    for (int i=0;i<edits;i++)
+        positions.append(QRandomGenerator::global()->bounded(count));
+
+    out << "lines: " << count << ", edits: " << edits << "\n";
+    printResult(out, "shared_ptr per line", benchLegacy(lines, count, positions), count, edits);
+    printResult(out, "Document", benchDocument(lines, count, positions), count, edits);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loads a document of the given number of lines into a QSynEdit, collapses
+ * all its folds, then maps every display row to its line and back, and
+ * scrolls through the document page by page. At last it inserts and deletes
+ * lines between the collapsed functions, mapping a row after each change.
+ *
+ * usage: foldbench [--lines N] [--repeat N] [--edits N]
+ *   e.g. foldbench -platform offscreen --lines 100000
+ *
+ * It exits with 1 if a row isn't mapped back to itself.
+ *
+ * Build it against an older qsynedit to compare the row <-> line mapping.
+ */
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <algorithm>
+#include "qsynedit/qsynedit.h"
+#include "qsynedit/document.h"
+#include "qsynedit/syntaxer/cpp.h"
+
+// lines of each function generated by generateCode()
+#define FUNCTION_LINES 13
+
+static QStringList generateCode(int count)
+{
+    QStringList lines;
+    int i=0;
+    while (lines.count()<count) {
+        lines << QString("static int function%1(int x, int y)").arg(i)
+              << "{"
+              << "    int result = 0;"
+              << "    for (int i=0;i<x;i++) {"
+              << "        if (i % 2 == 0) {"
+              << "            result += y;"
+              << "        } else {"
+              << "            result -= i;"
+              << "        }"
+              << "    }"
+              << "    return result;"
+              << "}"
+              << "";
+        i++;
+    }
+    return lines.mid(0, count);
+}
+
+static qint64 benchMapping(QSynedit::QSynEdit& editor, int repeat, int& checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int r=0;r<repeat;r++) {
+        for (int row=1;row<=editor.displayLineCount();row++) {
+            int line = editor.rowToLine(row);
+            checksum += editor.lineToRow(line) - row;
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+static qint64 benchScroll(QSynedit::QSynEdit& editor, int repeat, int& pages)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int r=0;r<repeat;r++) {
+        for (int top=1;top<=editor.displayLineCount();top+=editor.linesInWindow()) {
+            editor.setTopLine(top);
+            editor.repaint();
+            pages++;
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+static qint64 benchEdits(QSynedit::QSynEdit& editor, int edits, int& checksum)
+{
+    int functions = editor.document()->count() / FUNCTION_LINES;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0;i<functions && i<edits;i++) {
+        // the empty line after a function, outside of all folds
+        int line = QRandomGenerator::global()->bounded(functions) * FUNCTION_LINES + FUNCTION_LINES - 1;
+        editor.document()->insertLine(line, "int counter;");
+        int row = editor.displayLineCount() / 2;
+        checksum += editor.lineToRow(editor.rowToLine(row)) - row;
+        editor.document()->deleteAt(line);
+        checksum += editor.lineToRow(editor.rowToLine(row)) - row;
+    }
+    return timer.nsecsElapsed();
+}
+
+static bool printResult(QTextStream& out, const QString& name, QSynedit::QSynEdit& editor, int repeat)
+{
+    int checksum = 0;
+    int pages = 0;
+    qint64 mappingTime = benchMapping(editor, repeat, checksum);
+    qint64 scrollTime = benchScroll(editor, repeat, pages);
+    int rows = editor.displayLineCount() * repeat;
+    out << QString("%1: %2 rows, mapping %3 ms (%4 ns/row), %5 pages in %6 ms (%7 us/page)")
+           .arg(name)
+           .arg(editor.displayLineCount())
+           .arg(mappingTime / 1000000.0, 0, 'f', 1)
+           .arg(mappingTime / std::max(rows, 1))
+           .arg(pages)
+           .arg(scrollTime / 1000000.0, 0, 'f', 1)
+           .arg(scrollTime / 1000.0 / std::max(pages, 1), 0, 'f', 1);
+    if (checksum != 0)
+        out << ", row mapping mismatch!";
+    out << "\n";
+    return checksum == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList args = app.arguments();
+    int count = 100000;
+    int repeat = 1;
+    int edits = 1000;
+    for (int i=1;i<args.length();i++) {
+        if (args[i] == "--lines" && i+1<args.length()) {
+            count = std::max(1, args[++i].toInt());
+        } else if (args[i] == "--repeat" && i+1<args.length()) {
+            repeat = std::max(1, args[++i].toInt());
+        } else if (args[i] == "--edits" && i+1<args.length()) {
+            edits = std::max(0, args[++i].toInt());
+        } else {
+            out << "usage: foldbench [--lines N] [--repeat N] [--edits N]\n";
+            return 1;
+        }
+    }
+
+    QSynedit::QSynEdit editor;
+    editor.resize(800, 600);
+    editor.setUseCodeFolding(true);
+    editor.setSyntaxer(std::make_shared<QSynedit::CppSyntaxer>());
+    editor.document()->setContents(generateCode(count));
+    // lex the whole document now, so the fold ranges are ready
+    QString token;
+    QSynedit::PTokenAttribute attr;
+    editor.getTokenAttriAtRowCol(QSynedit::BufferCoord{1, editor.document()->count()}, token, attr);
+    editor.show();
+
+    out << "lines: " << editor.document()->count() << "\n";
+    bool matched = printResult(out, "expanded", editor, repeat);
+    QElapsedTimer timer;
+    timer.start();
+    editor.collapseAll();
+    qint64 collapseTime = timer.nsecsElapsed();
+    out << QString("collapse all: %1 ms\n").arg(collapseTime / 1000000.0, 0, 'f', 1);
+    matched = printResult(out, "collapsed", editor, repeat) && matched;
+    int checksum = 0;
+    int editCount = std::min(edits, editor.document()->count() / FUNCTION_LINES);
+    qint64 editTime = benchEdits(editor, edits, checksum);
+    out << QString("%1 line inserts/deletes between collapsed folds in %2 ms (%3 us/edit), %4 rows after them")
+           .arg(editCount * 2)
+           .arg(editTime / 1000000.0, 0, 'f', 1)
+           .arg(editTime / 1000.0 / std::max(editCount * 2, 1), 0, 'f', 1)
+           .arg(editor.displayLineCount());
+    if (checksum != 0)
+        out << ", row mapping mismatch!";
+    out << "\n";
+    return (matched && checksum == 0) ? 0 : 1;
+}
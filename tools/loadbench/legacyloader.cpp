@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "legacyloader.h"
+#include <QFile>
+#include <QSet>
+#include <QTextCodec>
+#include <QTextStream>
+#include "qt_utils/utils.h"
+#include "qt_utils/charsetinfo.h"
+
+static void removeLineBreak(QByteArray& line)
+{
+    if (line.endsWith("\r\n")) {
+        line.remove(line.length()-2,2);
+    } else if (line.endsWith("\r")) {
+        line.remove(line.length()-1,1);
+    } else if (line.endsWith("\n")){
+        line.remove(line.length()-1,1);
+    }
+}
+
+static bool tryLoadFileByEncoding(QByteArray encodingName, QFile& file, QStringList& lines) {
+    QTextCodec* codec = QTextCodec::codecForName(encodingName);
+    if (!codec)
+        return false;
+    file.reset();
+    lines.clear();
+    QTextCodec::ConverterState state;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        removeLineBreak(line);
+        QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
+        if (state.invalidChars>0)
+            return false;
+        lines.append(newLine);
+    }
+    return true;
+}
+
+QStringList legacyLoadFile(const QString &filename, const QByteArray &encoding, QByteArray &realEncoding)
+{
+    QStringList lines;
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly))
+        return lines;
+    if (encoding == ENCODING_AUTO_DETECT) {
+        if (file.atEnd()) {
+            realEncoding = ENCODING_ASCII;
+            return lines;
+        }
+        QByteArray line = file.readLine();
+        QTextCodec* codec = QTextCodec::codecForName(ENCODING_UTF8);
+        QTextCodec::ConverterState state;
+        bool needReread = false;
+        bool allAscii = true;
+        if ((line.length()>=3) && ((unsigned char)line[0]==0xEF) && ((unsigned char)line[1]==0xBB) && ((unsigned char)line[2]==0xBF) ) {
+            realEncoding = ENCODING_UTF8_BOM;
+            line = line.mid(3);
+        } else {
+            realEncoding = ENCODING_UTF8;
+        }
+        while (true) {
+            removeLineBreak(line);
+            if (isBinaryContent(line))
+                return QStringList();
+            if (allAscii) {
+                allAscii = isTextAllAscii(line);
+            }
+            if (allAscii) {
+                lines.append(QString::fromLatin1(line));
+            } else {
+                QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
+                if (state.invalidChars>0) {
+                    needReread = true;
+                    break;
+                }
+                lines.append(newLine);
+            }
+            if (file.atEnd())
+                break;
+            line = file.readLine();
+        }
+        if (!needReread) {
+            if (allAscii)
+                realEncoding = ENCODING_ASCII;
+            return lines;
+        }
+        realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
+        if (tryLoadFileByEncoding(realEncoding,file,lines))
+            return lines;
+        QList<PCharsetInfo> charsets = pCharsetInfoManager->findCharsetByLocale(pCharsetInfoManager->localeName());
+        QSet<QByteArray> encodingSet;
+        for (int i=0;i<charsets.size();i++) {
+            encodingSet.insert(charsets[i]->name);
+        }
+        encodingSet.remove(realEncoding);
+        foreach (const QByteArray& encodingName,encodingSet) {
+            if (encodingName == ENCODING_UTF8)
+                continue;
+            if (tryLoadFileByEncoding(encodingName,file,lines)) {
+                realEncoding = encodingName;
+                return lines;
+            }
+        }
+    } else {
+        realEncoding = encoding;
+    }
+    file.reset();
+    QTextStream textStream(&file);
+    textStream.setAutoDetectUnicode(realEncoding == ENCODING_UTF8_BOM);
+    textStream.setCodec(realEncoding == ENCODING_UTF8_BOM ? ENCODING_UTF8 : realEncoding.constData());
+    QString line;
+    lines.clear();
+    while (textStream.readLineInto(&line)) {
+        lines.append(line);
+    }
+    return lines;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACYLOADER_H
+#define LEGACYLOADER_H
+
+#include <QByteArray>
+#include <QStringList>
+
+/**
+ * @brief The line by line loading Document::loadFromFile() used before it
+ *  read files at once, kept as the baseline of the benchmark.
+ *
+ * The lines are returned instead of added to a document, the caller adds
+ * them with Document::setContents(), which costs the same as the old
+ * per line Document::addItem() calls.
+ */
+QStringList legacyLoadFile(const QString& filename, const QByteArray& encoding, QByteArray& realEncoding);
+
+#endif // LEGACYLOADER_H
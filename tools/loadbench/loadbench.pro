@@ -0,0 +1,42 @@
+QT += core gui widgets
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Measures loading files into a QSynedit::Document.
+# It's only built with the IDE when qmake is run with CONFIG+=benchmarks.
+
+win32: {
+DEFINES += _WIN32_WINNT=0x0601
+}
+
+msvc {
+    DEFINES += NOMINMAX
+}
+
+CONFIG(debug_and_release_target) {
+    CONFIG(debug, debug|release) {
+        OBJ_OUT_PWD = debug/
+    }
+    CONFIG(release, debug|release) {
+        OBJ_OUT_PWD = release/
+    }
+}
+
+INCLUDEPATH += ../../libs/qsynedit ../../libs/redpanda_qt_utils
+
+gcc | clang {
+LIBS += $$OUT_PWD/../../libs/qsynedit/$${OBJ_OUT_PWD}libqsynedit.a \
+        $$OUT_PWD/../../libs/redpanda_qt_utils/$${OBJ_OUT_PWD}libredpanda_qt_utils.a
+}
+msvc {
+LIBS += $$OUT_PWD/../../libs/qsynedit/$${OBJ_OUT_PWD}qsynedit.lib \
+        $$OUT_PWD/../../libs/redpanda_qt_utils/$${OBJ_OUT_PWD}redpanda_qt_utils.lib
+LIBS += advapi32.lib user32.lib
+}
+
+SOURCES += \
+    main.cpp \
+    legacyloader.cpp
+
+HEADERS += \
+    legacyloader.h
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loads files into a QSynedit::Document by Document::loadFromFile(), and by
+ * the line by line loading it used before.
+ *
+ * usage: loadbench [--repeat N] [--locale NAME] [file...]
+ *   e.g. loadbench -platform offscreen --locale zh_CN
+ *
+ * Without files, 10 MB and 100 MB UTF-8 files and a 10 MB GBK file of
+ * generated code are written to a temporary directory. GBK is only detected
+ * if it's a charset of the locale (zh_CN). Files larger than
+ * SYN_MAPPED_FILE_MIN_SIZE are opened as mapped documents by Document.
+ */
+#include <QGuiApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextCodec>
+#include <QTextStream>
+#include <algorithm>
+#include "qsynedit/document.h"
+#include "qt_utils/charsetinfo.h"
+#include "qt_utils/utils.h"
+#include "legacyloader.h"
+
+static bool generateFile(const QString& filename, qint64 size, const QByteArray& encoding)
+{
+    QTextCodec* codec = QTextCodec::codecForName(encoding);
+    QFile file(filename);
+    if (!codec || !file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QByteArray block;
+    for (int i=0;i<1000;i++) {
+        QString s = QString("static int compute%1(int x, int y)\n"
+                            "{\n"
+                            "    // 计算第%1个值\n"
+                            "    int result = x * %1 + y;\n"
+                            "    printf(\"结果: %d\\n\", result);\n"
+                            "    return result;\n"
+                            "}\n"
+                            "\n").arg(i);
+        block += codec->fromUnicode(s);
+    }
+    for (qint64 written=0;written<size;written+=block.length()) {
+        if (file.write(block) != block.length())
+            return false;
+    }
+    return true;
+}
+
+struct LoadResult {
+    qint64 time;
+    QByteArray encoding;
+    QStringList lines;
+};
+
+static LoadResult loadByDocument(const QString& filename, int repeat)
+{
+    LoadResult result;
+    result.time = -1;
+    QSynedit::Document document(QFont("monospace"), QFont("monospace"));
+    for (int r=0;r<repeat;r++) {
+        QElapsedTimer timer;
+        timer.start();
+        document.loadFromFile(filename, ENCODING_AUTO_DETECT, result.encoding);
+        qint64 time = timer.nsecsElapsed();
+        if (result.time < 0 || time < result.time)
+            result.time = time;
+    }
+    result.lines = document.contents();
+    return result;
+}
+
+static LoadResult loadByLegacy(const QString& filename, int repeat)
+{
+    LoadResult result;
+    result.time = -1;
+    QSynedit::Document document(QFont("monospace"), QFont("monospace"));
+    for (int r=0;r<repeat;r++) {
+        QElapsedTimer timer;
+        timer.start();
+        document.setContents(legacyLoadFile(filename, ENCODING_AUTO_DETECT, result.encoding));
+        qint64 time = timer.nsecsElapsed();
+        if (result.time < 0 || time < result.time)
+            result.time = time;
+    }
+    result.lines = document.contents();
+    return result;
+}
+
+static void benchFile(QTextStream& out, const QString& filename, int repeat)
+{
+    QFile file(filename);
+    out << QString("%1: %2 MB\n").arg(filename).arg(file.size() / 1024.0 / 1024.0, 0, 'f', 1);
+    LoadResult legacy = loadByLegacy(filename, repeat);
+    out << QString("  line by line: %1 ms, %2 lines, %3\n")
+           .arg(legacy.time / 1000000.0, 0, 'f', 1)
+           .arg(legacy.lines.count())
+           .arg(QString(legacy.encoding));
+    LoadResult result = loadByDocument(filename, repeat);
+    out << QString("  Document:     %1 ms, %2 lines, %3")
+           .arg(result.time / 1000000.0, 0, 'f', 1)
+           .arg(result.lines.count())
+           .arg(QString(result.encoding));
+    if (result.lines != legacy.lines || result.encoding != legacy.encoding)
+        out << ", contents mismatch!";
+    out << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList args = app.arguments();
+    int repeat = 3;
+    QString localeName = "zh_CN";
+    QStringList files;
+    for (int i=1;i<args.length();i++) {
+        if (args[i] == "--repeat" && i+1<args.length()) {
+            repeat = std::max(1, args[++i].toInt());
+        } else if (args[i] == "--locale" && i+1<args.length()) {
+            localeName = args[++i];
+        } else if (args[i].startsWith("--")) {
+            out << "usage: loadbench [--repeat N] [--locale NAME] [file...]\n";
+            return 1;
+        } else {
+            files.append(args[i]);
+        }
+    }
+    CharsetInfoManager charsetInfoManager(localeName);
+    pCharsetInfoManager = &charsetInfoManager;
+
+    QTemporaryDir dir;
+    if (files.isEmpty()) {
+        files << dir.filePath("utf8-10MB.c")
+              << dir.filePath("utf8-100MB.c")
+              << dir.filePath("gbk-10MB.c");
+        if (!generateFile(files[0], 10*1024*1024, ENCODING_UTF8)
+                || !generateFile(files[1], 100*1024*1024, ENCODING_UTF8)
+                || !generateFile(files[2], 10*1024*1024, "GBK")) {
+            out << "Can't generate the files in " << dir.path() << "\n";
+            return 1;
+        }
+    }
+    foreach (const QString& filename, files) {
+        benchFile(out, filename, repeat);
+    }
+    return 0;
+}
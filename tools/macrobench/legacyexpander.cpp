@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "legacyexpander.h"
+#include "macroexpander.h"
+
+LegacyExpander::LegacyExpander(const DefineMap &defines):
+    mDefines{defines}
+{
+
+}
+
+QString LegacyExpander::expandMacros(const QString &line, int depth)
+{
+    //prevent infinit recursion
+    if (depth > MAX_DEFINE_EXPAND_DEPTH)
+        return line;
+    QString word;
+    QString newLine;
+    int lenLine = line.length();
+    int i=0;
+    while (i< lenLine) {
+        QChar ch=line[i];
+        if (isWordChar(ch)) {
+            word += ch;
+        } else {
+            if (!word.isEmpty()) {
+                expandMacro(line,newLine,word,i,depth);
+            }
+            word = "";
+            if (i< lenLine) {
+                newLine += line[i];
+            }
+        }
+        i++;
+    }
+    if (!word.isEmpty()) {
+        expandMacro(line,newLine,word,i,depth);
+    }
+    return newLine;
+}
+
+void LegacyExpander::buildFormatValue(Define &define)
+{
+    define.formatValue = define.value;
+    QString args=define.args.mid(1,define.args.length()-2).trimmed();
+    if (args.isEmpty())
+        return;
+    define.argList = args.split(',');
+    for (int i=0;i<define.argList.size();i++) {
+        define.argList[i]=define.argList[i].trimmed();
+        define.argUsed.append(false);
+    }
+    // the same format as CppPreprocessor::parseArgs()
+    QString formatStr;
+    bool stringify = false;
+    foreach (const MacroToken& token, MacroExpander::tokenize(define.value)) {
+        if (token.type == MacroTokenType::Symbol
+                && (token.text == "#" || token.text == "##")) {
+            stringify = (token.text == "#");
+            formatStr = formatStr.trimmed();
+            continue;
+        }
+        if (token.type == MacroTokenType::Space && stringify)
+            continue;
+        int index = (token.type == MacroTokenType::Identifier) ? define.argList.indexOf(token.text) : -1;
+        if (index>=0) {
+            define.argUsed[index] = true;
+            if (stringify)
+                formatStr += "\"%"+QString("%1").arg(index+1)+"\"";
+            else
+                formatStr += "%"+QString("%1").arg(index+1);
+        } else {
+            formatStr += token.text;
+        }
+        stringify = false;
+    }
+    define.formatValue = formatStr;
+}
+
+void LegacyExpander::expandMacro(const QString &line, QString &newLine, QString &word, int &i, int depth)
+{
+    int lenLine = line.length();
+    PDefine define = mDefines.value(word);
+    if (define && define->args=="" ) {
+        if (define->value != word )
+            newLine += expandMacros(define->value,depth+1);
+        else
+            newLine += word;
+    } else if (define && (define->args!="")) {
+        while ((i<lenLine) && (line[i] == ' ' || line[i]=='\t'))
+            i++;
+        int argStart=-1;
+        int argEnd=-1;
+        if ((i<lenLine) && (line[i]=='(')) {
+            argStart =i+1;
+            int level=0;
+            bool inString=false;
+            while (i<lenLine) {
+                switch(line[i].unicode()) {
+                case '\\':
+                    if (inString)
+                        i++;
+                    break;
+                case '"':
+                    inString = !inString;
+                    break;
+                case '(':
+                    if (!inString)
+                        level++;
+                    break;
+                case ')':
+                    if (!inString)
+                        level--;
+                }
+                i++;
+                if (level==0)
+                    break;
+            }
+            if (level==0) {
+                argEnd = i-2;
+                QString args = line.mid(argStart,argEnd-argStart+1).trimmed();
+                QString formattedValue = expandFunction(define,args);
+                newLine += expandMacros(formattedValue,depth+1);
+            }
+        }
+    } else {
+        newLine += word;
+    }
+}
+
+QString LegacyExpander::expandFunction(const PDefine &define, QString args)
+{
+    // Replace function by this string
+    QString result = define->formatValue;
+    if (args.startsWith('(') && args.endsWith(')')) {
+        args = args.mid(1,args.length()-2);
+    }
+
+    QStringList argValues;
+    int i=0;
+    bool inString = false;
+    int lastSplit=0;
+    while (i<args.length()) {
+        switch(args[i].unicode()) {
+        case '\\':
+            if (inString)
+                i++;
+            break;
+        case '"':
+            inString = !inString;
+            break;
+        case ',':
+            if (!inString) {
+                argValues.append(args.mid(lastSplit,i-lastSplit));
+                lastSplit=i+1;
+            }
+            break;
+        }
+        i++;
+    }
+    argValues.append(args.mid(lastSplit,i-lastSplit));
+    if (argValues.length() == define->argList.length()
+            && argValues.length()>0) {
+        for (int i=0;i<argValues.length();i++) {
+            if (define->argUsed[i]) {
+                QString argValue = argValues[i];
+                result=result.arg(argValue.trimmed());
+            }
+        }
+    }
+    result.replace("%%","%");
+
+    return result;
+}
+
+bool LegacyExpander::isWordChar(const QChar &ch)
+{
+    return ch=='_'
+            || ch.isLetter()
+            || (ch>='0' && ch<='9');
+}
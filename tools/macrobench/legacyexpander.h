@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACYEXPANDER_H
+#define LEGACYEXPANDER_H
+
+#include "parserutils.h"
+
+/**
+ * @brief The text based expansion CppPreprocessor used before MacroExpander,
+ *  kept as the baseline of the benchmark.
+ */
+class LegacyExpander
+{
+public:
+    explicit LegacyExpander(const DefineMap& defines);
+    QString expandMacros(const QString& line, int depth);
+
+    static void buildFormatValue(Define& define);
+private:
+    void expandMacro(const QString& line, QString& newLine, QString& word, int& i, int depth);
+    QString expandFunction(const PDefine& define, QString args);
+    static bool isWordChar(const QChar& ch);
+private:
+    const DefineMap& mDefines;
+};
+
+#endif // LEGACYEXPANDER_H
@@ -0,0 +1,18 @@
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Benchmark of the macro expander used by the parser.
+# It's only built with the IDE when qmake is run with CONFIG+=benchmarks.
+
+INCLUDEPATH += ../../RedPandaIDE/parser
+
+SOURCES += \
+    ../../RedPandaIDE/parser/macroexpander.cpp \
+    legacyexpander.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../RedPandaIDE/parser/macroexpander.h \
+    legacyexpander.h
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the time used to expand macros in the code lines of the given
+ * headers, by MacroExpander and by the old text based expander.
+ *
+ * usage: macrobench [--repeat N] [--stress N] [header...]
+ *   e.g. macrobench --stress 2000 /usr/include/math.h /usr/include/x86_64-linux-gnu/bits/mathcalls.h
+ *
+ * Defines are collected from all the inputs before expanding, and branches
+ * are not evaluated, so the numbers are only meaningful as a comparison.
+ */
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include "macroexpander.h"
+#include "legacyexpander.h"
+
+struct BenchInput {
+    QStringList codeLines;
+    QStringList ifExpressions;
+    DefineMap defines;
+};
+
+static QString removeComments(const QString& text)
+{
+    QString result;
+    result.reserve(text.length());
+    int i=0;
+    while (i<text.length()) {
+        QChar ch = text[i];
+        if (ch == '"' || ch == '\'') {
+            int start = i;
+            i++;
+            while (i<text.length() && text[i]!=ch && text[i]!='\n') {
+                if (text[i]=='\\')
+                    i++;
+                i++;
+            }
+            i++;
+            result += text.mid(start, i-start);
+        } else if (ch == '/' && i+1<text.length() && text[i+1]=='/') {
+            while (i<text.length() && text[i]!='\n')
+                i++;
+        } else if (ch == '/' && i+1<text.length() && text[i+1]=='*') {
+            i+=2;
+            while (i+1<text.length() && !(text[i]=='*' && text[i+1]=='/')) {
+                if (text[i]=='\n')
+                    result += '\n';
+                i++;
+            }
+            i+=2;
+            result += ' ';
+        } else {
+            result += ch;
+            i++;
+        }
+    }
+    return result;
+}
+
+static void addDefine(BenchInput& input, const QString& line)
+{
+    QString s = line.trimmed();
+    int i=0;
+    while (i<s.length() && (s[i].isLetterOrNumber() || s[i]=='_'))
+        i++;
+    PDefine define = std::make_shared<Define>();
+    define->name = s.left(i);
+    if (i<s.length() && s[i]=='(') {
+        int end = s.indexOf(')', i);
+        if (end<0)
+            return;
+        define->args = s.mid(i, end-i+1);
+        i = end+1;
+    }
+    define->value = s.mid(i).trimmed();
+    define->hardCoded = false;
+    LegacyExpander::buildFormatValue(*define);
+    define->compiled = MacroExpander::compile(*define);
+    input.defines.insert(define->name, define);
+}
+
+static void addText(BenchInput& input, const QString& text)
+{
+    QString s = removeComments(text);
+    s.replace("\\\r\n"," ");
+    s.replace("\\\n"," ");
+    foreach (const QString& l, s.split('\n')) {
+        QString line = l.trimmed();
+        if (line.isEmpty())
+            continue;
+        if (!line.startsWith('#')) {
+            input.codeLines.append(line);
+            continue;
+        }
+        line = line.mid(1).trimmed();
+        if (line.startsWith("define") && line.length()>6 && !line[6].isLetterOrNumber()) {
+            addDefine(input, line.mid(6));
+        } else if (line.startsWith("if") && line.length()>2 && !line[2].isLetterOrNumber()) {
+            input.ifExpressions.append(line.mid(2).trimmed());
+        } else if (line.startsWith("elif") && line.length()>4 && !line[4].isLetterOrNumber()) {
+            input.ifExpressions.append(line.mid(4).trimmed());
+        }
+    }
+}
+
+// windows.h like input: A/W aliases, calling convention and export macros,
+// handle declarations by token pasting and nested function like macros
+static QString generateStressInput(int count)
+{
+    QString s;
+    QTextStream stream(&s);
+    stream << "#define UNICODE 1\n"
+           << "#define _WIN32_WINNT 0x0601\n"
+           << "#define WINAPI __stdcall\n"
+           << "#define DECLSPEC_IMPORT __declspec(dllimport)\n"
+           << "#define WINBASEAPI DECLSPEC_IMPORT\n"
+           << "#define CONST const\n"
+           << "#define __MINGW_NAME_AW(func) func##W\n"
+           << "#define TEXT(quote) L##quote\n"
+           << "#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__ *name\n"
+           << "#define LOWORD(l) ((WORD)(((DWORD_PTR)(l)) & 0xffff))\n"
+           << "#define MAKEWORD(a,b) ((WORD)(((BYTE)(((DWORD_PTR)(a)) & 0xff)) | ((WORD)((BYTE)(((DWORD_PTR)(b)) & 0xff))) << 8))\n"
+           << "#define MAKELONG(a,b) ((LONG)(((WORD)(((DWORD_PTR)(a)) & 0xffff)) | ((DWORD)((WORD)(((DWORD_PTR)(b)) & 0xffff))) << 16))\n"
+           << "#define FIELD_OFFSET(type,field) ((LONG)(LONG_PTR)&(((type *)0)->field))\n"
+           << "#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method\n"
+           << "#define STDMETHODCALLTYPE WINAPI\n"
+           << "#define DEBUG_LOG(fmt, ...) debug_printf(__FILE__, fmt, ## __VA_ARGS__)\n";
+    for (int i=0;i<count;i++) {
+        stream << QString("#define CreateObject%1 __MINGW_NAME_AW(CreateObject%1)\n").arg(i)
+               << QString("#if defined(UNICODE) && _WIN32_WINNT >= 0x0%1\n").arg(400+i%400)
+               << QString("WINBASEAPI HANDLE WINAPI CreateObject%1(CONST WCHAR *name, DWORD flags);\n").arg(i)
+               << "#endif\n"
+               << QString("DECLARE_HANDLE(HOBJECT%1);\n").arg(i)
+               << QString("STDMETHOD(Query%1)(THIS_ REFIID riid, void **ppv);\n").arg(i)
+               << QString("DWORD value%1 = MAKELONG(MAKEWORD(%1, LOWORD(%1)), MAKEWORD(1, 2));\n").arg(i)
+               << QString("DEBUG_LOG(TEXT(\"object %1\"), FIELD_OFFSET(OBJECT%1, size));\n").arg(i);
+    }
+    return s;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList args = app.arguments();
+    int repeat = 10;
+    BenchInput input;
+    for (int i=1;i<args.length();i++) {
+        if (args[i] == "--repeat" && i+1<args.length()) {
+            repeat = qMax(1, args[++i].toInt());
+        } else if (args[i] == "--stress" && i+1<args.length()) {
+            addText(input, generateStressInput(args[++i].toInt()));
+        } else {
+            QFile file(args[i]);
+            if (!file.open(QFile::ReadOnly)) {
+                out << "Can't open " << args[i] << "\n";
+                return 1;
+            }
+            addText(input, QString::fromUtf8(file.readAll()));
+        }
+    }
+    if (input.codeLines.isEmpty()) {
+        out << "usage: macrobench [--repeat N] [--stress N] [header...]\n";
+        return 1;
+    }
+    out << "defines: " << input.defines.count()
+        << ", code lines: " << input.codeLines.count()
+        << ", #if expressions: " << input.ifExpressions.count() << "\n";
+
+    QElapsedTimer timer;
+    LegacyExpander legacyExpander(input.defines);
+    int legacyLength = 0;
+    timer.start();
+    for (int r=0;r<repeat;r++) {
+        foreach (const QString& line, input.codeLines) {
+            legacyLength += legacyExpander.expandMacros(line, 1).length();
+        }
+    }
+    qint64 legacyTime = timer.nsecsElapsed();
+
+    MacroExpander expander([&input](const QString& name) {
+        return input.defines.value(name);
+    });
+    int length = 0;
+    timer.restart();
+    for (int r=0;r<repeat;r++) {
+        foreach (const QString& line, input.codeLines) {
+            length += expander.expandLine(line).length();
+        }
+    }
+    qint64 time = timer.nsecsElapsed();
+    MacroExpansionStatistics statistics = expander.statistics();
+
+    int trueCount = 0;
+    timer.restart();
+    for (int r=0;r<repeat;r++) {
+        foreach (const QString& expression, input.ifExpressions) {
+            if (expander.evaluateIf(expression) != 0)
+                trueCount++;
+        }
+    }
+    qint64 ifTime = timer.nsecsElapsed();
+    statistics = expander.statistics();
+
+    int lineCount = input.codeLines.count() * repeat;
+    out << QString("text based expander:  %1 ms, %2 ns/line, %3 chars\n")
+           .arg(legacyTime / 1000000.0, 0, 'f', 2)
+           .arg(legacyTime / lineCount)
+           .arg(legacyLength);
+    out << QString("token based expander: %1 ms, %2 ns/line, %3 chars, %4 replacements\n")
+           .arg(time / 1000000.0, 0, 'f', 2)
+           .arg(time / lineCount)
+           .arg(length)
+           .arg(statistics.replacements);
+    if (!input.ifExpressions.isEmpty()) {
+        out << QString("#if expressions: %1 ms, %2 ns/expression, %3 true, %4 compiled reused\n")
+               .arg(ifTime / 1000000.0, 0, 'f', 2)
+               .arg(ifTime / statistics.expressions)
+               .arg(trueCount)
+               .arg(statistics.compiledExpressionHits);
+    }
+    return 0;
+}
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parses C/C++ files or the units of a Red Panda C++ project (.dev) with
+ * CppParser, without the IDE, and reports the time used by each phase.
+ *
+ * usage: parserbench [options] file|project.dev...
+ *   -I dir             add a project include path
+ *   -D name[=value]    add a define
+ *   --compiler path    get the include paths and predefined macros from gcc/clang
+ *   --c                parse as C instead of C++
+ *   --serial           don't preprocess the units in worker threads
+ *   --compare-serial   run with the worker pool, then serially, and compare
+ *                      the times and the statements found
+ *   --generate N       add N generated units sharing a set of headers
+ *   --repeat N         parse N times, each time with a new parser
+ *   --json file        save the profile of the last run as JSON
+ *   --header-cache dir load and save the system header cache in dir
+ *   --check-header-reparse
+ *                      check that the files including a header are not
+ *                      reparsed when only a function body in it is changed
+ *
+ * The system header cache is not used unless --header-cache is given, so every
+ * run parses the same inputs. With an empty cache dir, the first run is a cold
+ * start and the next ones load the headers it saved, e.g.
+ *   parserbench --compiler g++ --header-cache /tmp/bench-cache --repeat 3 a.cpp
+ *
+ * --generate writes a project large enough to keep the worker pool busy into a
+ * temporary dir, e.g.
+ *   parserbench --generate 500 --compare-serial
+ */
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include "cppparser.h"
+#include "../utils.h"
+
+struct BenchOptions {
+    QStringList files;
+    QStringList includePaths;
+    QStringList projectIncludePaths;
+    QStringList defines;
+    QString compiler;
+    bool isCpp;
+    bool parallel;
+    int repeat;
+    QString jsonFile;
+    QString headerCacheDir;
+    bool compareSerial;
+    int generatedUnits;
+};
+
+static void addProject(BenchOptions& options, const QString& projectFile)
+{
+    SimpleIni ini;
+    ini.LoadFile(projectFile.toLocal8Bit());
+    QDir dir(QFileInfo(projectFile).absolutePath());
+    options.isCpp = ini.GetBoolValue("Project","IsCpp", options.isCpp);
+    options.projectIncludePaths.append(absolutePaths(dir.absolutePath(),
+                                fromByteArray(ini.GetValue("Project", "Includes", "")).split(";",
+#if QT_VERSION >= QT_VERSION_CHECK(5,15,0)
+            Qt::SkipEmptyParts
+#else
+            QString::SkipEmptyParts
+#endif
+            )));
+    int unitCount = ini.GetLongValue("Project","UnitCount",0);
+    for (int i=0;i<unitCount;i++) {
+        QByteArray groupName = toByteArray(QString("Unit%1").arg(i+1));
+        QString fileName = cleanPath(dir.absoluteFilePath(
+                                         fromByteArray(ini.GetValue(groupName,"FileName",""))));
+        if (isCFile(fileName) || isHFile(fileName))
+            options.files.append(fileName);
+    }
+}
+
+static QString runCompiler(const QString& compiler, const QStringList& arguments, bool readStdErr)
+{
+    QProcess process;
+    process.start(compiler, arguments);
+    process.closeWriteChannel();
+    if (!process.waitForFinished())
+        return QString();
+    return QString::fromLocal8Bit(readStdErr?process.readAllStandardError():process.readAllStandardOutput());
+}
+
+// the same include paths and predefined macros the IDE gets from the compiler set
+static void addCompilerSettings(BenchOptions& options)
+{
+    QString language = options.isCpp?"c++":"c";
+    QString output = runCompiler(options.compiler, {"-E","-v","-x",language,"-"}, true);
+    bool inList = false;
+    foreach (const QString& line, textToLines(output)) {
+        if (line.startsWith("#include <...> search starts here:")) {
+            inList = true;
+        } else if (line.startsWith("End of search list.")) {
+            inList = false;
+        } else if (inList) {
+            QString path = line.trimmed();
+            if (path.endsWith(" (framework directory)"))
+                continue;
+            options.includePaths.append(cleanPath(path));
+        }
+    }
+    output = runCompiler(options.compiler, {"-E","-dM","-x",language,"-"}, false);
+    foreach (const QString& line, textToLines(output)) {
+        if (line.startsWith("#define "))
+            options.defines.append(line);
+    }
+}
+
+static PCppParser createParser(const BenchOptions& options)
+{
+    PCppParser parser = std::make_shared<CppParser>();
+    parser->setEnabled(true);
+    parser->setParseGlobalHeaders(true);
+    parser->setParseLocalHeaders(true);
+    parser->setParallelParsing(options.parallel);
+    parser->setLanguage(options.isCpp?ParserLanguage::CPlusPlus:ParserLanguage::C);
+    foreach (const QString& path, options.includePaths) {
+        parser->addIncludePath(path);
+    }
+    foreach (const QString& path, options.projectIncludePaths) {
+        parser->addProjectIncludePath(path);
+    }
+    foreach (const QString& define, options.defines) {
+        parser->addHardDefineByLine(define);
+    }
+    parser->addHardDefineByLine("#define __FILE__  1");
+    parser->addHardDefineByLine("#define __LINE__  1");
+    parser->addHardDefineByLine("#define __DATE__  1");
+    parser->addHardDefineByLine("#define __TIME__  1");
+    parser->parseHardDefines();
+    foreach (const QString& file, options.files) {
+        parser->addProjectFile(file, true);
+    }
+    return parser;
+}
+
+static double nsToMs(qint64 nsecs)
+{
+    return nsecs / 1000000.0;
+}
+
+static qint64 median(QList<qint64> times)
+{
+    if (times.isEmpty())
+        return 0;
+    std::sort(times.begin(), times.end());
+    return times[times.count()/2];
+}
+
+static void printSummary(QTextStream& out, QList<qint64> wallTimes)
+{
+    if (wallTimes.count()<=1)
+        return;
+    std::sort(wallTimes.begin(), wallTimes.end());
+    out << QString("min %1 ms, median %2 ms, max %3 ms\n")
+           .arg(nsToMs(wallTimes.front()), 0, 'f', 2)
+           .arg(nsToMs(wallTimes[wallTimes.count()/2]), 0, 'f', 2)
+           .arg(nsToMs(wallTimes.back()), 0, 'f', 2);
+}
+
+// identifies the compiler the same way as the IDE does
+static QString compilerFingerprint(const QString& compiler)
+{
+    if (compiler.isEmpty())
+        return "parserbench";
+    QFileInfo compilerInfo(compiler);
+    return QString("%1 %2 %3")
+            .arg(compilerInfo.absoluteFilePath())
+            .arg(compilerInfo.lastModified().toMSecsSinceEpoch())
+            .arg(compilerInfo.size());
+}
+
+// one line per statement, sorted, so that the results of two runs can be compared
+static QStringList dumpStatements(const PCppParser& parser)
+{
+    QStringList lines;
+    QList<PStatement> pending;
+    foreach (const PStatement& statement, parser->statementList().childrenStatements())
+        pending.append(statement);
+    while (!pending.isEmpty()) {
+        PStatement statement = pending.takeLast();
+        lines.append(QString("%1, %2, %3, %4")
+                     .arg(statement->fullName)
+                     .arg((int)statement->kind)
+                     .arg(statement->fileName)
+                     .arg(statement->line));
+        foreach (const PStatement& child, parser->statementList().childrenStatements(statement))
+            pending.append(child);
+    }
+    lines.sort();
+    return lines;
+}
+
+/**
+ * @brief runs the parser once
+ * @param statements if not null, receives the dump of the statements found
+ * @return wall time in nanoseconds
+ */
+static qint64 runOnce(QTextStream& out, const BenchOptions& options, int run,
+                      ParserProfiler& profile, QStringList* statements)
+{
+    PCppParser parser = createParser(options);
+    if (!options.headerCacheDir.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        int cachedHeaders = parser->loadSystemHeaderCache(
+                    options.headerCacheDir, compilerFingerprint(options.compiler));
+        out << QString("run %1: %2 system headers loaded from the cache in %3 ms\n")
+               .arg(run)
+               .arg(cachedHeaders)
+               .arg(nsToMs(timer.nsecsElapsed()), 0, 'f', 2);
+    }
+    parser->parseFileList(false);
+    profile = parser->lastParseProfile();
+    CppParserMemoryReport report = parser->memoryReport();
+    if (statements)
+        *statements = dumpStatements(parser);
+    out << QString("run %1: %2 ms, preprocess %3 ms, tokenize %4 ms, parse %5 ms, "
+                   "%6 files, %7 lines, %8 tokens, %9 statements, %10 statements in total\n")
+           .arg(run)
+           .arg(nsToMs(profile.wallTime()), 0, 'f', 2)
+           .arg(nsToMs(profile.phaseTime(ParsePhase::Preprocess)), 0, 'f', 2)
+           .arg(nsToMs(profile.phaseTime(ParsePhase::Tokenize)), 0, 'f', 2)
+           .arg(nsToMs(profile.phaseTime(ParsePhase::Parse)), 0, 'f', 2)
+           .arg(profile.files().count())
+           .arg(profile.lineCount())
+           .arg(profile.tokenCount())
+           .arg(profile.statementCount())
+           .arg(report.statementCount);
+    out.flush();
+    return profile.wallTime();
+}
+
+/**
+ * @brief writes unitCount units into dir, each including three of a set of
+ *   headers, which include a common header in turn
+ * @return the files written
+ */
+static QStringList generateProject(const QString& dir, int unitCount)
+{
+    QStringList files;
+    QString common = cleanPath(QDir(dir).filePath("common.h"));
+    stringsToFile({
+                      "#ifndef GEN_COMMON_H",
+                      "#define GEN_COMMON_H",
+                      "#define GEN_MAX(a,b) ((a)>(b)?(a):(b))",
+                      "struct Base {",
+                      "    virtual ~Base() {}",
+                      "    virtual int size() const { return 0; }",
+                      "    int refs;",
+                      "};",
+                      "#endif"
+                  }, common);
+    files.append(common);
+    int headerCount = std::max(1, unitCount/10);
+    for (int i=0;i<headerCount;i++) {
+        QString header = cleanPath(QDir(dir).filePath(QString("shared%1.h").arg(i)));
+        stringsToFile({
+                          QString("#ifndef GEN_SHARED%1_H").arg(i),
+                          QString("#define GEN_SHARED%1_H").arg(i),
+                          "#include \"common.h\"",
+                          QString("namespace gen%1 {").arg(i),
+                          QString("enum class Kind%1 { First, Second, Third };").arg(i),
+                          QString("struct Item%1 : public Base {").arg(i),
+                          "    int id;",
+                          "    double values[8];",
+                          QString("    Kind%1 kind;").arg(i),
+                          "    int size() const override { return 8; }",
+                          "    double value(int index) const { return GEN_MAX(values[index], id); }",
+                          "};",
+                          "template<typename T>",
+                          QString("T larger%1(const T& a, const T& b) { return a<b?b:a; }").arg(i),
+                          QString("int count%1(const Item%1& item);").arg(i),
+                          "}",
+                          "#endif"
+                      }, header);
+        files.append(header);
+    }
+    for (int j=0;j<unitCount;j++) {
+        QString unit = cleanPath(QDir(dir).filePath(QString("unit%1.cpp").arg(j)));
+        QList<int> headers {j%headerCount, (j+1)%headerCount, (j*7)%headerCount};
+        QStringList lines;
+        foreach (int h, headers)
+            lines.append(QString("#include \"shared%1.h\"").arg(h));
+        int header = headers[0];
+        lines.append(QStringList{
+                         QString("namespace unit%1 {").arg(j),
+                         QString("class Worker%1 {").arg(j),
+                         "public:",
+                         QString("    explicit Worker%1(int limit): mLimit(limit) {}").arg(j),
+                         QString("    double run(const gen%1::Item%1& item) const;").arg(header),
+                         "private:",
+                         "    int mLimit;",
+                         "};",
+                         QString("double Worker%1::run(const gen%2::Item%2& item) const").arg(j).arg(header),
+                         "{",
+                         "    double total = 0;",
+                         "    for (int i=0;i<mLimit && i<item.size();i++) {",
+                         "        double v = item.value(i);",
+                         QString("        total = gen%1::larger%1(total, v);").arg(header),
+                         "    }",
+                         "    return total;",
+                         "}",
+                         "}"
+                     });
+        // each header function is defined by one unit
+        if (j<headerCount) {
+            lines.append(QStringList{
+                             QString("int gen%1::count%1(const gen%1::Item%1& item)").arg(j),
+                             "{",
+                             "    return item.id + item.size();",
+                             "}"
+                         });
+        }
+        stringsToFile(lines, unit);
+        files.append(unit);
+    }
+    return files;
+}
+
+static QStringList parsedFiles(const PCppParser& parser)
+{
+    QStringList files;
+    foreach (const FileParseProfile& file, parser->lastParseProfile().files())
+        files.append(QFileInfo(file.fileName).fileName());
+    files.sort();
+    return files;
+}
+
+static int checkHeaderReparse(QTextStream& out, const BenchOptions& options)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "Can't create a temporary dir\n";
+        return 1;
+    }
+    // the field in the #ifdef is only seen with the macro defined by the files including the header
+    QString header = cleanPath(dir.filePath("shape.h"));
+    QStringList headerLines {
+        "#ifndef SHAPE_H",
+        "#define SHAPE_H",
+        "struct Shape {",
+        "    int width;",
+        "#ifdef SHAPE_WITH_HEIGHT",
+        "    int height;",
+        "#endif",
+        "    int area() { return width; }",
+        "};",
+        "#endif"
+    };
+    stringsToFile(headerLines, header);
+    BenchOptions checkOptions = options;
+    checkOptions.files.clear();
+    checkOptions.files.append(header);
+    QStringList names {"a", "b"};
+    foreach (const QString& name, names) {
+        QString fileName = cleanPath(dir.filePath(name+".cpp"));
+        stringsToFile({
+                          "#define SHAPE_WITH_HEIGHT",
+                          "#include \"shape.h\"",
+                          QString("int %1(Shape& s) { return s.area() + s.height; }").arg(name)
+                      }, fileName);
+        checkOptions.files.append(fileName);
+    }
+    PCppParser parser = createParser(checkOptions);
+    parser->parseFileList(false);
+    if (!parser->findStatement("Shape::height")) {
+        out << "Shape::height is not found after the first parse\n";
+        return 1;
+    }
+
+    // only a function body is changed
+    headerLines[7] = "    int area() { return width * 2; }";
+    stringsToFile(headerLines, header);
+    parser->parseFile(header, true, false, false);
+    QStringList files = parsedFiles(parser);
+    if (files != QStringList{"shape.h"}) {
+        out << "body changed: reparsed " << files.join(", ") << ", expected shape.h only\n";
+        return 1;
+    }
+    if (!parser->findStatement("Shape::height") || !parser->findStatement("a") || !parser->findStatement("b")) {
+        out << "body changed: statements are lost\n";
+        return 1;
+    }
+
+    // a declaration is changed, the files including the header must be reparsed
+    headerLines.insert(6, "    int depth;");
+    stringsToFile(headerLines, header);
+    parser->parseFile(header, true, false, false);
+    files = parsedFiles(parser);
+    if (!files.contains("a.cpp") || !files.contains("b.cpp")) {
+        out << "declaration changed: reparsed " << files.join(", ") << ", expected a.cpp and b.cpp too\n";
+        return 1;
+    }
+    if (!parser->findStatement("Shape::depth") || !parser->findStatement("Shape::height")) {
+        out << "declaration changed: Shape::depth or Shape::height is not found\n";
+        return 1;
+    }
+    out << "header reparse check passed\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList args = app.arguments();
+    BenchOptions options;
+    options.isCpp = true;
+    options.parallel = true;
+    options.repeat = 1;
+    options.compareSerial = false;
+    options.generatedUnits = 0;
+    bool checkReparse = false;
+    for (int i=1;i<args.length();i++) {
+        const QString& arg = args[i];
+        if (arg == "-I" && i+1<args.length()) {
+            options.projectIncludePaths.append(QFileInfo(args[++i]).absoluteFilePath());
+        } else if (arg.startsWith("-I") && arg.length()>2) {
+            options.projectIncludePaths.append(QFileInfo(arg.mid(2)).absoluteFilePath());
+        } else if ((arg == "-D" && i+1<args.length()) || (arg.startsWith("-D") && arg.length()>2)) {
+            QString define = (arg == "-D")?args[++i]:arg.mid(2);
+            int pos = define.indexOf('=');
+            if (pos>=0)
+                options.defines.append("#define "+define.left(pos)+" "+define.mid(pos+1));
+            else
+                options.defines.append("#define "+define+" 1");
+        } else if (arg == "--compiler" && i+1<args.length()) {
+            options.compiler = args[++i];
+        } else if (arg == "--c") {
+            options.isCpp = false;
+        } else if (arg == "--serial") {
+            options.parallel = false;
+        } else if (arg == "--compare-serial") {
+            options.compareSerial = true;
+        } else if (arg == "--generate" && i+1<args.length()) {
+            options.generatedUnits = std::max(0, args[++i].toInt());
+        } else if (arg == "--check-header-reparse") {
+            checkReparse = true;
+        } else if (arg == "--repeat" && i+1<args.length()) {
+            options.repeat = std::max(1, args[++i].toInt());
+        } else if (arg == "--json" && i+1<args.length()) {
+            options.jsonFile = args[++i];
+        } else if (arg == "--header-cache" && i+1<args.length()) {
+            options.headerCacheDir = QFileInfo(args[++i]).absoluteFilePath();
+        } else if (arg.endsWith(".dev", Qt::CaseInsensitive)) {
+            addProject(options, QFileInfo(arg).absoluteFilePath());
+        } else {
+            options.files.append(cleanPath(QFileInfo(arg).absoluteFilePath()));
+        }
+    }
+    if (checkReparse) {
+        if (!options.compiler.isEmpty())
+            addCompilerSettings(options);
+        return checkHeaderReparse(out, options);
+    }
+    QTemporaryDir generatedDir;
+    if (options.generatedUnits>0) {
+        if (!generatedDir.isValid()) {
+            out << "Can't create a temporary dir\n";
+            return 1;
+        }
+        options.files.append(generateProject(generatedDir.path(), options.generatedUnits));
+    }
+    if (options.files.isEmpty()) {
+        out << "usage: parserbench [-I dir] [-D name[=value]] [--compiler path] [--c] [--serial] [--compare-serial]"
+            << " [--generate N] [--check-header-reparse]"
+            << " [--repeat N] [--json file] [--header-cache dir] file|project.dev...\n";
+        return 1;
+    }
+    if (!options.compiler.isEmpty())
+        addCompilerSettings(options);
+    if (options.compareSerial)
+        options.parallel = true;
+    out << "files: " << options.files.count()
+        << ", include paths: " << options.includePaths.count()+options.projectIncludePaths.count()
+        << ", defines: " << options.defines.count() << "\n";
+
+    QList<qint64> wallTimes;
+    ParserProfiler profile;
+    QStringList statements;
+    QStringList* dump = options.compareSerial?&statements:nullptr;
+    if (options.compareSerial)
+        out << "worker pool:\n";
+    for (int r=0;r<options.repeat;r++)
+        wallTimes.append(runOnce(out, options, r+1, profile, dump));
+    printSummary(out, wallTimes);
+    if (options.compareSerial) {
+        BenchOptions serialOptions = options;
+        serialOptions.parallel = false;
+        QList<qint64> serialWallTimes;
+        ParserProfiler serialProfile;
+        QStringList serialStatements;
+        out << "serial:\n";
+        for (int r=0;r<options.repeat;r++)
+            serialWallTimes.append(runOnce(out, serialOptions, r+1, serialProfile, &serialStatements));
+        printSummary(out, serialWallTimes);
+        out << QString("worker pool speedup: %1x (median)\n")
+               .arg((double)median(serialWallTimes) / std::max(median(wallTimes), Q_INT64_C(1)), 0, 'f', 2);
+        // both ways must give the same results
+        if (statements != serialStatements) {
+            out << QString("statements differ: %1 with the worker pool, %2 serial\n")
+                   .arg(statements.count()).arg(serialStatements.count());
+            int i = 0;
+            while (i<statements.count() && i<serialStatements.count()
+                   && statements[i]==serialStatements[i])
+                i++;
+            out << "first difference:\n"
+                << "  worker pool: " << (i<statements.count()?statements[i]:QString("(none)")) << "\n"
+                << "  serial:      " << (i<serialStatements.count()?serialStatements[i]:QString("(none)")) << "\n";
+            return 1;
+        }
+        out << QString("%1 statements are the same\n").arg(statements.count());
+    }
+    if (!options.jsonFile.isEmpty() && !profile.saveAsJson(options.jsonFile)) {
+        out << "Can't write " << options.jsonFile << "\n";
+        return 1;
+    }
+    return 0;
+}
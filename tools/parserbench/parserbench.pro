@@ -0,0 +1,59 @@
+QT += core gui widgets
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Runs CppParser headless over files or a .dev project and reports the time
+# used by each parse phase, so parser changes can be benchmarked on the same inputs.
+# It's only built with the IDE when qmake is run with CONFIG+=benchmarks.
+
+win32: {
+DEFINES += _WIN32_WINNT=0x0601
+}
+
+msvc {
+    DEFINES += NOMINMAX
+}
+
+CONFIG(debug_and_release_target) {
+    CONFIG(debug, debug|release) {
+        OBJ_OUT_PWD = debug/
+    }
+    CONFIG(release, debug|release) {
+        OBJ_OUT_PWD = release/
+    }
+}
+
+INCLUDEPATH += ../../RedPandaIDE ../../RedPandaIDE/parser ../../libs/qsynedit ../../libs/redpanda_qt_utils
+
+gcc | clang {
+LIBS += $$OUT_PWD/../../libs/qsynedit/$${OBJ_OUT_PWD}libqsynedit.a \
+        $$OUT_PWD/../../libs/redpanda_qt_utils/$${OBJ_OUT_PWD}libredpanda_qt_utils.a
+}
+msvc {
+LIBS += $$OUT_PWD/../../libs/qsynedit/$${OBJ_OUT_PWD}qsynedit.lib \
+        $$OUT_PWD/../../libs/redpanda_qt_utils/$${OBJ_OUT_PWD}redpanda_qt_utils.lib
+LIBS += advapi32.lib user32.lib
+}
+
+SOURCES += \
+    ../../RedPandaIDE/parser/cppparser.cpp \
+    ../../RedPandaIDE/parser/cpppreprocessor.cpp \
+    ../../RedPandaIDE/parser/cpptokenizer.cpp \
+    ../../RedPandaIDE/parser/includegraph.cpp \
+    ../../RedPandaIDE/parser/macroexpander.cpp \
+    ../../RedPandaIDE/parser/parserprofiler.cpp \
+    ../../RedPandaIDE/parser/parserutils.cpp \
+    ../../RedPandaIDE/parser/statementmodel.cpp \
+    ../../RedPandaIDE/parser/systemheadercache.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../RedPandaIDE/parser/cppparser.h \
+    ../../RedPandaIDE/parser/cpppreprocessor.h \
+    ../../RedPandaIDE/parser/cpptokenizer.h \
+    ../../RedPandaIDE/parser/includegraph.h \
+    ../../RedPandaIDE/parser/macroexpander.h \
+    ../../RedPandaIDE/parser/parserprofiler.h \
+    ../../RedPandaIDE/parser/parserutils.h \
+    ../../RedPandaIDE/parser/statementmodel.h \
+    ../../RedPandaIDE/parser/systemheadercache.h